@@ -0,0 +1,637 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGDB_ADAPTIVEDATABASEPAGER
+#define OSGDB_ADAPTIVEDATABASEPAGER 1
+
+#include <osgDB/DatabasePager>
+#include <osgDB/Registry>
+#include <osgDB/Callbacks>
+#include <osgDB/FileNameUtils>
+
+#include <osg/Stats>
+#include <osg/Timer>
+#include <osg/PagedLOD>
+#include <osg/NodeVisitor>
+
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <OpenThreads/Thread>
+
+#include <cfloat>
+#include <map>
+#include <list>
+#include <set>
+#include <vector>
+#include <sstream>
+
+namespace osgDB {
+
+/** DatabasePager with self tuning thread pools and a per frame merge budget.
+  *
+  * The stock pager runs the thread split chosen by setUpThreads() for its whole
+  * lifetime and merges every loaded subgraph in updateSceneGraph(), however
+  * many arrived. AdaptiveDatabasePager, when adaptive mode is enabled:
+  *
+  *   - measures the time each file and each HTTP read takes on the database
+  *     threads, and keeps latency histograms for both;
+  *   - every Settings::adaptInterval seconds compares the depth of the file and
+  *     HTTP request queues with their thread count and observed latency, adding
+  *     HANDLE_NON_HTTP / HANDLE_ONLY_HTTP threads up to the configured maximum
+  *     and retiring the added threads again once their queue stays empty;
+  *   - computes bounding spheres and collects the PagedLODs of each loaded
+  *     subgraph on the database thread that read it, so registerPagedLODs() no
+  *     longer runs FindPagedLODsVisitor over the subgraph in the update thread
+  *     (StateToCompile already runs on the database threads in the stock pager);
+  *   - merges at most as many subgraphs per frame as fit in
+  *     Settings::mergeBudget, based on the measured cost of a merge, most
+  *     recently and highest priority requested first; the rest wait for the
+  *     next frame;
+  *   - writes queue depths, thread counts, merge counts and latencies into an
+  *     osg::Stats object once per frame.
+  *
+  * Threads created by setUpThreads() are never retired. Install it as the
+  * pager of new viewers with:
+  *
+  *   osgDB::DatabasePager::prototype() = new osgDB::AdaptiveDatabasePager();
+  *
+  * or per viewer with view->setDatabasePager(new osgDB::AdaptiveDatabasePager()).
+  * To report into the viewer statistics:
+  *
+  *   pager->setStats(viewer->getViewerStats());
+  */
+class AdaptiveDatabasePager : public DatabasePager
+{
+    public:
+
+        struct Settings
+        {
+            Settings() :
+                adaptive(true),
+                adaptInterval(0.5),
+                maxFileThreads(4),
+                maxHttpThreads(8),
+                queueDepthPerThread(4),
+                targetHttpLatency(0.25),
+                idleIntervalsBeforeShrink(8),
+                mergeBudget(0.004),
+                maxMergesPerFrame(0) {}
+
+            bool            adaptive;                   // resize thread pools and instrument reads
+            double          adaptInterval;              // seconds between pool adjustments
+            unsigned int    maxFileThreads;             // non-HTTP threads, including the initial ones
+            unsigned int    maxHttpThreads;             // HTTP threads, including the initial ones
+            unsigned int    queueDepthPerThread;        // queued requests per thread that trigger growth
+            double          targetHttpLatency;          // seconds; slower HTTP reads with a backlog trigger growth
+            unsigned int    idleIntervalsBeforeShrink;  // empty intervals before an added thread is retired
+            double          mergeBudget;                // seconds of merging per frame, 0 for no limit
+            unsigned int    maxMergesPerFrame;          // 0 for no limit
+        };
+
+        /** Counts of read latencies, in the buckets given by getBucketLimit().*/
+        struct LatencyHistogram
+        {
+            enum { NUM_BUCKETS = 8 };
+
+            LatencyHistogram() : total(0), sum(0.0)
+            {
+                for (unsigned int i = 0; i < NUM_BUCKETS; ++i) counts[i] = 0;
+            }
+
+            /** Upper limit of a bucket in seconds; the last bucket is unbounded.*/
+            static double getBucketLimit(unsigned int bucket)
+            {
+                static const double limits[NUM_BUCKETS] = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 1.0, DBL_MAX };
+                return limits[bucket];
+            }
+
+            void add(double seconds)
+            {
+                unsigned int bucket = 0;
+                while (bucket < NUM_BUCKETS-1 && seconds > getBucketLimit(bucket)) ++bucket;
+                ++counts[bucket];
+                ++total;
+                sum += seconds;
+            }
+
+            double getMean() const { return total > 0 ? sum / (double)total : 0.0; }
+
+            unsigned int    counts[NUM_BUCKETS];
+            unsigned int    total;
+            double          sum;
+        };
+
+    public:
+
+        AdaptiveDatabasePager() :
+            DatabasePager()
+        {
+            init();
+        }
+
+        AdaptiveDatabasePager(const AdaptiveDatabasePager& rhs) :
+            DatabasePager(rhs),
+            _settings(rhs._settings),
+            _stats(rhs._stats)
+        {
+            init();
+        }
+
+        virtual const char* className() const { return "AdaptiveDatabasePager"; }
+
+        virtual DatabasePager* clone() const { return new AdaptiveDatabasePager(*this); }
+
+        void setSettings(const Settings& settings) { _settings = settings; }
+        const Settings& getSettings() const { return _settings; }
+
+        /** Set the Stats object the pager reports into once per frame, e.g. the viewer stats.*/
+        void setStats(osg::Stats* stats) { _stats = stats; }
+        osg::Stats* getStats() const { return _stats.get(); }
+
+        /** Latency histogram of all file (http == false) or HTTP reads so far.*/
+        LatencyHistogram getLatencyHistogram(bool http) const
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_latencyMutex);
+            return http ? _httpLatency : _fileLatency;
+        }
+
+        /** Number of running database threads handling file (http == false) or HTTP requests.*/
+        unsigned int getNumThreads(bool http) const
+        {
+            unsigned int count = 0;
+            for (unsigned int i = 0; i < _databaseThreads.size(); ++i)
+            {
+                if (!_databaseThreads[i]->getDone() && handles(_databaseThreads[i].get(), http))
+                    ++count;
+            }
+            return count;
+        }
+
+        /** Measured cost of merging one subgraph in seconds.*/
+        double getMergeCost() const { return _mergeCost; }
+
+    public: // DatabasePager
+
+        virtual void requestNodeFile(const std::string& fileName, osg::NodePath& nodePath,
+                                     float priority, const osg::FrameStamp* framestamp,
+                                     osg::ref_ptr<osg::Referenced>& databaseRequest,
+                                     const osg::Referenced* options)
+        {
+            const osg::Referenced* loadOptions = options;
+            if (_settings.adaptive)
+                loadOptions = getInstrumentedOptions(dynamic_cast<const Options*>(options));
+
+            DatabasePager::requestNodeFile(fileName, nodePath, priority, framestamp, databaseRequest, loadOptions);
+        }
+
+        virtual void registerPagedLODs(osg::Node* subgraph, unsigned int frameNumber = 0)
+        {
+            if (!subgraph) return;
+
+            PreparedList plods;
+            if (takePrepared(subgraph, plods))
+            {
+                for (PreparedList::iterator itr = plods.begin(); itr != plods.end(); ++itr)
+                {
+                    osg::ref_ptr<osg::PagedLOD> plod;
+                    if (itr->lock(plod))
+                    {
+                        plod->setFrameNumberOfLastTraversal(frameNumber);
+                        _activePagedLODList->insertPagedLOD(*itr);
+                    }
+                }
+                return;
+            }
+
+            DatabasePager::registerPagedLODs(subgraph, frameNumber);
+        }
+
+        virtual void updateSceneGraph(const osg::FrameStamp& frameStamp)
+        {
+            const osg::Timer* timer = osg::Timer::instance();
+
+            if (_settings.adaptive && frameStamp.getReferenceTime() - _lastAdaptTime >= _settings.adaptInterval)
+            {
+                _lastAdaptTime = frameStamp.getReferenceTime();
+                adaptThreads();
+                purgePrepared();
+            }
+
+            // Hold back the loaded subgraphs that don't fit in this frame's budget.
+            RequestQueue::RequestList deferred;
+            unsigned int candidates = 0;
+            const unsigned int limit = getMergeLimit();
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_dataToMergeList->_requestMutex);
+                RequestQueue::RequestList& list = _dataToMergeList->_requestList;
+                if (limit > 0 && list.size() > limit)
+                {
+                    list.sort(MergeOrder());
+                    RequestQueue::RequestList::iterator cut = list.begin();
+                    std::advance(cut, limit);
+                    deferred.splice(deferred.begin(), list, cut, list.end());
+                }
+                candidates = static_cast<unsigned int>(list.size());
+            }
+
+            _expireTime = 0.0;
+            const osg::Timer_t start = timer->tick();
+
+            DatabasePager::updateSceneGraph(frameStamp);
+
+            const double mergeTime = timer->delta_s(start, timer->tick()) - _expireTime;
+            if (candidates > 0)
+            {
+                const double cost = mergeTime / (double)candidates;
+                _mergeCost = _mergeCost > 0.0 ? _mergeCost*0.9 + cost*0.1 : cost;
+            }
+
+            if (!deferred.empty())
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_dataToMergeList->_requestMutex);
+                _dataToMergeList->_requestList.splice(_dataToMergeList->_requestList.begin(), deferred);
+            }
+
+            if (_stats.valid())
+                reportStats(frameStamp.getFrameNumber(), candidates, mergeTime);
+        }
+
+    protected:
+
+        virtual ~AdaptiveDatabasePager() {}
+
+        typedef std::vector< osg::observer_ptr<osg::PagedLOD> > PreparedList;
+
+        // Subgraph prepared on a database thread, waiting to be merged.
+        struct Prepared
+        {
+            osg::observer_ptr<osg::Node>    node;
+            PreparedList                    plods;
+            double                          time;
+        };
+        typedef std::map<const osg::Node*, Prepared> PreparedMap;
+
+        // Instrumented copy of a request's Options. The snapshot and the wrapped
+        // callback detect an original that changed since it was cloned.
+        struct InstrumentedOptions
+        {
+            osg::observer_ptr<const Options>    original;
+            osg::ref_ptr<const Options>         snapshot;
+            osg::ref_ptr<ReadFileCallback>      next;
+            osg::ref_ptr<Options>               instrumented;
+        };
+        typedef std::map<const Options*, InstrumentedOptions> InstrumentedOptionsMap;
+
+        // Collects the PagedLODs of a subgraph, as FindPagedLODsVisitor does.
+        struct CollectPagedLODsVisitor : public osg::NodeVisitor
+        {
+            CollectPagedLODsVisitor(PreparedList& plods) :
+                osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+                _plods(plods) {}
+
+            virtual void apply(osg::PagedLOD& plod)
+            {
+                _plods.push_back(&plod);
+                traverse(plod);
+            }
+
+            PreparedList& _plods;
+        };
+
+        // Times reads on the database threads and prepares the loaded subgraphs.
+        // Reads a plugin nests inside the pager's request pass straight through.
+        struct InstrumentedReadCallback : public ReadFileCallback
+        {
+            InstrumentedReadCallback(AdaptiveDatabasePager* pager, ReadFileCallback* next) :
+                _pager(pager),
+                _next(next) {}
+
+            virtual ReaderWriter::ReadResult readNode(const std::string& fileName, const Options* options)
+            {
+                osg::ref_ptr<AdaptiveDatabasePager> pager;
+                if (!_pager.lock(pager) || !pager->beginRead())
+                    return forward(fileName, options);
+
+                const osg::Timer* timer = osg::Timer::instance();
+                const osg::Timer_t start = timer->tick();
+
+                ReaderWriter::ReadResult result = forward(fileName, options);
+
+                const double latency = timer->delta_s(start, timer->tick());
+                pager->endRead();
+
+                pager->recordLatency(containsServerAddress(fileName), latency);
+                if (result.validNode())
+                    pager->prepare(result.getNode());
+                return result;
+            }
+
+            ReaderWriter::ReadResult forward(const std::string& fileName, const Options* options)
+            {
+                return _next.valid() ?
+                    _next->readNode(fileName, options) :
+                    ReadFileCallback::readNode(fileName, options);
+            }
+
+            osg::observer_ptr<AdaptiveDatabasePager>    _pager;
+            osg::ref_ptr<ReadFileCallback>              _next;
+        };
+
+        // Most recently requested first, then highest priority, as the read queues.
+        struct MergeOrder
+        {
+            bool operator()(const osg::ref_ptr<DatabaseRequest>& lhs, const osg::ref_ptr<DatabaseRequest>& rhs) const
+            {
+                if (lhs->_timestampLastRequest > rhs->_timestampLastRequest) return true;
+                if (lhs->_timestampLastRequest < rhs->_timestampLastRequest) return false;
+                return lhs->_priorityLastRequest > rhs->_priorityLastRequest;
+            }
+        };
+
+        void init()
+        {
+            _lastAdaptTime = 0.0;
+            _expireTime = 0.0;
+            _mergeCost = 0.0;
+            _fileIdleIntervals = 0;
+            _httpIdleIntervals = 0;
+            _lastFileLatency = LatencyHistogram();
+            _lastHttpLatency = LatencyHistogram();
+        }
+
+        static bool handles(const DatabaseThread* thread, bool http)
+        {
+            // DatabaseThread::_mode is protected, but setUpThreads() and adaptPool()
+            // name every thread after its mode.
+            const bool httpThread = thread->getName().find("HANDLE_ONLY_HTTP") == 0;
+            return http ? httpThread : !httpThread;
+        }
+
+        virtual void removeExpiredSubgraphs(const osg::FrameStamp& frameStamp)
+        {
+            const osg::Timer* timer = osg::Timer::instance();
+            const osg::Timer_t start = timer->tick();
+            DatabasePager::removeExpiredSubgraphs(frameStamp);
+            _expireTime += timer->delta_s(start, timer->tick());
+        }
+
+        static bool sameOptions(const Options* lhs, const Options* rhs)
+        {
+            if (!lhs || !rhs) return lhs == rhs;
+            return *lhs == *rhs;
+        }
+
+        // Returns the instrumented clone of options, rebuilding it when the original
+        // was deleted or modified, or the read callback it wraps changed.
+        const Options* getInstrumentedOptions(const Options* options)
+        {
+            const Options* source = options ? options : Registry::instance()->getOptions();
+
+            ReadFileCallback* next = options ? options->getReadFileCallback() : 0;
+            if (!next) next = Registry::instance()->getReadFileCallback();
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_optionsMutex);
+
+            InstrumentedOptions& entry = _instrumentedOptions[options];
+            if (entry.instrumented.valid() &&
+                entry.original.get() == options &&
+                entry.next.get() == next &&
+                sameOptions(entry.snapshot.get(), source))
+            {
+                return entry.instrumented.get();
+            }
+
+            osg::ref_ptr<Options> instrumented = source ? source->cloneOptions() : new Options();
+            instrumented->setReadFileCallback(new InstrumentedReadCallback(this, next));
+
+            entry.original = options;
+            entry.snapshot = source ? source->cloneOptions() : 0;
+            entry.next = next;
+            entry.instrumented = instrumented;
+            return instrumented.get();
+        }
+
+        // Marks the calling thread as inside a pager read; false when it already is.
+        bool beginRead()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_readingMutex);
+            return _readingThreads.insert(OpenThreads::Thread::CurrentThread()).second;
+        }
+
+        void endRead()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_readingMutex);
+            _readingThreads.erase(OpenThreads::Thread::CurrentThread());
+        }
+
+        void recordLatency(bool http, double seconds)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_latencyMutex);
+            (http ? _httpLatency : _fileLatency).add(seconds);
+        }
+
+        // Runs on a database thread: computes the bounds and collects the PagedLODs.
+        void prepare(osg::Node* node)
+        {
+            node->getBound();
+
+            Prepared prepared;
+            prepared.node = node;
+            prepared.time = osg::Timer::instance()->time_s();
+            CollectPagedLODsVisitor visitor(prepared.plods);
+            node->accept(visitor);
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_preparedMutex);
+            _prepared[node] = prepared;
+        }
+
+        bool takePrepared(osg::Node* node, PreparedList& plods)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_preparedMutex);
+            PreparedMap::iterator itr = _prepared.find(node);
+            if (itr == _prepared.end())
+                return false;
+
+            // the address may belong to a newer node than the one prepared
+            const bool valid = itr->second.node.get() == node;
+            if (valid)
+                plods.swap(itr->second.plods);
+            _prepared.erase(itr);
+            return valid;
+        }
+
+        // Drops entries of subgraphs that were discarded instead of merged.
+        void purgePrepared()
+        {
+            const double expiry = osg::Timer::instance()->time_s() - 60.0;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_preparedMutex);
+                for (PreparedMap::iterator itr = _prepared.begin(); itr != _prepared.end(); )
+                {
+                    if (!itr->second.node.valid() || itr->second.time < expiry)
+                        _prepared.erase(itr++);
+                    else
+                        ++itr;
+                }
+            }
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_optionsMutex);
+                for (InstrumentedOptionsMap::iterator itr = _instrumentedOptions.begin(); itr != _instrumentedOptions.end(); )
+                {
+                    if (itr->first && !itr->second.original.valid())
+                        _instrumentedOptions.erase(itr++);
+                    else
+                        ++itr;
+                }
+            }
+        }
+
+        unsigned int getMergeLimit() const
+        {
+            unsigned int limit = _settings.maxMergesPerFrame;
+            if (_settings.mergeBudget > 0.0 && _mergeCost > 0.0)
+            {
+                double fit = _settings.mergeBudget / _mergeCost;
+                unsigned int budgetLimit = fit < 1.0 ? 1u : fit > 1e6 ? 1000000u : (unsigned int)fit;
+                if (limit == 0 || budgetLimit < limit)
+                    limit = budgetLimit;
+            }
+            return limit;
+        }
+
+        void adaptThreads()
+        {
+            if (!_startThreadCalled)
+                return;
+
+            // forget retired threads that have finished their last request
+            for (DatabaseThreadList::iterator itr = _databaseThreads.begin(); itr != _databaseThreads.end(); )
+            {
+                if ((*itr)->getDone() && !(*itr)->isRunning())
+                    itr = _databaseThreads.erase(itr);
+                else
+                    ++itr;
+            }
+
+            LatencyHistogram fileLatency, httpLatency;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_latencyMutex);
+                fileLatency = _fileLatency;
+                httpLatency = _httpLatency;
+            }
+
+            adaptPool(false, _fileRequestQueue->size(), intervalMean(fileLatency, _lastFileLatency), _settings.maxFileThreads, _fileIdleIntervals);
+            adaptPool(true, _httpRequestQueue->size(), intervalMean(httpLatency, _lastHttpLatency), _settings.maxHttpThreads, _httpIdleIntervals);
+
+            _lastFileLatency = fileLatency;
+            _lastHttpLatency = httpLatency;
+        }
+
+        static double intervalMean(const LatencyHistogram& now, const LatencyHistogram& before)
+        {
+            const unsigned int count = now.total - before.total;
+            return count > 0 ? (now.sum - before.sum) / (double)count : 0.0;
+        }
+
+        void adaptPool(bool http, unsigned int depth, double latency, unsigned int maxThreads, unsigned int& idleIntervals)
+        {
+            const unsigned int threads = getNumThreads(http);
+            const unsigned int perThread = osg::maximum(_settings.queueDepthPerThread, 1u);
+
+            bool grow = threads < maxThreads && depth >= perThread * osg::maximum(threads, 1u);
+            if (http && threads < maxThreads && depth > threads && latency > _settings.targetHttpLatency)
+                grow = true;
+
+            if (grow)
+            {
+                idleIntervals = 0;
+                std::ostringstream name;
+                name << (http ? "HANDLE_ONLY_HTTP" : "HANDLE_NON_HTTP") << " adaptive " << _databaseThreads.size();
+                addDatabaseThread(http ? DatabaseThread::HANDLE_ONLY_HTTP : DatabaseThread::HANDLE_NON_HTTP, name.str());
+                return;
+            }
+
+            idleIntervals = depth == 0 ? idleIntervals + 1 : 0;
+            if (idleIntervals < _settings.idleIntervalsBeforeShrink)
+                return;
+
+            // retire the most recently added thread of this pool
+            for (DatabaseThreadList::reverse_iterator itr = _databaseThreads.rbegin(); itr != _databaseThreads.rend(); ++itr)
+            {
+                DatabaseThread* thread = itr->get();
+                if (thread->getDone() || !handles(thread, http) || thread->getName().find(" adaptive ") == std::string::npos)
+                    continue;
+
+                thread->setDone(true);
+                (http ? _httpRequestQueue : _fileRequestQueue)->release();
+                idleIntervals = 0;
+                break;
+            }
+        }
+
+        void reportStats(unsigned int frameNumber, unsigned int merged, double mergeTime)
+        {
+            LatencyHistogram fileLatency, httpLatency;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_latencyMutex);
+                fileLatency = _fileLatency;
+                httpLatency = _httpLatency;
+            }
+
+            _stats->setAttribute(frameNumber, "DatabasePager file queue", _fileRequestQueue->size());
+            _stats->setAttribute(frameNumber, "DatabasePager http queue", _httpRequestQueue->size());
+            _stats->setAttribute(frameNumber, "DatabasePager compile queue", _dataToCompileList->size());
+            _stats->setAttribute(frameNumber, "DatabasePager merge queue", _dataToMergeList->size());
+            _stats->setAttribute(frameNumber, "DatabasePager merged", merged);
+            _stats->setAttribute(frameNumber, "DatabasePager merge time", mergeTime);
+            _stats->setAttribute(frameNumber, "DatabasePager file threads", getNumThreads(false));
+            _stats->setAttribute(frameNumber, "DatabasePager http threads", getNumThreads(true));
+            _stats->setAttribute(frameNumber, "DatabasePager file latency", fileLatency.getMean());
+            _stats->setAttribute(frameNumber, "DatabasePager http latency", httpLatency.getMean());
+
+            for (unsigned int i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i)
+            {
+                std::ostringstream name;
+                name << "DatabasePager latency bucket " << i;
+                _stats->setAttribute(frameNumber, name.str(), fileLatency.counts[i] + httpLatency.counts[i]);
+            }
+        }
+
+        Settings                            _settings;
+        osg::ref_ptr<osg::Stats>            _stats;
+
+        mutable OpenThreads::Mutex          _latencyMutex;
+        LatencyHistogram                    _fileLatency;
+        LatencyHistogram                    _httpLatency;
+        LatencyHistogram                    _lastFileLatency;
+        LatencyHistogram                    _lastHttpLatency;
+
+        OpenThreads::Mutex                  _preparedMutex;
+        PreparedMap                         _prepared;
+
+        OpenThreads::Mutex                  _optionsMutex;
+        InstrumentedOptionsMap              _instrumentedOptions;
+
+        OpenThreads::Mutex                  _readingMutex;
+        std::set<OpenThreads::Thread*>      _readingThreads;
+
+        double                              _lastAdaptTime;
+        double                              _expireTime;
+        double                              _mergeCost;
+        unsigned int                        _fileIdleIntervals;
+        unsigned int                        _httpIdleIntervals;
+};
+
+}
+
+#endif
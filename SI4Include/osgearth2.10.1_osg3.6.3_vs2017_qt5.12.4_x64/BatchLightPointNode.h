@@ -0,0 +1,760 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGSIM_BATCHLIGHTPOINTNODE
+#define OSGSIM_BATCHLIGHTPOINTNODE 1
+
+#include <osgSim/LightPointNode>
+#include <osgSim/Sector>
+#include <osgSim/BlinkSequence>
+
+#include <osg/Geometry>
+#include <osg/Program>
+#include <osg/BlendFunc>
+#include <osg/Depth>
+#include <osg/PointSprite>
+#include <osg/GLDefines>
+#include <osgUtil/CullVisitor>
+
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+
+#include <map>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define OSGSIM_BATCH_SSE 1
+#endif
+
+namespace osgSim {
+
+/** LightPointNode that keeps its light points in structure of arrays buffers,
+  * sorted into the bins of a uniform grid, and culls and shades them in batches.
+  *
+  * On cull only the bins inside the view frustum and the maximum visible distance
+  * are processed. Eye space depth, pixel size, distance, intensity and the
+  * AzimSector, ElevationSector and AzimElevationSector fall offs are evaluated
+  * four points at a time; other Sector types are evaluated per point. Each
+  * BlinkSequence is evaluated once per cull and shared by all its points.
+  * The visible points are drawn as shader sized GL_POINTS, one geometry for
+  * each BlendingMode, from a ring of buffers per cull visitor so the draw of the
+  * previous frames is never overwritten. Each visit within a frame, as with
+  * nested render to texture cameras or several parents, gets its own buffers.
+  *
+  * The buffers are built from the LightPointList on the first cull; call
+  * dirtyLightPoints() after editing light points in place.
+  */
+class BatchLightPointNode : public LightPointNode
+{
+    public :
+
+        /** Counts from the most recent cull traversal.*/
+        struct Stats
+        {
+            Stats() : numBins(0), numVisibleBins(0), numPointsTested(0), numPointsDrawn(0) {}
+
+            unsigned int numBins;
+            unsigned int numVisibleBins;
+            unsigned int numPointsTested;
+            unsigned int numPointsDrawn;
+        };
+
+        BatchLightPointNode() :
+            _targetPointsPerBin(256),
+            _dirty(true),
+            _numBuiltLightPoints(0),
+            _hasSectors(false) {}
+
+        /** Copy constructor using CopyOp to manage deep vs shallow copy.*/
+        BatchLightPointNode(const BatchLightPointNode& lpn, const osg::CopyOp& copyop=osg::CopyOp::SHALLOW_COPY) :
+            LightPointNode(lpn, copyop),
+            _targetPointsPerBin(lpn._targetPointsPerBin),
+            _dirty(true),
+            _numBuiltLightPoints(0),
+            _hasSectors(false) {}
+
+        META_Node(osgSim, BatchLightPointNode);
+
+        /** Rebuild the buffers and the bins from the LightPointList on the next cull.*/
+        void dirtyLightPoints()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _dirty = true;
+        }
+
+        /** Set the average number of light points per bin of the spatial index.*/
+        void setTargetPointsPerBin(unsigned int num) { _targetPointsPerBin = osg::maximum(num, 1u); dirtyLightPoints(); }
+        unsigned int getTargetPointsPerBin() const { return _targetPointsPerBin; }
+
+        Stats getStats() const
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            return _stats;
+        }
+
+        virtual void traverse(osg::NodeVisitor& nv)
+        {
+            osgUtil::CullVisitor* cv = nv.asCullVisitor();
+            if (!cv)
+            {
+                LightPointNode::traverse(nv);
+                return;
+            }
+
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                if (_dirty || _numBuiltLightPoints != _lightPointList.size()) build();
+            }
+
+            if (_bins.empty()) return;
+
+            cull(*cv);
+        }
+
+    protected:
+
+        virtual ~BatchLightPointNode() {}
+
+        enum { RING_SIZE = 3, SIZE_ATTRIBUTE = 6, NO_BLINK = 0xffffffff, NO_SECTOR = 0xffffffff };
+
+        struct Bin
+        {
+            osg::BoundingBox _bb;
+            unsigned int _begin;
+            unsigned int _end;
+        };
+
+        // exposes the fall off parameters of the standard sectors through member pointers
+        struct AzimRangeParameters : public AzimRange
+        {
+            static float AzimRange::* cosAzim() { return &AzimRangeParameters::_cosAzim; }
+            static float AzimRange::* sinAzim() { return &AzimRangeParameters::_sinAzim; }
+            static float AzimRange::* cosAngle() { return &AzimRangeParameters::_cosAngle; }
+            static float AzimRange::* cosFadeAngle() { return &AzimRangeParameters::_cosFadeAngle; }
+        };
+
+        struct ElevationRangeParameters : public ElevationRange
+        {
+            static float ElevationRange::* cosMin() { return &ElevationRangeParameters::_cosMinElevation; }
+            static float ElevationRange::* cosMinFade() { return &ElevationRangeParameters::_cosMinFadeElevation; }
+            static float ElevationRange::* cosMax() { return &ElevationRangeParameters::_cosMaxElevation; }
+            static float ElevationRange::* cosMaxFade() { return &ElevationRangeParameters::_cosMaxFadeElevation; }
+        };
+
+        /** output geometries of one traversal, index 0 blended and 1 additive.*/
+        struct Slot
+        {
+            osg::ref_ptr<osg::Geometry> _geometries[2];
+        };
+
+        /** per cull visitor ring of output geometries. A node reached several times in
+          * a frame by the same cull visitor (nested render to texture cameras, several
+          * parents) uses one slot per visit, so no visit overwrites another's output.*/
+        struct RenderBuffers
+        {
+            RenderBuffers() : _frame(0), _numVisits(0), _time(0.0), _interval(0.0) {}
+
+            unsigned int _frame;
+            unsigned int _numVisits;
+            double _time;       // simulation time of this cull visitor's latest frame
+            double _interval;   // time since its previous frame, shared by all visits of a frame
+            std::vector<Slot> _ring[RING_SIZE];
+        };
+
+        /** per cull state, so that several cull threads can run at once.*/
+        struct CullState
+        {
+            osg::Matrixf _modelView;
+            osg::Vec3 _eyeLocal;
+            float _pixelScale;
+            bool _perspective;
+            float _intensity;
+            float _minPixelSize;
+            float _maxPixelSize;
+            float _maxVisibleDistance2;
+            std::vector<osg::Vec4> _blinkColors;
+            osg::Vec3Array* _vertices[2];
+            osg::Vec4Array* _colors[2];
+            osg::FloatArray* _sizes[2];
+            osg::BoundingBox _drawnBound;
+            unsigned int _numPointsTested;
+        };
+
+        void build()
+        {
+            _dirty = false;
+            _numBuiltLightPoints = (unsigned int)_lightPointList.size();
+
+            _x.clear(); _y.clear(); _z.clear();
+            _r.clear(); _g.clear(); _b.clear(); _a.clear();
+            _intensity.clear(); _radius.clear();
+            _additive.clear(); _blink.clear(); _customSector.clear();
+            for (unsigned int i = 0; i < 8; ++i) _sector[i].clear();
+            _blinkSequences.clear();
+            _customSectors.clear();
+            _bins.clear();
+            _hasSectors = false;
+
+            // bin the points that are on in a uniform grid sized for the target bin size
+            std::vector<unsigned int> points;
+            osg::BoundingBox bb;
+            for (unsigned int i = 0; i < _lightPointList.size(); ++i)
+            {
+                if (!_lightPointList[i]._on) continue;
+                points.push_back(i);
+                bb.expandBy(_lightPointList[i]._position);
+            }
+            if (points.empty()) return;
+
+            float extents[3] = { bb.xMax()-bb.xMin(), bb.yMax()-bb.yMin(), bb.zMax()-bb.zMin() };
+            float maxExtent = osg::maximum(extents[0], osg::maximum(extents[1], extents[2]));
+            unsigned int numCells = osg::maximum(1u, (unsigned int)points.size() / _targetPointsPerBin);
+
+            unsigned int dims[3] = { 1, 1, 1 };
+            if (maxExtent > 0.0f)
+            {
+                double volume = 1.0;
+                unsigned int numAxes = 0;
+                for (unsigned int k = 0; k < 3; ++k)
+                {
+                    if (extents[k] > maxExtent*1e-3f) { volume *= extents[k]; ++numAxes; }
+                }
+                double cellSize = pow(volume / (double)numCells, 1.0 / (double)numAxes);
+                for (unsigned int k = 0; k < 3; ++k)
+                {
+                    if (extents[k] > maxExtent*1e-3f)
+                        dims[k] = (unsigned int)osg::clampBetween(ceil(extents[k] / cellSize), 1.0, 1024.0);
+                }
+            }
+
+            std::vector<unsigned int> cells(points.size());
+            std::vector<unsigned int> counts(dims[0]*dims[1]*dims[2] + 1, 0);
+            for (unsigned int i = 0; i < points.size(); ++i)
+            {
+                const osg::Vec3& p = _lightPointList[points[i]]._position;
+                unsigned int c[3];
+                for (unsigned int k = 0; k < 3; ++k)
+                {
+                    float t = extents[k] > 0.0f ? (p[k] - bb._min[k]) / extents[k] : 0.0f;
+                    c[k] = osg::minimum((unsigned int)(t * (float)dims[k]), dims[k]-1);
+                }
+                cells[i] = (c[2]*dims[1] + c[1])*dims[0] + c[0];
+                ++counts[cells[i]+1];
+            }
+            for (unsigned int c = 1; c < counts.size(); ++c) counts[c] += counts[c-1];
+
+            std::vector<unsigned int> order(points.size());
+            std::vector<unsigned int> fill(counts.begin(), counts.end()-1);
+            for (unsigned int i = 0; i < points.size(); ++i) order[fill[cells[i]]++] = points[i];
+
+            for (unsigned int c = 0; c+1 < counts.size(); ++c)
+            {
+                if (counts[c] == counts[c+1]) continue;
+                Bin bin;
+                bin._begin = counts[c];
+                bin._end = counts[c+1];
+                for (unsigned int i = bin._begin; i < bin._end; ++i) bin._bb.expandBy(_lightPointList[order[i]]._position);
+                _bins.push_back(bin);
+            }
+
+            // structure of arrays, in bin order
+            std::map<const BlinkSequence*, unsigned int> blinkIndices;
+            for (unsigned int i = 0; i < order.size(); ++i)
+            {
+                const LightPoint& lp = _lightPointList[order[i]];
+                _x.push_back(lp._position.x()); _y.push_back(lp._position.y()); _z.push_back(lp._position.z());
+                _r.push_back(lp._color.r()); _g.push_back(lp._color.g()); _b.push_back(lp._color.b()); _a.push_back(lp._color.a());
+                _intensity.push_back(lp._intensity);
+                _radius.push_back(lp._radius);
+                _additive.push_back(lp._blendingMode == LightPoint::ADDITIVE ? 1 : 0);
+
+                unsigned int blink = NO_BLINK;
+                if (lp._blinkSequence.valid())
+                {
+                    std::map<const BlinkSequence*, unsigned int>::iterator itr = blinkIndices.find(lp._blinkSequence.get());
+                    if (itr == blinkIndices.end())
+                    {
+                        itr = blinkIndices.insert(std::make_pair(lp._blinkSequence.get(), (unsigned int)_blinkSequences.size())).first;
+                        _blinkSequences.push_back(lp._blinkSequence);
+                    }
+                    blink = itr->second;
+                }
+                _blink.push_back(blink);
+
+                addSector(lp._sector.get());
+            }
+
+            // pad to a multiple of 4 with points that are never visible
+            while (_x.size() % 4)
+            {
+                _x.push_back(0.0f); _y.push_back(0.0f); _z.push_back(0.0f);
+                _r.push_back(0.0f); _g.push_back(0.0f); _b.push_back(0.0f); _a.push_back(0.0f);
+                _intensity.push_back(0.0f);
+                _radius.push_back(0.0f);
+                _additive.push_back(0);
+                _blink.push_back(NO_BLINK);
+                addSector(0);
+            }
+
+            if (!_hasSectors)
+            {
+                for (unsigned int i = 0; i < 8; ++i) std::vector<float>().swap(_sector[i]);
+            }
+
+            buildStateSets();
+        }
+
+        void addSector(const Sector* sector)
+        {
+            // defaults that evaluate to 1 everywhere
+            float s[8] = { 1.0f, 0.0f, -1.0f, -1.0f, -1.0f, -1.0f, 1.0f, 1.0f };
+            unsigned int custom = NO_SECTOR;
+
+            if (sector)
+            {
+                _hasSectors = true;
+                const AzimRange* azim = dynamic_cast<const AzimRange*>(sector);
+                const ElevationRange* elevation = dynamic_cast<const ElevationRange*>(sector);
+                bool standard = dynamic_cast<const AzimSector*>(sector) || dynamic_cast<const ElevationSector*>(sector) ||
+                                dynamic_cast<const AzimElevationSector*>(sector);
+                if (standard)
+                {
+                    if (azim)
+                    {
+                        s[0] = azim->*AzimRangeParameters::cosAzim();
+                        s[1] = azim->*AzimRangeParameters::sinAzim();
+                        s[2] = azim->*AzimRangeParameters::cosAngle();
+                        s[3] = azim->*AzimRangeParameters::cosFadeAngle();
+                    }
+                    if (elevation)
+                    {
+                        s[4] = elevation->*ElevationRangeParameters::cosMin();
+                        s[5] = elevation->*ElevationRangeParameters::cosMinFade();
+                        s[6] = elevation->*ElevationRangeParameters::cosMax();
+                        s[7] = elevation->*ElevationRangeParameters::cosMaxFade();
+                    }
+                }
+                else
+                {
+                    custom = (unsigned int)_customSectors.size();
+                    _customSectors.push_back(const_cast<Sector*>(sector));
+                }
+            }
+
+            for (unsigned int i = 0; i < 8; ++i) _sector[i].push_back(s[i]);
+            _customSector.push_back(custom);
+        }
+
+        void buildStateSets()
+        {
+            if (_stateSets[0].valid()) return;
+
+            static const char* vertexSource =
+                "#version 120\n"
+                "attribute float lp_size;\n"
+                "void main()\n"
+                "{\n"
+                "    gl_Position = ftransform();\n"
+                "    gl_FrontColor = gl_Color;\n"
+                "    gl_PointSize = lp_size;\n"
+                "}\n";
+
+            static const char* fragmentSource =
+                "#version 120\n"
+                "void main()\n"
+                "{\n"
+                "    gl_FragColor = gl_Color;\n"
+                "}\n";
+
+            static const char* spriteFragmentSource =
+                "#version 120\n"
+                "void main()\n"
+                "{\n"
+                "    vec2 d = gl_PointCoord*2.0 - 1.0;\n"
+                "    float r2 = dot(d, d);\n"
+                "    if (r2 > 1.0) discard;\n"
+                "    gl_FragColor = vec4(gl_Color.rgb, gl_Color.a*(1.0 - r2));\n"
+                "}\n";
+
+            osg::Program* program = new osg::Program();
+            program->setName("BatchLightPointNode");
+            program->addShader(new osg::Shader(osg::Shader::VERTEX, vertexSource));
+            program->addShader(new osg::Shader(osg::Shader::FRAGMENT, _pointSprites ? spriteFragmentSource : fragmentSource));
+            program->addBindAttribLocation("lp_size", SIZE_ATTRIBUTE);
+
+            for (unsigned int mode = 0; mode < 2; ++mode)
+            {
+                osg::StateSet* stateset = new osg::StateSet();
+                stateset->setAttributeAndModes(program, osg::StateAttribute::ON);
+                stateset->setMode(GL_VERTEX_PROGRAM_POINT_SIZE, osg::StateAttribute::ON);
+                stateset->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+                stateset->setAttributeAndModes(new osg::Depth(osg::Depth::LESS, 0.0, 1.0, false), osg::StateAttribute::ON);
+                stateset->setAttributeAndModes(mode == 0 ?
+                    new osg::BlendFunc(osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE_MINUS_SRC_ALPHA) :
+                    new osg::BlendFunc(osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE), osg::StateAttribute::ON);
+                if (_pointSprites)
+                    stateset->setTextureAttributeAndModes(0, new osg::PointSprite(), osg::StateAttribute::ON);
+                stateset->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+                _stateSets[mode] = stateset;
+            }
+        }
+
+        static osg::Geometry* createGeometry()
+        {
+            osg::Geometry* geometry = new osg::Geometry();
+            geometry->setUseDisplayList(false);
+            geometry->setUseVertexBufferObjects(true);
+            geometry->setVertexArray(new osg::Vec3Array());
+            geometry->setColorArray(new osg::Vec4Array(), osg::Array::BIND_PER_VERTEX);
+            geometry->setVertexAttribArray(SIZE_ATTRIBUTE, new osg::FloatArray(), osg::Array::BIND_PER_VERTEX);
+            geometry->addPrimitiveSet(new osg::DrawArrays(GL_POINTS, 0, 0));
+            return geometry;
+        }
+
+        /** the output geometries for this visit of the node by a cull visitor.*/
+        Slot getSlot(const osgUtil::CullVisitor& cv)
+        {
+            Slot slot;
+            if (!cv.getFrameStamp())
+            {
+                // frames can't be told apart, so nothing can be reused safely
+                for (unsigned int mode = 0; mode < 2; ++mode)
+                    slot._geometries[mode] = createGeometry();
+                return slot;
+            }
+
+            unsigned int frame = cv.getFrameStamp()->getFrameNumber();
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            RenderBuffers& buffers = _renderBuffers[&cv];
+            if (buffers._frame != frame)
+            {
+                buffers._frame = frame;
+                buffers._numVisits = 0;
+            }
+
+            std::vector<Slot>& slots = buffers._ring[frame % RING_SIZE];
+            unsigned int visit = buffers._numVisits++;
+            if (visit >= slots.size())
+            {
+                slots.resize(visit + 1);
+                for (unsigned int mode = 0; mode < 2; ++mode)
+                    slots[visit]._geometries[mode] = createGeometry();
+            }
+            return slots[visit];
+        }
+
+        /** the lesser of the AzimRange and ElevationRange fall offs, as AzimElevationSector.*/
+        static float sectorScalar(float ex, float ey, float ez, const float* s)
+        {
+            float azim = 1.0f;
+            float dot = ex*s[1] + ey*s[0];
+            float length = sqrtf(ex*ex + ey*ey);
+            if (dot < s[3]*length) return 0.0f;
+            if (dot < s[2]*length) azim = (dot - s[3]*length) / ((s[2]-s[3])*length);
+
+            float elevation = 1.0f;
+            dot = ez;
+            length = sqrtf(ex*ex + ey*ey + ez*ez);
+            if (dot > s[7]*length || dot < s[5]*length) return 0.0f;
+            if (dot > s[6]*length) elevation = (dot - s[7]*length) / ((s[6]-s[7])*length);
+            else if (dot < s[4]*length) elevation = (dot - s[5]*length) / ((s[4]-s[5])*length);
+            return osg::minimum(azim, elevation);
+        }
+
+#if defined(OSGSIM_BATCH_SSE)
+        static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+        {
+            return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+        }
+
+        /** the lesser of the AzimRange and ElevationRange fall offs of four points.*/
+        static __m128 sectorSSE(__m128 ex, __m128 ey, __m128 ez, const float* const* s)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 tiny = _mm_set1_ps(1e-30f);
+
+            __m128 cosAzim = _mm_loadu_ps(s[0]), sinAzim = _mm_loadu_ps(s[1]);
+            __m128 cosAngle = _mm_loadu_ps(s[2]), cosFade = _mm_loadu_ps(s[3]);
+
+            __m128 dot = _mm_add_ps(_mm_mul_ps(ex, sinAzim), _mm_mul_ps(ey, cosAzim));
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+            __m128 fadeLength = _mm_mul_ps(cosFade, length);
+            __m128 angleLength = _mm_mul_ps(cosAngle, length);
+            __m128 fade = _mm_div_ps(_mm_sub_ps(dot, fadeLength), _mm_max_ps(_mm_sub_ps(angleLength, fadeLength), tiny));
+            __m128 azim = select(_mm_cmplt_ps(dot, angleLength), fade, one);
+            azim = select(_mm_cmplt_ps(dot, fadeLength), zero, azim);
+
+            __m128 cosMin = _mm_loadu_ps(s[4]), cosMinFade = _mm_loadu_ps(s[5]);
+            __m128 cosMax = _mm_loadu_ps(s[6]), cosMaxFade = _mm_loadu_ps(s[7]);
+
+            length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(length, length), _mm_mul_ps(ez, ez)));
+            __m128 minLength = _mm_mul_ps(cosMin, length), minFadeLength = _mm_mul_ps(cosMinFade, length);
+            __m128 maxLength = _mm_mul_ps(cosMax, length), maxFadeLength = _mm_mul_ps(cosMaxFade, length);
+            __m128 upper = _mm_div_ps(_mm_sub_ps(ez, maxFadeLength), _mm_min_ps(_mm_sub_ps(maxLength, maxFadeLength), _mm_sub_ps(zero, tiny)));
+            __m128 lower = _mm_div_ps(_mm_sub_ps(ez, minFadeLength), _mm_max_ps(_mm_sub_ps(minLength, minFadeLength), tiny));
+            __m128 elevation = select(_mm_cmplt_ps(ez, minLength), lower, one);
+            elevation = select(_mm_cmpgt_ps(ez, maxLength), upper, elevation);
+            elevation = select(_mm_or_ps(_mm_cmpgt_ps(ez, maxFadeLength), _mm_cmplt_ps(ez, minFadeLength)), zero, elevation);
+
+            return _mm_min_ps(azim, elevation);
+        }
+#endif
+
+        /** intensity, alpha scale and pixel size of the points [begin,end), a multiple of 4.*/
+        void shade(CullState& state, unsigned int begin, unsigned int end, float* intensity, float* size) const
+        {
+            const osg::Matrixf& m = state._modelView;
+
+#if defined(OSGSIM_BATCH_SSE)
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 m02 = _mm_set1_ps(m(0,2)), m12 = _mm_set1_ps(m(1,2)), m22 = _mm_set1_ps(m(2,2)), m32 = _mm_set1_ps(m(3,2));
+            const __m128 m00 = _mm_set1_ps(m(0,0)), m10 = _mm_set1_ps(m(1,0)), m20 = _mm_set1_ps(m(2,0)), m30 = _mm_set1_ps(m(3,0));
+            const __m128 m01 = _mm_set1_ps(m(0,1)), m11 = _mm_set1_ps(m(1,1)), m21 = _mm_set1_ps(m(2,1)), m31 = _mm_set1_ps(m(3,1));
+            const __m128 eyeX = _mm_set1_ps(state._eyeLocal.x()), eyeY = _mm_set1_ps(state._eyeLocal.y()), eyeZ = _mm_set1_ps(state._eyeLocal.z());
+            const __m128 maxDistance2 = _mm_set1_ps(state._maxVisibleDistance2);
+            const __m128 pixelScale = _mm_set1_ps(state._pixelScale);
+            const __m128 systemIntensity = _mm_set1_ps(state._intensity);
+            const __m128 minPixelSize = _mm_set1_ps(state._minPixelSize);
+            const __m128 maxPixelSize = _mm_set1_ps(state._maxPixelSize);
+            const __m128 inverseMinPixelSize = _mm_set1_ps(state._minPixelSize > 0.0f ? 1.0f/state._minPixelSize : 0.0f);
+
+            for (unsigned int i = begin; i < end; i += 4)
+            {
+                __m128 x = _mm_loadu_ps(&_x[i]), y = _mm_loadu_ps(&_y[i]), z = _mm_loadu_ps(&_z[i]);
+
+                __m128 ex = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m10)), _mm_add_ps(_mm_mul_ps(z, m20), m30));
+                __m128 ey = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m01), _mm_mul_ps(y, m11)), _mm_add_ps(_mm_mul_ps(z, m21), m31));
+                __m128 ez = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m02), _mm_mul_ps(y, m12)), _mm_add_ps(_mm_mul_ps(z, m22), m32));
+                __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez));
+
+                __m128 visible = _mm_and_ps(_mm_cmplt_ps(ez, zero), _mm_cmple_ps(distance2, maxDistance2));
+
+                __m128 value = _mm_mul_ps(_mm_loadu_ps(&_intensity[i]), systemIntensity);
+                if (_hasSectors)
+                {
+                    const float* s[8];
+                    for (unsigned int k = 0; k < 8; ++k) s[k] = &_sector[k][i];
+                    value = _mm_mul_ps(value, sectorSSE(_mm_sub_ps(eyeX, x), _mm_sub_ps(eyeY, y), _mm_sub_ps(eyeZ, z), s));
+                }
+
+                __m128 pixelSize = _mm_mul_ps(_mm_loadu_ps(&_radius[i]), pixelScale);
+                if (state._perspective)
+                    pixelSize = _mm_div_ps(pixelSize, _mm_max_ps(_mm_sub_ps(zero, ez), _mm_set1_ps(1e-6f)));
+
+                // points below the minimum size fade with their area
+                __m128 small = _mm_cmplt_ps(pixelSize, minPixelSize);
+                __m128 ratio = _mm_mul_ps(pixelSize, inverseMinPixelSize);
+                value = select(small, _mm_mul_ps(value, _mm_mul_ps(ratio, ratio)), value);
+                pixelSize = _mm_min_ps(_mm_max_ps(pixelSize, minPixelSize), maxPixelSize);
+
+                _mm_storeu_ps(&intensity[i-begin], _mm_and_ps(visible, value));
+                _mm_storeu_ps(&size[i-begin], pixelSize);
+            }
+#else
+            for (unsigned int i = begin; i < end; ++i)
+            {
+                float ex = _x[i]*m(0,0) + _y[i]*m(1,0) + _z[i]*m(2,0) + m(3,0);
+                float ey = _x[i]*m(0,1) + _y[i]*m(1,1) + _z[i]*m(2,1) + m(3,1);
+                float ez = _x[i]*m(0,2) + _y[i]*m(1,2) + _z[i]*m(2,2) + m(3,2);
+                float distance2 = ex*ex + ey*ey + ez*ez;
+
+                float value = _intensity[i]*state._intensity;
+                if (_hasSectors)
+                {
+                    float s[8];
+                    for (unsigned int k = 0; k < 8; ++k) s[k] = _sector[k][i];
+                    value *= sectorScalar(state._eyeLocal.x()-_x[i], state._eyeLocal.y()-_y[i], state._eyeLocal.z()-_z[i], s);
+                }
+
+                float pixelSize = _radius[i]*state._pixelScale;
+                if (state._perspective) pixelSize /= osg::maximum(-ez, 1e-6f);
+
+                if (pixelSize < state._minPixelSize)
+                {
+                    float ratio = pixelSize / state._minPixelSize;
+                    value *= ratio*ratio;
+                }
+                pixelSize = osg::minimum(osg::maximum(pixelSize, state._minPixelSize), state._maxPixelSize);
+
+                intensity[i-begin] = (ez < 0.0f && distance2 <= state._maxVisibleDistance2) ? value : 0.0f;
+                size[i-begin] = pixelSize;
+            }
+#endif
+        }
+
+        void emit(CullState& state, unsigned int begin, unsigned int end, const float* intensity, const float* size) const
+        {
+            for (unsigned int i = begin; i < end; ++i)
+            {
+                float value = intensity[i-begin];
+                if (!(value > 0.0f)) continue;
+
+                if (_customSector[i] != NO_SECTOR)
+                {
+                    osg::Vec3 eyeLocal = state._eyeLocal - osg::Vec3(_x[i], _y[i], _z[i]);
+                    value *= (*_customSectors[_customSector[i]])(eyeLocal);
+                    if (!(value > 0.0f)) continue;
+                }
+
+                osg::Vec4 color(_r[i], _g[i], _b[i], _a[i]*value);
+                if (_blink[i] != NO_BLINK) color = osg::componentMultiply(color, state._blinkColors[_blink[i]]);
+                if (!(color.a() > 0.0f)) continue;
+
+                unsigned int mode = _additive[i];
+                osg::Vec3 position(_x[i], _y[i], _z[i]);
+                state._vertices[mode]->push_back(position);
+                state._colors[mode]->push_back(color);
+                state._sizes[mode]->push_back(size[i-begin]);
+                state._drawnBound.expandBy(position);
+            }
+        }
+
+        void cull(osgUtil::CullVisitor& cv)
+        {
+            CullState state;
+            state._modelView = *cv.getModelViewMatrix();
+            state._eyeLocal = cv.getEyeLocal();
+            state._intensity = _lightSystem.valid() ? _lightSystem->getIntensity() : 1.0f;
+            state._minPixelSize = _minPixelSize;
+            state._maxPixelSize = osg::maximum(_maxPixelSize, _minPixelSize);
+            state._maxVisibleDistance2 = _maxVisibleDistance2;
+            state._numPointsTested = 0;
+
+            const osg::Matrix& projection = *cv.getProjectionMatrix();
+            const osg::Viewport* viewport = cv.getViewport();
+            float height = viewport ? (float)viewport->height() : 1024.0f;
+            state._perspective = projection(3,3) == 0.0;
+            state._pixelScale = (float)projection(1,1) * height * 0.5f;
+
+            // each blink sequence once per cull, over the time since this cull
+            // visitor's previous frame
+            double time = cv.getFrameStamp() ? cv.getFrameStamp()->getSimulationTime() : 0.0;
+            double interval;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                RenderBuffers& buffers = _renderBuffers[&cv];
+                if (time != buffers._time)
+                {
+                    buffers._interval = osg::clampBetween(time - buffers._time, 0.0, 1.0);
+                    buffers._time = time;
+                }
+                interval = buffers._interval;
+            }
+            bool animate = !_lightSystem.valid() || _lightSystem->getAnimationState() != LightPointSystem::ANIMATION_OFF;
+            state._blinkColors.resize(_blinkSequences.size());
+            for (unsigned int b = 0; b < _blinkSequences.size(); ++b)
+                state._blinkColors[b] = animate ? _blinkSequences[b]->color(time, interval) : osg::Vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+            Slot slot = getSlot(cv);
+            osg::ref_ptr<osg::Geometry>* geometries = slot._geometries;
+            for (unsigned int mode = 0; mode < 2; ++mode)
+            {
+                state._vertices[mode] = static_cast<osg::Vec3Array*>(geometries[mode]->getVertexArray());
+                state._colors[mode] = static_cast<osg::Vec4Array*>(geometries[mode]->getColorArray());
+                state._sizes[mode] = static_cast<osg::FloatArray*>(geometries[mode]->getVertexAttribArray(SIZE_ATTRIBUTE));
+                state._vertices[mode]->clear();
+                state._colors[mode]->clear();
+                state._sizes[mode]->clear();
+            }
+
+            float maxDistance = _maxVisibleDistance2 < FLT_MAX ? sqrtf(_maxVisibleDistance2) : FLT_MAX;
+            std::vector<float> intensity, size;
+            unsigned int numVisibleBins = 0;
+            for (std::vector<Bin>::const_iterator itr = _bins.begin(); itr != _bins.end(); ++itr)
+            {
+                if (cv.isCulled(itr->_bb)) continue;
+                if (maxDistance < FLT_MAX && distanceToBox(itr->_bb, state._eyeLocal) > maxDistance) continue;
+
+                ++numVisibleBins;
+
+                // shade whole groups of 4 around the bin, the padding makes this safe at the end
+                unsigned int begin = itr->_begin & ~3u;
+                unsigned int end = (itr->_end + 3) & ~3u;
+                intensity.resize(end - begin);
+                size.resize(end - begin);
+                shade(state, begin, end, &intensity[0], &size[0]);
+                emit(state, itr->_begin, itr->_end, &intensity[itr->_begin - begin], &size[itr->_begin - begin]);
+                state._numPointsTested += itr->_end - itr->_begin;
+            }
+
+            unsigned int numDrawn = 0;
+            for (unsigned int mode = 0; mode < 2; ++mode)
+            {
+                osg::Geometry* geometry = geometries[mode].get();
+                unsigned int count = (unsigned int)state._vertices[mode]->size();
+                numDrawn += count;
+                if (count == 0) continue;
+
+                static_cast<osg::DrawArrays*>(geometry->getPrimitiveSet(0))->setCount(count);
+                state._vertices[mode]->dirty();
+                state._colors[mode]->dirty();
+                state._sizes[mode]->dirty();
+                geometry->getPrimitiveSet(0)->dirty();
+                geometry->setInitialBound(state._drawnBound);
+                geometry->dirtyBound();
+
+                osg::RefMatrix* modelView = cv.getModelViewMatrix();
+                cv.updateCalculatedNearFar(*modelView, state._drawnBound);
+                cv.pushStateSet(_stateSets[mode].get());
+                cv.addDrawableAndDepth(geometry, modelView, -(state._drawnBound.center() * (*modelView)).z());
+                cv.popStateSet();
+            }
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _stats.numBins = (unsigned int)_bins.size();
+            _stats.numVisibleBins = numVisibleBins;
+            _stats.numPointsTested = state._numPointsTested;
+            _stats.numPointsDrawn = numDrawn;
+        }
+
+        static float distanceToBox(const osg::BoundingBox& bb, const osg::Vec3& p)
+        {
+            osg::Vec3 d(osg::maximum(osg::maximum(bb.xMin()-p.x(), p.x()-bb.xMax()), 0.0f),
+                        osg::maximum(osg::maximum(bb.yMin()-p.y(), p.y()-bb.yMax()), 0.0f),
+                        osg::maximum(osg::maximum(bb.zMin()-p.z(), p.z()-bb.zMax()), 0.0f));
+            return d.length();
+        }
+
+        unsigned int _targetPointsPerBin;
+        bool _dirty;
+        unsigned int _numBuiltLightPoints;
+        bool _hasSectors;
+
+        // structure of arrays, sorted by bin and padded to a multiple of 4
+        std::vector<float> _x, _y, _z;
+        std::vector<float> _r, _g, _b, _a;
+        std::vector<float> _intensity;
+        std::vector<float> _radius;
+        std::vector<float> _sector[8];
+        std::vector<unsigned char> _additive;
+        std::vector<unsigned int> _blink;
+        std::vector<unsigned int> _customSector;
+
+        std::vector< osg::ref_ptr<BlinkSequence> > _blinkSequences;
+        std::vector< osg::ref_ptr<Sector> > _customSectors;
+        std::vector<Bin> _bins;
+
+        osg::ref_ptr<osg::StateSet> _stateSets[2];
+        std::map<const osgUtil::CullVisitor*, RenderBuffers> _renderBuffers;
+        Stats _stats;
+        mutable OpenThreads::Mutex _mutex;
+};
+
+}
+
+#endif
@@ -0,0 +1,450 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2010 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGPARTICLE_BATCHMODULARPROGRAM
+#define OSGPARTICLE_BATCHMODULARPROGRAM
+
+#include <osgParticle/Program>
+#include <osgParticle/ModularProgram>
+#include <osgParticle/ParticleSystem>
+#include <osgParticle/BatchOperator>
+
+#include <osg/NodeVisitor>
+
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/Condition>
+#include <OpenThreads/ScopedLock>
+
+#include <vector>
+
+namespace osgParticle
+{
+
+/** The live particles of a ParticleSystem copied into structure-of-arrays form.
+    gather() copies the requested fields of every live particle, span() hands out
+    ranges of them, and scatter() writes the velocities back.
+*/
+class ParticleSoA
+{
+public:
+    ParticleSoA() : _fields(0) {}
+
+    unsigned int size() const { return (unsigned int)_indices.size(); }
+
+    void gather(ParticleSystem* ps, unsigned int fields)
+    {
+        _fields = fields | ParticleSpan::VELOCITY;
+        _indices.clear();
+
+        const int n = ps->numParticles();
+        for (int i = 0; i < n; ++i)
+            if (ps->getParticle(i)->isAlive())
+                _indices.push_back(i);
+
+        const unsigned int count = size();
+        resize(_vx, count, true); resize(_vy, count, true); resize(_vz, count, true);
+        resize(_px, count, (_fields & ParticleSpan::POSITION) != 0);
+        resize(_py, count, (_fields & ParticleSpan::POSITION) != 0);
+        resize(_pz, count, (_fields & ParticleSpan::POSITION) != 0);
+        resize(_massInv, count, (_fields & ParticleSpan::MASS_INV) != 0);
+        resize(_radius, count, (_fields & ParticleSpan::RADIUS) != 0);
+
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            const Particle* P = ps->getParticle(_indices[i]);
+            const osg::Vec3& v = P->getVelocity();
+            _vx[i] = v.x(); _vy[i] = v.y(); _vz[i] = v.z();
+
+            if (_fields & ParticleSpan::POSITION)
+            {
+                const osg::Vec3& p = P->getPosition();
+                _px[i] = p.x(); _py[i] = p.y(); _pz[i] = p.z();
+            }
+            if (_fields & ParticleSpan::MASS_INV) _massInv[i] = P->getMassInv();
+            if (_fields & ParticleSpan::RADIUS) _radius[i] = P->getRadius();
+        }
+    }
+
+    void scatter(ParticleSystem* ps) const
+    {
+        for (unsigned int i = 0; i < _indices.size(); ++i)
+            ps->getParticle(_indices[i])->setVelocity(osg::Vec3(_vx[i], _vy[i], _vz[i]));
+    }
+
+    ParticleSpan span(unsigned int begin, unsigned int end)
+    {
+        ParticleSpan s;
+        s.count = end - begin;
+        if (s.count == 0) return s;
+
+        s.vx = &_vx[begin]; s.vy = &_vy[begin]; s.vz = &_vz[begin];
+        if (_fields & ParticleSpan::POSITION) { s.px = &_px[begin]; s.py = &_py[begin]; s.pz = &_pz[begin]; }
+        if (_fields & ParticleSpan::MASS_INV) s.massInv = &_massInv[begin];
+        if (_fields & ParticleSpan::RADIUS) s.radius = &_radius[begin];
+        return s;
+    }
+
+protected:
+    static void resize(std::vector<float>& v, unsigned int count, bool used)
+    {
+        if (used) v.resize(count);
+    }
+
+    unsigned int        _fields;
+    std::vector<int>    _indices;
+    std::vector<float>  _vx, _vy, _vz;
+    std::vector<float>  _px, _py, _pz;
+    std::vector<float>  _massInv;
+    std::vector<float>  _radius;
+};
+
+/** Threads that share the batch operator work of large particle systems.
+    run() splits [0, count) into chunks, processes them on the pool and the
+    calling thread, and returns when all are done. One pool can serve any
+    number of programs, one run() at a time.
+*/
+class ParticleThreadPool : public osg::Referenced
+{
+public:
+    struct Task
+    {
+        virtual ~Task() {}
+        virtual void run(unsigned int begin, unsigned int end) = 0;
+    };
+
+    ParticleThreadPool(unsigned int numThreads = 0) :
+        _task(0),
+        _count(0),
+        _chunkSize(0),
+        _next(0),
+        _remaining(0),
+        _generation(0),
+        _done(false)
+    {
+        if (numThreads == 0)
+        {
+            int cpus = OpenThreads::GetNumberOfProcessors();
+            numThreads = cpus > 1 ? (unsigned int)(cpus - 1) : 1;
+        }
+
+        for (unsigned int i = 0; i < numThreads; ++i)
+        {
+            Worker* worker = new Worker(this);
+            _workers.push_back(worker);
+            worker->start();
+        }
+    }
+
+    unsigned int getNumThreads() const { return (unsigned int)_workers.size(); }
+
+    void run(Task& task, unsigned int count, unsigned int chunkSize)
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> runLock(_runMutex);
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _task = &task;
+            _count = count;
+            _chunkSize = chunkSize > 0 ? chunkSize : 1;
+            _next = 0;
+            _remaining = (count + _chunkSize - 1) / _chunkSize;
+            ++_generation;
+            _work.broadcast();
+        }
+
+        processChunks();
+
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+        while (_remaining > 0)
+            _finished.wait(&_mutex);
+        _task = 0;
+    }
+
+protected:
+    virtual ~ParticleThreadPool()
+    {
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _done = true;
+            _work.broadcast();
+        }
+        for (unsigned int i = 0; i < _workers.size(); ++i)
+        {
+            _workers[i]->join();
+            delete _workers[i];
+        }
+    }
+
+    struct Worker : public OpenThreads::Thread
+    {
+        Worker(ParticleThreadPool* pool) : _pool(pool) {}
+        virtual void run() { _pool->workerLoop(); }
+        ParticleThreadPool* _pool;
+    };
+
+    void workerLoop()
+    {
+        unsigned int seen = 0;
+        for (;;)
+        {
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                while (_generation == seen && !_done)
+                    _work.wait(&_mutex);
+                if (_done)
+                    return;
+                seen = _generation;
+            }
+            processChunks();
+        }
+    }
+
+    void processChunks()
+    {
+        for (;;)
+        {
+            unsigned int begin;
+            Task* task;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                if (!_task || _next >= _count)
+                    return;
+                task = _task;
+                begin = _next;
+                _next += _chunkSize;
+            }
+
+            unsigned int end = begin + _chunkSize < _count ? begin + _chunkSize : _count;
+            task->run(begin, end);
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            if (--_remaining == 0)
+                _finished.broadcast();
+        }
+    }
+
+    OpenThreads::Mutex      _runMutex;
+    OpenThreads::Mutex      _mutex;
+    OpenThreads::Condition  _work;
+    OpenThreads::Condition  _finished;
+    std::vector<Worker*>    _workers;
+    Task*                   _task;
+    unsigned int            _count;
+    unsigned int            _chunkSize;
+    unsigned int            _next;
+    unsigned int            _remaining;
+    unsigned int            _generation;
+    bool                    _done;
+};
+
+/** A ModularProgram that runs its operators over a structure-of-arrays copy of the particles.
+    Consecutive BatchOperators are applied span by span, with SIMD kernels, and
+    split across a ParticleThreadPool once the system has more live particles
+    than the parallel threshold. Other operators still work: the velocities are
+    written back before they run and gathered again afterwards.
+    Operators are applied in the order they were added, as in ModularProgram.
+*/
+class BatchModularProgram : public Program
+{
+public:
+    BatchModularProgram() :
+        Program(),
+        _parallelThreshold(8192),
+        _chunkSize(2048) {}
+
+    BatchModularProgram(const BatchModularProgram& copy, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY) :
+        Program(copy, copyop),
+        _operators(copy._operators),
+        _threadPool(copy._threadPool),
+        _parallelThreshold(copy._parallelThreshold),
+        _chunkSize(copy._chunkSize) {}
+
+    /** Converts a ModularProgram, replacing its built-in operators with batch versions.*/
+    BatchModularProgram(const ModularProgram& copy) :
+        Program(copy),
+        _parallelThreshold(8192),
+        _chunkSize(2048)
+    {
+        for (int i = 0; i < copy.numOperators(); ++i)
+        {
+            const Operator* op = copy.getOperator(i);
+            Operator* batch = createBatchOperator(op);
+            addOperator(batch ? batch : const_cast<Operator*>(op));
+        }
+    }
+
+    META_Node(osgParticle, BatchModularProgram);
+
+    int numOperators() const { return static_cast<int>(_operators.size()); }
+    void addOperator(Operator* o) { _operators.push_back(o); }
+    Operator* getOperator(int i) { return _operators[i].get(); }
+    const Operator* getOperator(int i) const { return _operators[i].get(); }
+    void removeOperator(int i) { _operators.erase(_operators.begin() + i); }
+
+    /// Pool for large systems; NULL to always update on the calling thread.
+    void setThreadPool(ParticleThreadPool* pool) { _threadPool = pool; }
+    ParticleThreadPool* getThreadPool() const { return _threadPool.get(); }
+
+    /// Live particle count from which the update is split across the thread pool.
+    void setParallelThreshold(unsigned int count) { _parallelThreshold = count; }
+    unsigned int getParallelThreshold() const { return _parallelThreshold; }
+
+    /// Particles per chunk handed to a thread.
+    void setChunkSize(unsigned int count) { _chunkSize = count; }
+    unsigned int getChunkSize() const { return _chunkSize; }
+
+protected:
+    virtual ~BatchModularProgram() {}
+    BatchModularProgram& operator=(const BatchModularProgram&) { return *this; }
+
+    typedef std::vector< osg::ref_ptr<Operator> > Operator_vector;
+
+    // applies a run of batch operators to [begin, end)
+    struct RunTask : public ParticleThreadPool::Task
+    {
+        RunTask(ParticleSoA& soa, BatchOperator* const* ops, unsigned int numOps, double dt) :
+            _soa(soa), _ops(ops), _numOps(numOps), _dt(dt) {}
+
+        virtual void run(unsigned int begin, unsigned int end)
+        {
+            ParticleSpan span = _soa.span(begin, end);
+            for (unsigned int i = 0; i < _numOps; ++i)
+                _ops[i]->operate(span, _dt);
+        }
+
+        ParticleSoA&            _soa;
+        BatchOperator* const*   _ops;
+        unsigned int            _numOps;
+        double                  _dt;
+    };
+
+    virtual void execute(double dt)
+    {
+        ParticleSystem* ps = getParticleSystem();
+        if (!ps) return;
+
+        unsigned int fields = 0;
+        for (Operator_vector::iterator itr = _operators.begin(); itr != _operators.end(); ++itr)
+        {
+            BatchOperator* batch = dynamic_cast<BatchOperator*>(itr->get());
+            if (batch && batch->isEnabled()) fields |= batch->getRequiredFields();
+        }
+
+        bool gathered = false;
+        std::vector<BatchOperator*> run;
+
+        for (Operator_vector::iterator itr = _operators.begin(); itr != _operators.end(); ++itr)
+        {
+            Operator* op = itr->get();
+            BatchOperator* batch = dynamic_cast<BatchOperator*>(op);
+
+            if (batch)
+            {
+                if (!batch->isEnabled()) continue;
+                if (!gathered)
+                {
+                    _soa.gather(ps, fields);
+                    gathered = true;
+                }
+                batch->beginOperate(this);
+                run.push_back(batch);
+                continue;
+            }
+
+            // a per particle operator: flush the batch run and hand it the particles
+            flush(run, dt);
+            if (gathered)
+            {
+                _soa.scatter(ps);
+                gathered = false;
+            }
+
+            op->beginOperate(this);
+            op->operateParticles(ps, dt);
+            op->endOperate();
+        }
+
+        flush(run, dt);
+        if (gathered)
+            _soa.scatter(ps);
+    }
+
+    void flush(std::vector<BatchOperator*>& run, double dt)
+    {
+        if (run.empty()) return;
+
+        RunTask task(_soa, &run[0], (unsigned int)run.size(), dt);
+        const unsigned int count = _soa.size();
+        if (_threadPool.valid() && count >= _parallelThreshold)
+            _threadPool->run(task, count, _chunkSize);
+        else
+            task.run(0, count);
+
+        for (unsigned int i = 0; i < run.size(); ++i)
+            run[i]->endOperate();
+        run.clear();
+    }
+
+    Operator_vector                     _operators;
+    osg::ref_ptr<ParticleThreadPool>    _threadPool;
+    unsigned int                        _parallelThreshold;
+    unsigned int                        _chunkSize;
+    ParticleSoA                         _soa;
+};
+
+/** Replaces every ModularProgram of a subgraph with a BatchModularProgram.
+    Effects such as ExplosionEffect keep a pointer to the program they built,
+    so apply the visitor after the effects are configured.
+*/
+class UseBatchProgramsVisitor : public osg::NodeVisitor
+{
+public:
+    UseBatchProgramsVisitor(ParticleThreadPool* pool = 0) :
+        osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+        _pool(pool) {}
+
+    virtual void apply(osg::Node& node)
+    {
+        ModularProgram* program = dynamic_cast<ModularProgram*>(&node);
+        if (program)
+            _programs.push_back(program);
+        traverse(node);
+    }
+
+    /// Swap the programs found; call after the traversal.
+    unsigned int replace()
+    {
+        unsigned int replaced = 0;
+        for (unsigned int i = 0; i < _programs.size(); ++i)
+        {
+            osg::ref_ptr<ModularProgram> program = _programs[i];
+            osg::ref_ptr<BatchModularProgram> batch = new BatchModularProgram(*program);
+            batch->setThreadPool(_pool.get());
+
+            osg::Node::ParentList parents = program->getParents();
+            for (unsigned int p = 0; p < parents.size(); ++p)
+                parents[p]->replaceChild(program.get(), batch.get());
+            ++replaced;
+        }
+        _programs.clear();
+        return replaced;
+    }
+
+protected:
+    osg::ref_ptr<ParticleThreadPool>                    _pool;
+    std::vector< osg::ref_ptr<ModularProgram> >         _programs;
+};
+
+}
+
+#endif
@@ -0,0 +1,456 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2010 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGPARTICLE_BATCHOPERATOR
+#define OSGPARTICLE_BATCHOPERATOR
+
+#include <osgParticle/Operator>
+#include <osgParticle/Particle>
+#include <osgParticle/Program>
+#include <osgParticle/AccelOperator>
+#include <osgParticle/ForceOperator>
+#include <osgParticle/DampingOperator>
+#include <osgParticle/FluidFrictionOperator>
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define OSGPARTICLE_BATCH_SSE 1
+#endif
+
+namespace osgParticle
+{
+
+/** A range of live particles in structure-of-arrays layout.
+    Each pointer addresses the first particle of the range; fields that no
+    operator of the program asked for (see BatchOperator::getRequiredFields())
+    are NULL.
+*/
+struct ParticleSpan
+{
+    enum Field
+    {
+        VELOCITY    = 1<<0,
+        POSITION    = 1<<1,
+        MASS_INV    = 1<<2,
+        RADIUS      = 1<<3
+    };
+
+    ParticleSpan() : count(0), vx(0), vy(0), vz(0), px(0), py(0), pz(0), massInv(0), radius(0) {}
+
+    unsigned int    count;
+    float*          vx;
+    float*          vy;
+    float*          vz;
+    const float*    px;
+    const float*    py;
+    const float*    pz;
+    const float*    massInv;
+    const float*    radius;
+};
+
+/** An Operator that can also process particles in batches.
+    BatchModularProgram hands it whole ParticleSpans, possibly from several
+    threads at once, so operate(span) must only read the operator's own state.
+    The per particle operate() keeps it usable in a ModularProgram.
+*/
+class BatchOperator : public Operator
+{
+public:
+    BatchOperator() : Operator() {}
+    BatchOperator(const BatchOperator& copy, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY) : Operator(copy, copyop) {}
+
+    /// Bitmask of ParticleSpan::Field the operator reads or writes.
+    virtual unsigned int getRequiredFields() const { return ParticleSpan::VELOCITY; }
+
+    /// Process a range of live particles.
+    virtual void operate(const ParticleSpan& span, double dt) = 0;
+
+    using Operator::operate;
+
+protected:
+    virtual ~BatchOperator() {}
+};
+
+namespace BatchKernels
+{
+    /// x[i] += c for the whole span
+    inline void add(float* x, float c, unsigned int count)
+    {
+        unsigned int i = 0;
+#if defined(OSGPARTICLE_BATCH_SSE)
+        const __m128 vc = _mm_set1_ps(c);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), vc));
+#endif
+        for (; i < count; ++i)
+            x[i] += c;
+    }
+
+    /// x[i] += c * s[i] for the whole span
+    inline void addScaled(float* x, float c, const float* s, unsigned int count)
+    {
+        unsigned int i = 0;
+#if defined(OSGPARTICLE_BATCH_SSE)
+        const __m128 vc = _mm_set1_ps(c);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(vc, _mm_loadu_ps(s + i))));
+#endif
+        for (; i < count; ++i)
+            x[i] += c * s[i];
+    }
+}
+
+/** Batch version of AccelOperator.*/
+class BatchAccelOperator : public BatchOperator
+{
+public:
+    BatchAccelOperator() : BatchOperator(), _accel(0, 0, 0) {}
+    BatchAccelOperator(const BatchAccelOperator& copy, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY)
+    :   BatchOperator(copy, copyop), _accel(copy._accel) {}
+
+    META_Object(osgParticle, BatchAccelOperator);
+
+    const osg::Vec3& getAcceleration() const { return _accel; }
+    void setAcceleration(const osg::Vec3& v) { _accel = v; }
+    void setToGravity(float scale = 1) { _accel.set(0, 0, -9.80665f * scale); }
+
+    virtual void operate(Particle* P, double dt) { P->addVelocity(_xf_accel * dt); }
+
+    virtual void operate(const ParticleSpan& span, double dt)
+    {
+        const osg::Vec3 dv = _xf_accel * dt;
+        BatchKernels::add(span.vx, dv.x(), span.count);
+        BatchKernels::add(span.vy, dv.y(), span.count);
+        BatchKernels::add(span.vz, dv.z(), span.count);
+    }
+
+    virtual void beginOperate(Program* prg)
+    {
+        _xf_accel = prg->getReferenceFrame() == Program::RELATIVE_RF ? prg->rotateLocalToWorld(_accel) : _accel;
+    }
+
+protected:
+    virtual ~BatchAccelOperator() {}
+    BatchAccelOperator& operator=(const BatchAccelOperator&) { return *this; }
+
+    osg::Vec3 _accel;
+    osg::Vec3 _xf_accel;
+};
+
+/** Batch version of ForceOperator.*/
+class BatchForceOperator : public BatchOperator
+{
+public:
+    BatchForceOperator() : BatchOperator(), _force(0, 0, 0) {}
+    BatchForceOperator(const BatchForceOperator& copy, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY)
+    :   BatchOperator(copy, copyop), _force(copy._force) {}
+
+    META_Object(osgParticle, BatchForceOperator);
+
+    const osg::Vec3& getForce() const { return _force; }
+    void setForce(const osg::Vec3& f) { _force = f; }
+
+    virtual unsigned int getRequiredFields() const { return ParticleSpan::VELOCITY | ParticleSpan::MASS_INV; }
+
+    virtual void operate(Particle* P, double dt) { P->addVelocity(_xf_force * (P->getMassInv() * dt)); }
+
+    virtual void operate(const ParticleSpan& span, double dt)
+    {
+        BatchKernels::addScaled(span.vx, _xf_force.x() * dt, span.massInv, span.count);
+        BatchKernels::addScaled(span.vy, _xf_force.y() * dt, span.massInv, span.count);
+        BatchKernels::addScaled(span.vz, _xf_force.z() * dt, span.massInv, span.count);
+    }
+
+    virtual void beginOperate(Program* prg)
+    {
+        _xf_force = prg->getReferenceFrame() == Program::RELATIVE_RF ? prg->rotateLocalToWorld(_force) : _force;
+    }
+
+protected:
+    virtual ~BatchForceOperator() {}
+    BatchForceOperator& operator=(const BatchForceOperator&) { return *this; }
+
+    osg::Vec3 _force;
+    osg::Vec3 _xf_force;
+};
+
+/** Batch version of DampingOperator.*/
+class BatchDampingOperator : public BatchOperator
+{
+public:
+    BatchDampingOperator() : BatchOperator(), _damping(1.0f, 1.0f, 1.0f), _cutoffLow(0.0f), _cutoffHigh(FLT_MAX) {}
+    BatchDampingOperator(const BatchDampingOperator& copy, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY)
+    :   BatchOperator(copy, copyop), _damping(copy._damping),
+        _cutoffLow(copy._cutoffLow), _cutoffHigh(copy._cutoffHigh) {}
+
+    META_Object(osgParticle, BatchDampingOperator);
+
+    void setDamping(const osg::Vec3& damping) { _damping = damping; }
+    const osg::Vec3& getDamping() const { return _damping; }
+
+    void setCutoff(float low, float high) { _cutoffLow = low; _cutoffHigh = high; }
+    float getCutoffLow() const { return _cutoffLow; }
+    float getCutoffHigh() const { return _cutoffHigh; }
+
+    virtual void operate(Particle* P, double dt)
+    {
+        const osg::Vec3& vel = P->getVelocity();
+        float length2 = vel.length2();
+        if (length2 >= _cutoffLow && length2 <= _cutoffHigh)
+            P->setVelocity(osg::Vec3(vel.x() * factor(_damping.x(), dt), vel.y() * factor(_damping.y(), dt), vel.z() * factor(_damping.z(), dt)));
+    }
+
+    virtual void operate(const ParticleSpan& span, double dt)
+    {
+        const float fx = factor(_damping.x(), dt), fy = factor(_damping.y(), dt), fz = factor(_damping.z(), dt);
+        float* vx = span.vx;
+        float* vy = span.vy;
+        float* vz = span.vz;
+        unsigned int i = 0;
+#if defined(OSGPARTICLE_BATCH_SSE)
+        const __m128 low = _mm_set1_ps(_cutoffLow), high = _mm_set1_ps(_cutoffHigh), one = _mm_set1_ps(1.0f);
+        const __m128 dx = _mm_set1_ps(fx), dy = _mm_set1_ps(fy), dz = _mm_set1_ps(fz);
+        for (; i + 4 <= span.count; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(vx + i), y = _mm_loadu_ps(vy + i), z = _mm_loadu_ps(vz + i);
+            __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(length2, low), _mm_cmple_ps(length2, high));
+            // factor where inside the cutoff range, 1 elsewhere
+            _mm_storeu_ps(vx + i, _mm_mul_ps(x, _mm_or_ps(_mm_and_ps(inside, dx), _mm_andnot_ps(inside, one))));
+            _mm_storeu_ps(vy + i, _mm_mul_ps(y, _mm_or_ps(_mm_and_ps(inside, dy), _mm_andnot_ps(inside, one))));
+            _mm_storeu_ps(vz + i, _mm_mul_ps(z, _mm_or_ps(_mm_and_ps(inside, dz), _mm_andnot_ps(inside, one))));
+        }
+#endif
+        for (; i < span.count; ++i)
+        {
+            float length2 = vx[i]*vx[i] + vy[i]*vy[i] + vz[i]*vz[i];
+            if (length2 >= _cutoffLow && length2 <= _cutoffHigh)
+            {
+                vx[i] *= fx;
+                vy[i] *= fy;
+                vz[i] *= fz;
+            }
+        }
+    }
+
+protected:
+    virtual ~BatchDampingOperator() {}
+    BatchDampingOperator& operator=(const BatchDampingOperator&) { return *this; }
+
+    static float factor(float damping, double dt) { return (float)(1.0 - (1.0 - damping) * dt); }
+
+    osg::Vec3 _damping;
+    float _cutoffLow;
+    float _cutoffHigh;
+};
+
+/** Batch version of FluidFrictionOperator.*/
+class BatchFluidFrictionOperator : public BatchOperator
+{
+public:
+    BatchFluidFrictionOperator() :
+        BatchOperator(),
+        _ovr_rad(0),
+        _relative(false)
+    {
+        setFluidToAir();
+    }
+
+    BatchFluidFrictionOperator(const BatchFluidFrictionOperator& copy, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY)
+    :   BatchOperator(copy, copyop),
+        _coeff_A(copy._coeff_A), _coeff_B(copy._coeff_B),
+        _density(copy._density), _viscosity(copy._viscosity),
+        _ovr_rad(copy._ovr_rad), _wind(copy._wind),
+        _relative(false) {}
+
+    META_Object(osgParticle, BatchFluidFrictionOperator);
+
+    void setFluidDensity(float d) { _density = d; _coeff_B = 0.2f * osg::PI * _density; }
+    float getFluidDensity() const { return _density; }
+
+    void setFluidViscosity(float v) { _viscosity = v; _coeff_A = 6 * osg::PI * _viscosity; }
+    float getFluidViscosity() const { return _viscosity; }
+
+    void setWind(const osg::Vec3& wind) { _wind = wind; }
+    const osg::Vec3& getWind() const { return _wind; }
+
+    void setOverrideRadius(float r) { _ovr_rad = r; }
+    float getOverrideRadius() const { return _ovr_rad; }
+
+    void setFluidToAir() { setFluidViscosity(1.8e-5f); setFluidDensity(1.2929f); }
+    void setFluidToWater() { setFluidViscosity(1.002e-3f); setFluidDensity(1.0f); }
+
+    virtual unsigned int getRequiredFields() const
+    {
+        return ParticleSpan::VELOCITY | ParticleSpan::MASS_INV | (_ovr_rad > 0 ? 0u : (unsigned int)ParticleSpan::RADIUS);
+    }
+
+    virtual void beginOperate(Program* prg)
+    {
+        _relative = prg->getReferenceFrame() == Program::RELATIVE_RF;
+        if (_relative)
+        {
+            _ex = prg->rotateLocalToWorld(osg::Vec3(1, 0, 0));
+            _ey = prg->rotateLocalToWorld(osg::Vec3(0, 1, 0));
+            _ez = prg->rotateLocalToWorld(osg::Vec3(0, 0, 1));
+        }
+    }
+
+    virtual void operate(Particle* P, double dt)
+    {
+        float r = _ovr_rad > 0 ? _ovr_rad : P->getRadius();
+        osg::Vec3 v = P->getVelocity() - _wind;
+        float vm = v.normalize();
+        float R = _coeff_A * r * vm + _coeff_B * r * r * vm * vm;
+
+        osg::Vec3 Fr(-R * v.x(), -R * v.y(), -R * v.z());
+        if (_relative)
+            Fr = _ex * Fr.x() + _ey * Fr.y() + _ez * Fr.z();
+
+        // correct unwanted velocity increments
+        osg::Vec3 dv = Fr * P->getMassInv() * dt;
+        float dvl = dv.length();
+        if (dvl > vm)
+            dv *= vm / dvl;
+
+        P->addVelocity(dv);
+    }
+
+    // With n = v/|v|, R*n = (A*r + B*r*r*|v|) * v, so no division is needed for the force.
+    virtual void operate(const ParticleSpan& span, double dt)
+    {
+        const float fdt = (float)dt;
+        unsigned int i = 0;
+#if defined(OSGPARTICLE_BATCH_SSE)
+        const __m128 A = _mm_set1_ps(_coeff_A), B = _mm_set1_ps(_coeff_B);
+        const __m128 wx = _mm_set1_ps(_wind.x()), wy = _mm_set1_ps(_wind.y()), wz = _mm_set1_ps(_wind.z());
+        const __m128 ovr = _mm_set1_ps(_ovr_rad), vdt = _mm_set1_ps(fdt), zero = _mm_setzero_ps();
+        const __m128 e0x = _mm_set1_ps(_ex.x()), e0y = _mm_set1_ps(_ex.y()), e0z = _mm_set1_ps(_ex.z());
+        const __m128 e1x = _mm_set1_ps(_ey.x()), e1y = _mm_set1_ps(_ey.y()), e1z = _mm_set1_ps(_ey.z());
+        const __m128 e2x = _mm_set1_ps(_ez.x()), e2y = _mm_set1_ps(_ez.y()), e2z = _mm_set1_ps(_ez.z());
+        for (; i + 4 <= span.count; i += 4)
+        {
+            __m128 vx = _mm_sub_ps(_mm_loadu_ps(span.vx + i), wx);
+            __m128 vy = _mm_sub_ps(_mm_loadu_ps(span.vy + i), wy);
+            __m128 vz = _mm_sub_ps(_mm_loadu_ps(span.vz + i), wz);
+            __m128 vm = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+            __m128 r = _ovr_rad > 0 ? ovr : _mm_loadu_ps(span.radius + i);
+
+            // -(A*r + B*r*r*|v|) * mass_inv * dt
+            __m128 k = _mm_add_ps(_mm_mul_ps(A, r), _mm_mul_ps(_mm_mul_ps(B, _mm_mul_ps(r, r)), vm));
+            k = _mm_sub_ps(zero, _mm_mul_ps(k, _mm_mul_ps(_mm_loadu_ps(span.massInv + i), vdt)));
+
+            __m128 dx = _mm_mul_ps(k, vx), dy = _mm_mul_ps(k, vy), dz = _mm_mul_ps(k, vz);
+            if (_relative)
+            {
+                __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, e0x), _mm_mul_ps(dy, e1x)), _mm_mul_ps(dz, e2x));
+                __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, e0y), _mm_mul_ps(dy, e1y)), _mm_mul_ps(dz, e2y));
+                __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, e0z), _mm_mul_ps(dy, e1z)), _mm_mul_ps(dz, e2z));
+                dx = rx; dy = ry; dz = rz;
+            }
+
+            // correct unwanted velocity increments: scale by |v|/|dv| where |dv| > |v|
+            __m128 dvl = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            __m128 clamp = _mm_cmpgt_ps(dvl, vm);
+            __m128 scale = _mm_or_ps(_mm_and_ps(clamp, _mm_div_ps(vm, _mm_or_ps(dvl, _mm_andnot_ps(clamp, _mm_set1_ps(1.0f))))),
+                                     _mm_andnot_ps(clamp, _mm_set1_ps(1.0f)));
+
+            _mm_storeu_ps(span.vx + i, _mm_add_ps(_mm_loadu_ps(span.vx + i), _mm_mul_ps(dx, scale)));
+            _mm_storeu_ps(span.vy + i, _mm_add_ps(_mm_loadu_ps(span.vy + i), _mm_mul_ps(dy, scale)));
+            _mm_storeu_ps(span.vz + i, _mm_add_ps(_mm_loadu_ps(span.vz + i), _mm_mul_ps(dz, scale)));
+        }
+#endif
+        for (; i < span.count; ++i)
+        {
+            float vx = span.vx[i] - _wind.x(), vy = span.vy[i] - _wind.y(), vz = span.vz[i] - _wind.z();
+            float vm = std::sqrt(vx*vx + vy*vy + vz*vz);
+            float r = _ovr_rad > 0 ? _ovr_rad : span.radius[i];
+            float k = -(_coeff_A * r + _coeff_B * r * r * vm) * span.massInv[i] * fdt;
+
+            osg::Vec3 dv(k * vx, k * vy, k * vz);
+            if (_relative)
+                dv = _ex * dv.x() + _ey * dv.y() + _ez * dv.z();
+
+            float dvl = dv.length();
+            if (dvl > vm)
+                dv *= vm / dvl;
+
+            span.vx[i] += dv.x();
+            span.vy[i] += dv.y();
+            span.vz[i] += dv.z();
+        }
+    }
+
+protected:
+    virtual ~BatchFluidFrictionOperator() {}
+    BatchFluidFrictionOperator& operator=(const BatchFluidFrictionOperator&) { return *this; }
+
+    float       _coeff_A;
+    float       _coeff_B;
+    float       _density;
+    float       _viscosity;
+    float       _ovr_rad;
+    osg::Vec3   _wind;
+    bool        _relative;
+    osg::Vec3   _ex, _ey, _ez;
+};
+
+/** Returns a batch operator with the same settings as a built-in operator, or NULL
+    if there is no batch version of it.*/
+inline BatchOperator* createBatchOperator(const Operator* op)
+{
+    BatchOperator* result = 0;
+
+    if (const AccelOperator* accel = dynamic_cast<const AccelOperator*>(op))
+    {
+        BatchAccelOperator* batch = new BatchAccelOperator();
+        batch->setAcceleration(accel->getAcceleration());
+        result = batch;
+    }
+    else if (const ForceOperator* force = dynamic_cast<const ForceOperator*>(op))
+    {
+        BatchForceOperator* batch = new BatchForceOperator();
+        batch->setForce(force->getForce());
+        result = batch;
+    }
+    else if (const DampingOperator* damping = dynamic_cast<const DampingOperator*>(op))
+    {
+        BatchDampingOperator* batch = new BatchDampingOperator();
+        batch->setDamping(damping->getDamping());
+        batch->setCutoff(damping->getCutoffLow(), damping->getCutoffHigh());
+        result = batch;
+    }
+    else if (const FluidFrictionOperator* friction = dynamic_cast<const FluidFrictionOperator*>(op))
+    {
+        BatchFluidFrictionOperator* batch = new BatchFluidFrictionOperator();
+        batch->setFluidDensity(friction->getFluidDensity());
+        batch->setFluidViscosity(friction->getFluidViscosity());
+        batch->setWind(friction->getWind());
+        batch->setOverrideRadius(friction->getOverrideRadius());
+        result = batch;
+    }
+
+    if (result)
+    {
+        result->setName(op->getName());
+        result->setEnabled(op->isEnabled());
+    }
+    return result;
+}
+
+}
+
+#endif
@@ -0,0 +1,311 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef OSGEARTH_BLOCK_COMPRESSOR_H
+#define OSGEARTH_BLOCK_COMPRESSOR_H 1
+
+#include <osgEarth/Common>
+#include <osgEarth/ImageUtils>
+#include <osg/Image>
+#include <osg/Texture>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+namespace osgEarth
+{
+    /**
+     * Fast CPU encoder for the BC1 (DXT1) and BC3 (DXT5) block compressed
+     * texture formats.
+     *
+     * Endpoints are chosen with a "range fit": the per-channel bounding box
+     * of each 4x4 block, inset by 1/16 of its extent, and texels are assigned
+     * by projecting onto the endpoint axis. This trades a little quality for
+     * an encoder that runs in a few milliseconds per 256x256 tile, which is
+     * what a tile pipeline needs. Output images are 4x (BC3) or 8x (BC1)
+     * smaller than RGBA8 and can be handed to osg::Texture2D as-is.
+     */
+    class BlockCompressor
+    {
+    public:
+        enum Format
+        {
+            FORMAT_BC1,     // RGB, 4 bits per texel
+            FORMAT_BC3,     // RGBA, 8 bits per texel
+            FORMAT_AUTO     // BC3 if the image has alpha, else BC1
+        };
+
+        struct Options
+        {
+            Options() : format(FORMAT_AUTO), mipmaps(true) { }
+            Format format;
+            bool   mipmaps;     // encode a full mipmap chain
+        };
+
+    public:
+        /**
+         * Encodes an image. Returns NULL if the image is already compressed,
+         * is 3D, or cannot be converted to RGBA8.
+         */
+        static osg::Image* compress(const osg::Image* input, const Options& options =Options())
+        {
+            if (!input || !input->data() || input->r() > 1 || ImageUtils::isCompressed(input))
+                return 0L;
+
+            osg::ref_ptr<osg::Image> rgba;
+            if (input->getPixelFormat() == GL_RGBA && input->getDataType() == GL_UNSIGNED_BYTE &&
+                input->getPacking() <= 4u)
+                rgba = const_cast<osg::Image*>(input);
+            else
+                rgba = ImageUtils::convertToRGBA8(input);
+
+            if (!rgba.valid())
+                return 0L;
+
+            Format format = options.format;
+            if (format == FORMAT_AUTO)
+                format = hasAlpha(rgba.get()) ? FORMAT_BC3 : FORMAT_BC1;
+
+            const unsigned blockBytes = format == FORMAT_BC1 ? 8u : 16u;
+
+            // Build the level chain (level 0 is the input itself).
+            std::vector< osg::ref_ptr<osg::Image> > levels;
+            levels.push_back(rgba.get());
+            if (options.mipmaps)
+            {
+                while (levels.back()->s() > 1 || levels.back()->t() > 1)
+                    levels.push_back(downsample(levels.back().get()));
+            }
+
+            osg::Image::MipmapDataType offsets;
+            unsigned total = 0u;
+            for (unsigned i = 0; i < levels.size(); ++i)
+            {
+                if (i > 0u)
+                    offsets.push_back(total);
+                total += blocksX(levels[i].get()) * blocksY(levels[i].get()) * blockBytes;
+            }
+
+            unsigned char* data = new unsigned char[total];
+            unsigned char* ptr = data;
+            for (unsigned i = 0; i < levels.size(); ++i)
+            {
+                encodeLevel(levels[i].get(), format, ptr);
+                ptr += blocksX(levels[i].get()) * blocksY(levels[i].get()) * blockBytes;
+            }
+
+            GLenum pf = format == FORMAT_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+            osg::Image* output = new osg::Image();
+            output->setImage(rgba->s(), rgba->t(), 1, pf, pf, GL_UNSIGNED_BYTE, data, osg::Image::USE_NEW_DELETE);
+            output->setMipmapLevels(offsets);
+            output->setFileName(input->getFileName());
+            return output;
+        }
+
+        /** Encodes one 4x4 block of RGBA8 texels (row-major) as BC1. */
+        static void encodeBC1(const unsigned char* texels, unsigned char* out)
+        {
+            encodeColor(texels, out);
+        }
+
+        /** Encodes one 4x4 block of RGBA8 texels (row-major) as BC3. */
+        static void encodeBC3(const unsigned char* texels, unsigned char* out)
+        {
+            encodeAlpha(texels, out);
+            encodeColor(texels, out + 8);
+        }
+
+    private:
+        static unsigned blocksX(const osg::Image* image) { return ((unsigned)image->s() + 3u) / 4u; }
+        static unsigned blocksY(const osg::Image* image) { return ((unsigned)image->t() + 3u) / 4u; }
+
+        static bool hasAlpha(const osg::Image* image)
+        {
+            for (int t = 0; t < image->t(); ++t)
+            {
+                const unsigned char* p = image->data(0, t);
+                for (int s = 0; s < image->s(); ++s, p += 4)
+                    if (p[3] != 255u)
+                        return true;
+            }
+            return false;
+        }
+
+        // 2x2 box filter of an RGBA8 image.
+        static osg::Image* downsample(const osg::Image* src)
+        {
+            int s = osg::maximum(src->s() / 2, 1);
+            int t = osg::maximum(src->t() / 2, 1);
+            osg::Image* dst = new osg::Image();
+            dst->allocateImage(s, t, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+
+            for (int y = 0; y < t; ++y)
+            {
+                int y0 = osg::minimum(y*2, src->t()-1), y1 = osg::minimum(y*2+1, src->t()-1);
+                unsigned char* d = dst->data(0, y);
+                for (int x = 0; x < s; ++x, d += 4)
+                {
+                    int x0 = osg::minimum(x*2, src->s()-1), x1 = osg::minimum(x*2+1, src->s()-1);
+                    const unsigned char* a = src->data(x0, y0);
+                    const unsigned char* b = src->data(x1, y0);
+                    const unsigned char* c = src->data(x0, y1);
+                    const unsigned char* e = src->data(x1, y1);
+                    for (int k = 0; k < 4; ++k)
+                        d[k] = (unsigned char)(((unsigned)a[k] + b[k] + c[k] + e[k] + 2u) >> 2);
+                }
+            }
+            return dst;
+        }
+
+        static void encodeLevel(const osg::Image* image, Format format, unsigned char* out)
+        {
+            unsigned char block[64];
+            const unsigned bx = blocksX(image), by = blocksY(image);
+
+            for (unsigned j = 0; j < by; ++j)
+            {
+                for (unsigned i = 0; i < bx; ++i)
+                {
+                    // gather the block, replicating edge texels for partial blocks
+                    for (unsigned y = 0; y < 4u; ++y)
+                    {
+                        int t = osg::minimum((int)(j*4u + y), image->t()-1);
+                        for (unsigned x = 0; x < 4u; ++x)
+                        {
+                            int s = osg::minimum((int)(i*4u + x), image->s()-1);
+                            ::memcpy(block + (y*4u + x)*4u, image->data(s, t), 4);
+                        }
+                    }
+
+                    if (format == FORMAT_BC1)
+                    {
+                        encodeBC1(block, out);
+                        out += 8;
+                    }
+                    else
+                    {
+                        encodeBC3(block, out);
+                        out += 16;
+                    }
+                }
+            }
+        }
+
+        static unsigned short to565(int r, int g, int b)
+        {
+            return (unsigned short)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        }
+
+        static void from565(unsigned short c, int* rgb)
+        {
+            int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+            rgb[0] = (r << 3) | (r >> 2);
+            rgb[1] = (g << 2) | (g >> 4);
+            rgb[2] = (b << 3) | (b >> 2);
+        }
+
+        static void encodeColor(const unsigned char* texels, unsigned char* out)
+        {
+            int mn[3] = { 255, 255, 255 }, mx[3] = { 0, 0, 0 };
+            for (int i = 0; i < 16; ++i)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    mn[k] = osg::minimum(mn[k], (int)texels[i*4+k]);
+                    mx[k] = osg::maximum(mx[k], (int)texels[i*4+k]);
+                }
+            }
+
+            for (int k = 0; k < 3; ++k)
+            {
+                int inset = (mx[k] - mn[k]) >> 4;
+                mn[k] = osg::minimum(mn[k] + inset, 255);
+                mx[k] = osg::maximum(mx[k] - inset, 0);
+            }
+
+            unsigned short c0 = to565(mx[0], mx[1], mx[2]);
+            unsigned short c1 = to565(mn[0], mn[1], mn[2]);
+            unsigned indices = 0u;
+
+            if (c0 != c1)
+            {
+                // c0 > c1 selects four-color mode; c0 is the "max" endpoint.
+                if (c0 < c1)
+                    std::swap(c0, c1);
+
+                int e0[3], e1[3];
+                from565(c0, e0);
+                from565(c1, e1);
+                int d[3] = { e0[0]-e1[0], e0[1]-e1[1], e0[2]-e1[2] };
+                int dd = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+
+                // linear position along e1->e0 to palette index
+                static const unsigned s_remap[4] = { 1u, 3u, 2u, 0u };
+
+                for (int i = 0; i < 16; ++i)
+                {
+                    const unsigned char* p = texels + i*4;
+                    int dot = (p[0]-e1[0])*d[0] + (p[1]-e1[1])*d[1] + (p[2]-e1[2])*d[2];
+                    int level = dd > 0 ? (dot*3 + dd/2) / dd : 0;
+                    level = osg::clampBetween(level, 0, 3);
+                    indices |= s_remap[level] << (i*2);
+                }
+            }
+
+            out[0] = (unsigned char)(c0 & 0xff);
+            out[1] = (unsigned char)(c0 >> 8);
+            out[2] = (unsigned char)(c1 & 0xff);
+            out[3] = (unsigned char)(c1 >> 8);
+            out[4] = (unsigned char)(indices & 0xff);
+            out[5] = (unsigned char)((indices >> 8) & 0xff);
+            out[6] = (unsigned char)((indices >> 16) & 0xff);
+            out[7] = (unsigned char)(indices >> 24);
+        }
+
+        static void encodeAlpha(const unsigned char* texels, unsigned char* out)
+        {
+            int a0 = 0, a1 = 255;
+            for (int i = 0; i < 16; ++i)
+            {
+                a0 = osg::maximum(a0, (int)texels[i*4+3]);
+                a1 = osg::minimum(a1, (int)texels[i*4+3]);
+            }
+
+            // a0 > a1 selects the eight-value mode.
+            unsigned long long bits = 0ull;
+            if (a0 > a1)
+            {
+                int range = a0 - a1;
+                for (int i = 0; i < 16; ++i)
+                {
+                    int level = ((texels[i*4+3] - a1)*7 + range/2) / range;
+                    unsigned index = level == 7 ? 0u : level == 0 ? 1u : (unsigned)(8 - level);
+                    bits |= (unsigned long long)index << (i*3);
+                }
+            }
+
+            out[0] = (unsigned char)a0;
+            out[1] = (unsigned char)a1;
+            for (int k = 0; k < 6; ++k)
+                out[2+k] = (unsigned char)((bits >> (k*8)) & 0xff);
+        }
+    };
+}
+
+#endif // OSGEARTH_BLOCK_COMPRESSOR_H
@@ -0,0 +1,748 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef OSGEARTHUTIL_CLUSTERGRID_H
+#define OSGEARTHUTIL_CLUSTERGRID_H 1
+
+#include <osgEarthUtil/Common>
+#include <osgEarthUtil/ClusterNode>
+#include <osgEarth/MapNode>
+#include <osgEarth/Horizon>
+#include <osgEarth/ThreadingUtils>
+#include <osgUtil/CullVisitor>
+#include <osg/Viewport>
+#include <OpenThreads/Thread>
+#include <OpenThreads/ScopedLock>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Grid based clustering.
+ *
+ * ClusterNode compares every projected node against every existing cluster,
+ * which is O(n^2) per cull. The classes in this file bucket points into a
+ * hashed grid whose cell size equals the cluster radius, so each point only
+ * visits the 3x3 neighborhood of its cell and clustering runs in O(n).
+ *
+ * Everything here is header-only and builds on the public osgEarth API.
+ */
+namespace osgEarth { namespace Util
+{
+    /**
+     * Spatial hash of integer grid cells to chains of point indices.
+     * Buckets are sized to the number of insertions so lookups are O(1).
+     */
+    class ClusterCellHash
+    {
+    public:
+        ClusterCellHash() : _mask(0u) { }
+
+        //! Resets the table for up to "count" insertions.
+        void reset(unsigned count)
+        {
+            unsigned size = 16u;
+            while (size < count * 2u)
+                size <<= 1;
+            _mask = size - 1u;
+            _heads.assign(size, ~0u);
+            _cx.clear();
+            _cy.clear();
+            _values.clear();
+            _next.clear();
+            _cx.reserve(count);
+            _cy.reserve(count);
+            _values.reserve(count);
+            _next.reserve(count);
+        }
+
+        //! Adds a value to the cell (cx, cy).
+        void insert(int cx, int cy, unsigned value)
+        {
+            unsigned b = bucket(cx, cy);
+            _cx.push_back(cx);
+            _cy.push_back(cy);
+            _values.push_back(value);
+            _next.push_back(_heads[b]);
+            _heads[b] = (unsigned)_values.size() - 1u;
+        }
+
+        //! First entry in the chain holding cell (cx, cy), or ~0u.
+        unsigned first(int cx, int cy) const
+        {
+            return _heads.empty() ? ~0u : skip(_heads[bucket(cx, cy)], cx, cy);
+        }
+
+        //! Entry following "entry" in the same cell, or ~0u.
+        unsigned next(unsigned entry) const
+        {
+            return skip(_next[entry], _cx[entry], _cy[entry]);
+        }
+
+        //! Value stored at "entry".
+        unsigned value(unsigned entry) const { return _values[entry]; }
+
+    private:
+        unsigned bucket(int cx, int cy) const
+        {
+            return (((unsigned)cx * 73856093u) ^ ((unsigned)cy * 19349663u)) & _mask;
+        }
+
+        unsigned skip(unsigned e, int cx, int cy) const
+        {
+            while (e != ~0u && (_cx[e] != cx || _cy[e] != cy))
+                e = _next[e];
+            return e;
+        }
+
+        unsigned _mask;
+        std::vector<unsigned> _heads;
+        std::vector<int> _cx, _cy;
+        std::vector<unsigned> _values;
+        std::vector<unsigned> _next;
+    };
+
+    /**
+     * Greedy O(n) clustering of 2D points with a fixed radius.
+     *
+     * Points are processed in order. A point joins the first existing cluster
+     * whose seed lies within the radius (and that the predicate accepts);
+     * otherwise it seeds a new cluster. Since the cell size equals the radius
+     * only the 3x3 cells around a point can contain a matching seed.
+     */
+    class ClusterGrid
+    {
+    public:
+        struct Result
+        {
+            //! Seed location of each cluster.
+            std::vector<osg::Vec2d> seeds;
+            //! Indices of the input points in each cluster.
+            std::vector< std::vector<unsigned> > members;
+
+            void clear() { seeds.clear(); members.clear(); }
+            unsigned size() const { return (unsigned)seeds.size(); }
+        };
+
+        //! Predicate that accepts every pair
+        struct AlwaysCluster
+        {
+            bool operator()(unsigned, unsigned) const { return true; }
+        };
+
+    public:
+        ClusterGrid(double radius =50.0) : _radius(radius) { }
+
+        void setRadius(double value) { _radius = value; }
+        double getRadius() const { return _radius; }
+
+        //! Clusters "points" into "out".
+        void cluster(const std::vector<osg::Vec2d>& points, Result& out)
+        {
+            AlwaysCluster always;
+            cluster(points, out, always);
+        }
+
+        /**
+         * Clusters "points" into "out". "canCluster(a, b)" is called with the
+         * index of a cluster's seed point and a candidate point index.
+         */
+        template<typename PRED>
+        void cluster(const std::vector<osg::Vec2d>& points, Result& out, PRED& canCluster)
+        {
+            out.clear();
+            if (points.empty())
+                return;
+
+            const double r = _radius > 0.0 ? _radius : 1.0;
+            const double r2 = r*r;
+            const double inv = 1.0 / r;
+
+            _hash.reset((unsigned)points.size());
+            _seedIndex.clear();
+
+            for (unsigned i = 0; i < points.size(); ++i)
+            {
+                const osg::Vec2d& p = points[i];
+                int cx = (int)std::floor(p.x() * inv);
+                int cy = (int)std::floor(p.y() * inv);
+
+                unsigned found = ~0u;
+                for (int dy = -1; dy <= 1 && found == ~0u; ++dy)
+                {
+                    for (int dx = -1; dx <= 1 && found == ~0u; ++dx)
+                    {
+                        for (unsigned e = _hash.first(cx + dx, cy + dy); e != ~0u; e = _hash.next(e))
+                        {
+                            unsigned c = _hash.value(e);
+                            if ((out.seeds[c] - p).length2() <= r2 && canCluster(_seedIndex[c], i))
+                            {
+                                found = c;
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                if (found == ~0u)
+                {
+                    found = out.size();
+                    out.seeds.push_back(p);
+                    out.members.push_back(std::vector<unsigned>());
+                    _seedIndex.push_back(i);
+                    _hash.insert(cx, cy, found);
+                }
+
+                out.members[found].push_back(i);
+            }
+        }
+
+    private:
+        double _radius;
+        ClusterCellHash _hash;
+        std::vector<unsigned> _seedIndex;
+    };
+
+    /**
+     * Cluster hierarchy precomputed for a range of zoom levels, in the manner
+     * of "supercluster". Input points are in normalized map coordinates
+     * ([0..1] in both axes, e.g. spherical mercator), and the radius is in
+     * pixels of a tile of size "extent". Building is O(n) per level; querying
+     * a level just returns the prebuilt list.
+     *
+     * Use this for static data sets where the same clusters are needed
+     * frame after frame at a given zoom.
+     */
+    class ClusterHierarchy
+    {
+    public:
+        struct Cluster
+        {
+            //! Weighted center in normalized coordinates
+            osg::Vec2d center;
+            //! Number of input points in the cluster
+            unsigned count;
+            //! Indices into the next finer level (or input points at the finest level)
+            std::vector<unsigned> children;
+        };
+
+        typedef std::vector<Cluster> Level;
+
+    public:
+        ClusterHierarchy() :
+            _radius(40.0), _extent(256.0), _minZoom(0u), _maxZoom(16u) { }
+
+        void setRadius(double pixels) { _radius = pixels; }
+        double getRadius() const { return _radius; }
+
+        void setExtent(double pixels) { _extent = pixels; }
+        double getExtent() const { return _extent; }
+
+        void setZoomRange(unsigned minZoom, unsigned maxZoom) {
+            _minZoom = minZoom;
+            _maxZoom = osg::maximum(minZoom, maxZoom);
+        }
+        unsigned getMinZoom() const { return _minZoom; }
+        unsigned getMaxZoom() const { return _maxZoom; }
+
+        //! Builds all levels from normalized input points.
+        void build(const std::vector<osg::Vec2d>& points)
+        {
+            _levels.clear();
+            _levels.resize(_maxZoom - _minZoom + 2u);
+
+            // finest level: one cluster per input point.
+            Level& finest = _levels.back();
+            finest.resize(points.size());
+            for (unsigned i = 0; i < points.size(); ++i)
+            {
+                finest[i].center = points[i];
+                finest[i].count = 1u;
+                finest[i].children.push_back(i);
+            }
+
+            std::vector<osg::Vec2d> centers;
+            ClusterGrid::Result result;
+
+            for (int z = (int)_maxZoom; z >= (int)_minZoom; --z)
+            {
+                const Level& finer = _levels[z - _minZoom + 1];
+                Level& level = _levels[z - _minZoom];
+
+                centers.resize(finer.size());
+                for (unsigned i = 0; i < finer.size(); ++i)
+                    centers[i] = finer[i].center;
+
+                ClusterGrid grid(_radius / (_extent * std::pow(2.0, (double)z)));
+                grid.cluster(centers, result);
+
+                level.resize(result.size());
+                for (unsigned c = 0; c < result.size(); ++c)
+                {
+                    Cluster& cluster = level[c];
+                    cluster.center.set(0.0, 0.0);
+                    cluster.count = 0u;
+                    cluster.children = result.members[c];
+
+                    for (unsigned k = 0; k < cluster.children.size(); ++k)
+                    {
+                        const Cluster& child = finer[cluster.children[k]];
+                        cluster.center += child.center * (double)child.count;
+                        cluster.count += child.count;
+                    }
+                    cluster.center /= (double)cluster.count;
+                }
+            }
+        }
+
+        //! Clusters for a zoom level (clamped to the built range).
+        const Level& getLevel(unsigned zoom) const
+        {
+            static const Level s_empty;
+            if (_levels.empty())
+                return s_empty;
+            zoom = osg::clampBetween(zoom, _minZoom, _maxZoom);
+            return _levels[zoom - _minZoom];
+        }
+
+        //! Collects the input point indices under a cluster at a zoom level.
+        void getLeaves(unsigned zoom, unsigned clusterIndex, std::vector<unsigned>& out) const
+        {
+            if (_levels.empty())
+                return;
+            zoom = osg::clampBetween(zoom, _minZoom, _maxZoom);
+            collect(zoom - _minZoom, clusterIndex, out);
+        }
+
+    private:
+        void collect(unsigned level, unsigned index, std::vector<unsigned>& out) const
+        {
+            const Cluster& c = _levels[level][index];
+            if (level + 1u == _levels.size())
+            {
+                out.insert(out.end(), c.children.begin(), c.children.end());
+                return;
+            }
+            for (unsigned k = 0; k < c.children.size(); ++k)
+                collect(level + 1u, c.children[k], out);
+        }
+
+        double _radius;
+        double _extent;
+        unsigned _minZoom, _maxZoom;
+        std::vector<Level> _levels;
+    };
+
+    /**
+     * Drop-in alternative to ClusterNode that clusters with a ClusterGrid.
+     *
+     * Results are reused until the camera moves more than the reuse threshold
+     * (in pixels), and clustering can optionally run on a background thread,
+     * in which case the cull always uses the most recently completed result.
+     */
+    class GridClusterNode : public osg::Node
+    {
+    public:
+        typedef ClusterNode::Cluster Cluster;
+        typedef ClusterNode::ClusterList ClusterList;
+        typedef ClusterNode::StyleClusterCallback StyleClusterCallback;
+        typedef ClusterNode::CanClusterCallback CanClusterCallback;
+
+    public:
+        GridClusterNode(MapNode* mapNode =0L, osg::Image* defaultImage =0L) :
+            _radius(50u),
+            _defaultImage(defaultImage),
+            _nextLabel(0u),
+            _mapNode(mapNode),
+            _reuseThreshold(2.0),
+            _revision(0u),
+            _enabled(true),
+            _dirty(true)
+        {
+            setCullingActive(false);
+            if (mapNode)
+                _horizon = new Horizon(mapNode->getMapSRS());
+        }
+
+        MapNode* getMapNode() const { return _mapNode.get(); }
+        void setMapNode(MapNode* mapNode) {
+            _mapNode = mapNode;
+            _horizon = mapNode ? new Horizon(mapNode->getMapSRS()) : 0L;
+            _dirty = true;
+        }
+
+        void addNode(osg::Node* node) {
+            if (!node) return;
+            _nodes.push_back(node);
+            dirtyNodes();
+        }
+
+        void removeNode(osg::Node* node) {
+            osg::NodeList::iterator i = std::find(_nodes.begin(), _nodes.end(), node);
+            if (i != _nodes.end()) {
+                _nodes.erase(i);
+                dirtyNodes();
+            }
+        }
+
+        void clear() {
+            _nodes.clear();
+            dirtyNodes();
+        }
+
+        unsigned int getRadius() const { return _radius; }
+        void setRadius(unsigned int radius) { _radius = radius; _dirty = true; }
+
+        bool getEnabled() const { return _enabled; }
+        void setEnabled(bool enabled) { _enabled = enabled; _dirty = true; }
+
+        //! Camera movement, in pixels, below which the previous clusters are reused.
+        double getReuseThreshold() const { return _reuseThreshold; }
+        void setReuseThreshold(double pixels) { _reuseThreshold = pixels; }
+
+        /**
+         * Whether to cluster on a background thread. The cull picks up the
+         * latest completed result, so clusters may lag the camera by a frame.
+         * Note that a CanClusterCallback will then be called off the cull thread.
+         */
+        bool getAsynchronous() const { return _worker.valid(); }
+        void setAsynchronous(bool value)
+        {
+            if (value && !_worker.valid())
+            {
+                _worker = new Worker();
+                _worker->startThread();
+            }
+            else if (!value && _worker.valid())
+            {
+                _worker->cancel();
+                _worker = 0L;
+            }
+            _dirty = true;
+        }
+
+        StyleClusterCallback* getStyleCallback() { return _styleCallback.get(); }
+        void setStyleCallback(StyleClusterCallback* callback) { _styleCallback = callback; }
+
+        CanClusterCallback* getCanClusterCallback() { return _canClusterCallback.get(); }
+        void setCanClusterCallback(CanClusterCallback* callback) { _canClusterCallback = callback; _dirty = true; }
+
+        //! Clusters computed by the most recent cull.
+        const ClusterList& getClusters() const { return _clusters; }
+
+    public: // osg::Node
+
+        virtual void traverse(osg::NodeVisitor& nv)
+        {
+            osgUtil::CullVisitor* cv = nv.getVisitorType() == nv.CULL_VISITOR ?
+                dynamic_cast<osgUtil::CullVisitor*>(&nv) : 0L;
+
+            if (!cv || !_enabled)
+            {
+                for (unsigned i = 0; i < _nodes.size(); ++i)
+                    _nodes[i]->accept(nv);
+                return;
+            }
+
+            updateClusters(cv);
+
+            for (unsigned i = 0; i < _clusters.size(); ++i)
+            {
+                Cluster& c = _clusters[i];
+                if (c.nodes.size() == 1u)
+                    c.nodes[0]->accept(nv);
+                else if (c.marker.valid())
+                    c.marker->accept(nv);
+            }
+        }
+
+        virtual osg::BoundingSphere computeBound() const
+        {
+            osg::BoundingSphere bs;
+            for (unsigned i = 0; i < _nodes.size(); ++i)
+                bs.expandBy(_nodes[i]->getBound());
+            return bs;
+        }
+
+    protected:
+
+        virtual ~GridClusterNode()
+        {
+            if (_worker.valid())
+                _worker->cancel();
+        }
+
+        // Snapshot of the inputs needed to compute a clustering.
+        struct Job : public osg::Referenced
+        {
+            unsigned revision;
+            double radius;
+            osg::NodeList nodes;
+            std::vector<osg::Vec2d> screen;
+            std::vector<unsigned> visible;
+            osg::ref_ptr<CanClusterCallback> canCluster;
+            ClusterGrid::Result result;
+
+            void run()
+            {
+                Pred pred(this);
+                ClusterGrid grid(radius);
+                grid.cluster(screen, result, pred);
+            }
+
+            struct Pred
+            {
+                Pred(Job* job) : _job(job) { }
+                bool operator()(unsigned a, unsigned b) const {
+                    return !_job->canCluster.valid() || (*_job->canCluster)(
+                        _job->nodes[_job->visible[a]].get(),
+                        _job->nodes[_job->visible[b]].get());
+                }
+                Job* _job;
+            };
+        };
+
+        // Background thread that clusters the most recently posted job.
+        class Worker : public OpenThreads::Thread, public osg::Referenced
+        {
+        public:
+            Worker() : _done(false) { }
+
+            void post(Job* job)
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                _pending = job;
+                _wake.set();
+            }
+
+            Job* takeCompleted()
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                return _completed.release();
+            }
+
+            virtual int cancel()
+            {
+                _done = true;
+                _wake.set();
+                join();
+                return 0;
+            }
+
+            virtual void run()
+            {
+                while (!_done)
+                {
+                    _wake.waitAndReset();
+
+                    osg::ref_ptr<Job> job;
+                    {
+                        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                        job = _pending.release();
+                    }
+
+                    if (job.valid() && !_done)
+                    {
+                        job->run();
+                        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                        _completed = job.get();
+                    }
+                }
+            }
+
+        private:
+            volatile bool _done;
+            OpenThreads::Mutex _mutex;
+            Threading::Event _wake;
+            osg::ref_ptr<Job> _pending;
+            osg::ref_ptr<Job> _completed;
+        };
+
+        void dirtyNodes()
+        {
+            ++_revision;
+            _dirty = true;
+            dirtyBound();
+        }
+
+        // True if the camera moved enough that the clusters need recomputing.
+        bool cameraMoved(const osg::Matrixd& mvpw) const
+        {
+            const osg::BoundingSphere& bs = getBound();
+            if (!bs.valid())
+                return false;
+
+            osg::Vec3d c = bs.center();
+            osg::Vec3d e = c + osg::Vec3d(bs.radius(), 0.0, 0.0);
+
+            osg::Vec3d c0 = c * _lastMVPW, c1 = c * mvpw;
+            osg::Vec3d e0 = e * _lastMVPW, e1 = e * mvpw;
+
+            double t2 = _reuseThreshold * _reuseThreshold;
+            return
+                (osg::Vec2d(c1.x(), c1.y()) - osg::Vec2d(c0.x(), c0.y())).length2() > t2 ||
+                (osg::Vec2d(e1.x(), e1.y()) - osg::Vec2d(e0.x(), e0.y())).length2() > t2;
+        }
+
+        Job* createJob(osgUtil::CullVisitor* cv, const osg::Matrixd& mvpw)
+        {
+            osg::ref_ptr<Job> job = new Job();
+            job->revision = _revision;
+            job->radius = (double)_radius;
+            job->nodes = _nodes;
+            job->canCluster = _canClusterCallback.get();
+            job->screen.reserve(_nodes.size());
+            job->visible.reserve(_nodes.size());
+
+            if (_horizon.valid())
+            {
+                osg::Vec3d eye = osg::Matrixd::inverse(*cv->getModelViewMatrix()).getTrans();
+                _horizon->setEye(eye);
+            }
+
+            const osg::Viewport* vp = cv->getViewport();
+            double w = vp ? vp->width() : 0.0, h = vp ? vp->height() : 0.0;
+
+            for (unsigned i = 0; i < _nodes.size(); ++i)
+            {
+                osg::Vec3d world = _nodes[i]->getBound().center();
+                if (_horizon.valid() && !_horizon->isVisible(world))
+                    continue;
+
+                osg::Vec3d s = world * mvpw;
+                if (s.z() < 0.0 || s.z() > 1.0 || s.x() < 0.0 || s.y() < 0.0 || s.x() > w || s.y() > h)
+                    continue;
+
+                job->screen.push_back(osg::Vec2d(s.x(), s.y()));
+                job->visible.push_back(i);
+            }
+            return job.release();
+        }
+
+        void applyJob(Job* job)
+        {
+            _nextLabel = 0u;
+            _clusters.clear();
+            _clusters.reserve(job->result.size());
+
+            for (unsigned c = 0; c < job->result.size(); ++c)
+            {
+                const std::vector<unsigned>& members = job->result.members[c];
+
+                _clusters.push_back(Cluster());
+                Cluster& cluster = _clusters.back();
+                cluster.nodes.reserve(members.size());
+
+                osg::Vec3d center;
+                for (unsigned k = 0; k < members.size(); ++k)
+                {
+                    osg::Node* node = job->nodes[job->visible[members[k]]].get();
+                    cluster.nodes.push_back(node);
+                    center += node->getBound().center();
+                }
+
+                if (members.size() > 1u && _mapNode.valid())
+                {
+                    center /= (double)members.size();
+                    cluster.marker = getOrCreateLabel();
+
+                    GeoPoint pos;
+                    pos.fromWorld(_mapNode->getMapSRS(), center);
+                    cluster.marker->setPosition(pos);
+
+                    std::stringstream buf;
+                    buf << members.size();
+                    cluster.marker->setText(buf.str());
+
+                    if (_styleCallback.valid())
+                        (*_styleCallback)(cluster);
+                }
+            }
+        }
+
+        void updateClusters(osgUtil::CullVisitor* cv)
+        {
+            const osg::Viewport* vp = cv->getViewport();
+            if (!vp)
+                return;
+
+            osg::Matrixd mvpw =
+                (*cv->getModelViewMatrix()) *
+                (*cv->getProjectionMatrix()) *
+                vp->computeWindowMatrix();
+
+            if (_dirty || cameraMoved(mvpw))
+            {
+                osg::ref_ptr<Job> job = createJob(cv, mvpw);
+                _lastMVPW = mvpw;
+                _dirty = false;
+
+                if (_worker.valid())
+                {
+                    _worker->post(job.get());
+                }
+                else
+                {
+                    job->run();
+                    applyJob(job.get());
+                }
+            }
+
+            if (_worker.valid())
+            {
+                osg::ref_ptr<Job> done = _worker->takeCompleted();
+                if (done.valid() && done->revision == _revision)
+                    applyJob(done.get());
+            }
+        }
+
+        PlaceNode* getOrCreateLabel()
+        {
+            if (_nextLabel < _labelPool.size())
+                return _labelPool[_nextLabel++].get();
+
+            PlaceNode* label = new PlaceNode();
+            label->setIconImage(_defaultImage.get());
+            label->setDynamic(true);
+            _labelPool.push_back(label);
+            ++_nextLabel;
+            return label;
+        }
+
+        osg::NodeList _nodes;
+        unsigned int _radius;
+        osg::ref_ptr<osg::Image> _defaultImage;
+        PlaceNodeList _labelPool;
+        unsigned _nextLabel;
+        osg::observer_ptr<MapNode> _mapNode;
+        osg::ref_ptr<StyleClusterCallback> _styleCallback;
+        osg::ref_ptr<CanClusterCallback> _canClusterCallback;
+        osg::ref_ptr<Horizon> _horizon;
+        osg::ref_ptr<Worker> _worker;
+        osg::Matrixd _lastMVPW;
+        double _reuseThreshold;
+        unsigned _revision;
+        ClusterList _clusters;
+        bool _enabled;
+        bool _dirty;
+    };
+
+} } // namespace osgEarth::Util
+
+#endif // OSGEARTHUTIL_CLUSTERGRID_H
@@ -0,0 +1,796 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef OSGEARTHFEATURES_COMPILED_EXPRESSION_H
+#define OSGEARTHFEATURES_COMPILED_EXPRESSION_H 1
+
+#include <osgEarthFeatures/Common>
+#include <osgEarthFeatures/Feature>
+#include <osgEarthSymbology/Expression>
+#include <osgEarth/StringUtils>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+namespace osgEarth { namespace Features
+{
+    using namespace osgEarth;
+    using namespace osgEarth::Symbology;
+
+    /**
+     * A NumericExpression compiled for evaluation over many features.
+     *
+     * Feature::eval() pushes every variable through set() and replays the
+     * RPN with a fresh operand stack for each feature. This class parses
+     * the expression once, binds each distinct attribute name to a column,
+     * folds constant subexpressions, and emits a short stack bytecode that
+     * runs one instruction at a time over a whole batch of features.
+     *
+     * The compiled program is checked against the reference evaluator when
+     * it is built. Expressions it cannot reproduce exactly, and features
+     * that lack an attribute (which Feature::eval() resolves through the
+     * session's ScriptEngine), are evaluated through Feature::eval() so the
+     * results always match the per-feature path.
+     *
+     * A compiled expression is immutable and may be shared between threads.
+     */
+    class CompiledNumericExpression // NO EXPORT; header only
+    {
+    public:
+        /** Compiles "expr". */
+        CompiledNumericExpression(const NumericExpression& expr) :
+            _expr(expr),
+            _compiled(false),
+            _constant(false),
+            _constantValue(0.0),
+            _maxDepth(0u)
+        {
+            compile();
+        }
+
+        /** Whether the bytecode path is in use; false means every feature goes through Feature::eval(). */
+        bool isCompiled() const { return _compiled; }
+
+        /** Whether the expression folded to a constant. */
+        bool isConstant() const { return _compiled && _constant; }
+
+        /** Distinct attribute names the expression reads, in column order. */
+        const std::vector<std::string>& getAttributeNames() const { return _columns; }
+
+        /** Number of bytecode instructions after folding. */
+        unsigned getNumInstructions() const { return (unsigned)_code.size(); }
+
+        /** Evaluates the expression for one feature. */
+        double eval(const Feature* feature, const FilterContext* context) const
+        {
+            double result = 0.0;
+            evalBatch(&feature, 1u, context, &result);
+            return result;
+        }
+
+        /** Evaluates the expression for every feature in the list, in list order. */
+        void eval(const FeatureList& features, const FilterContext* context, std::vector<double>& output) const
+        {
+            output.resize(features.size());
+
+            const Feature* batch[BATCH_SIZE];
+            unsigned n = 0u, offset = 0u;
+            for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+            {
+                batch[n++] = i->get();
+                if (n == BATCH_SIZE)
+                {
+                    evalBatch(batch, n, context, &output[offset]);
+                    offset += n;
+                    n = 0u;
+                }
+            }
+            if (n > 0u)
+                evalBatch(batch, n, context, &output[offset]);
+        }
+
+        /** Evaluates the expression for "count" features into "output". */
+        void eval(const Feature* const* features, unsigned count, const FilterContext* context, double* output) const
+        {
+            for (unsigned offset = 0u; offset < count; offset += BATCH_SIZE)
+                evalBatch(features + offset, osg::minimum(count - offset, (unsigned)BATCH_SIZE), context, output + offset);
+        }
+
+    protected:
+        // Features per batch; sized so the columns and the operand stack stay in cache.
+        enum { BATCH_SIZE = 256 };
+
+        // Same order, and therefore the same precedence, as NumericExpression's operators.
+        enum Op { OPERAND, VARIABLE, ADD, SUB, MULT, DIV, MOD, MIN, MAX, LPAREN, RPAREN, COMMA };
+
+        enum Operands { STACK_STACK, STACK_CONSTANT, CONSTANT_STACK };
+
+        struct Atom
+        {
+            Atom(Op op, double value =0.0, unsigned column =0u) : _op(op), _value(value), _column(column) { }
+            Op       _op;
+            double   _value;
+            unsigned _column;
+        };
+
+        struct Instruction
+        {
+            Instruction(Op op, Operands operands =STACK_STACK, double value =0.0, unsigned column =0u) :
+                _op(op), _operands(operands), _value(value), _column(column) { }
+            Op       _op;        // OPERAND pushes _value, VARIABLE pushes column _column
+            Operands _operands;
+            double   _value;     // the constant operand, if any
+            unsigned _column;
+        };
+
+        // Compile-time operand: a folded constant, or a value on the runtime stack.
+        struct Entry
+        {
+            Entry(bool constant, double value) : _constant(constant), _value(value) { }
+            bool   _constant;
+            double _value;
+        };
+
+        static bool isOperator(Op op) { return op >= ADD && op <= MAX; }
+
+        static double apply(Op op, double l, double r)
+        {
+            switch (op)
+            {
+            case ADD:  return l + r;
+            case SUB:  return l - r;
+            case MULT: return l * r;
+            case DIV:  return l / r;
+            case MOD:  return fmod(l, r);
+            case MIN:  return l < r ? l : r;
+            case MAX:  return l > r ? l : r;
+            default:   return 0.0;
+            }
+        }
+
+        /**
+         * Tokenizes and orders the expression the way NumericExpression
+         * does, then folds it into bytecode. Returns the variable names
+         * in order of appearance.
+         */
+        bool parse(std::vector<std::string>& names)
+        {
+            StringTokenizer tokenizer("", "");
+            tokenizer.addDelims("[],()%*/+-", true);
+            tokenizer.addQuotes("'\"", true);
+            tokenizer.keepEmpties() = false;
+
+            StringVector t;
+            tokenizer.tokenize(_expr.expr(), t);
+
+            std::vector<Atom> infix;
+            bool invar = false;
+            for (unsigned i = 0; i < t.size(); ++i)
+            {
+                if (t[i] == "[" && !invar) invar = true;
+                else if (t[i] == "]" && invar)
+                {
+                    invar = false;
+                    infix.push_back(Atom(VARIABLE, 0.0, (unsigned)names.size()));
+                    names.push_back(t[i-1]);
+                }
+                else if (t[i] == "(") infix.push_back(Atom(LPAREN));
+                else if (t[i] == ")") infix.push_back(Atom(RPAREN));
+                else if (t[i] == ",") infix.push_back(Atom(COMMA));
+                else if (t[i] == "%") infix.push_back(Atom(MOD));
+                else if (t[i] == "*") infix.push_back(Atom(MULT));
+                else if (t[i] == "/") infix.push_back(Atom(DIV));
+                else if (t[i] == "+") infix.push_back(Atom(ADD));
+                else if (t[i] == "-") infix.push_back(Atom(SUB));
+                else if (t[i] == "min") infix.push_back(Atom(MIN));
+                else if (t[i] == "max") infix.push_back(Atom(MAX));
+                else if ((t[i][0] >= '0' && t[i][0] <= '9') || t[i][0] == '.')
+                    infix.push_back(Atom(OPERAND, as<double>(t[i], 0.0)));
+                else if (i == 0 || t[i-1] != "[")
+                {
+                    // a bare name, or a script call kept whole with its arguments
+                    std::string var = t[i];
+                    if (i + 1 < t.size() && t[i+1] == "(")
+                    {
+                        int depth = 0;
+                        do
+                        {
+                            ++i;
+                            var += t[i];
+                            if (t[i] == "(") ++depth;
+                            else if (t[i] == ")") --depth;
+                        }
+                        while (i + 1 < t.size() && depth > 0);
+                    }
+                    infix.push_back(Atom(VARIABLE, 0.0, (unsigned)names.size()));
+                    names.push_back(var);
+                }
+            }
+
+            // shunting-yard, with NumericExpression's precedence rules
+            std::vector<Atom> rpn, stack;
+            for (unsigned i = 0; i < infix.size(); ++i)
+            {
+                const Atom& a = infix[i];
+                if (a._op == LPAREN)
+                {
+                    stack.push_back(a);
+                }
+                else if (a._op == RPAREN)
+                {
+                    while (!stack.empty())
+                    {
+                        Atom top = stack.back();
+                        stack.pop_back();
+                        if (top._op == LPAREN)
+                            break;
+                        rpn.push_back(top);
+                    }
+                }
+                else if (a._op == COMMA)
+                {
+                    while (!stack.empty() && stack.back()._op != LPAREN)
+                    {
+                        rpn.push_back(stack.back());
+                        stack.pop_back();
+                    }
+                }
+                else if (isOperator(a._op))
+                {
+                    if (!stack.empty() && a._op <= stack.back()._op)
+                    {
+                        while (!stack.empty() && a._op < stack.back()._op && isOperator(stack.back()._op))
+                        {
+                            rpn.push_back(stack.back());
+                            stack.pop_back();
+                        }
+                    }
+                    stack.push_back(a);
+                }
+                else
+                {
+                    rpn.push_back(a);
+                }
+            }
+            while (!stack.empty())
+            {
+                rpn.push_back(stack.back());
+                stack.pop_back();
+            }
+
+            return emit(rpn);
+        }
+
+        /**
+         * Folds the RPN into bytecode. Constants stay symbolic until an
+         * operator needs them and become immediate operands, so only
+         * attribute-dependent values ever occupy the operand stack.
+         */
+        bool emit(const std::vector<Atom>& rpn)
+        {
+            std::vector<Entry> stack;
+            unsigned depth = 0u;
+
+            for (unsigned i = 0; i < rpn.size(); ++i)
+            {
+                const Atom& a = rpn[i];
+                if (a._op == OPERAND)
+                {
+                    stack.push_back(Entry(true, a._value));
+                }
+                else if (a._op == VARIABLE)
+                {
+                    _code.push_back(Instruction(VARIABLE, STACK_STACK, 0.0, a._column));
+                    stack.push_back(Entry(false, 0.0));
+                    _maxDepth = osg::maximum(_maxDepth, ++depth);
+                }
+                else if (isOperator(a._op))
+                {
+                    if (stack.size() < 2)
+                        return false;
+
+                    Entry r = stack.back(); stack.pop_back();
+                    Entry l = stack.back(); stack.pop_back();
+
+                    if (l._constant && r._constant)
+                    {
+                        stack.push_back(Entry(true, apply(a._op, l._value, r._value)));
+                        continue;
+                    }
+
+                    if (r._constant)
+                        _code.push_back(Instruction(a._op, STACK_CONSTANT, r._value));
+                    else if (l._constant)
+                        _code.push_back(Instruction(a._op, CONSTANT_STACK, l._value));
+                    else
+                    {
+                        _code.push_back(Instruction(a._op, STACK_STACK));
+                        --depth;
+                    }
+                    stack.push_back(Entry(false, 0.0));
+                }
+                else
+                {
+                    return false;
+                }
+            }
+
+            if (stack.size() != 1u)
+                return false;
+
+            _constant = stack[0]._constant;
+            _constantValue = stack[0]._value;
+            if (_constant)
+                _code.clear();
+            return true;
+        }
+
+        /** Parses, binds columns and validates against NumericExpression. */
+        void compile()
+        {
+            std::vector<std::string> names;
+            if (!parse(names))
+            {
+                _code.clear();
+                return;
+            }
+
+            const NumericExpression::Variables& vars = _expr.variables();
+            if (vars.size() != names.size())
+            {
+                _code.clear();
+                return;
+            }
+
+            // One column per distinct attribute; attribute lookup is case-insensitive.
+            std::vector<unsigned> varColumns(names.size());
+            for (unsigned i = 0; i < names.size(); ++i)
+            {
+                if (names[i] != vars[i].first)
+                {
+                    _code.clear();
+                    return;
+                }
+
+                std::string key = toLower(names[i]);
+                unsigned c = 0;
+                while (c < _columns.size() && toLower(_columns[c]) != key)
+                    ++c;
+                if (c == _columns.size())
+                    _columns.push_back(names[i]);
+                varColumns[i] = c;
+            }
+
+            for (unsigned i = 0; i < _code.size(); ++i)
+            {
+                if (_code[i]._op == VARIABLE)
+                    _code[i]._column = varColumns[_code[i]._column];
+            }
+
+            _compiled = true;
+
+            // Probe with a few variable assignments and require agreement
+            // with the reference evaluator.
+            const double probes[3][2] = { { 1.25, 0.5 }, { 7.5, -1.75 }, { -3.0, 2.25 } };
+            std::vector<double> values(_columns.size());
+            for (unsigned p = 0; p < 3 && _compiled; ++p)
+            {
+                for (unsigned c = 0; c < values.size(); ++c)
+                    values[c] = probes[p][0] + probes[p][1] * (double)c;
+
+                NumericExpression reference(_expr);
+                for (unsigned i = 0; i < vars.size(); ++i)
+                    reference.set(vars[i], values[varColumns[i]]);
+
+                double expected = reference.eval();
+                double actual = run(values);
+                bool same =
+                    (expected != expected && actual != actual) ||
+                    expected == actual ||
+                    fabs(expected - actual) <= 1e-12 * osg::maximum(1.0, fabs(expected));
+
+                if (!same)
+                {
+                    _compiled = false;
+                    _constant = false;
+                    _code.clear();
+                    _columns.clear();
+                }
+            }
+        }
+
+        /** Runs the bytecode for a single set of column values. */
+        double run(const std::vector<double>& values) const
+        {
+            if (_constant)
+                return _constantValue;
+
+            std::vector<double> columns(values.empty() ? 1u : values.size());
+            for (unsigned c = 0; c < values.size(); ++c)
+                columns[c] = values[c];
+
+            double result = 0.0;
+            std::vector<double> stack(osg::maximum(_maxDepth, 1u));
+            execute(&columns[0], 1u, 1u, &stack[0], &result);
+            return result;
+        }
+
+        /**
+         * Executes the bytecode over n features. columns holds one run of
+         * "stride" values per attribute; stack holds _maxDepth runs.
+         */
+        void execute(const double* columns, unsigned n, unsigned stride, double* stack, double* output) const
+        {
+            double* top = stack;
+            unsigned depth = 0u;
+            for (unsigned i = 0; i < _code.size(); ++i)
+            {
+                const Instruction& in = _code[i];
+                if (in._op == VARIABLE)
+                {
+                    top = stack + (depth++) * stride;
+                    const double* src = columns + in._column * stride;
+                    for (unsigned j = 0; j < n; ++j)
+                        top[j] = src[j];
+                }
+                else if (in._operands == STACK_CONSTANT)
+                {
+                    applyConstantRhs(in._op, top, in._value, n);
+                }
+                else if (in._operands == CONSTANT_STACK)
+                {
+                    applyConstantLhs(in._op, in._value, top, n);
+                }
+                else
+                {
+                    double* lhs = top - stride;
+                    applyStack(in._op, lhs, top, n);
+                    top = lhs;
+                    --depth;
+                }
+            }
+
+            for (unsigned j = 0; j < n; ++j)
+                output[j] = top[j];
+        }
+
+        // The per-op loops are kept separate so the compiler can vectorize each.
+
+        static void applyStack(Op op, double* l, const double* r, unsigned n)
+        {
+            unsigned j;
+            switch (op)
+            {
+            case ADD:  for (j = 0; j < n; ++j) l[j] = l[j] + r[j]; break;
+            case SUB:  for (j = 0; j < n; ++j) l[j] = l[j] - r[j]; break;
+            case MULT: for (j = 0; j < n; ++j) l[j] = l[j] * r[j]; break;
+            case DIV:  for (j = 0; j < n; ++j) l[j] = l[j] / r[j]; break;
+            case MOD:  for (j = 0; j < n; ++j) l[j] = fmod(l[j], r[j]); break;
+            case MIN:  for (j = 0; j < n; ++j) l[j] = l[j] < r[j] ? l[j] : r[j]; break;
+            case MAX:  for (j = 0; j < n; ++j) l[j] = l[j] > r[j] ? l[j] : r[j]; break;
+            default: break;
+            }
+        }
+
+        static void applyConstantRhs(Op op, double* l, double r, unsigned n)
+        {
+            unsigned j;
+            switch (op)
+            {
+            case ADD:  for (j = 0; j < n; ++j) l[j] = l[j] + r; break;
+            case SUB:  for (j = 0; j < n; ++j) l[j] = l[j] - r; break;
+            case MULT: for (j = 0; j < n; ++j) l[j] = l[j] * r; break;
+            case DIV:  for (j = 0; j < n; ++j) l[j] = l[j] / r; break;
+            case MOD:  for (j = 0; j < n; ++j) l[j] = fmod(l[j], r); break;
+            case MIN:  for (j = 0; j < n; ++j) l[j] = l[j] < r ? l[j] : r; break;
+            case MAX:  for (j = 0; j < n; ++j) l[j] = l[j] > r ? l[j] : r; break;
+            default: break;
+            }
+        }
+
+        static void applyConstantLhs(Op op, double l, double* r, unsigned n)
+        {
+            unsigned j;
+            switch (op)
+            {
+            case ADD:  for (j = 0; j < n; ++j) r[j] = l + r[j]; break;
+            case SUB:  for (j = 0; j < n; ++j) r[j] = l - r[j]; break;
+            case MULT: for (j = 0; j < n; ++j) r[j] = l * r[j]; break;
+            case DIV:  for (j = 0; j < n; ++j) r[j] = l / r[j]; break;
+            case MOD:  for (j = 0; j < n; ++j) r[j] = fmod(l, r[j]); break;
+            case MIN:  for (j = 0; j < n; ++j) r[j] = l < r[j] ? l : r[j]; break;
+            case MAX:  for (j = 0; j < n; ++j) r[j] = l > r[j] ? l : r[j]; break;
+            default: break;
+            }
+        }
+
+        /** Evaluates up to BATCH_SIZE features. */
+        void evalBatch(const Feature* const* features, unsigned n, const FilterContext* context, double* output) const
+        {
+            if (_compiled && _constant)
+            {
+                for (unsigned j = 0; j < n; ++j)
+                    output[j] = _constantValue;
+                return;
+            }
+
+            bool fallback[BATCH_SIZE];
+            bool anyFallback = !_compiled;
+            for (unsigned j = 0; j < n; ++j)
+                fallback[j] = !_compiled;
+
+            if (_compiled)
+            {
+                // Gather: one attribute lookup per feature and distinct name.
+                unsigned numColumns = (unsigned)_columns.size();
+                std::vector<double> columns(osg::maximum(numColumns, 1u) * BATCH_SIZE);
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    double* column = &columns[c * BATCH_SIZE];
+                    for (unsigned j = 0; j < n; ++j)
+                    {
+                        const AttributeTable& attrs = features[j]->getAttrs();
+                        AttributeTable::const_iterator a = attrs.find(_columns[c]);
+                        if (a != attrs.end())
+                        {
+                            column[j] = a->second.getDouble(0.0);
+                        }
+                        else
+                        {
+                            // Feature::eval() resolves missing attributes, e.g. through a script.
+                            column[j] = 0.0;
+                            anyFallback = fallback[j] = true;
+                        }
+                    }
+                }
+
+                std::vector<double> stack(osg::maximum(_maxDepth, 1u) * BATCH_SIZE);
+                execute(&columns[0], n, BATCH_SIZE, &stack[0], output);
+            }
+
+            if (anyFallback)
+            {
+                NumericExpression expr(_expr);
+                for (unsigned j = 0; j < n; ++j)
+                {
+                    if (fallback[j])
+                        output[j] = features[j]->eval(expr, context);
+                }
+            }
+        }
+
+    private:
+        NumericExpression         _expr;
+        bool                      _compiled;
+        bool                      _constant;
+        double                    _constantValue;
+        std::vector<Instruction>  _code;
+        std::vector<std::string>  _columns;
+        unsigned                  _maxDepth;
+    };
+
+    //--------------------------------------------------------------------
+
+    /**
+     * A StringExpression compiled for evaluation over many features.
+     *
+     * The expression is split once into literal runs and attribute
+     * references, using the StringExpression parser itself so that quoting
+     * and bracket rules match exactly. Each feature's result is then built
+     * with one attribute lookup per reference and no per-feature set() or
+     * variable scan. Features lacking an attribute are evaluated through
+     * Feature::eval() so script-backed variables behave as before.
+     *
+     * A compiled expression is immutable and may be shared between threads.
+     */
+    class CompiledStringExpression // NO EXPORT; header only
+    {
+    public:
+        /** Compiles "expr". */
+        CompiledStringExpression(const StringExpression& expr) :
+            _expr(expr),
+            _compiled(false),
+            _literalSize(0u)
+        {
+            compile();
+        }
+
+        /** Whether the split form is in use; false means every feature goes through Feature::eval(). */
+        bool isCompiled() const { return _compiled; }
+
+        /** Whether the expression has no attribute references. */
+        bool isConstant() const { return _compiled && _columns.empty(); }
+
+        /** Distinct attribute names the expression reads. */
+        const std::vector<std::string>& getAttributeNames() const { return _columns; }
+
+        /** Evaluates the expression for one feature. */
+        std::string eval(const Feature* feature, const FilterContext* context) const
+        {
+            std::string result;
+            std::vector<std::string> values;
+            if (!build(feature, values, result))
+            {
+                StringExpression expr(_expr);
+                result = feature->eval(expr, context);
+            }
+            return result;
+        }
+
+        /** Evaluates the expression for every feature in the list, in list order. */
+        void eval(const FeatureList& features, const FilterContext* context, std::vector<std::string>& output) const
+        {
+            output.resize(features.size());
+
+            std::vector<std::string> values;
+            StringExpression expr(_expr);
+
+            unsigned j = 0u;
+            for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++j)
+            {
+                if (!build(i->get(), values, output[j]))
+                    output[j] = (*i)->eval(expr, context);
+            }
+        }
+
+    protected:
+        struct Part
+        {
+            Part(const std::string& literal) : _literal(literal), _column(-1) { }
+            Part(int column) : _column(column) { }
+            std::string _literal;
+            int         _column;   // -1 for a literal run
+        };
+
+        /**
+         * Evaluates the reference with a unique marker in each variable and
+         * splits the result on the markers, which yields the literal runs
+         * exactly as StringExpression parsed them.
+         */
+        void compile()
+        {
+            const StringExpression::Variables& vars = _expr.variables();
+            const char OPEN = '\x01', CLOSE = '\x02';
+
+            if (_expr.expr().find(OPEN) != std::string::npos || _expr.expr().find(CLOSE) != std::string::npos)
+                return;
+
+            std::vector<int> varColumns(vars.size());
+            StringExpression marked(_expr);
+            for (unsigned i = 0; i < vars.size(); ++i)
+            {
+                std::string key = toLower(vars[i].first);
+                unsigned c = 0;
+                while (c < _columns.size() && toLower(_columns[c]) != key)
+                    ++c;
+                if (c == _columns.size())
+                    _columns.push_back(vars[i].first);
+                varColumns[i] = (int)c;
+
+                std::ostringstream buf;
+                buf << OPEN << i << CLOSE;
+                marked.set(vars[i], buf.str());
+            }
+
+            const std::string result = marked.eval();
+            std::string::size_type pos = 0;
+            while (pos < result.size())
+            {
+                std::string::size_type open = result.find(OPEN, pos);
+                if (open == std::string::npos)
+                {
+                    _parts.push_back(Part(result.substr(pos)));
+                    break;
+                }
+                if (open > pos)
+                    _parts.push_back(Part(result.substr(pos, open - pos)));
+
+                std::string::size_type close = result.find(CLOSE, open);
+                if (close == std::string::npos)
+                {
+                    clear();
+                    return;
+                }
+                unsigned var = as<unsigned>(result.substr(open + 1, close - open - 1), (unsigned)vars.size());
+                if (var >= vars.size())
+                {
+                    clear();
+                    return;
+                }
+                _parts.push_back(Part(varColumns[var]));
+                pos = close + 1;
+            }
+
+            for (unsigned i = 0; i < _parts.size(); ++i)
+                _literalSize += (unsigned)_parts[i]._literal.size();
+
+            _compiled = true;
+
+            // Confirm with plain values that the split form reproduces the reference.
+            StringExpression reference(_expr);
+            std::vector<std::string> values(_columns.size());
+            for (unsigned c = 0; c < values.size(); ++c)
+            {
+                std::ostringstream buf;
+                buf << "v" << c;
+                values[c] = buf.str();
+            }
+            for (unsigned i = 0; i < vars.size(); ++i)
+                reference.set(vars[i], values[varColumns[i]]);
+
+            std::string actual;
+            concatenate(values, actual);
+            if (actual != reference.eval())
+                clear();
+        }
+
+        void clear()
+        {
+            _compiled = false;
+            _parts.clear();
+            _columns.clear();
+            _literalSize = 0u;
+        }
+
+        void concatenate(const std::vector<std::string>& values, std::string& output) const
+        {
+            output.clear();
+            output.reserve(_literalSize + 16u * values.size());
+            for (unsigned i = 0; i < _parts.size(); ++i)
+            {
+                if (_parts[i]._column < 0)
+                    output += _parts[i]._literal;
+                else
+                    output += values[_parts[i]._column];
+            }
+        }
+
+        /**
+         * Builds the result for one feature. Returns false when the
+         * feature needs the Feature::eval() path.
+         */
+        bool build(const Feature* feature, std::vector<std::string>& values, std::string& output) const
+        {
+            if (!_compiled)
+                return false;
+
+            values.resize(_columns.size());
+            const AttributeTable& attrs = feature->getAttrs();
+            for (unsigned c = 0; c < _columns.size(); ++c)
+            {
+                AttributeTable::const_iterator a = attrs.find(_columns[c]);
+                if (a == attrs.end())
+                    return false;
+                values[c] = a->second.getString();
+            }
+
+            concatenate(values, output);
+            return true;
+        }
+
+    private:
+        StringExpression          _expr;
+        bool                      _compiled;
+        std::vector<Part>         _parts;
+        std::vector<std::string>  _columns;
+        unsigned                  _literalSize;
+    };
+
+} } // namespace osgEarth::Features
+
+#endif // OSGEARTHFEATURES_COMPILED_EXPRESSION_H
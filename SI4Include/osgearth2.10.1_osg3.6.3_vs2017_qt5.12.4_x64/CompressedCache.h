@@ -0,0 +1,386 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef OSGEARTH_COMPRESSED_CACHE_H
+#define OSGEARTH_COMPRESSED_CACHE_H 1
+
+#include <osgEarth/Common>
+#include <osgEarth/Cache>
+#include <osgEarth/CacheBin>
+#include <osgEarth/BlockCompressor>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Atomic>
+#include <map>
+
+namespace osgEarth
+{
+    /**
+     * CacheBin that keeps a block compressed (BC1/BC3) copy of every image
+     * next to the source record.
+     *
+     * Images written to the bin are stored unchanged, and a compressed copy
+     * (with mipmaps) is encoded on a TaskService and written under a
+     * derived key. Reads return the compressed copy when it exists, so cache
+     * hits skip PNG/JPEG decoding entirely and go to the GPU at 1/4 to 1/8
+     * of the RGBA8 size. A source record without a compressed copy is
+     * returned as-is and, when the bin has a TaskService, queued for
+     * encoding; reads never encode on the calling thread. Writing a record
+     * drops its compressed copy, and any encode of the previous image still
+     * queued, before the new image is encoded.
+     *
+     * Compressed copies are written with "WriteImageHint=IncludeData" so
+     * the raw blocks are serialized without needing an image plugin.
+     */
+    class CompressedCacheBin : public CacheBin
+    {
+    public:
+        struct Stats
+        {
+            unsigned compressedHits;    // reads served from a compressed copy
+            unsigned sourceHits;        // reads served from the source record
+            unsigned encoded;           // compressed copies written
+        };
+
+    public:
+        /**
+         * Wraps a cache bin.
+         * @param source   Bin holding the source records (and the compressed copies)
+         * @param service  Task service for encoding; NULL to encode written images on the
+         *                 calling thread and never encode on read
+         */
+        CompressedCacheBin(
+            CacheBin* source,
+            TaskService* service =0L,
+            const BlockCompressor::Options& options =BlockCompressor::Options()) :
+            CacheBin(source ? source->getID() : std::string()),
+            _source(source),
+            _service(service),
+            _options(options),
+            _generation(0u)
+        {
+            _writeOptions = Registry::cloneOrCreateOptions();
+            _writeOptions->setOptionString("WriteImageHint=IncludeData");
+        }
+
+        CacheBin* getSource() const { return _source.get(); }
+
+        //! Key under which the compressed copy of "key" is stored.
+        static std::string getCompressedKey(const std::string& key) { return key + "_bc"; }
+
+        Stats getStats() const
+        {
+            Stats s;
+            s.compressedHits = _compressedHits;
+            s.sourceHits = _sourceHits;
+            s.encoded = _encoded;
+            return s;
+        }
+
+        //! Encodes "image" and stores it under the compressed key for "key".
+        bool writeCompressed(const std::string& key, const osg::Image* image, const Config& metadata)
+        {
+            osg::ref_ptr<osg::Image> compressed = BlockCompressor::compress(image, _options);
+            if (!compressed.valid())
+                return false;
+
+            return storeCompressed(key, compressed.get(), metadata);
+        }
+
+    public: // CacheBin
+
+        virtual ReadResult readImage(const std::string& key, const osgDB::Options* dbo)
+        {
+            ReadResult compressed = _source->readImage(getCompressedKey(key), dbo);
+            if (compressed.succeeded() && ImageUtils::isCompressed(compressed.getImage()))
+            {
+                ++_compressedHits;
+                return compressed;
+            }
+
+            ReadResult r = _source->readImage(key, dbo);
+            if (r.succeeded())
+            {
+                ++_sourceHits;
+                // encoding here would stall the pager thread this read runs on
+                if (_service.valid())
+                    queue(key, r.getImage(), r.metadata(), false);
+            }
+            return r;
+        }
+
+        virtual ReadResult readObject(const std::string& key, const osgDB::Options* dbo)
+        {
+            return _source->readObject(key, dbo);
+        }
+
+        virtual ReadResult readString(const std::string& key, const osgDB::Options* dbo)
+        {
+            return _source->readString(key, dbo);
+        }
+
+        virtual bool write(const std::string& key, const osg::Object* object, const Config& metadata, const osgDB::Options* dbo)
+        {
+            // the compressed copy of the previous record must not outlive it
+            invalidate(key);
+
+            bool ok = _source->write(key, object, metadata, dbo);
+
+            const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+            if (ok && image)
+                queue(key, image, metadata, true);
+
+            return ok;
+        }
+
+        virtual RecordStatus getRecordStatus(const std::string& key)
+        {
+            return _source->getRecordStatus(key);
+        }
+
+        virtual bool remove(const std::string& key)
+        {
+            invalidate(key);
+            return _source->remove(key);
+        }
+
+        virtual bool touch(const std::string& key)
+        {
+            _source->touch(getCompressedKey(key));
+            return _source->touch(key);
+        }
+
+        virtual Config readMetadata() { return _source->readMetadata(); }
+        virtual bool writeMetadata(const Config& meta) { return _source->writeMetadata(meta); }
+        virtual bool clear() { return _source->clear(); }
+        virtual bool compact() { return _source->compact(); }
+        virtual unsigned getStorageSize() { return _source->getStorageSize(); }
+
+    protected:
+        virtual ~CompressedCacheBin() { }
+
+        struct EncodeTask : public TaskRequest
+        {
+            EncodeTask(CompressedCacheBin* bin, const std::string& key, const osg::Image* image, const Config& meta, unsigned generation) :
+                _bin(bin), _key(key), _image(image), _meta(meta), _generation(generation) { }
+
+            void operator()(ProgressCallback* /*progress*/)
+            {
+                osg::ref_ptr<CompressedCacheBin> bin;
+                if (_bin.lock(bin))
+                    bin->encode(_key, _image.get(), _meta, _generation);
+            }
+
+            osg::observer_ptr<CompressedCacheBin> _bin;
+            std::string _key;
+            osg::ref_ptr<const osg::Image> _image;
+            Config _meta;
+            unsigned _generation;
+        };
+
+        typedef std::map<std::string, unsigned> PendingMap; // key -> generation of its queued encode
+
+        //! Writes an encoded copy.
+        bool storeCompressed(const std::string& key, const osg::Image* compressed, const Config& metadata)
+        {
+            bool ok = _source->write(getCompressedKey(key), compressed, metadata, _writeOptions.get());
+            if (ok)
+                ++_encoded;
+            return ok;
+        }
+
+        //! Removes the compressed copy of "key" and cancels any encode queued for it.
+        void invalidate(const std::string& key)
+        {
+            Threading::ScopedMutexLock lock(_pendingMutex);
+            _pending.erase(key);
+            _source->remove(getCompressedKey(key));
+        }
+
+        //! Queues an encode of "image"; "replace" supersedes an encode already queued for the key.
+        void queue(const std::string& key, const osg::Image* image, const Config& metadata, bool replace)
+        {
+            if (!image || ImageUtils::isCompressed(image))
+                return;
+
+            if (!_service.valid())
+            {
+                writeCompressed(key, image, metadata);
+                return;
+            }
+
+            unsigned generation;
+            {
+                Threading::ScopedMutexLock lock(_pendingMutex);
+                PendingMap::iterator i = _pending.find(key);
+                if (i != _pending.end() && !replace)
+                    return;
+                generation = ++_generation;
+                _pending[key] = generation;
+            }
+            _service->add(new EncodeTask(this, key, image, metadata, generation));
+        }
+
+        bool isCurrent(const std::string& key, unsigned generation) const
+        {
+            PendingMap::const_iterator i = _pending.find(key);
+            return i != _pending.end() && i->second == generation;
+        }
+
+        //! Runs a queued encode, storing the result only if no later write() superseded it.
+        void encode(const std::string& key, const osg::Image* image, const Config& metadata, unsigned generation)
+        {
+            osg::ref_ptr<osg::Image> compressed = BlockCompressor::compress(image, _options);
+
+            {
+                Threading::ScopedMutexLock lock(_pendingMutex);
+                if (!isCurrent(key, generation))
+                    return;
+                if (!compressed.valid())
+                {
+                    _pending.erase(key);
+                    return;
+                }
+            }
+
+            // store without the lock, so encoders don't wait on each other's writes
+            storeCompressed(key, compressed.get(), metadata);
+
+            // a write() or remove() during the store may have been overtaken by it,
+            // leaving a copy of the old image; drop that copy.
+            Threading::ScopedMutexLock lock(_pendingMutex);
+            if (isCurrent(key, generation))
+                _pending.erase(key);
+            else
+                _source->remove(getCompressedKey(key));
+        }
+
+        osg::ref_ptr<CacheBin> _source;
+        osg::ref_ptr<TaskService> _service;
+        BlockCompressor::Options _options;
+        osg::ref_ptr<osgDB::Options> _writeOptions;
+        Threading::Mutex _pendingMutex;
+        PendingMap _pending;
+        unsigned _generation;
+        OpenThreads::Atomic _compressedHits;
+        OpenThreads::Atomic _sourceHits;
+        OpenThreads::Atomic _encoded;
+    };
+
+
+    /**
+     * Cache that wraps every bin of another cache in a CompressedCacheBin.
+     * Without a TaskService, the cache creates one with two threads.
+     *
+     * Usage:
+     *   osg::ref_ptr<Cache> cache = CacheFactory::create(cacheOptions);
+     *   map->setCache(new CompressedCache(cache.get()));
+     *
+     * All layers reading through the map's cache then receive compressed
+     * imagery on cache hits.
+     */
+    class CompressedCache : public Cache
+    {
+    public:
+        CompressedCache(
+            Cache* source =0L,
+            TaskService* service =0L,
+            const BlockCompressor::Options& options =BlockCompressor::Options()) :
+            Cache(source ? source->getCacheOptions() : CacheOptions()),
+            _source(source),
+            _service(service),
+            _options(options)
+        {
+            _ok = source && source->isOK();
+            if (!_service.valid())
+                _service = new TaskService("CompressedCache", 2);
+        }
+
+        CompressedCache(const CompressedCache& rhs, const osg::CopyOp& op =osg::CopyOp::DEEP_COPY_ALL) :
+            Cache(rhs, op),
+            _source(rhs._source),
+            _service(rhs._service),
+            _options(rhs._options)
+        {
+            Threading::ScopedMutexLock lock(rhs._binsMutex);
+            _wrappedBins = rhs._wrappedBins;
+        }
+
+        META_Object(osgEarth, CompressedCache);
+
+        Cache* getSource() const { return _source.get(); }
+
+    public: // Cache
+
+        virtual CacheBin* addBin(const std::string& binID)
+        {
+            Threading::ScopedMutexLock lock(_binsMutex);
+
+            BinMap::iterator i = _wrappedBins.find(binID);
+            if (i != _wrappedBins.end())
+                return i->second.get();
+
+            CacheBin* bin = _source.valid() ? _source->addBin(binID) : 0L;
+            if (!bin)
+                return 0L;
+
+            CompressedCacheBin* wrapped = new CompressedCacheBin(bin, _service.get(), _options);
+            _wrappedBins[binID] = wrapped;
+            return wrapped;
+        }
+
+        virtual CacheBin* getOrCreateDefaultBin()
+        {
+            return addBin("_default");
+        }
+
+        virtual void removeBin(CacheBin* bin)
+        {
+            Threading::ScopedMutexLock lock(_binsMutex);
+            for (BinMap::iterator i = _wrappedBins.begin(); i != _wrappedBins.end(); ++i)
+            {
+                if (i->second.get() == bin)
+                {
+                    if (_source.valid())
+                        _source->removeBin(i->second->getSource());
+                    _wrappedBins.erase(i);
+                    break;
+                }
+            }
+        }
+
+        virtual off_t getApproximateSize() const { return _source.valid() ? _source->getApproximateSize() : 0; }
+        virtual bool compact() { return _source.valid() && _source->compact(); }
+        virtual bool clear() { return _source.valid() && _source->clear(); }
+
+    protected:
+        virtual ~CompressedCache() { }
+
+        typedef std::map<std::string, osg::ref_ptr<CompressedCacheBin> > BinMap;
+
+        osg::ref_ptr<Cache> _source;
+        osg::ref_ptr<TaskService> _service;
+        BlockCompressor::Options _options;
+        mutable Threading::Mutex _binsMutex;
+        BinMap _wrappedBins;
+    };
+}
+
+#endif // OSGEARTH_COMPRESSED_CACHE_H
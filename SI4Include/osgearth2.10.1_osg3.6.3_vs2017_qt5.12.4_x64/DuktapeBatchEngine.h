@@ -0,0 +1,482 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef OSGEARTHDRIVERS_DUKTAPE_BATCH_ENGINE_H
+#define OSGEARTHDRIVERS_DUKTAPE_BATCH_ENGINE_H 1
+
+#include <osgEarthFeatures/ScriptEngine>
+#include <osgEarthFeatures/Script>
+#include <osgEarthFeatures/Feature>
+#include <osgEarthFeatures/GeometryUtils>
+#include <osgEarthSymbology/StyleSheet>
+#include <osgEarth/Containers>
+#include <osgEarth/Metrics>
+#include <osgEarth/ThreadingUtils>
+#include <osg/Timer>
+#include <sstream>
+#include <list>
+#include "duktape.h"
+#include "JSGeometry"
+
+namespace osgEarth { namespace Drivers { namespace Duktape
+{
+    using namespace osgEarth::Features;
+    using namespace osgEarth::Symbology;
+
+    /**
+     * Duktape engine that evaluates a script over a whole list of features
+     * in one call into the interpreter.
+     *
+     * Each thread keeps one warm context in which the engine's script
+     * library is loaded once. Code snippets are compiled once per context
+     * and cached in the context's stash; the least recently used ones are
+     * dropped beyond setMaxCachedScripts() snippets per context. A batch passes the features to
+     * the script as one array; each element exposes "id", "properties"
+     * and a lazily converted "geometry", and is bound to the global
+     * "feature" in turn before the snippet runs, so snippets written for
+     * DuktapeEngine work unchanged.
+     *
+     * Per-script timing is reported through Metrics when a backend is
+     * installed, and accumulated in getScriptStats().
+     *
+     * Like the scriptengine_javascript plugin, this needs the Duktape
+     * sources (duktape.c) compiled into the application.
+     */
+    class DuktapeBatchEngine : public osgEarth::Features::ScriptEngine
+    {
+    public:
+        /** Accumulated cost of one code snippet. */
+        struct ScriptStats
+        {
+            ScriptStats() : _batches(0u), _features(0u), _errors(0u), _compiles(0u), _evictions(0u), _time(0.0) { }
+
+            unsigned long long _batches;
+            unsigned long long _features;
+            unsigned long long _errors;
+            unsigned long long _compiles;   // one per snippet per thread context
+            unsigned long long _evictions;  // times the compiled snippet was dropped from a context's cache
+            double             _time;       // seconds, summed over threads
+
+            /** Features evaluated per second of script time. */
+            double getFeaturesPerSecond() const { return _time > 0.0 ? (double)_features / _time : 0.0; }
+        };
+
+        typedef std::map<std::string, ScriptStats> ScriptStatsMap;
+
+    public:
+        /** Construct the engine; the options' script is the library loaded into every context. */
+        DuktapeBatchEngine(const ScriptEngineOptions& options =ScriptEngineOptions()) :
+            ScriptEngine(options),
+            _options(options),
+            _maxCachedScripts(256u)
+        {
+            //nop
+        }
+
+        /** Maximum number of compiled snippets kept by each thread's context. Default is 256. */
+        void setMaxCachedScripts(unsigned value) { _maxCachedScripts = value > 0u ? value : 1u; }
+        unsigned getMaxCachedScripts() const { return _maxCachedScripts; }
+
+        /** Engine options that load a style sheet's script library. */
+        static ScriptEngineOptions getOptions(const StyleSheet::ScriptDef* def)
+        {
+            ScriptEngineOptions options;
+            if (def)
+                options.script() = Script(def->code, def->language, def->name);
+            return options;
+        }
+
+        /** Report language support */
+        bool supported(std::string lang) {
+            return osgEarth::toLower(lang).compare("javascript") == 0;
+        }
+
+        /** Run a javascript code snippet for a single feature. */
+        ScriptResult run(
+            const std::string&                       code,
+            osgEarth::Features::Feature const*       feature,
+            osgEarth::Features::FilterContext const* context)
+        {
+            std::vector<const Feature*> features(1, feature);
+            std::vector<ScriptResult> results;
+            runBatch(code, features, context, results);
+            return results.empty() ? ScriptResult("", false) : results[0];
+        }
+
+        /** Runs a script for a single feature. */
+        ScriptResult run(Script* script, Feature const* feature, FilterContext const* context)
+        {
+            return script ? run(script->getCode(), feature, context) : ScriptResult("", false);
+        }
+
+        /**
+         * Runs a code snippet once for each feature in the list, in a
+         * single call into the interpreter. "results" receives one entry
+         * per feature, in list order. Returns false if the snippet did
+         * not compile.
+         */
+        bool runBatch(
+            const std::string&  code,
+            const FeatureList&  features,
+            FilterContext const* context,
+            std::vector<ScriptResult>& results)
+        {
+            std::vector<const Feature*> list;
+            list.reserve(features.size());
+            for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+                list.push_back(i->get());
+            return runBatch(code, list, context, results);
+        }
+
+        /** Same as above for a vector of features; null entries yield a null "feature". */
+        bool runBatch(
+            const std::string&                 code,
+            const std::vector<const Feature*>& features,
+            FilterContext const*               /*context*/,
+            std::vector<ScriptResult>&         results)
+        {
+            results.clear();
+            if (features.empty())
+                return true;
+
+            osg::ref_ptr<Context>& slot = _contexts.get();
+            if (!slot.valid())
+                slot = new Context();
+            Context& c = *slot.get();
+            if (!c._ctx && !c.initialize(_script))
+            {
+                results.assign(features.size(), ScriptResult("", false, "Failed to create a Duktape context"));
+                return false;
+            }
+
+            Config args;
+            if (Metrics::enabled())
+            {
+                args.set("script", code);
+                args.set("features", (unsigned)features.size());
+                Metrics::begin("DuktapeBatchEngine::runBatch", args);
+            }
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            duk_context* ctx = c._ctx;
+            duk_idx_t top = duk_get_top(ctx);
+            bool compiled = false;
+            bool newlyCompiled = false;
+            std::vector<std::string> evicted;
+            unsigned errors = 0u;
+
+            duk_get_global_string(ctx, "oe_duk_run_batch");             // [driver]
+            if (c.pushFunction(code, _maxCachedScripts, newlyCompiled, evicted)) // [driver, fn]
+            {
+                compiled = true;
+                c._features = &features;
+                c.pushFeatures(features);                               // [driver, fn, features]
+
+                if (duk_pcall(ctx, 2) == DUK_EXEC_SUCCESS)              // [[values, ok]]
+                {
+                    duk_get_prop_index(ctx, -1, 0);                     // [result, values]
+                    duk_get_prop_index(ctx, -2, 1);                     // [result, values, ok]
+                    results.reserve(features.size());
+                    for (unsigned i = 0; i < features.size(); ++i)
+                    {
+                        duk_get_prop_index(ctx, -2, i);
+                        duk_get_prop_index(ctx, -2, i);                 // [..., value, ok]
+                        bool ok = duk_to_boolean(ctx, -1) != 0;
+                        std::string value = duk_safe_to_string(ctx, -2);
+                        if (ok)
+                            results.push_back(ScriptResult(value));
+                        else
+                        {
+                            results.push_back(ScriptResult("", false, value));
+                            ++errors;
+                        }
+                        duk_pop_2(ctx);
+                    }
+                }
+                else
+                {
+                    std::string err = duk_safe_to_string(ctx, -1);
+                    OE_WARN << LC << "Batch script error: " << err << std::endl;
+                    results.assign(features.size(), ScriptResult("", false, err));
+                    errors = (unsigned)features.size();
+                }
+                c._features = 0L;
+            }
+            else
+            {
+                std::string err = duk_safe_to_string(ctx, -1);
+                OE_WARN << LC << "Failed to compile \"" << code << "\": " << err << std::endl;
+                results.assign(features.size(), ScriptResult("", false, err));
+                errors = (unsigned)features.size();
+            }
+            duk_set_top(ctx, top);
+
+            double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+            {
+                Threading::ScopedMutexLock lock(_statsMutex);
+                ScriptStats& stats = _stats[code];
+                ++stats._batches;
+                stats._features += features.size();
+                stats._errors += errors;
+                stats._time += seconds;
+                if (newlyCompiled)
+                    ++stats._compiles;
+                for (std::vector<std::string>::const_iterator i = evicted.begin(); i != evicted.end(); ++i)
+                    ++_stats[*i]._evictions;
+            }
+
+            if (Metrics::enabled())
+            {
+                args.set("errors", errors);
+                Metrics::end("DuktapeBatchEngine::runBatch", args);
+            }
+
+            return compiled;
+        }
+
+        /** Per-snippet statistics, keyed by code. */
+        ScriptStatsMap getScriptStats() const
+        {
+            Threading::ScopedMutexLock lock(_statsMutex);
+            return _stats;
+        }
+
+        void resetScriptStats()
+        {
+            Threading::ScopedMutexLock lock(_statsMutex);
+            _stats.clear();
+        }
+
+    protected:
+        virtual ~DuktapeBatchEngine() { }
+
+        /** One thread's Duktape heap; owns the heap, so it is never copied. */
+        struct Context : public osg::Referenced
+        {
+            Context() : _ctx(0L), _features(0L) { }
+
+            ~Context()
+            {
+                if (_ctx)
+                    duk_destroy_heap(_ctx);
+            }
+
+            /** Creates the heap and loads the library and helper functions. */
+            bool initialize(const optional<Script>& library)
+            {
+                _ctx = duk_create_heap_default();
+                if (!_ctx)
+                    return false;
+
+                // stash a pointer back to this context for the native callbacks
+                duk_push_global_stash(_ctx);
+                duk_push_pointer(_ctx, this);
+                duk_put_prop_string(_ctx, -2, "oe_context");
+                duk_pop(_ctx);
+
+                duk_push_global_object(_ctx);
+                GeometryAPI::install(_ctx);
+
+                // prototype for feature objects: "geometry" is converted on first access
+                duk_push_object(_ctx);
+                duk_push_string(_ctx, "geometry");
+                duk_push_c_function(_ctx, getGeometry, 0);
+                duk_def_prop(_ctx, -3, DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_HAVE_ENUMERABLE | DUK_DEFPROP_ENUMERABLE);
+                duk_put_prop_string(_ctx, -2, "oe_duk_feature_proto");
+                duk_pop(_ctx);
+
+                duk_eval_string_noresult(_ctx,
+                    "var feature = null;"
+                    "oe_duk_run_batch = function(fn, features) {"
+                    "    var n = features.length, values = new Array(n), ok = new Array(n);"
+                    "    for (var i = 0; i < n; ++i) {"
+                    "        feature = features[i];"
+                    "        try { values[i] = fn(); ok[i] = true; }"
+                    "        catch (e) { values[i] = String(e); ok[i] = false; }"
+                    "    }"
+                    "    feature = null;"
+                    "    return [values, ok];"
+                    "};");
+
+                if (library.isSet() && !library->getCode().empty())
+                {
+                    if (duk_peval_string(_ctx, library->getCode().c_str()) != 0)
+                    {
+                        OE_WARN << LC << "Script library error: " << duk_safe_to_string(_ctx, -1) << std::endl;
+                    }
+                    duk_pop(_ctx);
+                }
+
+                return true;
+            }
+
+            /**
+             * Pushes the compiled snippet, compiling and caching it on first use.
+             * Snippets beyond "maxCached" are dropped in least recently used
+             * order and their code appended to "evicted".
+             */
+            bool pushFunction(const std::string& code, unsigned maxCached, bool& newlyCompiled, std::vector<std::string>& evicted)
+            {
+                std::string key = "oe_fn:" + code;
+                duk_push_global_stash(_ctx);                            // [stash]
+
+                LRUIndex::iterator i = _lruIndex.find(code);
+                if (i != _lruIndex.end())
+                {
+                    _lru.splice(_lru.begin(), _lru, i->second);
+                    duk_get_prop_string(_ctx, -1, key.c_str());         // [stash, fn]
+                    duk_remove(_ctx, -2);                               // [fn]
+                    return true;
+                }
+
+                duk_push_string(_ctx, "oe_batch_script");
+                if (duk_pcompile_lstring_filename(_ctx, DUK_COMPILE_EVAL, code.c_str(), code.size()) != 0)
+                {
+                    duk_remove(_ctx, -2);                               // [error]
+                    return false;
+                }
+                duk_dup(_ctx, -1);                                      // [stash, fn, fn]
+                duk_put_prop_string(_ctx, -3, key.c_str());             // [stash, fn]
+                _lru.push_front(code);
+                _lruIndex[code] = _lru.begin();
+
+                while (_lru.size() > maxCached)
+                {
+                    const std::string& oldest = _lru.back();
+                    duk_del_prop_string(_ctx, -2, ("oe_fn:" + oldest).c_str());
+                    evicted.push_back(oldest);
+                    _lruIndex.erase(oldest);
+                    _lru.pop_back();
+                }
+
+                duk_remove(_ctx, -2);                                   // [fn]
+                newlyCompiled = true;
+                return true;
+            }
+
+            /** Pushes an array of feature objects. */
+            void pushFeatures(const std::vector<const Feature*>& features)
+            {
+                duk_get_global_string(_ctx, "oe_duk_feature_proto");    // [proto]
+                duk_push_array(_ctx);                                   // [proto, array]
+                for (unsigned i = 0; i < features.size(); ++i)
+                {
+                    const Feature* feature = features[i];
+                    if (!feature)
+                    {
+                        duk_push_null(_ctx);
+                        duk_put_prop_index(_ctx, -2, i);
+                        continue;
+                    }
+
+                    duk_push_object(_ctx);                              // [proto, array, f]
+                    duk_dup(_ctx, -3);
+                    duk_set_prototype(_ctx, -2);
+
+                    duk_push_uint(_ctx, i);
+                    duk_put_prop_string(_ctx, -2, "\xff" "oe_index");
+
+                    duk_push_number(_ctx, (double)feature->getFID());
+                    duk_put_prop_string(_ctx, -2, "id");
+
+                    duk_push_object(_ctx);                              // [proto, array, f, props]
+                    const AttributeTable& attrs = feature->getAttrs();
+                    for (AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+                    {
+                        const AttributeValue& v = a->second;
+                        if (!v.second.set)
+                            duk_push_null(_ctx);
+                        else if (v.first == ATTRTYPE_DOUBLE)
+                            duk_push_number(_ctx, v.second.doubleValue);
+                        else if (v.first == ATTRTYPE_INT)
+                            duk_push_int(_ctx, v.second.intValue);
+                        else if (v.first == ATTRTYPE_BOOL)
+                            duk_push_boolean(_ctx, v.second.boolValue ? 1 : 0);
+                        else
+                            duk_push_lstring(_ctx, v.second.stringValue.c_str(), v.second.stringValue.size());
+                        duk_put_prop_string(_ctx, -2, a->first.c_str());
+                    }
+                    duk_put_prop_string(_ctx, -2, "properties");        // [proto, array, f]
+
+                    duk_put_prop_index(_ctx, -2, i);                    // [proto, array]
+                }
+                duk_remove(_ctx, -2);                                   // [array]
+            }
+
+            /** Getter for feature.geometry: GeoJSON with the geometry API bound, cached on the object. */
+            static duk_ret_t getGeometry(duk_context* ctx)
+            {
+                duk_push_this(ctx);                                     // [this]
+                duk_get_prop_string(ctx, -1, "\xff" "oe_geometry");
+                if (!duk_is_undefined(ctx, -1))
+                    return 1;
+                duk_pop(ctx);
+
+                duk_push_global_stash(ctx);
+                duk_get_prop_string(ctx, -1, "oe_context");
+                Context* c = static_cast<Context*>(duk_get_pointer(ctx, -1));
+                duk_pop_2(ctx);                                         // [this]
+
+                duk_get_prop_string(ctx, -1, "\xff" "oe_index");
+                unsigned index = duk_get_uint(ctx, -1);
+                duk_pop(ctx);
+
+                // only valid while the batch that created the object runs
+                if (!c || !c->_features || index >= c->_features->size() ||
+                    !(*c->_features)[index] || !(*c->_features)[index]->getGeometry())
+                {
+                    duk_push_undefined(ctx);
+                    return 1;
+                }
+
+                std::string json = GeometryUtils::geometryToGeoJSON((*c->_features)[index]->getGeometry());
+                duk_get_global_string(ctx, "oe_duk_bind_geometry_api"); // [this, bind]
+                duk_push_lstring(ctx, json.c_str(), json.size());
+                duk_json_decode(ctx, -1);                               // [this, bind, geom]
+                duk_call(ctx, 1);                                       // [this, geom]
+                duk_dup(ctx, -1);
+                duk_put_prop_string(ctx, -3, "\xff" "oe_geometry");
+                return 1;
+            }
+
+            typedef std::list<std::string> LRUList;
+            typedef std::map<std::string, LRUList::iterator> LRUIndex;
+
+            duk_context*                       _ctx;
+            const std::vector<const Feature*>* _features;   // batch in progress
+            LRUList                            _lru;        // cached snippets, most recently used first
+            LRUIndex                           _lruIndex;
+
+        private:
+            Context(const Context&);
+            Context& operator=(const Context&);
+        };
+
+        PerThread< osg::ref_ptr<Context> > _contexts;
+
+        const ScriptEngineOptions _options;
+        unsigned                  _maxCachedScripts;
+
+        mutable Threading::Mutex _statsMutex;
+        ScriptStatsMap           _stats;
+    };
+
+} } } // namespace osgEarth::Drivers::Duktape
+
+#endif // OSGEARTHDRIVERS_DUKTAPE_BATCH_ENGINE_H
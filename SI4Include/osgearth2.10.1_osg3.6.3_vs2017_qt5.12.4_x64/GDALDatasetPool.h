@@ -0,0 +1,417 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef OSGEARTH_DRIVER_GDAL_DATASET_POOL
+#define OSGEARTH_DRIVER_GDAL_DATASET_POOL 1
+
+#include <osgEarth/Common>
+#include <osgEarth/GeoCommon>
+#include <osgEarth/Registry>
+#include <osgEarth/ThreadingUtils>
+#include <osg/Referenced>
+#include <osg/Timer>
+#include <OpenThreads/Condition>
+#include <OpenThreads/ScopedLock>
+#include <gdal.h>
+#include <string>
+#include <vector>
+
+namespace osgEarth { namespace Drivers
+{
+    using namespace osgEarth;
+
+    /**
+     * Bounded pool of read-only GDAL dataset handles for a single source.
+     *
+     * GDAL datasets are not thread-safe, but separate handles to the same
+     * source are independent. Instead of serializing every read behind
+     * GDAL_SCOPED_LOCK, the pool opens up to getMaxHandles() handles on
+     * demand and hands each one to a single thread at a time; a thread is
+     * given back the handle it used last when that handle is free, which
+     * keeps that handle's block cache warm for the thread's tiles.
+     *
+     * Only driver registration stays under the global GDAL mutex; reads
+     * run in parallel.
+     */
+    class GDALDatasetPool : public osg::Referenced // NO EXPORT; header only
+    {
+    public:
+        /** Read counters, accumulated since construction or resetStats(). */
+        struct Stats
+        {
+            Stats() : _reads(0u), _failedReads(0u), _bytesRead(0u), _waits(0u), _handlesOpened(0u), _readTime(0.0), _elapsedTime(0.0) { }
+
+            unsigned long long _reads;
+            unsigned long long _failedReads;
+            unsigned long long _bytesRead;
+            unsigned long long _waits;         // acquires that had to wait for a free handle
+            unsigned long long _handlesOpened;
+            double             _readTime;      // seconds spent in RasterIO, summed over threads
+            double             _elapsedTime;   // wall-clock seconds
+
+            /** Reads per wall-clock second. */
+            double getThroughput() const { return _elapsedTime > 0.0 ? (double)_reads / _elapsedTime : 0.0; }
+
+            /** Bytes per wall-clock second. */
+            double getBandwidth() const { return _elapsedTime > 0.0 ? (double)_bytesRead / _elapsedTime : 0.0; }
+
+            /** Average number of reads in flight; approaches the thread count when reads do not contend. */
+            double getConcurrency() const { return _elapsedTime > 0.0 ? _readTime / _elapsedTime : 0.0; }
+        };
+
+        /**
+         * Scoped ownership of one pooled handle. The handle is returned to
+         * the pool on destruction.
+         */
+        class Handle
+        {
+        public:
+            Handle(GDALDatasetPool* pool) : _pool(pool), _slot(pool ? pool->acquire() : -1) { }
+            ~Handle() { if (_slot >= 0) _pool->release(_slot); }
+
+            bool valid() const { return _slot >= 0; }
+            GDALDatasetH get() const { return _slot >= 0 ? _pool->_slots[_slot]._dataset : 0L; }
+
+        private:
+            Handle(const Handle&);
+            Handle& operator=(const Handle&);
+
+            GDALDatasetPool* _pool;
+            int              _slot;
+        };
+
+    public:
+        /**
+         * Opens the first handle to "source" and reads the raster metadata.
+         * maxHandles = 0 uses one handle per processor.
+         */
+        GDALDatasetPool(const std::string& source, unsigned maxHandles =0u) :
+            _source(source),
+            _maxHandles(maxHandles > 0u ? maxHandles : (unsigned)osg::maximum(OpenThreads::GetNumberOfProcessors(), 1)),
+            _opening(0u),
+            _waits(0u),
+            _rasterXSize(0),
+            _rasterYSize(0),
+            _rasterCount(0),
+            _dataType(GDT_Unknown),
+            _noDataValue(0.0),
+            _hasNoDataValue(false)
+        {
+            // Handle::get() reads _slots without the pool mutex, so the
+            // vector must never reallocate.
+            _slots.reserve(_maxHandles);
+            for (unsigned i = 0; i < 6; ++i)
+                _geoTransform[i] = 0.0;
+
+            registerDrivers();
+
+            GDALDatasetH dataset = open();
+            if (dataset)
+            {
+                _rasterXSize = GDALGetRasterXSize(dataset);
+                _rasterYSize = GDALGetRasterYSize(dataset);
+                _rasterCount = GDALGetRasterCount(dataset);
+                if (GDALGetGeoTransform(dataset, _geoTransform) != CE_None)
+                {
+                    _geoTransform[1] = 1.0;
+                    _geoTransform[5] = 1.0;
+                }
+
+                const char* projection = GDALGetProjectionRef(dataset);
+                if (projection)
+                    _projection = projection;
+
+                if (_rasterCount > 0)
+                {
+                    GDALRasterBandH band = GDALGetRasterBand(dataset, 1);
+                    int hasNoData = 0;
+                    _dataType = GDALGetRasterDataType(band);
+                    _noDataValue = GDALGetRasterNoDataValue(band, &hasNoData);
+                    _hasNoDataValue = hasNoData != 0;
+                }
+
+                _slots.push_back(Slot(dataset));
+                _stats._handlesOpened = 1u;
+            }
+
+            _statsStart = osg::Timer::instance()->tick();
+        }
+
+        /**
+         * Registers the GDAL drivers. Registration mutates the global driver
+         * manager, so it is the one step done under the GDAL mutex.
+         */
+        static void registerDrivers()
+        {
+            GDAL_SCOPED_LOCK;
+            if (GDALGetDriverCount() == 0)
+                GDALAllRegister();
+        }
+
+        /** Whether the source opened. */
+        bool isOK() const { return !_slots.empty(); }
+
+        const std::string& getSource() const { return _source; }
+
+        /** Upper bound on the number of open handles. */
+        unsigned getMaxHandles() const { return _maxHandles; }
+
+        /** Number of handles opened so far. */
+        unsigned getNumHandles() const
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            return (unsigned)_slots.size();
+        }
+
+        int getRasterXSize() const { return _rasterXSize; }
+        int getRasterYSize() const { return _rasterYSize; }
+        int getRasterCount() const { return _rasterCount; }
+
+        /** GDAL affine geotransform of the source. */
+        const double* getGeoTransform() const { return _geoTransform; }
+
+        /** WKT of the source SRS, or empty. */
+        const std::string& getProjection() const { return _projection; }
+
+        /** Data type and no-data value of band 1. */
+        GDALDataType getDataType() const { return _dataType; }
+        bool hasNoDataValue() const { return _hasNoDataValue; }
+        double getNoDataValue() const { return _noDataValue; }
+
+        /**
+         * Reads a window of the source into "data" through a pooled handle,
+         * resampling to bufXSize x bufYSize. Pixels are interleaved by band
+         * in the order of "bands" (1-based). The resampling method is used
+         * with GDAL 2 and later; older releases always use nearest.
+         */
+        bool read(int xOff, int yOff, int xSize, int ySize,
+                  void* data, int bufXSize, int bufYSize,
+                  GDALDataType bufType, int bandCount, int* bands,
+                  ElevationInterpolation interp =INTERP_NEAREST)
+        {
+            Handle handle(this);
+            if (!handle.valid())
+                return false;
+
+            int pixelSpace = GDALGetDataTypeSize(bufType) / 8 * bandCount;
+            int lineSpace = pixelSpace * bufXSize;
+            int bandSpace = GDALGetDataTypeSize(bufType) / 8;
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+#if GDAL_VERSION_MAJOR >= 2
+            GDALRasterIOExtraArg extra;
+            INIT_RASTERIO_EXTRA_ARG(extra);
+            extra.eResampleAlg = toResampleAlg(interp);
+            CPLErr err = GDALDatasetRasterIOEx(
+                handle.get(), GF_Read, xOff, yOff, xSize, ySize,
+                data, bufXSize, bufYSize, bufType, bandCount, bands,
+                pixelSpace, lineSpace, bandSpace, &extra);
+#else
+            CPLErr err = GDALDatasetRasterIO(
+                handle.get(), GF_Read, xOff, yOff, xSize, ySize,
+                data, bufXSize, bufYSize, bufType, bandCount, bands,
+                pixelSpace, lineSpace, bandSpace);
+#endif
+
+            double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            Threading::ScopedMutexLock lock(_statsMutex);
+            _stats._readTime += seconds;
+            if (err == CE_None)
+            {
+                ++_stats._reads;
+                _stats._bytesRead += (unsigned long long)lineSpace * (unsigned long long)bufYSize;
+            }
+            else
+            {
+                ++_stats._failedReads;
+            }
+            return err == CE_None;
+        }
+
+        /** Snapshot of the read counters. */
+        Stats getStats() const
+        {
+            Stats stats;
+            {
+                Threading::ScopedMutexLock lock(_statsMutex);
+                stats = _stats;
+                stats._elapsedTime = osg::Timer::instance()->delta_s(_statsStart, osg::Timer::instance()->tick());
+            }
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                stats._waits = _waits;
+            }
+            return stats;
+        }
+
+        /** Restarts the read counters and the throughput clock. */
+        void resetStats()
+        {
+            {
+                Threading::ScopedMutexLock lock(_statsMutex);
+                _stats = Stats();
+                _statsStart = osg::Timer::instance()->tick();
+            }
+            Threading::ScopedMutexLock lock(_mutex);
+            _waits = 0u;
+        }
+
+    protected:
+
+        virtual ~GDALDatasetPool()
+        {
+            for (unsigned i = 0; i < _slots.size(); ++i)
+                GDALClose(_slots[i]._dataset);
+        }
+
+        struct Slot
+        {
+            Slot(GDALDatasetH dataset) : _dataset(dataset), _owner(0u), _busy(false) { }
+            GDALDatasetH _dataset;
+            unsigned     _owner;    // thread that used this handle last
+            bool         _busy;
+        };
+
+        /**
+         * Takes a free handle, preferring the calling thread's previous
+         * one. Opens a new handle while below the bound, otherwise waits.
+         * Returns the slot index, or -1 if no handle could be opened.
+         */
+        int acquire()
+        {
+            unsigned me = Threading::getCurrentThreadId();
+            bool waited = false;
+
+            Threading::ScopedMutexLock lock(_mutex);
+            for (;;)
+            {
+                int free = -1;
+                for (unsigned i = 0; i < _slots.size(); ++i)
+                {
+                    if (_slots[i]._busy)
+                        continue;
+                    if (_slots[i]._owner == me)
+                    {
+                        free = (int)i;
+                        break;
+                    }
+                    if (free < 0)
+                        free = (int)i;
+                }
+
+                if (free >= 0)
+                {
+                    _slots[free]._busy = true;
+                    _slots[free]._owner = me;
+                    return free;
+                }
+
+                if (_slots.size() + _opening < _maxHandles)
+                {
+                    // Open outside the pool mutex so other threads can keep
+                    // trading handles while this one touches the disk.
+                    GDALDatasetH dataset;
+                    ++_opening;
+                    {
+                        OpenThreads::ReverseScopedLock<Threading::Mutex> unlock(_mutex);
+                        dataset = open();
+                    }
+                    --_opening;
+
+                    if (dataset)
+                    {
+                        _slots.push_back(Slot(dataset));
+                        _slots.back()._busy = true;
+                        _slots.back()._owner = me;
+                        {
+                            Threading::ScopedMutexLock statsLock(_statsMutex);
+                            ++_stats._handlesOpened;
+                        }
+                        return (int)_slots.size() - 1;
+                    }
+
+                    // The source will not open again (e.g. out of file
+                    // handles); stop growing and share what we have.
+                    _maxHandles = (unsigned)_slots.size();
+                    if (_slots.empty())
+                        return -1;
+                    continue;
+                }
+
+                if (!waited)
+                {
+                    ++_waits;
+                    waited = true;
+                }
+                _available.wait(&_mutex);
+            }
+        }
+
+        void release(int slot)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _slots[slot]._busy = false;
+            _available.signal();
+        }
+
+        GDALDatasetH open() const
+        {
+            return GDALOpen(_source.c_str(), GA_ReadOnly);
+        }
+
+#if GDAL_VERSION_MAJOR >= 2
+        static GDALRIOResampleAlg toResampleAlg(ElevationInterpolation interp)
+        {
+            switch (interp)
+            {
+            case INTERP_NEAREST:     return GRIORA_NearestNeighbour;
+            case INTERP_AVERAGE:     return GRIORA_Average;
+            case INTERP_CUBIC:       return GRIORA_Cubic;
+            case INTERP_CUBICSPLINE: return GRIORA_CubicSpline;
+            default:                 return GRIORA_Bilinear;
+            }
+        }
+#endif
+
+        std::string                _source;
+        std::vector<Slot>          _slots;
+        unsigned                   _maxHandles;
+        unsigned                   _opening;
+        unsigned long long         _waits;
+        mutable Threading::Mutex   _mutex;
+        OpenThreads::Condition     _available;
+
+        int                        _rasterXSize;
+        int                        _rasterYSize;
+        int                        _rasterCount;
+        double                     _geoTransform[6];
+        std::string                _projection;
+        GDALDataType               _dataType;
+        double                     _noDataValue;
+        bool                       _hasNoDataValue;
+
+        mutable Threading::Mutex   _statsMutex;
+        Stats                      _stats;
+        osg::Timer_t               _statsStart;
+    };
+
+} } // namespace osgEarth::Drivers
+
+#endif // OSGEARTH_DRIVER_GDAL_DATASET_POOL
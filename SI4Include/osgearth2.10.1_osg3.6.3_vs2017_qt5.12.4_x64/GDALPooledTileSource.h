@@ -0,0 +1,328 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef OSGEARTH_DRIVER_GDAL_POOLED_TILE_SOURCE
+#define OSGEARTH_DRIVER_GDAL_POOLED_TILE_SOURCE 1
+
+#include <osgEarthDrivers/gdal/GDALOptions>
+#include <osgEarthDrivers/gdal/GDALDatasetPool>
+#include <osgEarth/TileSource>
+#include <osgEarth/TileKey>
+#include <osgEarth/Profile>
+#include <osgEarth/SpatialReference>
+#include <osgEarth/Progress>
+#include <osgEarth/Notify>
+#include <osg/Image>
+#include <osg/Shape>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace osgEarth { namespace Drivers
+{
+    using namespace osgEarth;
+
+    /**
+     * Read-only TileSource for a single GDAL raster that reads tiles
+     * through a GDALDatasetPool, so concurrent tile requests proceed in
+     * parallel instead of queueing on the global GDAL mutex.
+     *
+     * Tiles are produced in the native SRS and extent of the raster; the
+     * layer reprojects them when the map profile differs. Rotated rasters,
+     * sub-datasets, external datasets and warp profiles are not supported;
+     * use the "gdal" driver for those. Imagery is expanded from 1 (gray),
+     * 2 (gray/alpha), 3 (RGB) or 4 (RGBA) bands to RGBA; elevation comes
+     * from band 1.
+     */
+    class GDALPooledTileSource : public TileSource // NO EXPORT; header only
+    {
+    public:
+        /** maxHandles = 0 uses one handle per processor. */
+        GDALPooledTileSource(const GDALOptions& options =GDALOptions(), unsigned maxHandles =0u) :
+            TileSource(options),
+            _options(options),
+            _maxHandles(maxHandles)
+        {
+            for (unsigned i = 0; i < 6; ++i)
+                _geoTransform[i] = 0.0;
+        }
+
+        /** Pool serving this source, once initialized; exposes read statistics. */
+        GDALDatasetPool* getPool() const { return _pool.get(); }
+
+        virtual const char* className() const { return "GDALPooledTileSource"; }
+
+    protected:
+
+        virtual ~GDALPooledTileSource() { }
+
+        virtual Status initialize(const osgDB::Options* readOptions)
+        {
+            if (!_options.url().isSet() || _options.url()->empty())
+                return Status::Error(Status::ConfigurationError, "Missing required url");
+
+            if (_options.externalDataset().valid() || _options.subDataSet().isSet() ||
+                _options.warpProfile().isSet() || _options.connection().isSet())
+            {
+                return Status::Error(Status::ConfigurationError,
+                    "External datasets, sub-datasets, connections and warp profiles require the gdal driver");
+            }
+
+            _pool = new GDALDatasetPool(_options.url()->full(), _maxHandles);
+            if (!_pool->isOK())
+                return Status::Error(Status::ResourceUnavailable, "Failed to open " + _options.url()->full());
+
+            if (_pool->getRasterCount() < 1)
+                return Status::Error(Status::ResourceUnavailable, "No raster bands in " + _options.url()->full());
+
+            const double* gt = _pool->getGeoTransform();
+            for (unsigned i = 0; i < 6; ++i)
+                _geoTransform[i] = gt[i];
+
+            if (_geoTransform[2] != 0.0 || _geoTransform[4] != 0.0)
+                return Status::Error(Status::ResourceUnavailable, "Rotated rasters require the gdal driver");
+
+            // SRS creation goes through OGR's global state.
+            {
+                GDAL_SCOPED_LOCK;
+                _srs = SpatialReference::create(_pool->getProjection());
+            }
+            if (!_srs.valid())
+                return Status::Error(Status::ResourceUnavailable, "Unrecognized SRS in " + _options.url()->full());
+
+            double x0 = _geoTransform[0];
+            double x1 = _geoTransform[0] + _geoTransform[1] * (double)_pool->getRasterXSize();
+            double y0 = _geoTransform[3];
+            double y1 = _geoTransform[3] + _geoTransform[5] * (double)_pool->getRasterYSize();
+
+            _extent = GeoExtent(_srs.get(), osg::minimum(x0, x1), osg::minimum(y0, y1), osg::maximum(x0, x1), osg::maximum(y0, y1));
+
+            if (!getProfile())
+            {
+                const Profile* profile = Profile::create(_srs.get(), _extent.xMin(), _extent.yMin(), _extent.xMax(), _extent.yMax());
+                if (!profile)
+                    return Status::Error(Status::ResourceUnavailable, "Cannot create a profile for " + _options.url()->full());
+                setProfile(profile);
+            }
+
+            getDataExtents().push_back(DataExtent(_extent.transform(getProfile()->getSRS())));
+
+            OE_INFO << "[GDALPooledTileSource] " << _options.url()->full() << ": "
+                << _pool->getRasterXSize() << "x" << _pool->getRasterYSize()
+                << ", up to " << _pool->getMaxHandles() << " handles" << std::endl;
+
+            return STATUS_OK;
+        }
+
+        virtual osg::Image* createImage(const TileKey& key, ProgressCallback* progress)
+        {
+            if (!_pool.valid() || (progress && progress->isCanceled()))
+                return 0L;
+
+            GeoExtent extent = key.getExtent().transform(_srs.get());
+            if (!extent.isValid() || !extent.intersects(_extent))
+                return 0L;
+
+            int size = getPixelsPerTile();
+
+            // Source window in fractional pixels, and the part of the tile it fills.
+            double px0 = (extent.xMin() - _geoTransform[0]) / _geoTransform[1];
+            double px1 = (extent.xMax() - _geoTransform[0]) / _geoTransform[1];
+            double py0 = (extent.yMax() - _geoTransform[3]) / _geoTransform[5];
+            double py1 = (extent.yMin() - _geoTransform[3]) / _geoTransform[5];
+            if (px1 < px0) std::swap(px0, px1);
+            if (py1 < py0) std::swap(py0, py1);
+
+            int sx0, sx1, sy0, sy1, dx0, dx1, dy0, dy1;
+            if (!clip(px0, px1, _pool->getRasterXSize(), size, sx0, sx1, dx0, dx1) ||
+                !clip(py0, py1, _pool->getRasterYSize(), size, sy0, sy1, dy0, dy1))
+            {
+                return 0L;
+            }
+
+            int bands[4] = { 1, 2, 3, 4 };
+            int bandCount = osg::minimum(_pool->getRasterCount(), 4);
+            int bw = dx1 - dx0, bh = dy1 - dy0;
+
+            std::vector<unsigned char> buffer(bw * bh * bandCount);
+            if (!_pool->read(sx0, sy0, sx1 - sx0, sy1 - sy0, &buffer[0], bw, bh, GDT_Byte, bandCount, bands, _options.interpolation().get()))
+                return 0L;
+
+            bool noData = _pool->hasNoDataValue() && bandCount == 1;
+            unsigned char noDataValue = (unsigned char)_pool->getNoDataValue();
+
+            osg::ref_ptr<osg::Image> image = new osg::Image();
+            image->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+            memset(image->data(), 0, image->getTotalSizeInBytes());
+
+            for (int r = 0; r < bh; ++r)
+            {
+                // GDAL rows run north to south, osg::Image rows south to north.
+                const unsigned char* src = &buffer[r * bw * bandCount];
+                unsigned char* dst = image->data(dx0, size - 1 - (dy0 + r));
+                for (int c = 0; c < bw; ++c, src += bandCount, dst += 4)
+                {
+                    switch (bandCount)
+                    {
+                    case 1:
+                        dst[0] = dst[1] = dst[2] = src[0];
+                        dst[3] = noData && src[0] == noDataValue ? 0 : 255;
+                        break;
+                    case 2:
+                        dst[0] = dst[1] = dst[2] = src[0];
+                        dst[3] = src[1];
+                        break;
+                    case 3:
+                        dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+                        dst[3] = 255;
+                        break;
+                    default:
+                        dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+                        dst[3] = src[3];
+                        break;
+                    }
+                }
+            }
+
+            return image.release();
+        }
+
+        virtual osg::HeightField* createHeightField(const TileKey& key, ProgressCallback* progress)
+        {
+            if (!_pool.valid() || (progress && progress->isCanceled()))
+                return 0L;
+
+            GeoExtent extent = key.getExtent().transform(_srs.get());
+            if (!extent.isValid() || !extent.intersects(_extent))
+                return 0L;
+
+            int size = osg::maximum(getPixelsPerTile(), 2);
+            int width = _pool->getRasterXSize();
+            int height = _pool->getRasterYSize();
+
+            // Heightfield posts sit on the tile edges; in source pixel
+            // coordinates (pixel centers at integers) they span [u0,u1]x[v0,v1].
+            double u0 = (extent.xMin() - _geoTransform[0]) / _geoTransform[1] - 0.5;
+            double u1 = (extent.xMax() - _geoTransform[0]) / _geoTransform[1] - 0.5;
+            double v0 = (extent.yMin() - _geoTransform[3]) / _geoTransform[5] - 0.5;
+            double v1 = (extent.yMax() - _geoTransform[3]) / _geoTransform[5] - 0.5;
+
+            int ix0 = osg::clampBetween((int)floor(osg::minimum(u0, u1)), 0, width - 1);
+            int ix1 = osg::clampBetween((int)ceil(osg::maximum(u0, u1)), 0, width - 1);
+            int iy0 = osg::clampBetween((int)floor(osg::minimum(v0, v1)), 0, height - 1);
+            int iy1 = osg::clampBetween((int)ceil(osg::maximum(v0, v1)), 0, height - 1);
+
+            // Read the covering window, decimated to at most twice the tile
+            // resolution so low LODs come from the source overviews.
+            int nw = ix1 - ix0 + 1, nh = iy1 - iy0 + 1;
+            int bw = osg::minimum(nw, 2 * size), bh = osg::minimum(nh, 2 * size);
+            double sx = (double)nw / (double)bw, sy = (double)nh / (double)bh;
+
+            std::vector<float> buffer(bw * bh);
+            int band = 1;
+            if (!_pool->read(ix0, iy0, nw, nh, &buffer[0], bw, bh, GDT_Float32, 1, &band, _options.interpolation().get()))
+                return 0L;
+
+            osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+            hf->allocate(size, size);
+
+            for (int r = 0; r < size; ++r)
+            {
+                double v = v0 + (v1 - v0) * (double)r / (double)(size - 1);
+                for (int c = 0; c < size; ++c)
+                {
+                    double u = u0 + (u1 - u0) * (double)c / (double)(size - 1);
+                    float h = NO_DATA_VALUE;
+                    if (u >= -0.5 && u <= (double)width - 0.5 && v >= -0.5 && v <= (double)height - 0.5)
+                    {
+                        // buffer pixel b is centered on source pixel ix0 + (b + 0.5) * sx - 0.5
+                        h = sample(buffer, bw, bh, (u - ix0 + 0.5) / sx - 0.5, (v - iy0 + 0.5) / sy - 0.5);
+                    }
+                    hf->setHeight(c, r, h);
+                }
+            }
+
+            return hf.release();
+        }
+
+        /**
+         * Clips the fractional source span [p0,p1], which maps onto "size"
+         * tile pixels, to the raster [0,rasterSize). Outputs the integer
+         * source window and the tile pixels it covers.
+         */
+        static bool clip(double p0, double p1, int rasterSize, int size, int& s0, int& s1, int& d0, int& d1)
+        {
+            double scale = (double)size / (p1 - p0);
+            d0 = osg::clampBetween((int)floor((osg::maximum(p0, 0.0) - p0) * scale + 0.5), 0, size);
+            d1 = osg::clampBetween((int)floor((osg::minimum(p1, (double)rasterSize) - p0) * scale + 0.5), 0, size);
+            if (d1 <= d0)
+                return false;
+
+            s0 = osg::clampBetween((int)floor(p0 + d0 / scale + 0.5), 0, rasterSize - 1);
+            s1 = osg::clampBetween((int)floor(p0 + d1 / scale + 0.5), s0 + 1, rasterSize);
+            return true;
+        }
+
+        /** Bilinear sample of the read buffer, skipping no-data neighbors. */
+        float sample(const std::vector<float>& buffer, int bw, int bh, double x, double y) const
+        {
+            x = osg::clampBetween(x, 0.0, (double)(bw - 1));
+            y = osg::clampBetween(y, 0.0, (double)(bh - 1));
+            int x0 = (int)x, y0 = (int)y;
+            int x1 = osg::minimum(x0 + 1, bw - 1), y1 = osg::minimum(y0 + 1, bh - 1);
+            double fx = x - x0, fy = y - y0;
+
+            const int xs[4] = { x0, x1, x0, x1 };
+            const int ys[4] = { y0, y0, y1, y1 };
+            const double ws[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+
+            double sum = 0.0, weight = 0.0;
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                float h = buffer[ys[i] * bw + xs[i]];
+                if (isValidHeight(h))
+                {
+                    sum += ws[i] * h;
+                    weight += ws[i];
+                }
+            }
+            return weight > 0.0 ? (float)(sum / weight) : NO_DATA_VALUE;
+        }
+
+        bool isValidHeight(float h) const
+        {
+            if (h != h)
+                return false;
+            if (_pool->hasNoDataValue() && h == (float)_pool->getNoDataValue())
+                return false;
+            return true;
+        }
+
+    private:
+        const GDALOptions                   _options;
+        unsigned                            _maxHandles;
+        osg::ref_ptr<GDALDatasetPool>       _pool;
+        osg::ref_ptr<const SpatialReference> _srs;
+        GeoExtent                           _extent;
+        double                              _geoTransform[6];
+    };
+
+} } // namespace osgEarth::Drivers
+
+#endif // OSGEARTH_DRIVER_GDAL_POOLED_TILE_SOURCE
@@ -0,0 +1,754 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2019 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#ifndef OSGEARTH_HASHED_STATE_SET_CACHE_H
+#define OSGEARTH_HASHED_STATE_SET_CACHE_H 1
+
+#include <osgEarth/Common>
+#include <osgEarth/ThreadingUtils>
+#include <osg/StateSet>
+#include <osg/NodeVisitor>
+#include <osg/Node>
+#include <osg/Material>
+#include <osg/BlendFunc>
+#include <osg/Depth>
+#include <osg/LineWidth>
+#include <osg/PolygonOffset>
+#include <osg/CullFace>
+#include <osg/Point>
+#include <osg/Program>
+#include <osg/Texture>
+#include <osg/Timer>
+#include <cstring>
+#include <set>
+#include <vector>
+
+namespace osgEarth
+{
+    /**
+     * Structural fingerprints of StateSets and StateAttributes.
+     *
+     * Two objects that compare() equal always have the same fingerprint,
+     * so a fingerprint mismatch proves inequality without a deep compare.
+     * The converse does not hold; equal fingerprints still need compare().
+     */
+    struct StateFingerprint // header-only; no export
+    {
+        typedef unsigned long long Hash;
+
+        /** Fingerprint of an attribute: its class and slot, plus content for common types. */
+        static Hash of(const osg::StateAttribute* attr)
+        {
+            Hash h = seed();
+            if (!attr)
+                return h;
+
+            h = mix(h, std::string(attr->className()));
+            h = mix(h, (Hash)attr->getType());
+            h = mix(h, (Hash)attr->getMember());
+
+            if (const osg::Material* m = dynamic_cast<const osg::Material*>(attr))
+            {
+                h = mix(h, (Hash)m->getColorMode());
+                h = mix(h, m->getAmbient(osg::Material::FRONT));
+                h = mix(h, m->getDiffuse(osg::Material::FRONT));
+                h = mix(h, m->getSpecular(osg::Material::FRONT));
+                h = mix(h, m->getEmission(osg::Material::FRONT));
+                h = mix(h, m->getShininess(osg::Material::FRONT));
+            }
+            else if (const osg::BlendFunc* b = dynamic_cast<const osg::BlendFunc*>(attr))
+            {
+                h = mix(h, (Hash)b->getSource());
+                h = mix(h, (Hash)b->getDestination());
+                h = mix(h, (Hash)b->getSourceAlpha());
+                h = mix(h, (Hash)b->getDestinationAlpha());
+            }
+            else if (const osg::Depth* d = dynamic_cast<const osg::Depth*>(attr))
+            {
+                h = mix(h, (Hash)d->getFunction());
+                h = mix(h, (Hash)d->getWriteMask());
+                h = mix(h, d->getZNear());
+                h = mix(h, d->getZFar());
+            }
+            else if (const osg::LineWidth* w = dynamic_cast<const osg::LineWidth*>(attr))
+            {
+                h = mix(h, w->getWidth());
+            }
+            else if (const osg::PolygonOffset* p = dynamic_cast<const osg::PolygonOffset*>(attr))
+            {
+                h = mix(h, p->getFactor());
+                h = mix(h, p->getUnits());
+            }
+            else if (const osg::CullFace* c = dynamic_cast<const osg::CullFace*>(attr))
+            {
+                h = mix(h, (Hash)c->getMode());
+            }
+            else if (const osg::Point* pt = dynamic_cast<const osg::Point*>(attr))
+            {
+                h = mix(h, pt->getSize());
+            }
+            else if (const osg::Program* prog = dynamic_cast<const osg::Program*>(attr))
+            {
+                h = mix(h, (Hash)prog->getNumShaders());
+                for (unsigned i = 0; i < prog->getNumShaders(); ++i)
+                {
+                    const osg::Shader* shader = prog->getShader(i);
+                    if (shader)
+                    {
+                        h = mix(h, (Hash)shader->getType());
+                        h = mix(h, shader->getShaderSource());
+                    }
+                }
+            }
+            else if (const osg::Texture* t = dynamic_cast<const osg::Texture*>(attr))
+            {
+                h = mix(h, (Hash)t->getTextureTarget());
+                h = mix(h, (Hash)t->getWrap(osg::Texture::WRAP_S));
+                h = mix(h, (Hash)t->getWrap(osg::Texture::WRAP_T));
+                h = mix(h, (Hash)t->getWrap(osg::Texture::WRAP_R));
+                h = mix(h, (Hash)t->getFilter(osg::Texture::MIN_FILTER));
+                h = mix(h, (Hash)t->getFilter(osg::Texture::MAG_FILTER));
+                for (unsigned i = 0; i < t->getNumImages(); ++i)
+                {
+                    const osg::Image* image = t->getImage(i);
+                    if (image)
+                    {
+                        h = mix(h, (Hash)image->s());
+                        h = mix(h, (Hash)image->t());
+                        h = mix(h, (Hash)image->r());
+                        h = mix(h, (Hash)image->getPixelFormat());
+                        h = mix(h, (Hash)image->getDataType());
+                    }
+                }
+            }
+            return h;
+        }
+
+        /** Fingerprint of a uniform's name, type and values. */
+        static Hash of(const osg::Uniform* uniform)
+        {
+            Hash h = seed();
+            if (!uniform)
+                return h;
+
+            h = mix(h, uniform->getName());
+            h = mix(h, (Hash)uniform->getType());
+            h = mix(h, (Hash)uniform->getNumElements());
+            h = mix(h, uniform->getFloatArray());
+            h = mix(h, uniform->getDoubleArray());
+            h = mix(h, uniform->getIntArray());
+            h = mix(h, uniform->getUIntArray());
+            h = mix(h, uniform->getUInt64Array());
+            h = mix(h, uniform->getInt64Array());
+            return h;
+        }
+
+        /** Fingerprint of a state set, from the same parts StateSet::compare() examines. */
+        static Hash of(const osg::StateSet* ss)
+        {
+            Hash h = seed();
+            if (!ss)
+                return h;
+
+            h = mix(h, ss->getAttributeList());
+            h = mix(h, ss->getModeList());
+
+            const osg::StateSet::TextureAttributeList& tal = ss->getTextureAttributeList();
+            h = mix(h, (Hash)tal.size());
+            for (unsigned i = 0; i < tal.size(); ++i)
+                h = mix(h, tal[i]);
+
+            const osg::StateSet::TextureModeList& tml = ss->getTextureModeList();
+            h = mix(h, (Hash)tml.size());
+            for (unsigned i = 0; i < tml.size(); ++i)
+                h = mix(h, tml[i]);
+
+            const osg::StateSet::UniformList& ul = ss->getUniformList();
+            h = mix(h, (Hash)ul.size());
+            for (osg::StateSet::UniformList::const_iterator i = ul.begin(); i != ul.end(); ++i)
+            {
+                h = mix(h, of(i->second.first.get()));
+                h = mix(h, (Hash)i->second.second);
+            }
+
+            h = mix(h, (Hash)ss->getRenderBinMode());
+            h = mix(h, (Hash)(ss->getBinNumber() + 0x8000));
+            h = mix(h, ss->getBinName());
+            return h;
+        }
+
+    protected:
+        static Hash seed() { return 14695981039346656037ULL; }
+
+        static Hash mix(Hash h, Hash v)
+        {
+            // FNV-1a over the 8 bytes of v
+            for (unsigned i = 0; i < 8; ++i, v >>= 8)
+                h = (h ^ (v & 0xff)) * 1099511628211ULL;
+            return h;
+        }
+
+        static Hash mix(Hash h, const std::string& s)
+        {
+            h = mix(h, (Hash)s.size());
+            for (std::string::size_type i = 0; i < s.size(); ++i)
+                h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+            return h;
+        }
+
+        static Hash mix(Hash h, float f)
+        {
+            // +0 and -0 compare equal, so they must hash equal
+            if (f == 0.0f) f = 0.0f;
+            unsigned bits;
+            memcpy(&bits, &f, sizeof(bits));
+            return mix(h, (Hash)bits);
+        }
+
+        static Hash mix(Hash h, double d)
+        {
+            if (d == 0.0) d = 0.0;
+            Hash bits;
+            memcpy(&bits, &d, sizeof(bits));
+            return mix(h, bits);
+        }
+
+        static Hash mix(Hash h, const osg::Vec4& v)
+        {
+            for (unsigned i = 0; i < 4; ++i)
+                h = mix(h, v[i]);
+            return h;
+        }
+
+        static Hash mix(Hash h, const osg::Array* array)
+        {
+            if (!array)
+                return mix(h, (Hash)0);
+
+            const unsigned char* data = static_cast<const unsigned char*>(array->getDataPointer());
+            unsigned size = array->getTotalDataSize();
+            h = mix(h, (Hash)size);
+            for (unsigned i = 0; i < size; ++i)
+                h = (h ^ data[i]) * 1099511628211ULL;
+            return h;
+        }
+
+        static Hash mix(Hash h, const osg::StateSet::AttributeList& list)
+        {
+            h = mix(h, (Hash)list.size());
+            for (osg::StateSet::AttributeList::const_iterator i = list.begin(); i != list.end(); ++i)
+            {
+                h = mix(h, of(i->second.first.get()));
+                h = mix(h, (Hash)i->second.second);
+            }
+            return h;
+        }
+
+        static Hash mix(Hash h, const osg::StateSet::ModeList& list)
+        {
+            h = mix(h, (Hash)list.size());
+            for (osg::StateSet::ModeList::const_iterator i = list.begin(); i != list.end(); ++i)
+            {
+                h = mix(h, (Hash)i->first);
+                h = mix(h, (Hash)i->second);
+            }
+            return h;
+        }
+    };
+
+    /**
+     * StateSetCache replacement that finds duplicates by fingerprint.
+     *
+     * StateSetCache keeps its entries in ordered sets, so every probe costs
+     * O(log n) deep compare() calls under a single mutex. This cache
+     * fingerprints the probe once (see StateFingerprint), looks it up in
+     * one of several independently locked hash tables chosen by the
+     * fingerprint, and calls compare() only against entries with the same
+     * fingerprint. Fingerprints of cached entries are computed when they
+     * are inserted; if a cached entry is modified afterwards, its stale
+     * fingerprint can only cause a missed share, and it is re-filed under
+     * its new fingerprint the next time a probe collides with it.
+     *
+     * Sharing rules and the not-for-live-graphs caveat are the same as
+     * for StateSetCache.
+     */
+    class HashedStateSetCache : public osg::Referenced // header-only; no export
+    {
+    public:
+        typedef StateFingerprint::Hash Hash;
+
+        /** Sharing statistics; the probe cost counts compare() calls and time. */
+        struct Stats
+        {
+            Stats() : _probes(0u), _ineligible(0u), _hits(0u), _misses(0u), _compares(0u), _refiled(0u), _probeTime(0.0) { }
+
+            unsigned long long _probes;
+            unsigned long long _ineligible;
+            unsigned long long _hits;
+            unsigned long long _misses;
+            unsigned long long _compares;
+            unsigned long long _refiled;     // entries re-filed after being modified in the cache
+            double             _probeTime;   // seconds, summed over threads
+
+            /** Fraction of eligible probes answered with an existing object. */
+            double getDedupRatio() const { return _hits + _misses > 0u ? (double)_hits / (double)(_hits + _misses) : 0.0; }
+
+            /** Average compare() calls per eligible probe. */
+            double getComparesPerProbe() const { return _hits + _misses > 0u ? (double)_compares / (double)(_hits + _misses) : 0.0; }
+
+            /** Average microseconds per probe. */
+            double getMicrosecondsPerProbe() const { return _probes > 0u ? 1e6 * _probeTime / (double)_probes : 0.0; }
+        };
+
+    public:
+        HashedStateSetCache(unsigned maxSize =0u) :
+            _stateSets(maxSize),
+            _attributes(maxSize)
+        {
+            //nop
+        }
+
+        /** Caps the number of entries in each of the state set and attribute tables; 0 = no cap. */
+        void setMaxSize(unsigned maxSize)
+        {
+            _stateSets.setMaxSize(maxSize);
+            _attributes.setMaxSize(maxSize);
+        }
+
+        /** Check whether a StateSet is eligible for sharing. */
+        bool eligible(const osg::StateSet* stateSet) const
+        {
+            if (!stateSet || stateSet->getDataVariance() == osg::Object::DYNAMIC)
+                return false;
+            if (stateSet->getUpdateCallback() || stateSet->getEventCallback())
+                return false;
+
+            const osg::StateSet::UniformList& ul = stateSet->getUniformList();
+            for (osg::StateSet::UniformList::const_iterator i = ul.begin(); i != ul.end(); ++i)
+            {
+                const osg::Uniform* u = i->second.first.get();
+                if (u && (u->getDataVariance() == osg::Object::DYNAMIC || u->getUpdateCallback() || u->getEventCallback()))
+                    return false;
+            }
+            return true;
+        }
+
+        /** Check whether a StateAttribute is eligible for sharing. */
+        bool eligible(const osg::StateAttribute* attr) const
+        {
+            if (!attr || attr->getDataVariance() == osg::Object::DYNAMIC)
+                return false;
+            if (attr->getUpdateCallback() || attr->getEventCallback())
+                return false;
+            return true;
+        }
+
+        /**
+         * Looks in the cache for a stateset matching the input. If found,
+         * returns the cached one in output. If not found, stores the input
+         * in the cache and returns the same one in output. Returns true
+         * if the input was eligible.
+         */
+        bool share(
+            osg::ref_ptr<osg::StateSet>& input,
+            osg::ref_ptr<osg::StateSet>& output,
+            bool                         checkEligible =true)
+        {
+            if (checkEligible && !eligible(input.get()))
+            {
+                _stateSets.countIneligible();
+                output = input;
+                return false;
+            }
+            output = _stateSets.share(input.get());
+            return true;
+        }
+
+        /** Same as above for a state attribute. */
+        bool share(
+            osg::ref_ptr<osg::StateAttribute>& input,
+            osg::ref_ptr<osg::StateAttribute>& output,
+            bool                               checkEligible =true)
+        {
+            if (checkEligible && !eligible(input.get()))
+            {
+                _attributes.countIneligible();
+                output = input;
+                return false;
+            }
+            output = _attributes.share(input.get());
+            return true;
+        }
+
+        /** Combines equivalent state attributes in a graph into shared instances. */
+        void consolidateStateAttributes(osg::Node* node)
+        {
+            if (!node)
+                return;
+            ShareAttributes visitor(this);
+            node->accept(visitor);
+        }
+
+        /** Combines equivalent state sets in a graph into shared instances. */
+        void consolidateStateSets(osg::Node* node)
+        {
+            if (!node)
+                return;
+            ShareStateSets visitor(this);
+            node->accept(visitor);
+        }
+
+        /** Calls consolidateStateAttributes followed by consolidateStateSets. */
+        void optimize(osg::Node* node)
+        {
+            consolidateStateAttributes(node);
+            consolidateStateSets(node);
+        }
+
+        /** Number of statesets in the cache. */
+        unsigned size() const { return _stateSets.size(); }
+
+        /** Number of attributes in the cache. */
+        unsigned getNumAttributes() const { return _attributes.size(); }
+
+        /** Clears out the cache. */
+        void clear()
+        {
+            _stateSets.clear();
+            _attributes.clear();
+        }
+
+        Stats getStateSetStats() const { return _stateSets.getStats(); }
+        Stats getAttributeStats() const { return _attributes.getStats(); }
+
+        void resetStats()
+        {
+            _stateSets.resetStats();
+            _attributes.resetStats();
+        }
+
+        void releaseGLObjects(osg::State* state) const
+        {
+            _stateSets.releaseGLObjects(state);
+            _attributes.releaseGLObjects(state);
+        }
+
+    protected:
+
+        virtual ~HashedStateSetCache() { }
+
+        /**
+         * Fingerprint-keyed table split into independently locked shards.
+         * T is osg::StateSet or osg::StateAttribute.
+         */
+        template<typename T>
+        class Table
+        {
+        public:
+            enum { NUM_SHARDS = 16 };
+
+            Table(unsigned maxSize) : _maxSize(maxSize) { }
+
+            void setMaxSize(unsigned maxSize) { _maxSize = maxSize; }
+
+            T* share(T* input)
+            {
+                osg::Timer_t start = osg::Timer::instance()->tick();
+
+                Hash hash = StateFingerprint::of(input);
+                Shard& shard = _shards[hash % NUM_SHARDS];
+                Threading::ScopedMutexLock lock(shard._mutex);
+
+                Bucket& bucket = shard.bucket(hash);
+                T* result = 0L;
+                std::vector<Entry> modified;
+                for (unsigned i = 0; i < bucket.size() && !result; )
+                {
+                    Entry& e = bucket[i];
+                    if (e._hash != hash)
+                    {
+                        ++i;
+                        continue;
+                    }
+
+                    ++shard._stats._compares;
+                    if (e._object.get() == input || compare(*e._object.get(), *input) == 0)
+                    {
+                        result = e._object.get();
+                        continue;
+                    }
+
+                    Hash current = StateFingerprint::of(e._object.get());
+                    if (current != hash)
+                    {
+                        // modified since it was cached; take it out of this bucket
+                        modified.push_back(Entry(current, e._object.get()));
+                        bucket.erase(bucket.begin() + i);
+                        --shard._count;
+                        ++shard._stats._refiled;
+                    }
+                    else ++i;
+                }
+
+                // Re-file modified entries under their current fingerprint.
+                // One that now belongs to another shard is dropped, since
+                // taking a second shard lock could deadlock against a probe
+                // doing the reverse; a later probe re-inserts an equivalent.
+                for (unsigned i = 0; i < modified.size(); ++i)
+                {
+                    if (&_shards[modified[i]._hash % NUM_SHARDS] == &shard)
+                        shard.insert(modified[i]);
+                }
+
+                if (result)
+                {
+                    ++shard._stats._hits;
+                }
+                else
+                {
+                    ++shard._stats._misses;
+                    shard.insert(Entry(hash, input));
+                    if (_maxSize > 0u && shard._count * NUM_SHARDS > _maxSize)
+                        shard.prune();
+                    result = input;
+                }
+
+                ++shard._stats._probes;
+                shard._stats._probeTime += osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+                return result;
+            }
+
+            void countIneligible()
+            {
+                // not tied to a fingerprint; count it against the first shard
+                Threading::ScopedMutexLock lock(_shards[0]._mutex);
+                ++_shards[0]._stats._probes;
+                ++_shards[0]._stats._ineligible;
+            }
+
+            unsigned size() const
+            {
+                unsigned total = 0u;
+                for (unsigned s = 0; s < NUM_SHARDS; ++s)
+                {
+                    Threading::ScopedMutexLock lock(_shards[s]._mutex);
+                    total += _shards[s]._count;
+                }
+                return total;
+            }
+
+            void clear()
+            {
+                for (unsigned s = 0; s < NUM_SHARDS; ++s)
+                {
+                    Threading::ScopedMutexLock lock(_shards[s]._mutex);
+                    _shards[s]._buckets.clear();
+                    _shards[s]._count = 0u;
+                }
+            }
+
+            Stats getStats() const
+            {
+                Stats total;
+                for (unsigned s = 0; s < NUM_SHARDS; ++s)
+                {
+                    Threading::ScopedMutexLock lock(_shards[s]._mutex);
+                    const Stats& st = _shards[s]._stats;
+                    total._probes     += st._probes;
+                    total._ineligible += st._ineligible;
+                    total._hits       += st._hits;
+                    total._misses     += st._misses;
+                    total._compares   += st._compares;
+                    total._refiled    += st._refiled;
+                    total._probeTime  += st._probeTime;
+                }
+                return total;
+            }
+
+            void resetStats()
+            {
+                for (unsigned s = 0; s < NUM_SHARDS; ++s)
+                {
+                    Threading::ScopedMutexLock lock(_shards[s]._mutex);
+                    _shards[s]._stats = Stats();
+                }
+            }
+
+            void releaseGLObjects(osg::State* state) const
+            {
+                for (unsigned s = 0; s < NUM_SHARDS; ++s)
+                {
+                    Threading::ScopedMutexLock lock(_shards[s]._mutex);
+                    for (unsigned b = 0; b < _shards[s]._buckets.size(); ++b)
+                    {
+                        const Bucket& bucket = _shards[s]._buckets[b];
+                        for (unsigned i = 0; i < bucket.size(); ++i)
+                            bucket[i]._object->releaseGLObjects(state);
+                    }
+                }
+            }
+
+        protected:
+            struct Entry
+            {
+                Entry(Hash hash, T* object) : _hash(hash), _object(object) { }
+                Hash           _hash;
+                osg::ref_ptr<T> _object;
+            };
+            typedef std::vector<Entry> Bucket;
+
+            struct Shard
+            {
+                Shard() : _count(0u) { }
+
+                Bucket& bucket(Hash hash)
+                {
+                    if (_buckets.empty())
+                        _buckets.resize(64);
+                    // the low bits chose the shard; index buckets with the rest
+                    return _buckets[(hash / NUM_SHARDS) % _buckets.size()];
+                }
+
+                void insert(const Entry& e)
+                {
+                    bucket(e._hash).push_back(e);
+                    if (++_count > _buckets.size())
+                        rehash(_buckets.size() * 2);
+                }
+
+                void rehash(unsigned numBuckets)
+                {
+                    std::vector<Bucket> old;
+                    old.swap(_buckets);
+                    _buckets.resize(numBuckets);
+                    for (unsigned b = 0; b < old.size(); ++b)
+                        for (unsigned i = 0; i < old[b].size(); ++i)
+                            _buckets[(old[b][i]._hash / NUM_SHARDS) % numBuckets].push_back(old[b][i]);
+                }
+
+                /** Drops entries referenced only by the cache. */
+                void prune()
+                {
+                    for (unsigned b = 0; b < _buckets.size(); ++b)
+                    {
+                        Bucket& bucket = _buckets[b];
+                        for (unsigned i = 0; i < bucket.size(); )
+                        {
+                            if (bucket[i]._object->referenceCount() <= 1)
+                            {
+                                bucket[i] = bucket.back();
+                                bucket.pop_back();
+                                --_count;
+                            }
+                            else ++i;
+                        }
+                    }
+                }
+
+                std::vector<Bucket>      _buckets;
+                unsigned                 _count;
+                Stats                    _stats;
+                mutable Threading::Mutex _mutex;
+            };
+
+            static int compare(const osg::StateSet& lhs, const osg::StateSet& rhs) { return lhs.compare(rhs, true); }
+            static int compare(const osg::StateAttribute& lhs, const osg::StateAttribute& rhs) { return lhs.compare(rhs); }
+
+            Shard    _shards[NUM_SHARDS];
+            unsigned _maxSize;
+        };
+
+        /** Shares state attributes, including texture attributes, across a graph. */
+        class ShareAttributes : public osg::NodeVisitor
+        {
+        public:
+            ShareAttributes(HashedStateSetCache* cache) :
+                osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+                _cache(cache)
+            {
+                setNodeMaskOverride(~0u);
+            }
+
+            void apply(osg::Node& node)
+            {
+                osg::StateSet* ss = node.getStateSet();
+                if (ss && _cache->eligible(ss) && _visited.insert(ss).second)
+                {
+                    shareList(ss, ss->getAttributeList(), -1);
+                    for (unsigned u = 0; u < ss->getTextureAttributeList().size(); ++u)
+                        shareList(ss, ss->getTextureAttributeList()[u], (int)u);
+                }
+                traverse(node);
+            }
+
+        protected:
+            void shareList(osg::StateSet* ss, const osg::StateSet::AttributeList& list, int unit)
+            {
+                // collect first; setAttribute() would invalidate the iteration
+                std::vector<osg::StateSet::RefAttributePair> replacements;
+                for (osg::StateSet::AttributeList::const_iterator i = list.begin(); i != list.end(); ++i)
+                {
+                    osg::ref_ptr<osg::StateAttribute> in = i->second.first.get(), out;
+                    if (_cache->share(in, out) && out.get() != in.get())
+                        replacements.push_back(osg::StateSet::RefAttributePair(out, i->second.second));
+                }
+                for (unsigned i = 0; i < replacements.size(); ++i)
+                {
+                    if (unit < 0)
+                        ss->setAttribute(replacements[i].first.get(), replacements[i].second);
+                    else
+                        ss->setTextureAttribute((unsigned)unit, replacements[i].first.get(), replacements[i].second);
+                }
+            }
+
+            HashedStateSetCache*     _cache;
+            std::set<osg::StateSet*> _visited;
+        };
+
+        /** Shares state sets across a graph. */
+        class ShareStateSets : public osg::NodeVisitor
+        {
+        public:
+            ShareStateSets(HashedStateSetCache* cache) :
+                osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+                _cache(cache)
+            {
+                setNodeMaskOverride(~0u);
+            }
+
+            void apply(osg::Node& node)
+            {
+                if (node.getStateSet())
+                {
+                    osg::ref_ptr<osg::StateSet> in = node.getStateSet(), out;
+                    if (_cache->share(in, out) && out.get() != in.get())
+                        node.setStateSet(out.get());
+                }
+                traverse(node);
+            }
+
+        protected:
+            HashedStateSetCache* _cache;
+        };
+
+        Table<osg::StateSet>       _stateSets;
+        Table<osg::StateAttribute> _attributes;
+    };
+}
+
+#endif // OSGEARTH_HASHED_STATE_SET_CACHE_H
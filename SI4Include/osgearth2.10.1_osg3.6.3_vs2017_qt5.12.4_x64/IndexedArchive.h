@@ -0,0 +1,555 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGDB_INDEXEDARCHIVE
+#define OSGDB_INDEXEDARCHIVE 1
+
+#include <osgDB/Archive>
+#include <osgDB/Registry>
+#include <osgDB/ObjectWrapper>
+#include <osgDB/FileNameUtils>
+#include <osgDB/fstream>
+#include <osgDB/MappedBinaryReader>
+
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+
+#include <map>
+#include <vector>
+#include <sstream>
+#include <cstring>
+
+namespace osgDB {
+
+/** On-disk layout of an indexed archive (.osgi).
+  *
+  *   Header | entry data ... | Entry[numEntries] | bucket[numBuckets] | names
+  *
+  * The header, entries and bucket table are written in the byte order of the
+  * host that built the archive, and read in place. Header::byteOrder holds
+  * BYTE_ORDER_MARK, and an archive whose mark doesn't read back as such was
+  * written on a host of the other byte order and is rejected. The bucket table is an open addressed hash table
+  * (linear probing, numBuckets a power of two) of entry indices keyed by the
+  * 64 bit FNV-1a hash of the normalized file name, so a lookup reads the table
+  * straight out of the mapped file. Entry data is stored raw or compressed with
+  * one of the osgDB compressors.
+  */
+namespace IndexedArchiveFormat
+{
+    enum Compression
+    {
+        COMPRESS_NONE = 0,
+        COMPRESS_ZLIB = 1
+    };
+
+    struct Header
+    {
+        char                magic[8];
+        unsigned int        version;
+        unsigned int        numEntries;
+        unsigned int        numBuckets;
+        unsigned int        byteOrder;      // BYTE_ORDER_MARK in the writer's byte order
+        unsigned long long  indexOffset;
+        unsigned long long  namesOffset;
+        unsigned long long  namesSize;
+    };
+
+    struct Entry
+    {
+        unsigned long long  hash;
+        unsigned long long  offset;
+        unsigned long long  storedSize;
+        unsigned long long  size;
+        unsigned int        nameOffset;
+        unsigned int        nameLength;
+        unsigned int        compression;
+        unsigned int        reserved;
+    };
+
+    static const char           MAGIC[8] = { 'O', 'S', 'G', 'I', 'D', 'X', 'A', '\0' };
+    static const unsigned int   VERSION = 1;
+    static const unsigned int   EMPTY_BUCKET = 0xFFFFFFFFu;
+    static const unsigned int   BYTE_ORDER_MARK = 0x01020304u;
+
+    /** Archive names use '/' separators and no leading "./" or '/'.*/
+    inline std::string normalizeName(const std::string& fileName)
+    {
+        std::string name = fileName;
+        for (std::string::iterator itr = name.begin(); itr != name.end(); ++itr)
+            if (*itr == '\\') *itr = '/';
+
+        std::string::size_type start = 0;
+        while (start < name.size())
+        {
+            if (name[start] == '/') ++start;
+            else if (name.compare(start, 2, "./") == 0) start += 2;
+            else break;
+        }
+        return name.substr(start);
+    }
+
+    inline unsigned long long hashName(const std::string& name)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (std::string::const_iterator itr = name.begin(); itr != name.end(); ++itr)
+        {
+            hash ^= static_cast<unsigned char>(*itr);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    inline const char* getCompressorName(unsigned int compression)
+    {
+        return compression == COMPRESS_ZLIB ? "zlib" : 0;
+    }
+
+    inline BaseCompressor* findCompressor(unsigned int compression)
+    {
+        const char* name = getCompressorName(compression);
+        if (!name) return 0;
+
+        // the zlib compressor is registered by the osg plugin
+        Registry::instance()->getReaderWriterForExtension("osgb");
+        return Registry::instance()->getObjectWrapperManager()->findCompressor(name);
+    }
+}
+
+/** Read only Archive over a memory mapped .osgi file.
+  *
+  * The whole file is mapped once in open(). Lookups hash the name and probe the
+  * mapped bucket table, and uncompressed entries are handed to the ReaderWriter
+  * for their extension through a std::istream over the mapping, so reads take
+  * no locks and make no copies; any number of database threads can read from
+  * one archive at once. Compressed entries are inflated into a buffer owned by
+  * the reading call.
+  *
+  * Use mount() to make "<archive>.osgi/<entry>" paths readable through the
+  * Registry, e.g. by the DatabasePager or osgEarth's TMS driver. Packages are
+  * written with IndexedArchiveWriter.
+  */
+class IndexedArchive : public Archive
+{
+    public:
+
+        IndexedArchive()
+        {
+            supportsExtension("osgi", "OpenSceneGraph indexed archive format");
+            close();
+        }
+
+        virtual const char* libraryName() const { return "osgDB"; }
+        virtual const char* className() const { return "IndexedArchive"; }
+
+        /** Open and map an archive, returns false if it isn't a valid .osgi file.*/
+        bool open(const std::string& fileName)
+        {
+            close();
+
+            osg::ref_ptr<MappedFile> file = new MappedFile();
+            if (!file->open(fileName) || file->size() < sizeof(IndexedArchiveFormat::Header))
+                return false;
+
+            const IndexedArchiveFormat::Header* header = reinterpret_cast<const IndexedArchiveFormat::Header*>(file->data());
+            if (std::memcmp(header->magic, IndexedArchiveFormat::MAGIC, sizeof(header->magic)) != 0 ||
+                header->version != IndexedArchiveFormat::VERSION ||
+                header->byteOrder != IndexedArchiveFormat::BYTE_ORDER_MARK)
+                return false;
+
+            const unsigned long long indexSize =
+                (unsigned long long)header->numEntries * sizeof(IndexedArchiveFormat::Entry) +
+                (unsigned long long)header->numBuckets * sizeof(unsigned int);
+
+            if (header->indexOffset % 8 != 0 ||
+                !fits(header->indexOffset, indexSize, file->size()) ||
+                !fits(header->namesOffset, header->namesSize, file->size()) ||
+                header->numBuckets == 0 ||
+                (header->numBuckets & (header->numBuckets - 1)) != 0 ||
+                header->numBuckets <= header->numEntries)
+                return false;
+
+            const IndexedArchiveFormat::Entry* entries = reinterpret_cast<const IndexedArchiveFormat::Entry*>(file->data() + header->indexOffset);
+            const unsigned int* buckets = reinterpret_cast<const unsigned int*>(entries + header->numEntries);
+
+            // lookups read the index unchecked, so every entry and bucket is validated here once
+            for (unsigned int i = 0; i < header->numEntries; ++i)
+            {
+                const IndexedArchiveFormat::Entry& entry = entries[i];
+                if (!fits(entry.nameOffset, entry.nameLength, header->namesSize) ||
+                    !fits(entry.offset, entry.storedSize, file->size()) ||
+                    (entry.compression != IndexedArchiveFormat::COMPRESS_NONE && !IndexedArchiveFormat::getCompressorName(entry.compression)) ||
+                    (entry.compression == IndexedArchiveFormat::COMPRESS_NONE && entry.storedSize != entry.size))
+                    return false;
+            }
+            for (unsigned int i = 0; i < header->numBuckets; ++i)
+            {
+                if (buckets[i] != IndexedArchiveFormat::EMPTY_BUCKET && buckets[i] >= header->numEntries)
+                    return false;
+            }
+
+            _file = file;
+            _fileName = fileName;
+            _header = header;
+            _entries = entries;
+            _buckets = buckets;
+            _names = file->data() + header->namesOffset;
+            return true;
+        }
+
+        /** Open an archive and add it to the Registry's archive cache, so that
+          * "<fileName>/<entry>" paths are read from it. Returns NULL on failure.*/
+        static IndexedArchive* mount(const std::string& fileName, Registry* registry = Registry::instance())
+        {
+            osg::ref_ptr<IndexedArchive> archive = new IndexedArchive();
+            if (!archive->open(fileName))
+                return 0;
+
+            registry->addArchiveExtension("osgi");
+            registry->addToArchiveCache(fileName, archive.get());
+            return archive.get();
+        }
+
+        virtual void close()
+        {
+            _file = 0;
+            _header = 0;
+            _entries = 0;
+            _buckets = 0;
+            _names = 0;
+        }
+
+        virtual std::string getArchiveFileName() const { return _fileName; }
+        virtual std::string getMasterFileName() const { return std::string(); }
+
+        virtual bool fileExists(const std::string& filename) const
+        {
+            return findEntry(filename) != 0;
+        }
+
+        virtual FileType getFileType(const std::string& filename) const
+        {
+            if (findEntry(filename)) return REGULAR_FILE;
+
+            const std::string prefix = IndexedArchiveFormat::normalizeName(filename) + "/";
+            for (unsigned int i = 0; _header && i < _header->numEntries; ++i)
+            {
+                if (_entries[i].nameLength > prefix.size() &&
+                    std::memcmp(_names + _entries[i].nameOffset, prefix.data(), prefix.size()) == 0)
+                    return DIRECTORY;
+            }
+            return FILE_NOT_FOUND;
+        }
+
+        virtual bool getFileNames(FileNameList& fileNames) const
+        {
+            if (!_header) return false;
+            for (unsigned int i = 0; i < _header->numEntries; ++i)
+                fileNames.push_back(std::string(_names + _entries[i].nameOffset, _entries[i].nameLength));
+            return true;
+        }
+
+        unsigned int getNumEntries() const { return _header ? _header->numEntries : 0; }
+
+        virtual ReadResult readObject(const std::string& fileName, const Options* options = NULL) const { return read(READ_OBJECT, fileName, options); }
+        virtual ReadResult readImage(const std::string& fileName, const Options* options = NULL) const { return read(READ_IMAGE, fileName, options); }
+        virtual ReadResult readHeightField(const std::string& fileName, const Options* options = NULL) const { return read(READ_HEIGHTFIELD, fileName, options); }
+        virtual ReadResult readNode(const std::string& fileName, const Options* options = NULL) const { return read(READ_NODE, fileName, options); }
+        virtual ReadResult readShader(const std::string& fileName, const Options* options = NULL) const { return read(READ_SHADER, fileName, options); }
+
+        /** Archives are written with IndexedArchiveWriter; these return FILE_NOT_HANDLED.*/
+        virtual WriteResult writeObject(const osg::Object&, const std::string&, const Options* = NULL) const { return WriteResult::FILE_NOT_HANDLED; }
+        virtual WriteResult writeImage(const osg::Image&, const std::string&, const Options* = NULL) const { return WriteResult::FILE_NOT_HANDLED; }
+        virtual WriteResult writeHeightField(const osg::HeightField&, const std::string&, const Options* = NULL) const { return WriteResult::FILE_NOT_HANDLED; }
+        virtual WriteResult writeNode(const osg::Node&, const std::string&, const Options* = NULL) const { return WriteResult::FILE_NOT_HANDLED; }
+        virtual WriteResult writeShader(const osg::Shader&, const std::string&, const Options* = NULL) const { return WriteResult::FILE_NOT_HANDLED; }
+
+    protected:
+
+        virtual ~IndexedArchive() {}
+
+        enum ReadType
+        {
+            READ_OBJECT,
+            READ_IMAGE,
+            READ_HEIGHTFIELD,
+            READ_NODE,
+            READ_SHADER
+        };
+
+        /** True if [offset, offset+length) lies within [0, limit), without overflowing.*/
+        static bool fits(unsigned long long offset, unsigned long long length, unsigned long long limit)
+        {
+            return offset <= limit && length <= limit - offset;
+        }
+
+        const IndexedArchiveFormat::Entry* findEntry(const std::string& fileName) const
+        {
+            if (!_header || _header->numEntries == 0) return 0;
+
+            const std::string name = IndexedArchiveFormat::normalizeName(fileName);
+            const unsigned long long hash = IndexedArchiveFormat::hashName(name);
+            const unsigned int mask = _header->numBuckets - 1;
+
+            for (unsigned int bucket = (unsigned int)hash & mask, probes = 0; probes < _header->numBuckets; bucket = (bucket + 1) & mask, ++probes)
+            {
+                const unsigned int index = _buckets[bucket];
+                if (index == IndexedArchiveFormat::EMPTY_BUCKET)
+                    return 0;
+
+                const IndexedArchiveFormat::Entry& entry = _entries[index];
+                if (entry.hash == hash &&
+                    entry.nameLength == name.size() &&
+                    std::memcmp(_names + entry.nameOffset, name.data(), name.size()) == 0)
+                    return &entry;
+            }
+            return 0;
+        }
+
+        ReadResult read(ReadType type, const std::string& fileName, const Options* options) const
+        {
+            const IndexedArchiveFormat::Entry* entry = findEntry(fileName);
+            if (!entry)
+                return ReadResult::FILE_NOT_FOUND;
+
+            ReaderWriter* rw = Registry::instance()->getReaderWriterForExtension(getLowerCaseFileExtension(fileName));
+            if (!rw)
+                return ReadResult::FILE_NOT_HANDLED;
+
+            const char* data = _file->data() + entry->offset;
+            size_t size = static_cast<size_t>(entry->storedSize);
+
+            std::string inflated;
+            if (entry->compression != IndexedArchiveFormat::COMPRESS_NONE)
+            {
+                BaseCompressor* compressor = IndexedArchiveFormat::findCompressor(entry->compression);
+                if (!compressor)
+                    return ReadResult("IndexedArchive: no decompressor for entry " + fileName);
+
+                MappedStreamBuf buffer(data, size);
+                std::istream in(&buffer);
+                if (!compressor->decompress(in, inflated) || inflated.size() != entry->size)
+                    return ReadResult("IndexedArchive: failed to decompress entry " + fileName);
+
+                data = inflated.data();
+                size = inflated.size();
+            }
+
+            MappedStreamBuf buffer(data, size);
+            std::istream in(&buffer);
+            switch (type)
+            {
+                case READ_OBJECT:       return rw->readObject(in, options);
+                case READ_IMAGE:        return rw->readImage(in, options);
+                case READ_HEIGHTFIELD:  return rw->readHeightField(in, options);
+                case READ_NODE:         return rw->readNode(in, options);
+                default:                return rw->readShader(in, options);
+            }
+        }
+
+        osg::ref_ptr<MappedFile>                _file;
+        std::string                             _fileName;
+        const IndexedArchiveFormat::Header*     _header;
+        const IndexedArchiveFormat::Entry*      _entries;
+        const unsigned int*                     _buckets;
+        const char*                             _names;
+};
+
+/** Builds an indexed archive (.osgi).
+  *
+  * Entries may be added from any number of threads; serializing and compressing
+  * happen outside the writer's lock, which only covers appending the bytes. An
+  * entry added twice keeps the last data. close() writes the index and must be
+  * called before the archive is opened for reading.
+  */
+class IndexedArchiveWriter : public osg::Referenced
+{
+    public:
+
+        IndexedArchiveWriter() :
+            _compression(IndexedArchiveFormat::COMPRESS_NONE),
+            _offset(0) {}
+
+        /** Compression for subsequently added entries. Entries that don't shrink are stored raw.*/
+        void setCompression(IndexedArchiveFormat::Compression compression) { _compression = compression; }
+        IndexedArchiveFormat::Compression getCompression() const { return _compression; }
+
+        bool open(const std::string& fileName)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+            _out.close();
+            _out.clear();
+            _out.open(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!_out) return false;
+
+            _entries.clear();
+            _names.clear();
+            _entryMap.clear();
+
+            IndexedArchiveFormat::Header header;
+            std::memset(&header, 0, sizeof(header));
+            _out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            _offset = sizeof(header);
+            return _out.good();
+        }
+
+        bool isOpen() const { return _out.is_open(); }
+
+        /** Add raw file contents under an archive name.*/
+        bool addFile(const std::string& fileName, const std::string& data)
+        {
+            const std::string name = IndexedArchiveFormat::normalizeName(fileName);
+            if (name.empty()) return false;
+
+            IndexedArchiveFormat::Entry entry;
+            std::memset(&entry, 0, sizeof(entry));
+            entry.hash = IndexedArchiveFormat::hashName(name);
+            entry.size = data.size();
+
+            std::string compressed;
+            const IndexedArchiveFormat::Compression compression = _compression;
+            BaseCompressor* compressor = IndexedArchiveFormat::findCompressor(compression);
+            if (compressor)
+            {
+                std::ostringstream out(std::ios::out | std::ios::binary);
+                if (compressor->compress(out, data))
+                    compressed = out.str();
+            }
+
+            const bool useCompressed = !compressed.empty() && compressed.size() < data.size();
+            const std::string& stored = useCompressed ? compressed : data;
+            entry.compression = useCompressed ? compression : IndexedArchiveFormat::COMPRESS_NONE;
+            entry.storedSize = stored.size();
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            if (!_out.is_open()) return false;
+
+            entry.offset = _offset;
+            _out.write(stored.data(), stored.size());
+            _offset += stored.size();
+
+            std::map<std::string, unsigned int>::iterator itr = _entryMap.find(name);
+            if (itr != _entryMap.end())
+            {
+                entry.nameOffset = _entries[itr->second].nameOffset;
+                entry.nameLength = _entries[itr->second].nameLength;
+                _entries[itr->second] = entry;
+            }
+            else
+            {
+                entry.nameOffset = static_cast<unsigned int>(_names.size());
+                entry.nameLength = static_cast<unsigned int>(name.size());
+                _names += name;
+                _entryMap[name] = static_cast<unsigned int>(_entries.size());
+                _entries.push_back(entry);
+            }
+            return _out.good();
+        }
+
+        /** Serialize an object with the ReaderWriter for the name's extension and add it.*/
+        ReaderWriter::WriteResult::WriteStatus writeObject(const osg::Object& object, const std::string& fileName, const Options* options = 0)
+        {
+            ReaderWriter* rw = Registry::instance()->getReaderWriterForExtension(getLowerCaseFileExtension(fileName));
+            if (!rw) return ReaderWriter::WriteResult::FILE_NOT_HANDLED;
+
+            std::ostringstream out(std::ios::out | std::ios::binary);
+            ReaderWriter::WriteResult result;
+            if (const osg::Image* image = dynamic_cast<const osg::Image*>(&object))
+                result = rw->writeImage(*image, out, options);
+            else if (const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(&object))
+                result = rw->writeHeightField(*hf, out, options);
+            else if (const osg::Node* node = dynamic_cast<const osg::Node*>(&object))
+                result = rw->writeNode(*node, out, options);
+            else if (const osg::Shader* shader = dynamic_cast<const osg::Shader*>(&object))
+                result = rw->writeShader(*shader, out, options);
+            else
+                result = rw->writeObject(object, out, options);
+
+            if (!result.success()) return result.status();
+            return addFile(fileName, out.str()) ? ReaderWriter::WriteResult::FILE_SAVED : ReaderWriter::WriteResult::ERROR_IN_WRITING_FILE;
+        }
+
+        unsigned int getNumEntries() const
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            return static_cast<unsigned int>(_entries.size());
+        }
+
+        /** Write the index and close the file.*/
+        bool close()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            if (!_out.is_open()) return false;
+
+            // entries are read in place, so align them
+            static const char padding[8] = { 0 };
+            const unsigned int pad = static_cast<unsigned int>((8 - _offset % 8) % 8);
+            _out.write(padding, pad);
+            _offset += pad;
+
+            unsigned int numBuckets = 1;
+            while (numBuckets < _entries.size() * 2) numBuckets <<= 1;
+            if (numBuckets <= _entries.size()) numBuckets <<= 1;
+
+            std::vector<unsigned int> buckets(numBuckets, IndexedArchiveFormat::EMPTY_BUCKET);
+            for (unsigned int i = 0; i < _entries.size(); ++i)
+            {
+                unsigned int bucket = (unsigned int)_entries[i].hash & (numBuckets - 1);
+                while (buckets[bucket] != IndexedArchiveFormat::EMPTY_BUCKET)
+                    bucket = (bucket + 1) & (numBuckets - 1);
+                buckets[bucket] = i;
+            }
+
+            IndexedArchiveFormat::Header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, IndexedArchiveFormat::MAGIC, sizeof(header.magic));
+            header.version = IndexedArchiveFormat::VERSION;
+            header.numEntries = static_cast<unsigned int>(_entries.size());
+            header.numBuckets = numBuckets;
+            header.byteOrder = IndexedArchiveFormat::BYTE_ORDER_MARK;
+            header.indexOffset = _offset;
+            header.namesOffset = _offset + _entries.size() * sizeof(IndexedArchiveFormat::Entry) + numBuckets * sizeof(unsigned int);
+            header.namesSize = _names.size();
+
+            if (!_entries.empty())
+                _out.write(reinterpret_cast<const char*>(&_entries[0]), _entries.size() * sizeof(IndexedArchiveFormat::Entry));
+            _out.write(reinterpret_cast<const char*>(&buckets[0]), buckets.size() * sizeof(unsigned int));
+            _out.write(_names.data(), _names.size());
+
+            _out.seekp(0);
+            _out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            const bool ok = _out.good();
+            _out.close();
+            return ok;
+        }
+
+    protected:
+
+        virtual ~IndexedArchiveWriter()
+        {
+            if (_out.is_open()) close();
+        }
+
+        mutable OpenThreads::Mutex                  _mutex;
+        IndexedArchiveFormat::Compression           _compression;
+        osgDB::ofstream                             _out;
+        unsigned long long                          _offset;
+        std::vector<IndexedArchiveFormat::Entry>    _entries;
+        std::string                                 _names;
+        std::map<std::string, unsigned int>         _entryMap;
+};
+
+}
+
+#endif
@@ -0,0 +1,279 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef OSGEARTHUTIL_INDEXED_ARCHIVE_PACKAGER_H
+#define OSGEARTHUTIL_INDEXED_ARCHIVE_PACKAGER_H 1
+
+#include <osgEarthUtil/Common>
+#include <osgEarth/TileHandler>
+#include <osgEarth/TileVisitor>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/ImageToHeightFieldConverter>
+#include <osgEarth/StringUtils>
+#include <osgDB/IndexedArchive>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgDB/fstream>
+#include <iterator>
+
+namespace osgEarth { namespace Util
+{
+    class IndexedArchivePackager;
+
+    /**
+     * TileHandler that writes the tiles of a layer into an indexed archive,
+     * under the same "layer/lod/x/y.ext" names TMSPackager uses on disk.
+     * Safe to use with a MultithreadedTileVisitor.
+     */
+    class WriteIndexedArchiveTileHandler : public TileHandler
+    {
+    public:
+        WriteIndexedArchiveTileHandler(TerrainLayer* layer, IndexedArchivePackager* packager) :
+            _layer(layer),
+            _packager(packager) { }
+
+        virtual bool handleTile(const TileKey& key, const TileVisitor& tv);
+
+        virtual bool hasData(const TileKey& key) const
+        {
+            return _layer->mayHaveData(key);
+        }
+
+        //! The archive is a single file, so tiles can't be written by other processes.
+        virtual std::string getProcessString() const { return std::string(); }
+
+        std::string getPathForTile(const TileKey& key) const;
+
+    protected:
+        osg::ref_ptr<TerrainLayer> _layer;
+        IndexedArchivePackager* _packager;
+    };
+
+    /**
+     * Packages the tiles of an ImageLayer or ElevationLayer into a single
+     * osgDB::IndexedArchive (.osgi), either directly through a TileVisitor or
+     * from a directory that TMSPackager has already written.
+     *
+     * Usage:
+     *   IndexedArchivePackager packager;
+     *   packager.setVisitor(new MultithreadedTileVisitor());
+     *   packager.getVisitor()->setMaxLevel(12);
+     *   packager.run(layer, map, "imagery.osgi");
+     *
+     * or, for an existing TMS repository:
+     *   packager.packDirectory("tms/out", "imagery.osgi");
+     *
+     * Mount the result with osgDB::IndexedArchive::mount("imagery.osgi") and
+     * read "imagery.osgi/<layer>/<lod>/<x>/<y>.<ext>".
+     */
+    class IndexedArchivePackager
+    {
+    public:
+        IndexedArchivePackager() :
+            _extension("png"),
+            _elevationPixelDepth(32),
+            _keepEmpties(false),
+            _compression(osgDB::IndexedArchiveFormat::COMPRESS_NONE) { }
+
+        //! Extension (and so image format) of the tiles.
+        const std::string& getExtension() const { return _extension; }
+        void setExtension(const std::string& value) { _extension = value; }
+
+        //! Name of the top level folder in the archive; defaults to the layer name.
+        const std::string& getLayerName() const { return _layerName; }
+        void setLayerName(const std::string& value) { _layerName = value; }
+
+        //! Elevation pixel depth, either 16 or 32.
+        unsigned getElevationPixelDepth() const { return _elevationPixelDepth; }
+        void setElevationPixelDepth(unsigned value) { _elevationPixelDepth = value; }
+
+        //! Whether to keep completely transparent images.
+        bool getKeepEmpties() const { return _keepEmpties; }
+        void setKeepEmpties(bool value) { _keepEmpties = value; }
+
+        //! Compression of the archive entries. Already compressed formats (png, jpg) gain little.
+        osgDB::IndexedArchiveFormat::Compression getCompression() const { return _compression; }
+        void setCompression(osgDB::IndexedArchiveFormat::Compression value) { _compression = value; }
+
+        //! Options passed to the image writers.
+        osgDB::Options* getWriteOptions() const { return _writeOptions.get(); }
+        void setWriteOptions(osgDB::Options* options) { _writeOptions = options; }
+
+        //! TileVisitor used to traverse the tiles; defaults to a TileVisitor.
+        TileVisitor* getVisitor() const { return _visitor.get(); }
+        void setVisitor(TileVisitor* visitor) { _visitor = visitor; }
+
+        //! Archive being written during run().
+        osgDB::IndexedArchiveWriter* getWriter() const { return _writer.get(); }
+
+        /**
+         * Builds the tiles of a layer into an archive.
+         * @return the number of tiles written, or -1 if the archive can't be written.
+         */
+        int run(TerrainLayer* layer, Map* map, const std::string& archiveFile)
+        {
+            if (!layer || !map)
+                return -1;
+
+            if (_layerName.empty())
+                _layerName = layer->getName();
+
+            _writer = new osgDB::IndexedArchiveWriter();
+            _writer->setCompression(_compression);
+            if (!_writer->open(archiveFile))
+            {
+                _writer = 0L;
+                return -1;
+            }
+
+            if (!_visitor.valid())
+                _visitor = new TileVisitor();
+
+            osg::ref_ptr<WriteIndexedArchiveTileHandler> handler = new WriteIndexedArchiveTileHandler(layer, this);
+            _visitor->setTileHandler(handler.get());
+            _visitor->run(map->getProfile());
+
+            int count = (int)_writer->getNumEntries();
+            bool ok = _writer->close();
+            _writer = 0L;
+            return ok ? count : -1;
+        }
+
+        /**
+         * Packs every file below a directory (e.g. a TMSPackager destination)
+         * into an archive, named by their path relative to the directory.
+         * @return the number of files written, or -1 if the archive can't be written.
+         */
+        int packDirectory(const std::string& directory, const std::string& archiveFile)
+        {
+            osg::ref_ptr<osgDB::IndexedArchiveWriter> writer = new osgDB::IndexedArchiveWriter();
+            writer->setCompression(_compression);
+            if (!writer->open(archiveFile))
+                return -1;
+
+            if (!addDirectory(writer.get(), directory, std::string()))
+            {
+                writer->close();
+                return -1;
+            }
+
+            int count = (int)writer->getNumEntries();
+            return writer->close() ? count : -1;
+        }
+
+    protected:
+        bool addDirectory(osgDB::IndexedArchiveWriter* writer, const std::string& directory, const std::string& prefix)
+        {
+            osgDB::DirectoryContents contents = osgDB::getDirectoryContents(directory);
+            for (osgDB::DirectoryContents::const_iterator i = contents.begin(); i != contents.end(); ++i)
+            {
+                if (*i == "." || *i == "..")
+                    continue;
+
+                std::string path = osgDB::concatPaths(directory, *i);
+                std::string name = prefix.empty() ? *i : prefix + "/" + *i;
+
+                if (osgDB::fileType(path) == osgDB::DIRECTORY)
+                {
+                    if (!addDirectory(writer, path, name))
+                        return false;
+                }
+                else
+                {
+                    osgDB::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+                    if (!in)
+                        return false;
+
+                    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                    if (!writer->addFile(name, data))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        std::string _extension;
+        std::string _layerName;
+        unsigned _elevationPixelDepth;
+        bool _keepEmpties;
+        osgDB::IndexedArchiveFormat::Compression _compression;
+        osg::ref_ptr<osgDB::Options> _writeOptions;
+        osg::ref_ptr<TileVisitor> _visitor;
+        osg::ref_ptr<osgDB::IndexedArchiveWriter> _writer;
+    };
+
+
+    inline bool WriteIndexedArchiveTileHandler::handleTile(const TileKey& key, const TileVisitor& /*tv*/)
+    {
+        osgDB::IndexedArchiveWriter* writer = _packager->getWriter();
+        if (!writer)
+            return false;
+
+        osg::ref_ptr<osg::Image> image;
+
+        ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(_layer.get());
+        ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>(_layer.get());
+
+        if (imageLayer)
+        {
+            GeoImage geoImage = imageLayer->createImage(key);
+            if (geoImage.valid())
+            {
+                if (!_packager->getKeepEmpties() && ImageUtils::isEmptyImage(geoImage.getImage()))
+                    return false;
+                image = geoImage.getImage();
+            }
+        }
+        else if (elevationLayer)
+        {
+            GeoHeightField hf = elevationLayer->createHeightField(key);
+            if (hf.valid())
+            {
+                ImageToHeightFieldConverter conv;
+                image = conv.convert(hf.getHeightField(), _packager->getElevationPixelDepth());
+            }
+        }
+
+        if (!image.valid())
+            return false;
+
+        return writer->writeObject(*image.get(), getPathForTile(key), _packager->getWriteOptions()) ==
+            osgDB::ReaderWriter::WriteResult::FILE_SAVED;
+    }
+
+    inline std::string WriteIndexedArchiveTileHandler::getPathForTile(const TileKey& key) const
+    {
+        unsigned lod = key.getLevelOfDetail();
+        unsigned x, y;
+        key.getTileXY(x, y);
+
+        // TMS rows count up from the bottom
+        unsigned w, h;
+        key.getProfile()->getNumTiles(lod, w, h);
+
+        return Stringify()
+            << toLegalFileName(_packager->getLayerName())
+            << "/" << lod << "/" << x << "/" << (h - y - 1)
+            << "." << _packager->getExtension();
+    }
+
+} } // namespace osgEarth::Util
+
+#endif // OSGEARTHUTIL_INDEXED_ARCHIVE_PACKAGER_H
@@ -0,0 +1,574 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2010 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGDB_MAPPEDBINARYREADER
+#define OSGDB_MAPPEDBINARYREADER 1
+
+#include <osg/Endian>
+#include <osg/Timer>
+
+#include <osgDB/InputStream>
+#include <osgDB/StreamOperator>
+#include <osgDB/DataTypes>
+#include <osgDB/Callbacks>
+#include <osgDB/Registry>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+
+#include <streambuf>
+#include <istream>
+#include <vector>
+#include <cstring>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace osgDB {
+
+/** Read only memory mapping of a whole file.*/
+class MappedFile : public osg::Referenced
+{
+    public:
+
+        MappedFile() :
+            _data(0),
+            _size(0)
+#if defined(_WIN32)
+            , _file(INVALID_HANDLE_VALUE),
+            _mapping(0)
+#endif
+        {}
+
+        /** Map the file, returns false if it can't be opened or is empty.*/
+        bool open(const std::string& fileName)
+        {
+            close();
+#if defined(_WIN32)
+            _file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+            if (_file == INVALID_HANDLE_VALUE) return false;
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) { close(); return false; }
+
+            _mapping = CreateFileMappingA(_file, 0, PAGE_READONLY, 0, 0, 0);
+            if (!_mapping) { close(); return false; }
+
+            _data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+            if (!_data) { close(); return false; }
+            _size = static_cast<size_t>(size.QuadPart);
+#else
+            int fd = ::open(fileName.c_str(), O_RDONLY);
+            if (fd < 0) return false;
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return false; }
+
+            void* data = ::mmap(0, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED) return false;
+
+    #if defined(MADV_SEQUENTIAL)
+            ::madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    #endif
+            _data = static_cast<const char*>(data);
+            _size = static_cast<size_t>(st.st_size);
+#endif
+            return true;
+        }
+
+        void close()
+        {
+#if defined(_WIN32)
+            if (_data) UnmapViewOfFile(_data);
+            if (_mapping) CloseHandle(_mapping);
+            if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+            _mapping = 0;
+            _file = INVALID_HANDLE_VALUE;
+#else
+            if (_data) ::munmap(const_cast<char*>(_data), _size);
+#endif
+            _data = 0;
+            _size = 0;
+        }
+
+        bool valid() const { return _data != 0; }
+        const char* data() const { return _data; }
+        size_t size() const { return _size; }
+
+    protected:
+
+        virtual ~MappedFile() { close(); }
+
+        const char*     _data;
+        size_t          _size;
+#if defined(_WIN32)
+        HANDLE          _file;
+        HANDLE          _mapping;
+#endif
+};
+
+/** std::streambuf reading straight from a memory block, with an inline take()
+  * for callers that want to consume the bytes without going through the stream.*/
+class MappedStreamBuf : public std::streambuf
+{
+    public:
+
+        MappedStreamBuf(const char* data, size_t size)
+        {
+            char* begin = const_cast<char*>(data);
+            setg(begin, begin, begin + size);
+        }
+
+        /** Consume size bytes, returns NULL if fewer remain.*/
+        const char* take(size_t size)
+        {
+            char* current = gptr();
+            if (static_cast<size_t>(egptr() - current) < size)
+            {
+                setg(eback(), egptr(), egptr());
+                return 0;
+            }
+            setg(eback(), current + size, egptr());
+            return current;
+        }
+
+        size_t tell() const { return static_cast<size_t>(gptr() - eback()); }
+
+        bool seek(size_t position)
+        {
+            if (position > static_cast<size_t>(egptr() - eback())) return false;
+            setg(eback(), eback() + position, egptr());
+            return true;
+        }
+
+    protected:
+
+        virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in)
+        {
+            if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+
+            off_type base = 0;
+            if (dir == std::ios_base::cur) base = gptr() - eback();
+            else if (dir == std::ios_base::end) base = egptr() - eback();
+
+            const off_type position = base + off;
+            if (position < 0 || !seek(static_cast<size_t>(position))) return pos_type(off_type(-1));
+            return pos_type(position);
+        }
+
+        virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in)
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+};
+
+/** Binary .osgb InputIterator over a memory block.
+  *
+  * Equivalent to the osg plugin's BinaryInputIterator, but primitives, strings
+  * and array payloads are copied straight out of the block by inline,
+  * non-virtual helpers instead of one std::istream::read() per value. Array
+  * payloads arrive through readCharArray(), which InputIterator::readComponentArray()
+  * calls once per array, so each vertex, normal or index array is one memcpy.
+  *
+  * If InputStream::decompress() swaps in a decompressed stream, the helpers fall
+  * back to reading from that stream.
+  */
+class MappedBinaryInputIterator : public InputIterator
+{
+    public:
+
+        MappedBinaryInputIterator(const char* data, size_t size, int byteSwap) :
+            _buffer(data, size),
+            _stream(&_buffer)
+        {
+            _in = &_stream;
+            _byteSwap = byteSwap;
+        }
+
+        virtual bool isBinary() const { return true; }
+
+        virtual void readBool( bool& b ) { char c = 0; readRaw(&c, CHAR_SIZE); b = (c != 0); }
+        virtual void readChar( char& c ) { readRaw(&c, CHAR_SIZE); }
+        virtual void readSChar( signed char& c ) { readRaw(&c, CHAR_SIZE); }
+        virtual void readUChar( unsigned char& c ) { readRaw(&c, CHAR_SIZE); }
+        virtual void readShort( short& s ) { readValue(s, SHORT_SIZE); }
+        virtual void readUShort( unsigned short& s ) { readValue(s, SHORT_SIZE); }
+        virtual void readInt( int& i ) { readValue(i, INT_SIZE); }
+        virtual void readUInt( unsigned int& i ) { readValue(i, INT_SIZE); }
+        virtual void readLong( long& l ) { int value = 0; readValue(value, LONG_SIZE); l = value; }
+        virtual void readULong( unsigned long& l ) { unsigned int value = 0; readValue(value, LONG_SIZE); l = value; }
+        virtual void readFloat( float& f ) { readValue(f, FLOAT_SIZE); }
+        virtual void readDouble( double& d ) { readValue(d, DOUBLE_SIZE); }
+
+        virtual void readString( std::string& s )
+        {
+            int size = 0;
+            readValue(size, INT_SIZE);
+            if (size < 0)
+            {
+                throwException("InputStream::readString() error, negative string size.");
+                return;
+            }
+
+            if (isMapped())
+            {
+                const char* data = _buffer.take(static_cast<size_t>(size));
+                if (data) s.assign(data, static_cast<size_t>(size));
+                else fail();
+            }
+            else if (size > 0)
+            {
+                s.resize(size);
+                _in->read(&s[0], size);
+            }
+            else s.clear();
+        }
+
+        virtual void readStream( std::istream& (*)(std::istream&) ) {}
+        virtual void readBase( std::ios_base& (*)(std::ios_base&) ) {}
+
+        virtual void readGLenum( ObjectGLenum& value )
+        {
+            unsigned int e = 0;
+            readValue(e, GLENUM_SIZE);
+            value.set(e);
+        }
+
+        virtual void readProperty( ObjectProperty& prop )
+        {
+            int value = 0;
+            if (prop._mapProperty) readValue(value, INT_SIZE);
+            prop.set(value);
+        }
+
+        virtual void readMark( ObjectMark& mark )
+        {
+            if (!_supportBinaryBrackets) return;
+
+            if (mark._name == "{")
+            {
+                _beginPositions.push_back(tell());
+
+                // block sizes are 64 bit from file version 149 on, as in BinaryInputIterator
+                if (_inputStream && _inputStream->getFileVersion() > 148)
+                {
+                    GLint64 size = 0;
+                    readValue(size, INT64_SIZE);
+                    _blockSizes.push_back(size);
+                }
+                else
+                {
+                    int size = 0;
+                    readValue(size, INT_SIZE);
+                    _blockSizes.push_back(size);
+                }
+            }
+            else if (mark._name == "}" && !_beginPositions.empty())
+            {
+                _beginPositions.pop_back();
+                _blockSizes.pop_back();
+            }
+        }
+
+        virtual void readCharArray( char* s, unsigned int size ) { if (size > 0) readRaw(s, size); }
+
+        virtual void readWrappedString( std::string& str ) { readString(str); }
+
+        virtual void advanceToCurrentEndBracket()
+        {
+            if (!_supportBinaryBrackets || _beginPositions.empty()) return;
+
+            const GLint64 position = _beginPositions.back() + _blockSizes.back();
+            _beginPositions.pop_back();
+            _blockSizes.pop_back();
+
+            if (isMapped())
+            {
+                if (position < 0 || !_buffer.seek(static_cast<size_t>(position))) fail();
+            }
+            else _in->seekg(std::streampos(position));
+        }
+
+    protected:
+
+        bool isMapped() const { return _in == &_stream; }
+
+        void fail() { _stream.setstate(std::ios_base::failbit); }
+
+        GLint64 tell()
+        {
+            return isMapped() ? static_cast<GLint64>(_buffer.tell()) : static_cast<GLint64>(_in->tellg());
+        }
+
+        void readRaw(void* dest, size_t size)
+        {
+            if (isMapped())
+            {
+                const char* data = _buffer.take(size);
+                if (data) std::memcpy(dest, data, size);
+                else fail();
+            }
+            else _in->read(static_cast<char*>(dest), size);
+        }
+
+        template<typename T>
+        void readValue(T& value, int size)
+        {
+            readRaw(&value, size);
+            if (_byteSwap) osg::swapBytes(reinterpret_cast<char*>(&value), size);
+        }
+
+        MappedStreamBuf         _buffer;
+        std::istream            _stream;
+        std::vector<GLint64>    _beginPositions;
+        std::vector<GLint64>    _blockSizes;
+};
+
+/** Reads binary native (.osgb) files through a memory mapping and MappedBinaryInputIterator.
+  *
+  * The results are the same as reading through the osg plugin. Files that aren't
+  * binary native files, or can't be mapped, return FILE_NOT_HANDLED so callers can
+  * fall back to the plugin. The reader keeps running totals of bytes read and time
+  * taken, so the throughput of a set of files can be measured by resetting the
+  * stats, reading them and calling getThroughput().
+  */
+class MappedBinaryReader
+{
+    public:
+
+        struct Stats
+        {
+            Stats() : files(0), bytes(0), seconds(0.0) {}
+
+            unsigned int        files;
+            unsigned long long  bytes;
+            double              seconds;
+        };
+
+        static ReaderWriter::ReadResult readNode(const std::string& fileName, const Options* options)
+        {
+            return read(InputStream::READ_SCENE, fileName, options);
+        }
+
+        static ReaderWriter::ReadResult readImage(const std::string& fileName, const Options* options)
+        {
+            return read(InputStream::READ_IMAGE, fileName, options);
+        }
+
+        static ReaderWriter::ReadResult readObject(const std::string& fileName, const Options* options)
+        {
+            return read(InputStream::READ_OBJECT, fileName, options);
+        }
+
+        /** True if the file is one this reader handles, judging by its extension.*/
+        static bool acceptsExtension(const std::string& fileName)
+        {
+            return getLowerCaseFileExtension(fileName) == "osgb";
+        }
+
+        static Stats getStats()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(getStatsMutex());
+            return getStatsInstance();
+        }
+
+        static void resetStats()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(getStatsMutex());
+            getStatsInstance() = Stats();
+        }
+
+        /** Megabytes read per second since the last resetStats().*/
+        static double getThroughput()
+        {
+            Stats stats = getStats();
+            return stats.seconds > 0.0 ? (double)stats.bytes / (1024.0*1024.0) / stats.seconds : 0.0;
+        }
+
+    protected:
+
+        static ReaderWriter::ReadResult read(InputStream::ReadType type, const std::string& fileName, const Options* options)
+        {
+            if (!acceptsExtension(fileName))
+                return ReaderWriter::ReadResult::FILE_NOT_HANDLED;
+
+            const std::string path = findDataFile(fileName, options);
+            if (path.empty())
+                return ReaderWriter::ReadResult::FILE_NOT_FOUND;
+
+            const osg::Timer_t start = osg::Timer::instance()->tick();
+
+            osg::ref_ptr<MappedFile> file = new MappedFile();
+            if (!file->open(path) || file->size() < 2*INT_SIZE)
+                return ReaderWriter::ReadResult::FILE_NOT_HANDLED;
+
+            unsigned int header[2];
+            std::memcpy(header, file->data(), 2*INT_SIZE);
+
+            int byteSwap = 0;
+            if (header[0] != OSG_HEADER_LOW || header[1] != OSG_HEADER_HIGH)
+            {
+                osg::swapBytes4(reinterpret_cast<char*>(&header[0]));
+                osg::swapBytes4(reinterpret_cast<char*>(&header[1]));
+                if (header[0] != OSG_HEADER_LOW || header[1] != OSG_HEADER_HIGH)
+                    return ReaderWriter::ReadResult::FILE_NOT_HANDLED;
+                byteSwap = 1;
+            }
+
+            osg::ref_ptr<Options> localOptions = options ? options->cloneOptions() : new Options();
+            localOptions->getDatabasePathList().push_front(getFilePath(path));
+
+            osg::ref_ptr<MappedBinaryInputIterator> ii =
+                new MappedBinaryInputIterator(file->data() + 2*INT_SIZE, file->size() - 2*INT_SIZE, byteSwap);
+
+            ReaderWriter::ReadResult result;
+            {
+                InputStream is(localOptions.get());
+
+                const InputStream::ReadType fileType = is.start(ii.get());
+                if (is.getException())
+                    return error(is);
+
+                const bool matches = type == InputStream::READ_OBJECT ?
+                    fileType != InputStream::READ_UNKNOWN :
+                    fileType == type;
+                if (!matches)
+                    return ReaderWriter::ReadResult::FILE_NOT_HANDLED;
+
+                is.decompress();
+                if (is.getException())
+                    return error(is);
+
+                if (type == InputStream::READ_IMAGE)
+                    result = ReaderWriter::ReadResult(is.readImage().get());
+                else if (type == InputStream::READ_SCENE)
+                    result = ReaderWriter::ReadResult(dynamic_cast<osg::Node*>(is.readObject().get()));
+                else
+                    result = ReaderWriter::ReadResult(is.readObject().get());
+
+                if (is.getException())
+                    return error(is);
+            }
+
+            const double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(getStatsMutex());
+                Stats& stats = getStatsInstance();
+                ++stats.files;
+                stats.bytes += file->size();
+                stats.seconds += seconds;
+            }
+
+            return result;
+        }
+
+        static ReaderWriter::ReadResult error(const InputStream& is)
+        {
+            return ReaderWriter::ReadResult(is.getException()->getError() + " At " + is.getException()->getField());
+        }
+
+        static OpenThreads::Mutex& getStatsMutex()
+        {
+            static OpenThreads::Mutex s_mutex;
+            return s_mutex;
+        }
+
+        static Stats& getStatsInstance()
+        {
+            static Stats s_stats;
+            return s_stats;
+        }
+};
+
+/** ReadFileCallback that reads .osgb files with MappedBinaryReader and passes
+  * everything else, and any file it doesn't handle, to the next callback or the
+  * default Registry implementation.*/
+class MappedBinaryReadCallback : public ReadFileCallback
+{
+    public:
+
+        MappedBinaryReadCallback(ReadFileCallback* next = 0) :
+            _next(next) {}
+
+        /** Install a callback on a Registry, chaining to the Registry's current read callback.*/
+        static MappedBinaryReadCallback* install(Registry* registry = Registry::instance())
+        {
+            MappedBinaryReadCallback* existing = dynamic_cast<MappedBinaryReadCallback*>(registry->getReadFileCallback());
+            if (existing)
+                return existing;
+
+            MappedBinaryReadCallback* callback = new MappedBinaryReadCallback(registry->getReadFileCallback());
+            registry->setReadFileCallback(callback);
+            return callback;
+        }
+
+        virtual ReaderWriter::ReadResult readObject(const std::string& fileName, const Options* options)
+        {
+            ReaderWriter::ReadResult result = MappedBinaryReader::readObject(fileName, options);
+            if (handled(result)) return result;
+            return _next.valid() ? _next->readObject(fileName, options) : ReadFileCallback::readObject(fileName, options);
+        }
+
+        virtual ReaderWriter::ReadResult readImage(const std::string& fileName, const Options* options)
+        {
+            ReaderWriter::ReadResult result = MappedBinaryReader::readImage(fileName, options);
+            if (handled(result)) return result;
+            return _next.valid() ? _next->readImage(fileName, options) : ReadFileCallback::readImage(fileName, options);
+        }
+
+        virtual ReaderWriter::ReadResult readNode(const std::string& fileName, const Options* options)
+        {
+            ReaderWriter::ReadResult result = MappedBinaryReader::readNode(fileName, options);
+            if (handled(result)) return result;
+            return _next.valid() ? _next->readNode(fileName, options) : ReadFileCallback::readNode(fileName, options);
+        }
+
+        virtual ReaderWriter::ReadResult readHeightField(const std::string& fileName, const Options* options)
+        {
+            return _next.valid() ? _next->readHeightField(fileName, options) : ReadFileCallback::readHeightField(fileName, options);
+        }
+
+        virtual ReaderWriter::ReadResult readShader(const std::string& fileName, const Options* options)
+        {
+            return _next.valid() ? _next->readShader(fileName, options) : ReadFileCallback::readShader(fileName, options);
+        }
+
+    protected:
+
+        virtual ~MappedBinaryReadCallback() {}
+
+        // Anything but "not handled" and "not found" (archives and servers aren't mapped) is final.
+        static bool handled(const ReaderWriter::ReadResult& result)
+        {
+            return result.status() != ReaderWriter::ReadResult::FILE_NOT_HANDLED &&
+                   result.status() != ReaderWriter::ReadResult::FILE_NOT_FOUND;
+        }
+
+        osg::ref_ptr<ReadFileCallback> _next;
+};
+
+}
+
+#endif
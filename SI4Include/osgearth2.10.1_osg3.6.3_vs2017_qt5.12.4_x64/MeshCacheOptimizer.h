@@ -0,0 +1,751 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGUTIL_MESHCACHEOPTIMIZER
+#define OSGUTIL_MESHCACHEOPTIMIZER 1
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <osg/Geometry>
+#include <osg/Notify>
+#include <osg/Timer>
+
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <OpenThreads/Atomic>
+
+#include <osgUtil/Optimizer>
+
+namespace osgUtil
+{
+
+// Reorders the per vertex arrays of a geometry, entry i of the result
+// taking entry order[i] of the original.
+class ReorderVertexArrayVisitor : public osg::ArrayVisitor
+{
+public:
+    ReorderVertexArrayVisitor(const std::vector<unsigned int>& order) : _order(order) {}
+
+    template<class ArrayType>
+    void reorder(ArrayType& array)
+    {
+        std::vector<typename ArrayType::ElementDataType> data;
+        data.reserve(_order.size());
+        for (std::vector<unsigned int>::const_iterator itr = _order.begin(); itr != _order.end(); ++itr)
+            data.push_back(array[*itr]);
+        array.assign(data.begin(), data.end());
+        array.dirty();
+    }
+
+    virtual void apply(osg::ByteArray& array) { reorder(array); }
+    virtual void apply(osg::ShortArray& array) { reorder(array); }
+    virtual void apply(osg::IntArray& array) { reorder(array); }
+    virtual void apply(osg::UByteArray& array) { reorder(array); }
+    virtual void apply(osg::UShortArray& array) { reorder(array); }
+    virtual void apply(osg::UIntArray& array) { reorder(array); }
+    virtual void apply(osg::FloatArray& array) { reorder(array); }
+    virtual void apply(osg::DoubleArray& array) { reorder(array); }
+
+    virtual void apply(osg::Vec2bArray& array) { reorder(array); }
+    virtual void apply(osg::Vec3bArray& array) { reorder(array); }
+    virtual void apply(osg::Vec4bArray& array) { reorder(array); }
+    virtual void apply(osg::Vec2sArray& array) { reorder(array); }
+    virtual void apply(osg::Vec3sArray& array) { reorder(array); }
+    virtual void apply(osg::Vec4sArray& array) { reorder(array); }
+    virtual void apply(osg::Vec2ubArray& array) { reorder(array); }
+    virtual void apply(osg::Vec3ubArray& array) { reorder(array); }
+    virtual void apply(osg::Vec4ubArray& array) { reorder(array); }
+    virtual void apply(osg::Vec2usArray& array) { reorder(array); }
+    virtual void apply(osg::Vec3usArray& array) { reorder(array); }
+    virtual void apply(osg::Vec4usArray& array) { reorder(array); }
+
+    virtual void apply(osg::Vec2Array& array) { reorder(array); }
+    virtual void apply(osg::Vec3Array& array) { reorder(array); }
+    virtual void apply(osg::Vec4Array& array) { reorder(array); }
+    virtual void apply(osg::Vec2dArray& array) { reorder(array); }
+    virtual void apply(osg::Vec3dArray& array) { reorder(array); }
+    virtual void apply(osg::Vec4dArray& array) { reorder(array); }
+
+protected:
+    ReorderVertexArrayVisitor& operator = (const ReorderVertexArrayVisitor&) { return *this; }
+
+    const std::vector<unsigned int>& _order;
+};
+
+// Optimizes the triangle order of indexed triangle meshes for the GPU's
+// post-transform cache, either with Tom Forsyth's linear-speed algorithm or
+// with Tipsify (Sander, Nehab & Barczak, "Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw", 2007), optionally sorts the Tipsify
+// clusters front to back to reduce overdraw, and reorders the vertex arrays
+// in the order the vertices are fetched.
+//
+// The collected geometries are processed on several threads; geometries
+// must be indexed (see IndexMeshVisitor) to be optimized, and the vertex
+// fetch order is only changed when the vertex arrays aren't shared.
+class MeshCacheVisitor : public BaseOptimizerVisitor
+{
+public:
+    enum Options
+    {
+        VERTEX_CACHE_FORSYTH =  (1 << 22),
+        VERTEX_CACHE_TIPSIFY =  (1 << 23),
+        OVERDRAW_CLUSTERS =     (1 << 24),
+        VERTEX_FETCH =          (1 << 25),
+        ALL_MESH_CACHE_OPTIMIZATIONS = VERTEX_CACHE_TIPSIFY | OVERDRAW_CLUSTERS | VERTEX_FETCH
+    };
+
+    // Post-transform cache misses of the triangles processed, measured with
+    // a FIFO cache as in VertexCacheMissVisitor.
+    struct Stats
+    {
+        Stats() : numGeometries(0), numTriangles(0), missesBefore(0), missesAfter(0), time(0.0) {}
+
+        unsigned int numGeometries;
+        unsigned int numTriangles;
+        unsigned long long missesBefore;
+        unsigned long long missesAfter;
+        double time;
+
+        // average cache miss ratio, i.e. vertices transformed per triangle
+        double getACMRBefore() const { return numTriangles ? (double)missesBefore/(double)numTriangles : 0.0; }
+        double getACMRAfter() const { return numTriangles ? (double)missesAfter/(double)numTriangles : 0.0; }
+
+        Stats& operator += (const Stats& rhs)
+        {
+            numGeometries += rhs.numGeometries;
+            numTriangles += rhs.numTriangles;
+            missesBefore += rhs.missesBefore;
+            missesAfter += rhs.missesAfter;
+            return *this;
+        }
+    };
+
+    MeshCacheVisitor(Optimizer* optimizer = 0, unsigned int options = ALL_MESH_CACHE_OPTIMIZATIONS)
+        : BaseOptimizerVisitor(optimizer, options),
+          _options(options),
+          _cacheSize(16),
+          _overdrawThreshold(1.05f),
+          _numThreads(0)
+    {
+    }
+
+    // Size of the FIFO cache Tipsify and the ACMR figures assume.
+    void setCacheSize(unsigned int size) { _cacheSize = size; }
+    unsigned int getCacheSize() const { return _cacheSize; }
+
+    // The overdraw sort is dropped for a mesh if it raises the ACMR by more than this factor.
+    void setOverdrawThreshold(float threshold) { _overdrawThreshold = threshold; }
+    float getOverdrawThreshold() const { return _overdrawThreshold; }
+
+    // Number of threads, 0 uses one per processor.
+    void setNumThreads(unsigned int numThreads) { _numThreads = numThreads; }
+    unsigned int getNumThreads() const { return _numThreads; }
+
+    void reset()
+    {
+        _geometryList.clear();
+        _stats = Stats();
+    }
+
+    virtual void apply(osg::Geometry& geom)
+    {
+        if (isOperationPermissibleForObject(&geom))
+            _geometryList.push_back(&geom);
+    }
+
+    const Stats& getStats() const { return _stats; }
+
+    void optimize()
+    {
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        std::sort(_geometryList.begin(), _geometryList.end());
+        _geometryList.erase(std::unique(_geometryList.begin(), _geometryList.end()), _geometryList.end());
+
+        unsigned int numThreads = _numThreads > 0 ? _numThreads : (unsigned int)osg::maximum(OpenThreads::GetNumberOfProcessors(), 1);
+        numThreads = osg::minimum(numThreads, (unsigned int)_geometryList.size());
+        _next.exchange(0);
+
+        std::vector<Worker*> workers;
+        for (unsigned int i = 1; i < numThreads; ++i)
+        {
+            Worker* worker = new Worker(this);
+            worker->start();
+            workers.push_back(worker);
+        }
+
+        Worker self(this);
+        self.run();
+
+        for (std::vector<Worker*>::iterator itr = workers.begin(); itr != workers.end(); ++itr)
+        {
+            (*itr)->join();
+            delete *itr;
+        }
+
+        _geometryList.clear();
+        _stats.time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+    }
+
+    void optimize(osg::Geometry& geom)
+    {
+        Stats stats;
+        process(geom, stats);
+        _stats += stats;
+    }
+
+    // Cache misses of a triangle list with a FIFO cache of the given size.
+    static unsigned int computeCacheMisses(const std::vector<unsigned int>& indices, unsigned int numVertices, unsigned int cacheSize)
+    {
+        std::vector<unsigned int> timestamps(numVertices, 0);
+        unsigned int time = cacheSize + 1;
+        unsigned int misses = 0;
+        for (std::vector<unsigned int>::const_iterator itr = indices.begin(); itr != indices.end(); ++itr)
+        {
+            if (time - timestamps[*itr] > cacheSize)
+            {
+                timestamps[*itr] = time++;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+
+    // Tom Forsyth's algorithm, with a 32 entry LRU cache model.
+    static void optimizeForsyth(std::vector<unsigned int>& indices, unsigned int numVertices)
+    {
+        const unsigned int maxCache = 32;
+        const unsigned int numTriangles = (unsigned int)(indices.size() / 3);
+        if (numTriangles == 0) return;
+
+        float cacheScores[maxCache];
+        for (unsigned int i = 0; i < maxCache; ++i)
+            cacheScores[i] = i < 3 ? 0.75f : powf(1.0f - float(i - 3) / float(maxCache - 3), 1.5f);
+
+        std::vector<unsigned int> live(numVertices, 0);
+        for (unsigned int i = 0; i < indices.size(); ++i) ++live[indices[i]];
+
+        std::vector<unsigned int> offsets(numVertices + 1, 0);
+        for (unsigned int v = 0; v < numVertices; ++v) offsets[v + 1] = offsets[v] + live[v];
+
+        std::vector<unsigned int> adjacency(indices.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (unsigned int t = 0; t < numTriangles; ++t)
+            for (unsigned int k = 0; k < 3; ++k)
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+
+        std::vector<int> cachePosition(numVertices, -1);
+        std::vector<float> vertexScores(numVertices);
+        for (unsigned int v = 0; v < numVertices; ++v)
+            vertexScores[v] = forsythScore(live[v], -1, cacheScores);
+
+        std::vector<float> triangleScores(numTriangles);
+        for (unsigned int t = 0; t < numTriangles; ++t)
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+        std::vector<unsigned char> emitted(numTriangles, 0);
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+
+        std::vector<unsigned int> cache, newCache;
+        cache.reserve(maxCache + 3);
+        newCache.reserve(maxCache + 3);
+
+        unsigned int cursor = 0;
+        int best = -1;
+        for (unsigned int n = 0; n < numTriangles; ++n)
+        {
+            if (best < 0)
+            {
+                // dead end, continue with the next triangle in input order
+                while (emitted[cursor]) ++cursor;
+                best = (int)cursor;
+            }
+
+            unsigned int t = (unsigned int)best;
+            emitted[t] = 1;
+
+            newCache.clear();
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                unsigned int v = indices[t * 3 + k];
+                result.push_back(v);
+                newCache.push_back(v);
+
+                // remove the triangle from the live part of the vertex's adjacency
+                unsigned int* begin = &adjacency[offsets[v]];
+                unsigned int* end = begin + live[v];
+                unsigned int* found = std::find(begin, end, t);
+                std::swap(*found, *(end - 1));
+                --live[v];
+            }
+            for (std::vector<unsigned int>::const_iterator itr = cache.begin(); itr != cache.end(); ++itr)
+            {
+                if (*itr != newCache[0] && *itr != newCache[1] && *itr != newCache[2])
+                    newCache.push_back(*itr);
+            }
+
+            for (unsigned int i = 0; i < newCache.size(); ++i)
+            {
+                unsigned int v = newCache[i];
+                int position = i < maxCache ? (int)i : -1;
+                cachePosition[v] = position;
+
+                float score = forsythScore(live[v], position, cacheScores);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+
+                for (unsigned int j = offsets[v]; j < offsets[v] + live[v]; ++j)
+                    triangleScores[adjacency[j]] += delta;
+            }
+
+            best = -1;
+            float bestScore = -1.0f;
+            for (unsigned int i = 0; i < newCache.size() && i < maxCache; ++i)
+            {
+                unsigned int v = newCache[i];
+                for (unsigned int j = offsets[v]; j < offsets[v] + live[v]; ++j)
+                {
+                    if (triangleScores[adjacency[j]] > bestScore)
+                    {
+                        bestScore = triangleScores[adjacency[j]];
+                        best = (int)adjacency[j];
+                    }
+                }
+            }
+
+            if (newCache.size() > maxCache) newCache.resize(maxCache);
+            cache.swap(newCache);
+        }
+
+        indices.swap(result);
+    }
+
+    // Tipsify, filling clusters with the index of the first triangle after each hard boundary.
+    static void optimizeTipsify(std::vector<unsigned int>& indices, unsigned int numVertices, unsigned int cacheSize, std::vector<unsigned int>* clusters = 0)
+    {
+        const unsigned int numTriangles = (unsigned int)(indices.size() / 3);
+        if (numTriangles == 0) return;
+
+        std::vector<unsigned int> live(numVertices, 0);
+        for (unsigned int i = 0; i < indices.size(); ++i) ++live[indices[i]];
+
+        std::vector<unsigned int> offsets(numVertices + 1, 0);
+        for (unsigned int v = 0; v < numVertices; ++v) offsets[v + 1] = offsets[v] + live[v];
+
+        std::vector<unsigned int> adjacency(indices.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (unsigned int t = 0; t < numTriangles; ++t)
+            for (unsigned int k = 0; k < 3; ++k)
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+
+        std::vector<unsigned int> timestamps(numVertices, 0);
+        std::vector<unsigned char> emitted(numTriangles, 0);
+        std::vector<unsigned int> deadEnds;
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+
+        if (clusters)
+        {
+            clusters->clear();
+            clusters->push_back(0);
+        }
+
+        unsigned int time = cacheSize + 1;
+        unsigned int cursor = 0;
+        int fan = (int)indices[0];
+        while (fan >= 0)
+        {
+            candidates.clear();
+            unsigned int f = (unsigned int)fan;
+            for (unsigned int j = offsets[f]; j < offsets[f + 1]; ++j)
+            {
+                unsigned int t = adjacency[j];
+                if (emitted[t]) continue;
+                emitted[t] = 1;
+
+                for (unsigned int k = 0; k < 3; ++k)
+                {
+                    unsigned int v = indices[t * 3 + k];
+                    result.push_back(v);
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if (time - timestamps[v] > cacheSize)
+                        timestamps[v] = time++;
+                }
+            }
+
+            // the candidate that will still be in the cache after its remaining triangles are emitted
+            fan = -1;
+            int bestPriority = -1;
+            for (std::vector<unsigned int>::const_iterator itr = candidates.begin(); itr != candidates.end(); ++itr)
+            {
+                unsigned int v = *itr;
+                if (live[v] == 0) continue;
+
+                int priority = 0;
+                if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+                    priority = (int)(time - timestamps[v]);
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    fan = (int)v;
+                }
+            }
+
+            if (fan < 0)
+            {
+                while (!deadEnds.empty())
+                {
+                    unsigned int v = deadEnds.back();
+                    deadEnds.pop_back();
+                    if (live[v] > 0) { fan = (int)v; break; }
+                }
+            }
+
+            if (fan < 0)
+            {
+                while (cursor < numVertices && live[cursor] == 0) ++cursor;
+                if (cursor < numVertices)
+                {
+                    fan = (int)cursor;
+                    if (clusters) clusters->push_back((unsigned int)(result.size() / 3));
+                }
+            }
+        }
+
+        indices.swap(result);
+    }
+
+    // Sorts clusters of triangles so that the ones facing away from the mesh
+    // centre, which are the most likely to occlude, are drawn first.
+    static void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<osg::Vec3d>& positions, const std::vector<unsigned int>& clusters)
+    {
+        const unsigned int numTriangles = (unsigned int)(indices.size() / 3);
+        if (clusters.size() < 2) return;
+
+        std::vector<osg::Vec3d> normals(clusters.size());
+        std::vector<osg::Vec3d> centroids(clusters.size());
+        std::vector<double> areas(clusters.size(), 0.0);
+        osg::Vec3d meshCentroid;
+        double meshArea = 0.0;
+
+        for (unsigned int c = 0; c < clusters.size(); ++c)
+        {
+            unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : numTriangles;
+            for (unsigned int t = clusters[c]; t < end; ++t)
+            {
+                const osg::Vec3d& p0 = positions[indices[t * 3]];
+                const osg::Vec3d& p1 = positions[indices[t * 3 + 1]];
+                const osg::Vec3d& p2 = positions[indices[t * 3 + 2]];
+                osg::Vec3d n = (p1 - p0) ^ (p2 - p0);
+                double area = n.length();
+                osg::Vec3d centre = (p0 + p1 + p2) / 3.0;
+
+                normals[c] += n;
+                centroids[c] += centre * area;
+                areas[c] += area;
+            }
+            meshCentroid += centroids[c];
+            meshArea += areas[c];
+        }
+        if (meshArea <= 0.0) return;
+        meshCentroid /= meshArea;
+
+        std::vector<std::pair<double, unsigned int> > order(clusters.size());
+        for (unsigned int c = 0; c < clusters.size(); ++c)
+        {
+            osg::Vec3d centroid = areas[c] > 0.0 ? centroids[c] / areas[c] : meshCentroid;
+            osg::Vec3d normal = normals[c];
+            normal.normalize();
+            order[c] = std::make_pair(-((centroid - meshCentroid) * normal), c);
+        }
+        std::stable_sort(order.begin(), order.end());
+
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (unsigned int i = 0; i < order.size(); ++i)
+        {
+            unsigned int c = order[i].second;
+            unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : numTriangles;
+            result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+        }
+        indices.swap(result);
+    }
+
+    // Order in which the vertices are first used; unused vertices go last.
+    static void computeFetchOrder(const std::vector<unsigned int>& indices, unsigned int numVertices, std::vector<unsigned int>& order, std::vector<unsigned int>& remap)
+    {
+        remap.assign(numVertices, 0xffffffff);
+        order.clear();
+        order.reserve(numVertices);
+        for (std::vector<unsigned int>::const_iterator itr = indices.begin(); itr != indices.end(); ++itr)
+        {
+            if (remap[*itr] == 0xffffffff)
+            {
+                remap[*itr] = (unsigned int)order.size();
+                order.push_back(*itr);
+            }
+        }
+        for (unsigned int v = 0; v < numVertices; ++v)
+        {
+            if (remap[v] == 0xffffffff)
+            {
+                remap[v] = (unsigned int)order.size();
+                order.push_back(v);
+            }
+        }
+    }
+
+protected:
+
+    class Worker : public OpenThreads::Thread
+    {
+    public:
+        Worker(MeshCacheVisitor* visitor) : _visitor(visitor) {}
+
+        virtual void run()
+        {
+            Stats stats;
+            for (;;)
+            {
+                unsigned int i = (++_visitor->_next) - 1;
+                if (i >= _visitor->_geometryList.size()) break;
+                _visitor->process(*_visitor->_geometryList[i], stats);
+            }
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_visitor->_statsMutex);
+            _visitor->_stats += stats;
+        }
+
+    protected:
+        MeshCacheVisitor* _visitor;
+    };
+
+    static float forsythScore(unsigned int live, int cachePosition, const float* cacheScores)
+    {
+        if (live == 0) return -1.0f;
+        float score = cachePosition >= 0 ? cacheScores[cachePosition] : 0.0f;
+        return score + 2.0f / sqrtf((float)live);
+    }
+
+    static bool isShared(const osg::Array* array)
+    {
+        return array && array->referenceCount() > 1;
+    }
+
+    void process(osg::Geometry& geom, Stats& stats)
+    {
+        osg::Array* vertices = geom.getVertexArray();
+        if (!vertices || vertices->getNumElements() == 0) return;
+
+        const unsigned int numVertices = vertices->getNumElements();
+        bool indexed = true;
+
+        std::vector<osg::Vec3d> positions;
+        if (_options & OVERDRAW_CLUSTERS)
+        {
+            if (osg::Vec3Array* v3 = dynamic_cast<osg::Vec3Array*>(vertices))
+                positions.assign(v3->begin(), v3->end());
+            else if (osg::Vec3dArray* v3d = dynamic_cast<osg::Vec3dArray*>(vertices))
+                positions.assign(v3d->begin(), v3d->end());
+        }
+
+        std::vector<unsigned int> indices, tipsified, clusters;
+        for (unsigned int p = 0; p < geom.getNumPrimitiveSets(); ++p)
+        {
+            osg::DrawElements* elements = geom.getPrimitiveSet(p)->getDrawElements();
+            if (!elements)
+            {
+                indexed = false;
+                continue;
+            }
+            if (elements->getMode() != GL_TRIANGLES || elements->getNumIndices() < 3) continue;
+
+            unsigned int count = elements->getNumIndices() - elements->getNumIndices() % 3;
+            indices.resize(count);
+            for (unsigned int i = 0; i < count; ++i) indices[i] = elements->getElement(i);
+
+            bool valid = true;
+            for (unsigned int i = 0; i < count && valid; ++i) valid = indices[i] < numVertices;
+            if (!valid) continue;
+
+            unsigned int before = computeCacheMisses(indices, numVertices, _cacheSize);
+
+            if (_options & (VERTEX_CACHE_TIPSIFY | OVERDRAW_CLUSTERS))
+            {
+                optimizeTipsify(indices, numVertices, _cacheSize, &clusters);
+                if ((_options & OVERDRAW_CLUSTERS) && positions.size() == numVertices)
+                {
+                    tipsified = indices;
+                    unsigned int tipsifyMisses = computeCacheMisses(indices, numVertices, _cacheSize);
+                    optimizeOverdraw(indices, positions, clusters);
+                    if (computeCacheMisses(indices, numVertices, _cacheSize) > tipsifyMisses * _overdrawThreshold)
+                        indices.swap(tipsified);
+                }
+            }
+            else if (_options & VERTEX_CACHE_FORSYTH)
+            {
+                optimizeForsyth(indices, numVertices);
+            }
+
+            unsigned int after = computeCacheMisses(indices, numVertices, _cacheSize);
+            if (after > before)
+            {
+                // keep the original order, which was already better
+                for (unsigned int i = 0; i < count; ++i) indices[i] = elements->getElement(i);
+                after = before;
+            }
+            else
+            {
+                for (unsigned int i = 0; i < count; ++i) elements->setElement(i, indices[i]);
+                elements->dirty();
+            }
+
+            stats.numTriangles += count / 3;
+            stats.missesBefore += before;
+            stats.missesAfter += after;
+        }
+
+        ++stats.numGeometries;
+
+        if ((_options & VERTEX_FETCH) && indexed)
+            reorderVertices(geom, numVertices);
+    }
+
+    bool isReorderable(osg::Array* array, unsigned int numVertices) const
+    {
+        return array && array->getBinding() == osg::Array::BIND_PER_VERTEX && array->getNumElements() == numVertices;
+    }
+
+    void reorderVertices(osg::Geometry& geom, unsigned int numVertices)
+    {
+        // shared arrays may belong to a geometry being processed on another thread
+        std::vector<osg::Array*> arrays;
+        arrays.push_back(geom.getVertexArray());
+        arrays.push_back(geom.getNormalArray());
+        arrays.push_back(geom.getColorArray());
+        arrays.push_back(geom.getSecondaryColorArray());
+        arrays.push_back(geom.getFogCoordArray());
+        for (unsigned int i = 0; i < geom.getNumTexCoordArrays(); ++i) arrays.push_back(geom.getTexCoordArray(i));
+        for (unsigned int i = 0; i < geom.getNumVertexAttribArrays(); ++i) arrays.push_back(geom.getVertexAttribArray(i));
+
+        for (std::vector<osg::Array*>::const_iterator itr = arrays.begin(); itr != arrays.end(); ++itr)
+        {
+            if (isReorderable(*itr, numVertices) && isShared(*itr)) return;
+        }
+
+        std::vector<unsigned int> indices;
+        for (unsigned int p = 0; p < geom.getNumPrimitiveSets(); ++p)
+        {
+            osg::DrawElements* elements = geom.getPrimitiveSet(p)->getDrawElements();
+            for (unsigned int i = 0; i < elements->getNumIndices(); ++i)
+            {
+                unsigned int index = elements->getElement(i);
+                if (index >= numVertices) return;
+                indices.push_back(index);
+            }
+        }
+
+        std::vector<unsigned int> order, remap;
+        computeFetchOrder(indices, numVertices, order, remap);
+
+        for (unsigned int p = 0; p < geom.getNumPrimitiveSets(); ++p)
+        {
+            osg::DrawElements* elements = geom.getPrimitiveSet(p)->getDrawElements();
+            for (unsigned int i = 0; i < elements->getNumIndices(); ++i)
+                elements->setElement(i, remap[elements->getElement(i)]);
+            elements->dirty();
+        }
+
+        ReorderVertexArrayVisitor reorder(order);
+        for (std::vector<osg::Array*>::const_iterator itr = arrays.begin(); itr != arrays.end(); ++itr)
+        {
+            if (isReorderable(*itr, numVertices)) (*itr)->accept(reorder);
+        }
+        geom.dirtyGLObjects();
+    }
+
+    typedef std::vector<osg::Geometry*> GeometryList;
+    GeometryList _geometryList;
+    unsigned int _options;
+    unsigned int _cacheSize;
+    float _overdrawThreshold;
+    unsigned int _numThreads;
+    OpenThreads::Atomic _next;
+    OpenThreads::Mutex _statsMutex;
+    Stats _stats;
+};
+
+/** Optimizer that adds the MeshCacheVisitor passes, selected with the
+  * MeshCacheVisitor::Options flags, to the standard optimizations.
+  * The mesh passes run after the standard ones, so that INDEX_MESH can
+  * prepare DrawArrays geometry for them.
+  *
+  * Usage:
+  *   osgUtil::MeshCacheOptimizer optimizer;
+  *   optimizer.optimize(node, osgUtil::Optimizer::INDEX_MESH | osgUtil::MeshCacheVisitor::ALL_MESH_CACHE_OPTIMIZATIONS);
+  *   OSG_NOTICE << optimizer.getMeshCacheStats().getACMRAfter() << std::endl;
+  */
+class MeshCacheOptimizer : public Optimizer
+{
+public:
+    MeshCacheOptimizer() : _cacheSize(16), _numThreads(0) {}
+
+    void setCacheSize(unsigned int size) { _cacheSize = size; }
+    unsigned int getCacheSize() const { return _cacheSize; }
+
+    void setNumThreads(unsigned int numThreads) { _numThreads = numThreads; }
+    unsigned int getNumThreads() const { return _numThreads; }
+
+    const MeshCacheVisitor::Stats& getMeshCacheStats() const { return _meshCacheStats; }
+
+    using Optimizer::optimize;
+
+    virtual void optimize(osg::Node* node, unsigned int options)
+    {
+        const unsigned int meshOptions = MeshCacheVisitor::VERTEX_CACHE_FORSYTH | MeshCacheVisitor::VERTEX_CACHE_TIPSIFY |
+                                         MeshCacheVisitor::OVERDRAW_CLUSTERS | MeshCacheVisitor::VERTEX_FETCH;
+
+        Optimizer::optimize(node, options & ~meshOptions);
+
+        _meshCacheStats = MeshCacheVisitor::Stats();
+        if (!node || (options & meshOptions) == 0) return;
+
+        OSG_INFO << "Optimizer::optimize() doing MESH_CACHE" << std::endl;
+
+        MeshCacheVisitor mcv(this, options & meshOptions);
+        mcv.setCacheSize(_cacheSize);
+        mcv.setNumThreads(_numThreads);
+        node->accept(mcv);
+        mcv.optimize();
+        _meshCacheStats = mcv.getStats();
+
+        OSG_INFO << "Optimizer::optimize() MESH_CACHE " << _meshCacheStats.numGeometries << " geometries, "
+                 << _meshCacheStats.numTriangles << " triangles, ACMR " << _meshCacheStats.getACMRBefore()
+                 << " -> " << _meshCacheStats.getACMRAfter() << " in " << _meshCacheStats.time * 1000.0 << "ms" << std::endl;
+    }
+
+protected:
+    unsigned int _cacheSize;
+    unsigned int _numThreads;
+    MeshCacheVisitor::Stats _meshCacheStats;
+};
+
+}
+#endif
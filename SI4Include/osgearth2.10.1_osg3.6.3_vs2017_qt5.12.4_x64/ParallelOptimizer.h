@@ -0,0 +1,361 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGUTIL_PARALLELOPTIMIZER
+#define OSGUTIL_PARALLELOPTIMIZER 1
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <osg/Geometry>
+#include <osg/Billboard>
+#include <osg/Notify>
+#include <osg/Timer>
+
+#include <OpenThreads/Thread>
+#include <OpenThreads/Atomic>
+
+#include <osgUtil/Optimizer>
+#include <osgUtil/MeshOptimizers>
+#include <osgUtil/MeshCacheOptimizer>
+#include <osgUtil/TriStripVisitor>
+
+namespace osgUtil
+{
+
+/** Optimizer that runs the passes working on independent objects on several
+  * threads, and times every pass.
+  *
+  * TESSELLATE_GEOMETRY, MAKE_FAST_GEOMETRY, TRISTRIP_GEOMETRY, INDEX_MESH,
+  * VERTEX_POSTTRANSFORM and VERTEX_PRETRANSFORM process each Geometry on its
+  * own, so these fan out across the threads. Geometries whose arrays or
+  * primitive sets are referenced elsewhere would be changed by more than one
+  * thread, so they are processed afterwards on the calling thread, in
+  * traversal order. The result therefore doesn't depend on the scheduling and
+  * is the same as the serial Optimizer's. The other passes, MERGE_GEOMETRY
+  * included, restructure the graph (adding and releasing children edits the
+  * parent lists of shared StateSets and child Groups) and run serially,
+  * through Optimizer, in the same order as Optimizer::optimize() applies them. The MeshCacheVisitor flags
+  * are handled as by MeshCacheOptimizer, after the standard passes.
+  *
+  * Usage:
+  *   osgUtil::ParallelOptimizer optimizer;
+  *   optimizer.optimize(node);
+  *   const osgUtil::ParallelOptimizer::PassTimings& timings = optimizer.getPassTimings();
+  */
+class ParallelOptimizer : public MeshCacheOptimizer
+{
+public:
+
+    struct PassTiming
+    {
+        PassTiming() : option(0), time(0.0), numObjects(0), parallel(false) {}
+
+        unsigned int option;
+        std::string name;
+        double time;              // seconds
+        unsigned int numObjects;  // objects processed by a parallel pass
+        bool parallel;
+    };
+    typedef std::vector<PassTiming> PassTimings;
+
+    ParallelOptimizer() : _parallel(true) {}
+
+    /** Run the independent passes on several threads, default is true. When false
+      * the passes are only timed.*/
+    void setParallel(bool parallel) { _parallel = parallel; }
+    bool getParallel() const { return _parallel; }
+
+    /** Timings of the passes run by the last call to optimize().*/
+    const PassTimings& getPassTimings() const { return _passTimings; }
+
+    double getTotalTime() const
+    {
+        double total = 0.0;
+        for (PassTimings::const_iterator itr = _passTimings.begin(); itr != _passTimings.end(); ++itr)
+            total += itr->time;
+        return total;
+    }
+
+    using Optimizer::optimize;
+
+    virtual void optimize(osg::Node* node, unsigned int options)
+    {
+        _passTimings.clear();
+        if (!node) return;
+
+        static const Pass passes[] =
+        {
+            { TESSELLATE_GEOMETRY, "TESSELLATE_GEOMETRY" },
+            { REMOVE_LOADED_PROXY_NODES, "REMOVE_LOADED_PROXY_NODES" },
+            { COMBINE_ADJACENT_LODS, "COMBINE_ADJACENT_LODS" },
+            { OPTIMIZE_TEXTURE_SETTINGS, "OPTIMIZE_TEXTURE_SETTINGS" },
+            { SHARE_DUPLICATE_STATE, "SHARE_DUPLICATE_STATE" },
+            { TEXTURE_ATLAS_BUILDER, "TEXTURE_ATLAS_BUILDER" },
+            { COPY_SHARED_NODES, "COPY_SHARED_NODES" },
+            { FLATTEN_STATIC_TRANSFORMS, "FLATTEN_STATIC_TRANSFORMS" },
+            { FLATTEN_STATIC_TRANSFORMS_DUPLICATING_SHARED_SUBGRAPHS, "FLATTEN_STATIC_TRANSFORMS_DUPLICATING_SHARED_SUBGRAPHS" },
+            { MERGE_GEODES, "MERGE_GEODES" },
+            { MAKE_FAST_GEOMETRY, "MAKE_FAST_GEOMETRY" },
+            { MERGE_GEOMETRY, "MERGE_GEOMETRY" },
+            { TRISTRIP_GEOMETRY, "TRISTRIP_GEOMETRY" },
+            { REMOVE_REDUNDANT_NODES, "REMOVE_REDUNDANT_NODES" },
+            { FLATTEN_BILLBOARDS, "FLATTEN_BILLBOARDS" },
+            { SPATIALIZE_GROUPS, "SPATIALIZE_GROUPS" },
+            { INDEX_MESH, "INDEX_MESH" },
+            { VERTEX_POSTTRANSFORM, "VERTEX_POSTTRANSFORM" },
+            { VERTEX_PRETRANSFORM, "VERTEX_PRETRANSFORM" },
+            { BUFFER_OBJECT_SETTINGS, "BUFFER_OBJECT_SETTINGS" },
+            { STATIC_OBJECT_DETECTION, "STATIC_OBJECT_DETECTION" }
+        };
+
+        for (unsigned int i = 0; i < sizeof(passes) / sizeof(passes[0]); ++i)
+        {
+            if ((options & passes[i].option) == 0) continue;
+
+            PassTiming timing;
+            timing.option = passes[i].option;
+            timing.name = passes[i].name;
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            if (_parallel && isParallelPass(passes[i].option))
+            {
+                timing.numObjects = runParallel(node, passes[i].option);
+                timing.parallel = true;
+            }
+            else
+            {
+                Optimizer::optimize(node, passes[i].option);
+            }
+            timing.time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            report(timing);
+            _passTimings.push_back(timing);
+        }
+
+        const unsigned int meshOptions = MeshCacheVisitor::VERTEX_CACHE_FORSYTH | MeshCacheVisitor::VERTEX_CACHE_TIPSIFY |
+                                         MeshCacheVisitor::OVERDRAW_CLUSTERS | MeshCacheVisitor::VERTEX_FETCH;
+        if (options & meshOptions)
+        {
+            unsigned int numThreads = getNumThreads();
+            if (!_parallel) setNumThreads(1);
+
+            PassTiming timing;
+            timing.option = options & meshOptions;
+            timing.name = "MESH_CACHE";
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            MeshCacheOptimizer::optimize(node, options & meshOptions);
+            timing.time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+            timing.numObjects = getMeshCacheStats().numGeometries;
+            timing.parallel = _parallel;
+
+            setNumThreads(numThreads);
+            report(timing);
+            _passTimings.push_back(timing);
+        }
+    }
+
+protected:
+
+    struct Pass
+    {
+        unsigned int option;
+        const char* name;
+    };
+
+    typedef std::vector<osg::Node*> ObjectList;
+
+    /** Collects, in traversal order and once each, the objects a parallel pass works on.*/
+    class CollectObjectsVisitor : public BaseOptimizerVisitor
+    {
+    public:
+        CollectObjectsVisitor(Optimizer* optimizer, unsigned int option) :
+            BaseOptimizerVisitor(optimizer, option) {}
+
+        virtual void apply(osg::Geometry& geom)
+        {
+            if (isOperationPermissibleForObject(&geom))
+                _objects.push_back(&geom);
+        }
+
+        virtual void apply(osg::Billboard&) {}
+
+        ObjectList& getObjects()
+        {
+            // drop the repeats of shared objects, keeping the first occurrence
+            std::vector<std::pair<osg::Node*, unsigned int> > sorted(_objects.size());
+            for (unsigned int i = 0; i < _objects.size(); ++i)
+                sorted[i] = std::make_pair(_objects[i], i);
+            std::sort(sorted.begin(), sorted.end());
+
+            std::vector<unsigned int> firsts;
+            for (unsigned int i = 0; i < sorted.size(); ++i)
+            {
+                if (i == 0 || sorted[i].first != sorted[i - 1].first)
+                    firsts.push_back(sorted[i].second);
+            }
+            std::sort(firsts.begin(), firsts.end());
+
+            ObjectList objects;
+            objects.reserve(firsts.size());
+            for (std::vector<unsigned int>::const_iterator itr = firsts.begin(); itr != firsts.end(); ++itr)
+                objects.push_back(_objects[*itr]);
+            _objects.swap(objects);
+            return _objects;
+        }
+
+    protected:
+        ObjectList _objects;
+    };
+
+    class Worker : public OpenThreads::Thread
+    {
+    public:
+        Worker(ParallelOptimizer* optimizer, unsigned int option, const ObjectList& objects, OpenThreads::Atomic& next) :
+            _optimizer(optimizer), _option(option), _objects(objects), _next(next) {}
+
+        virtual void run()
+        {
+            // each thread has its own visitors, the per object methods keep no shared state
+            TessellateVisitor tessellate(_optimizer);
+            MakeFastGeometryVisitor makeFast(_optimizer);
+            TriStripVisitor triStrip(_optimizer);
+            IndexMeshVisitor indexMesh(_optimizer);
+            VertexCacheVisitor vertexCache(_optimizer);
+            VertexAccessOrderVisitor vertexAccessOrder(_optimizer);
+
+            for (;;)
+            {
+                unsigned int i = (++_next) - 1;
+                if (i >= _objects.size()) break;
+
+                osg::Geometry* geom = _objects[i]->asGeometry();
+                switch (_option)
+                {
+                case TESSELLATE_GEOMETRY:   tessellate.apply(*geom); break;
+                case MAKE_FAST_GEOMETRY:    makeFast.apply(*geom); break;
+                case TRISTRIP_GEOMETRY:     triStrip.stripify(*geom); break;
+                case INDEX_MESH:            indexMesh.makeMesh(*geom); break;
+                case VERTEX_POSTTRANSFORM:  vertexCache.optimizeVertices(*geom); break;
+                case VERTEX_PRETRANSFORM:   vertexAccessOrder.optimizeOrder(*geom); break;
+                default: break;
+                }
+            }
+        }
+
+    protected:
+        Worker& operator = (const Worker&) { return *this; }
+
+        ParallelOptimizer* _optimizer;
+        unsigned int _option;
+        const ObjectList& _objects;
+        OpenThreads::Atomic& _next;
+    };
+
+    static bool isParallelPass(unsigned int option)
+    {
+        return option == TESSELLATE_GEOMETRY || option == MAKE_FAST_GEOMETRY ||
+               option == TRISTRIP_GEOMETRY || option == INDEX_MESH ||
+               option == VERTEX_POSTTRANSFORM || option == VERTEX_PRETRANSFORM;
+    }
+
+    static bool isShared(const osg::Referenced* data)
+    {
+        return data && data->referenceCount() > 1;
+    }
+
+    static bool hasSharedArrays(osg::Geometry& geom)
+    {
+        if (isShared(geom.getVertexArray()) || isShared(geom.getNormalArray()) || isShared(geom.getColorArray()) ||
+            isShared(geom.getSecondaryColorArray()) || isShared(geom.getFogCoordArray()))
+            return true;
+        for (unsigned int i = 0; i < geom.getTexCoordArrayList().size(); ++i)
+        {
+            if (isShared(geom.getTexCoordArrayList()[i].get())) return true;
+        }
+        for (unsigned int i = 0; i < geom.getVertexAttribArrayList().size(); ++i)
+        {
+            if (isShared(geom.getVertexAttribArrayList()[i].get())) return true;
+        }
+        for (unsigned int i = 0; i < geom.getNumPrimitiveSets(); ++i)
+        {
+            if (isShared(geom.getPrimitiveSet(i))) return true;
+        }
+        return false;
+    }
+
+    unsigned int runParallel(osg::Node* node, unsigned int option)
+    {
+        CollectObjectsVisitor collect(this, option);
+        node->accept(collect);
+        ObjectList& objects = collect.getObjects();
+
+        // Geometries sharing arrays or primitive sets with other geometries
+        // would have them rewritten by several threads at once, so they are
+        // processed afterwards on this thread.
+        ObjectList serial, parallel;
+        for (ObjectList::iterator itr = objects.begin(); itr != objects.end(); ++itr)
+        {
+            osg::Geometry* geom = (*itr)->asGeometry();
+            if (hasSharedArrays(*geom)) serial.push_back(geom);
+            else parallel.push_back(geom);
+        }
+        objects.swap(parallel);
+
+        unsigned int numThreads = getNumThreads() > 0 ? getNumThreads() : (unsigned int)osg::maximum(OpenThreads::GetNumberOfProcessors(), 1);
+        numThreads = osg::minimum(numThreads, (unsigned int)objects.size());
+
+        OpenThreads::Atomic next;
+        std::vector<Worker*> workers;
+        for (unsigned int i = 1; i < numThreads; ++i)
+        {
+            Worker* worker = new Worker(this, option, objects, next);
+            worker->start();
+            workers.push_back(worker);
+        }
+
+        Worker self(this, option, objects, next);
+        self.run();
+
+        for (std::vector<Worker*>::iterator itr = workers.begin(); itr != workers.end(); ++itr)
+        {
+            (*itr)->join();
+            delete *itr;
+        }
+
+        if (!serial.empty())
+        {
+            OpenThreads::Atomic serialNext;
+            Worker worker(this, option, serial, serialNext);
+            worker.run();
+        }
+
+        return (unsigned int)(objects.size() + serial.size());
+    }
+
+    void report(const PassTiming& timing) const
+    {
+        OSG_INFO << "Optimizer::optimize() " << timing.name << " took " << timing.time * 1000.0 << "ms";
+        if (timing.parallel) OSG_INFO << " (" << timing.numObjects << " objects in parallel)";
+        OSG_INFO << std::endl;
+    }
+
+    bool _parallel;
+    PassTimings _passTimings;
+};
+
+}
+
+#endif
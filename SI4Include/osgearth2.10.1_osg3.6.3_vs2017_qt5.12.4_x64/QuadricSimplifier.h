@@ -0,0 +1,894 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGUTIL_QUADRICSIMPLIFIER
+#define OSGUTIL_QUADRICSIMPLIFIER 1
+
+#include <osgUtil/Simplifier>
+#include <osgUtil/SmoothingVisitor>
+#include <osgUtil/TriStripVisitor>
+
+#include <osg/TriangleIndexFunctor>
+#include <osg/Notify>
+
+#include <OpenThreads/Thread>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+namespace osgUtil {
+
+/** A Simplifier that reduces triangles with quadric error metrics (Garland & Heckbert)
+  * instead of the EdgeCollapse set structures of the base class.
+  *
+  * Points, triangles, edges and quadrics are held in flat arrays, the per triangle
+  * quadrics and the initial collapse costs are computed on several threads, and the
+  * collapses are taken in error order from a binary heap. The options of Simplifier
+  * (sample ratio, maximum error, ContinueSimplificationCallback, tri stripping and
+  * smoothing) apply unchanged; the error passed to continueSimplification is the
+  * root mean square distance of the collapsed point to the planes it replaces.
+  *
+  * Up sampling (sampleRatio>1.0) is left to Simplifier.
+  *
+  * Usage:
+  *   osgUtil::QuadricSimplifier simplifier(0.25);
+  *   model->accept(simplifier);
+  */
+class QuadricSimplifier : public Simplifier
+{
+    public:
+
+        QuadricSimplifier(double sampleRatio=1.0, double maximumError=FLT_MAX, double maximumLength=0.0) :
+            Simplifier(sampleRatio, maximumError, maximumLength),
+            _preserveAttributes(true),
+            _boundaryWeight(10.0),
+            _numThreads(0) {}
+
+        META_NodeVisitor(osgUtil, QuadricSimplifier)
+
+        /** Keep the points where attributes (texture coordinates, normals, colors) are discontinuous,
+          * so that texture seams stay intact. Points sharing a position and all their per vertex
+          * attributes are welded either way. When false, points sharing a position are welded
+          * regardless of their attributes and take those of the first of them. Default is true.*/
+        void setPreserveAttributes(bool on) { _preserveAttributes = on; }
+        bool getPreserveAttributes() const { return _preserveAttributes; }
+
+        /** Set the weight of the planes that hold open mesh boundaries in place. Default is 10.*/
+        void setBoundaryWeight(double weight) { _boundaryWeight = weight; }
+        double getBoundaryWeight() const { return _boundaryWeight; }
+
+        /** Set the number of threads used for the error computation, 0 uses one per processor.*/
+        void setNumThreads(unsigned int numThreads) { _numThreads = numThreads; }
+        unsigned int getNumThreads() const { return _numThreads; }
+
+        virtual void apply(osg::Geometry& geom)
+        {
+            simplifyQuadric(geom, IndexList());
+        }
+
+        /** simplify the geometry, whilst protecting key points from being moved or removed.*/
+        void simplifyQuadric(osg::Geometry& geometry, const IndexList& protectedPoints)
+        {
+            if (!requiresDownSampling())
+            {
+                simplify(geometry, protectedPoints);
+                return;
+            }
+
+            Mesh mesh;
+            if (!mesh.read(geometry, _preserveAttributes))
+            {
+                OSG_INFO<<"QuadricSimplifier: unsupported geometry, using Simplifier."<<std::endl;
+                simplify(geometry, protectedPoints);
+                return;
+            }
+
+            if (mesh._numTriangles==0) return;
+
+            for(IndexList::const_iterator itr = protectedPoints.begin(); itr != protectedPoints.end(); ++itr)
+            {
+                if (*itr < mesh._canonical.size()) mesh._flags[mesh._canonical[*itr]] |= LOCKED;
+            }
+
+            unsigned int numOriginal = mesh._numTriangles;
+            mesh.computeQuadrics(_boundaryWeight, getNumberOfThreads());
+            mesh.collapse(*this, numOriginal, getNumberOfThreads());
+            mesh.write(geometry);
+
+            if (_smoothing)
+            {
+                osgUtil::SmoothingVisitor::smooth(geometry);
+            }
+
+            if (_triStrip)
+            {
+                osgUtil::TriStripVisitor stripper;
+                stripper.stripify(geometry);
+            }
+        }
+
+    protected:
+
+        enum Flags
+        {
+            DEAD = 1,   // collapsed into another point
+            LOCKED = 2, // may be a collapse target, but doesn't move
+            SEAM = 4    // attribute discontinuity, never collapsed
+        };
+
+        /** symmetric 4x4 error matrix, plus the sum of the weights of its planes.*/
+        struct Quadric
+        {
+            double q[10];
+            double w;
+
+            Quadric() { for(unsigned int i=0; i<10; ++i) q[i] = 0.0; w = 0.0; }
+
+            void addPlane(double a, double b, double c, double d, double weight)
+            {
+                q[0] += weight*a*a; q[1] += weight*a*b; q[2] += weight*a*c; q[3] += weight*a*d;
+                q[4] += weight*b*b; q[5] += weight*b*c; q[6] += weight*b*d;
+                q[7] += weight*c*c; q[8] += weight*c*d;
+                q[9] += weight*d*d;
+            }
+
+            Quadric& operator += (const Quadric& rhs)
+            {
+                for(unsigned int i=0; i<10; ++i) q[i] += rhs.q[i];
+                w += rhs.w;
+                return *this;
+            }
+
+            double error(const osg::Vec3d& v) const
+            {
+                double x = v.x(), y = v.y(), z = v.z();
+                double e = q[0]*x*x + 2.0*q[1]*x*y + 2.0*q[2]*x*z + 2.0*q[3]*x
+                         + q[4]*y*y + 2.0*q[5]*y*z + 2.0*q[6]*y
+                         + q[7]*z*z + 2.0*q[8]*z
+                         + q[9];
+                return w>0.0 ? osg::maximum(e, 0.0)/w : osg::maximum(e, 0.0);
+            }
+
+            /** point of least error, false if the matrix is close to singular.*/
+            bool optimal(osg::Vec3d& v) const
+            {
+                double a00 = q[0], a01 = q[1], a02 = q[2];
+                double a11 = q[4], a12 = q[5], a22 = q[7];
+                double c00 = a11*a22 - a12*a12;
+                double c01 = a02*a12 - a01*a22;
+                double c02 = a01*a12 - a02*a11;
+                double det = a00*c00 + a01*c01 + a02*c02;
+                double scale = a00 + a11 + a22;
+                if (scale<=0.0 || std::fabs(det) <= 1e-12*scale*scale*scale) return false;
+
+                double c11 = a00*a22 - a02*a02;
+                double c12 = a01*a02 - a00*a12;
+                double c22 = a00*a11 - a01*a01;
+                double b0 = -q[3], b1 = -q[6], b2 = -q[8];
+                double inv = 1.0/det;
+                v.set((c00*b0 + c01*b1 + c02*b2)*inv,
+                      (c01*b0 + c11*b1 + c12*b2)*inv,
+                      (c02*b0 + c12*b1 + c22*b2)*inv);
+                return true;
+            }
+        };
+
+        /** a candidate collapse of _remove into _keep, moving _keep to _position.*/
+        struct Candidate
+        {
+            double _error;
+            osg::Vec3d _position;
+            unsigned int _keep;
+            unsigned int _remove;
+            unsigned int _keepVersion;
+            unsigned int _removeVersion;
+
+            bool operator < (const Candidate& rhs) const { return _error > rhs._error; }
+        };
+
+        /** splits [0,count) over a number of threads, running the first range on the calling thread.*/
+        struct ParallelRange
+        {
+            virtual ~ParallelRange() {}
+            virtual void run(unsigned int begin, unsigned int end) = 0;
+
+            class Worker : public OpenThreads::Thread
+            {
+            public:
+                Worker(ParallelRange* range, unsigned int begin, unsigned int end) : _range(range), _begin(begin), _end(end) {}
+                virtual void run() { _range->run(_begin, _end); }
+            protected:
+                ParallelRange* _range;
+                unsigned int _begin, _end;
+            };
+
+            void execute(unsigned int count, unsigned int numThreads)
+            {
+                const unsigned int minimumPerThread = 4096;
+                numThreads = osg::minimum(numThreads, count/minimumPerThread);
+                if (numThreads<=1)
+                {
+                    run(0, count);
+                    return;
+                }
+
+                unsigned int chunk = (count + numThreads - 1)/numThreads;
+                std::vector<Worker*> workers;
+                for(unsigned int begin = chunk; begin < count; begin += chunk)
+                {
+                    Worker* worker = new Worker(this, begin, osg::minimum(begin+chunk, count));
+                    worker->start();
+                    workers.push_back(worker);
+                }
+
+                run(0, chunk);
+
+                for(std::vector<Worker*>::iterator itr = workers.begin(); itr != workers.end(); ++itr)
+                {
+                    (*itr)->join();
+                    delete *itr;
+                }
+            }
+        };
+
+        struct CollectTriangles
+        {
+            std::vector<unsigned int>* _indices;
+
+            CollectTriangles() : _indices(0) {}
+
+            void operator() (unsigned int p1, unsigned int p2, unsigned int p3)
+            {
+                if (p1==p2 || p2==p3 || p1==p3) return;
+                _indices->push_back(p1);
+                _indices->push_back(p2);
+                _indices->push_back(p3);
+            }
+        };
+
+        /** reorders the per vertex arrays of a geometry to the points kept by the simplification.*/
+        class RemapArrays : public osg::ArrayVisitor
+        {
+            public:
+
+                RemapArrays(const std::vector<unsigned int>& order) : _order(order) {}
+
+                template<class ArrayType>
+                void remap(ArrayType& array)
+                {
+                    std::vector<typename ArrayType::ElementDataType> data;
+                    data.reserve(_order.size());
+                    for(std::vector<unsigned int>::const_iterator itr = _order.begin(); itr != _order.end(); ++itr)
+                    {
+                        data.push_back(array[*itr]);
+                    }
+                    array.assign(data.begin(), data.end());
+                    array.dirty();
+                }
+
+                virtual void apply(osg::ByteArray& array) { remap(array); }
+                virtual void apply(osg::ShortArray& array) { remap(array); }
+                virtual void apply(osg::IntArray& array) { remap(array); }
+                virtual void apply(osg::UByteArray& array) { remap(array); }
+                virtual void apply(osg::UShortArray& array) { remap(array); }
+                virtual void apply(osg::UIntArray& array) { remap(array); }
+                virtual void apply(osg::FloatArray& array) { remap(array); }
+                virtual void apply(osg::DoubleArray& array) { remap(array); }
+
+                virtual void apply(osg::Vec2bArray& array) { remap(array); }
+                virtual void apply(osg::Vec3bArray& array) { remap(array); }
+                virtual void apply(osg::Vec4bArray& array) { remap(array); }
+                virtual void apply(osg::Vec2sArray& array) { remap(array); }
+                virtual void apply(osg::Vec3sArray& array) { remap(array); }
+                virtual void apply(osg::Vec4sArray& array) { remap(array); }
+                virtual void apply(osg::Vec2ubArray& array) { remap(array); }
+                virtual void apply(osg::Vec3ubArray& array) { remap(array); }
+                virtual void apply(osg::Vec4ubArray& array) { remap(array); }
+                virtual void apply(osg::Vec2usArray& array) { remap(array); }
+                virtual void apply(osg::Vec3usArray& array) { remap(array); }
+                virtual void apply(osg::Vec4usArray& array) { remap(array); }
+
+                virtual void apply(osg::Vec2Array& array) { remap(array); }
+                virtual void apply(osg::Vec3Array& array) { remap(array); }
+                virtual void apply(osg::Vec4Array& array) { remap(array); }
+                virtual void apply(osg::Vec2dArray& array) { remap(array); }
+                virtual void apply(osg::Vec3dArray& array) { remap(array); }
+                virtual void apply(osg::Vec4dArray& array) { remap(array); }
+
+            protected:
+
+                RemapArrays& operator = (const RemapArrays&) { return *this; }
+
+                const std::vector<unsigned int>& _order;
+        };
+
+        struct Mesh
+        {
+            osg::Geometry* _geometry;
+            unsigned int _numVertices;
+            unsigned int _numTriangles;
+            bool _preserveAttributes;
+
+            std::vector<osg::Vec3d> _positions;          // per point
+            std::vector<const osg::Array*> _attributes;  // per vertex arrays other than the positions
+            std::vector<unsigned int> _canonical;        // point -> first point it is welded to
+            std::vector<unsigned char> _flags;           // per point
+            std::vector<unsigned int> _versions;         // per point, bumped whenever it moves
+            std::vector<Quadric> _quadrics;              // per point
+            std::vector<std::vector<unsigned int> > _vertexTriangles; // point -> triangles using it
+
+            std::vector<unsigned int> _corners;          // 3 original points per triangle
+            std::vector<unsigned int> _triangles;        // 3 canonical points per triangle
+            std::vector<unsigned char> _triangleDead;
+
+            std::vector<unsigned int> _edges;            // 2 canonical points per unique edge
+            std::vector<unsigned int> _boundaryEdges;    // edge -> triangle for edges used by a single triangle
+
+            Mesh() : _geometry(0), _numVertices(0), _numTriangles(0), _preserveAttributes(true) {}
+
+            bool read(osg::Geometry& geometry, bool preserveAttributes)
+            {
+                _geometry = &geometry;
+                _preserveAttributes = preserveAttributes;
+
+                osg::Array* vertices = geometry.getVertexArray();
+                if (!vertices) return false;
+
+                _numVertices = vertices->getNumElements();
+                _positions.resize(_numVertices);
+                if (osg::Vec3Array* v3 = dynamic_cast<osg::Vec3Array*>(vertices))
+                {
+                    for(unsigned int i=0; i<_numVertices; ++i) _positions[i] = (*v3)[i];
+                }
+                else if (osg::Vec3dArray* v3d = dynamic_cast<osg::Vec3dArray*>(vertices))
+                {
+                    for(unsigned int i=0; i<_numVertices; ++i) _positions[i] = (*v3d)[i];
+                }
+                else
+                {
+                    return false;
+                }
+
+                // only triangles are simplified, as in Simplifier
+                for(unsigned int i=0; i<geometry.getNumPrimitiveSets(); ++i)
+                {
+                    GLenum mode = geometry.getPrimitiveSet(i)->getMode();
+                    if (mode==GL_POINTS || mode==GL_LINES || mode==GL_LINE_STRIP || mode==GL_LINE_LOOP) return false;
+                }
+
+                osg::TriangleIndexFunctor<CollectTriangles> collect;
+                collect._indices = &_corners;
+                geometry.accept(collect);
+
+                for(std::vector<unsigned int>::const_iterator itr = _corners.begin(); itr != _corners.end(); ++itr)
+                {
+                    if (*itr >= _numVertices) return false;
+                }
+
+                if (_preserveAttributes) collectAttributes(geometry);
+                weld();
+
+                _triangles.resize(_corners.size());
+                for(unsigned int i=0; i<_corners.size(); ++i) _triangles[i] = _canonical[_corners[i]];
+
+                _numTriangles = 0;
+                _triangleDead.assign(_corners.size()/3, 0);
+                _vertexTriangles.resize(_numVertices);
+                for(unsigned int t=0; t<_triangleDead.size(); ++t)
+                {
+                    const unsigned int* tri = &_triangles[t*3];
+                    if (tri[0]==tri[1] || tri[1]==tri[2] || tri[0]==tri[2])
+                    {
+                        _triangleDead[t] = 1;
+                        continue;
+                    }
+                    ++_numTriangles;
+                    for(unsigned int k=0; k<3; ++k) _vertexTriangles[tri[k]].push_back(t);
+                }
+
+                _versions.assign(_numVertices, 0);
+                buildEdges();
+                return true;
+            }
+
+            void addAttribute(const osg::Array* array)
+            {
+                if (array && array->getBinding()==osg::Array::BIND_PER_VERTEX && array->getNumElements()>=_numVertices)
+                    _attributes.push_back(array);
+            }
+
+            void collectAttributes(const osg::Geometry& geometry)
+            {
+                _attributes.clear();
+                addAttribute(geometry.getNormalArray());
+                addAttribute(geometry.getColorArray());
+                addAttribute(geometry.getSecondaryColorArray());
+                addAttribute(geometry.getFogCoordArray());
+                for(unsigned int i=0; i<geometry.getNumTexCoordArrays(); ++i) addAttribute(geometry.getTexCoordArray(i));
+                for(unsigned int i=0; i<geometry.getNumVertexAttribArrays(); ++i) addAttribute(geometry.getVertexAttribArray(i));
+            }
+
+            int compareAttributes(unsigned int lhs, unsigned int rhs) const
+            {
+                for(std::vector<const osg::Array*>::const_iterator itr = _attributes.begin(); itr != _attributes.end(); ++itr)
+                {
+                    int result = (*itr)->compare(lhs, rhs);
+                    if (result!=0) return result;
+                }
+                return 0;
+            }
+
+            /** orders points by position, then by attributes, so that the points to weld are adjacent.*/
+            struct VertexLess
+            {
+                const Mesh* _mesh;
+                bool operator() (unsigned int lhs, unsigned int rhs) const
+                {
+                    const osg::Vec3d& l = _mesh->_positions[lhs];
+                    const osg::Vec3d& r = _mesh->_positions[rhs];
+                    if (l<r) return true;
+                    if (r<l) return false;
+                    int result = _mesh->compareAttributes(lhs, rhs);
+                    if (result!=0) return result<0;
+                    return lhs<rhs;
+                }
+            };
+
+            void weld()
+            {
+                std::vector<unsigned int> order(_numVertices);
+                for(unsigned int i=0; i<_numVertices; ++i) order[i] = i;
+
+                VertexLess less;
+                less._mesh = this;
+                std::sort(order.begin(), order.end(), less);
+
+                _canonical.resize(_numVertices);
+                _flags.assign(_numVertices, 0);
+                for(unsigned int i=0; i<_numVertices;)
+                {
+                    unsigned int j = i+1;
+                    while(j<_numVertices && _positions[order[j]]==_positions[order[i]]) ++j;
+
+                    // points with equal attributes are welded; if several sets of attributes
+                    // meet at the position it is a seam, and all of its points are kept
+                    bool seam = false;
+                    unsigned int first = i;
+                    for(unsigned int k=i; k<j; ++k)
+                    {
+                        if (k>first && compareAttributes(order[k], order[first])!=0)
+                        {
+                            first = k;
+                            seam = true;
+                        }
+                        _canonical[order[k]] = order[first];
+                    }
+
+                    if (seam)
+                    {
+                        for(unsigned int k=i; k<j; ++k) _flags[order[k]] |= SEAM;
+                    }
+                    i = j;
+                }
+            }
+
+            void buildEdges()
+            {
+                // (min, max, triangle) for each half edge, sorted so that shared edges are adjacent
+                std::vector<unsigned long long> halfEdges;
+                halfEdges.reserve(_numTriangles*3);
+                for(unsigned int t=0; t<_triangleDead.size(); ++t)
+                {
+                    if (_triangleDead[t]) continue;
+                    const unsigned int* tri = &_triangles[t*3];
+                    for(unsigned int k=0; k<3; ++k)
+                    {
+                        unsigned int a = tri[k], b = tri[(k+1)%3];
+                        if (b<a) std::swap(a, b);
+                        halfEdges.push_back(((unsigned long long)a<<32) | b);
+                    }
+                }
+                std::sort(halfEdges.begin(), halfEdges.end());
+
+                for(unsigned int i=0; i<halfEdges.size();)
+                {
+                    unsigned int j = i+1;
+                    while(j<halfEdges.size() && halfEdges[j]==halfEdges[i]) ++j;
+
+                    unsigned int a = (unsigned int)(halfEdges[i]>>32);
+                    unsigned int b = (unsigned int)(halfEdges[i] & 0xffffffff);
+                    _edges.push_back(a);
+                    _edges.push_back(b);
+                    if (j-i==1)
+                    {
+                        _boundaryEdges.push_back(a);
+                        _boundaryEdges.push_back(b);
+                    }
+                    i = j;
+                }
+            }
+
+            osg::Vec3d faceNormal(unsigned int t) const
+            {
+                const unsigned int* tri = &_triangles[t*3];
+                return (_positions[tri[1]]-_positions[tri[0]]) ^ (_positions[tri[2]]-_positions[tri[0]]);
+            }
+
+            struct ComputeTriangleQuadrics : public ParallelRange
+            {
+                const Mesh* _mesh;
+                std::vector<Quadric>* _result;
+
+                virtual void run(unsigned int begin, unsigned int end)
+                {
+                    for(unsigned int t=begin; t<end; ++t)
+                    {
+                        if (_mesh->_triangleDead[t]) continue;
+
+                        osg::Vec3d n = _mesh->faceNormal(t);
+                        double area2 = n.normalize();
+                        if (area2<=0.0) continue;
+
+                        const osg::Vec3d& p = _mesh->_positions[_mesh->_triangles[t*3]];
+                        Quadric& q = (*_result)[t];
+                        q.addPlane(n.x(), n.y(), n.z(), -(n*p), area2*0.5);
+                        q.w = area2*0.5;
+                    }
+                }
+            };
+
+            void computeQuadrics(double boundaryWeight, unsigned int numThreads)
+            {
+                std::vector<Quadric> triangleQuadrics(_triangleDead.size());
+
+                ComputeTriangleQuadrics compute;
+                compute._mesh = this;
+                compute._result = &triangleQuadrics;
+                compute.execute((unsigned int)_triangleDead.size(), numThreads);
+
+                _quadrics.resize(_numVertices);
+                for(unsigned int t=0; t<_triangleDead.size(); ++t)
+                {
+                    if (_triangleDead[t]) continue;
+                    for(unsigned int k=0; k<3; ++k) _quadrics[_triangles[t*3+k]] += triangleQuadrics[t];
+                }
+
+                // planes through the boundary edges, perpendicular to their triangle, hold borders in place
+                for(unsigned int i=0; i<_boundaryEdges.size(); i+=2)
+                {
+                    unsigned int a = _boundaryEdges[i], b = _boundaryEdges[i+1];
+                    const std::vector<unsigned int>& triangles = _vertexTriangles[a];
+                    for(std::vector<unsigned int>::const_iterator itr = triangles.begin(); itr != triangles.end(); ++itr)
+                    {
+                        if (!usesPoint(*itr, b)) continue;
+
+                        osg::Vec3d edge = _positions[b]-_positions[a];
+                        osg::Vec3d n = edge ^ faceNormal(*itr);
+                        if (n.normalize()<=0.0) break;
+
+                        Quadric q;
+                        q.addPlane(n.x(), n.y(), n.z(), -(n*_positions[a]), boundaryWeight*edge.length2());
+                        for(unsigned int k=0; k<10; ++k)
+                        {
+                            _quadrics[a].q[k] += q.q[k];
+                            _quadrics[b].q[k] += q.q[k];
+                        }
+                        break;
+                    }
+                }
+            }
+
+            bool usesPoint(unsigned int t, unsigned int v) const
+            {
+                const unsigned int* tri = &_triangles[t*3];
+                return tri[0]==v || tri[1]==v || tri[2]==v;
+            }
+
+            bool candidate(unsigned int a, unsigned int b, Candidate& c) const
+            {
+                if ((_flags[a]|_flags[b]) & (DEAD|SEAM)) return false;
+                if ((_flags[a] & LOCKED) && (_flags[b] & LOCKED)) return false;
+
+                Quadric q = _quadrics[a];
+                q += _quadrics[b];
+
+                double errorA = q.error(_positions[a]);
+                double errorB = q.error(_positions[b]);
+
+                if (_flags[b] & LOCKED)
+                {
+                    std::swap(a, b);
+                    std::swap(errorA, errorB);
+                }
+
+                if (_flags[a] & LOCKED)
+                {
+                    c._position = _positions[a];
+                    c._error = errorA;
+                }
+                else
+                {
+                    // the attributes of the endpoint that fits best are kept
+                    if (errorB<errorA)
+                    {
+                        std::swap(a, b);
+                        std::swap(errorA, errorB);
+                    }
+
+                    c._position = _positions[a];
+                    c._error = errorA;
+
+                    osg::Vec3d p;
+                    if (q.optimal(p))
+                    {
+                        double error = q.error(p);
+                        if (error<c._error) { c._position = p; c._error = error; }
+                    }
+                    else
+                    {
+                        p = (_positions[a]+_positions[b])*0.5;
+                        double error = q.error(p);
+                        if (error<c._error) { c._position = p; c._error = error; }
+                    }
+                }
+
+                c._keep = a;
+                c._remove = b;
+                c._keepVersion = _versions[a];
+                c._removeVersion = _versions[b];
+                return true;
+            }
+
+            struct ComputeCandidates : public ParallelRange
+            {
+                const Mesh* _mesh;
+                std::vector<Candidate>* _result;
+                std::vector<unsigned char>* _valid;
+
+                virtual void run(unsigned int begin, unsigned int end)
+                {
+                    for(unsigned int i=begin; i<end; ++i)
+                    {
+                        (*_valid)[i] = _mesh->candidate(_mesh->_edges[i*2], _mesh->_edges[i*2+1], (*_result)[i]) ? 1 : 0;
+                    }
+                }
+            };
+
+            void collectNeighbours(unsigned int v, std::vector<unsigned int>& neighbours) const
+            {
+                neighbours.clear();
+                const std::vector<unsigned int>& triangles = _vertexTriangles[v];
+                for(std::vector<unsigned int>::const_iterator itr = triangles.begin(); itr != triangles.end(); ++itr)
+                {
+                    if (_triangleDead[*itr]) continue;
+                    const unsigned int* tri = &_triangles[*itr*3];
+                    for(unsigned int k=0; k<3; ++k)
+                    {
+                        if (tri[k]!=v) neighbours.push_back(tri[k]);
+                    }
+                }
+                std::sort(neighbours.begin(), neighbours.end());
+                neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+            }
+
+            /** true if moving point v of the triangles around it to p doesn't flip or collapse any of them.*/
+            bool keepsOrientation(unsigned int v, unsigned int other, const osg::Vec3d& p) const
+            {
+                const std::vector<unsigned int>& triangles = _vertexTriangles[v];
+                for(std::vector<unsigned int>::const_iterator itr = triangles.begin(); itr != triangles.end(); ++itr)
+                {
+                    unsigned int t = *itr;
+                    if (_triangleDead[t] || usesPoint(t, other)) continue;
+
+                    const unsigned int* tri = &_triangles[t*3];
+                    osg::Vec3d corners[3];
+                    for(unsigned int k=0; k<3; ++k) corners[k] = tri[k]==v ? p : _positions[tri[k]];
+
+                    osg::Vec3d before = faceNormal(t);
+                    osg::Vec3d after = (corners[1]-corners[0]) ^ (corners[2]-corners[0]);
+                    double lengths = before.length()*after.length();
+                    if (lengths<=0.0 || before*after < 0.2*lengths) return false;
+                }
+                return true;
+            }
+
+            bool collapse(const Candidate& c, std::vector<unsigned int>& keepNeighbours, std::vector<unsigned int>& removeNeighbours)
+            {
+                unsigned int keep = c._keep, remove = c._remove;
+
+                // link condition: the points shared by both ends must be those of the triangles on the edge
+                collectNeighbours(keep, keepNeighbours);
+                collectNeighbours(remove, removeNeighbours);
+                unsigned int shared = 0;
+                for(std::vector<unsigned int>::const_iterator i = keepNeighbours.begin(), j = removeNeighbours.begin();
+                    i != keepNeighbours.end() && j != removeNeighbours.end();)
+                {
+                    if (*i<*j) ++i;
+                    else if (*j<*i) ++j;
+                    else { ++shared; ++i; ++j; }
+                }
+
+                unsigned int onEdge = 0;
+                const std::vector<unsigned int>& removeTriangles = _vertexTriangles[remove];
+                for(std::vector<unsigned int>::const_iterator itr = removeTriangles.begin(); itr != removeTriangles.end(); ++itr)
+                {
+                    if (!_triangleDead[*itr] && usesPoint(*itr, keep)) ++onEdge;
+                }
+                if (onEdge==0 || shared!=onEdge) return false;
+
+                if (!keepsOrientation(keep, remove, c._position) || !keepsOrientation(remove, keep, c._position)) return false;
+
+                _positions[keep] = c._position;
+                _quadrics[keep] += _quadrics[remove];
+                _flags[remove] |= DEAD;
+                ++_versions[keep];
+                ++_versions[remove];
+
+                std::vector<unsigned int>& keepTriangles = _vertexTriangles[keep];
+                for(std::vector<unsigned int>::const_iterator itr = removeTriangles.begin(); itr != removeTriangles.end(); ++itr)
+                {
+                    unsigned int t = *itr;
+                    if (_triangleDead[t]) continue;
+                    if (usesPoint(t, keep))
+                    {
+                        _triangleDead[t] = 1;
+                        --_numTriangles;
+                        continue;
+                    }
+                    for(unsigned int k=0; k<3; ++k)
+                    {
+                        if (_triangles[t*3+k]==remove) _triangles[t*3+k] = keep;
+                    }
+                    keepTriangles.push_back(t);
+                }
+                std::vector<unsigned int>().swap(_vertexTriangles[remove]);
+
+                unsigned int live = 0;
+                for(unsigned int i=0; i<keepTriangles.size(); ++i)
+                {
+                    if (!_triangleDead[keepTriangles[i]]) keepTriangles[live++] = keepTriangles[i];
+                }
+                keepTriangles.resize(live);
+                return true;
+            }
+
+            void collapse(const Simplifier& simplifier, unsigned int numOriginal, unsigned int numThreads)
+            {
+                unsigned int numEdges = (unsigned int)(_edges.size()/2);
+                std::vector<Candidate> candidates(numEdges);
+                std::vector<unsigned char> valid(numEdges);
+
+                ComputeCandidates compute;
+                compute._mesh = this;
+                compute._result = &candidates;
+                compute._valid = &valid;
+                compute.execute(numEdges, numThreads);
+
+                std::vector<Candidate> heap;
+                heap.reserve(numEdges);
+                for(unsigned int i=0; i<numEdges; ++i)
+                {
+                    if (valid[i]) heap.push_back(candidates[i]);
+                }
+                std::vector<Candidate>().swap(candidates);
+                std::make_heap(heap.begin(), heap.end());
+
+                std::vector<unsigned int> keepNeighbours, removeNeighbours;
+                while(!heap.empty())
+                {
+                    std::pop_heap(heap.begin(), heap.end());
+                    Candidate c = heap.back();
+                    heap.pop_back();
+
+                    if (c._keepVersion!=_versions[c._keep] || c._removeVersion!=_versions[c._remove]) continue;
+                    if ((_flags[c._keep] | _flags[c._remove]) & DEAD) continue;
+
+                    if (!simplifier.continueSimplification((float)std::sqrt(c._error), numOriginal, _numTriangles)) break;
+
+                    if (!collapse(c, keepNeighbours, removeNeighbours)) continue;
+
+                    collectNeighbours(c._keep, keepNeighbours);
+                    for(std::vector<unsigned int>::const_iterator itr = keepNeighbours.begin(); itr != keepNeighbours.end(); ++itr)
+                    {
+                        Candidate next;
+                        if (candidate(c._keep, *itr, next))
+                        {
+                            heap.push_back(next);
+                            std::push_heap(heap.begin(), heap.end());
+                        }
+                    }
+                }
+            }
+
+            void write(osg::Geometry& geometry)
+            {
+                // seam corners keep their own point, all others use the canonical one
+                std::vector<unsigned int> indices;
+                indices.reserve(_numTriangles*3);
+                for(unsigned int t=0; t<_triangleDead.size(); ++t)
+                {
+                    if (_triangleDead[t]) continue;
+                    for(unsigned int k=0; k<3; ++k)
+                    {
+                        unsigned int v = _triangles[t*3+k];
+                        indices.push_back((_flags[v] & SEAM) ? _corners[t*3+k] : v);
+                    }
+                }
+
+                std::vector<unsigned int> newIndex(_numVertices, 0xffffffff);
+                std::vector<unsigned int> order;
+                for(std::vector<unsigned int>::iterator itr = indices.begin(); itr != indices.end(); ++itr)
+                {
+                    if (newIndex[*itr]==0xffffffff)
+                    {
+                        newIndex[*itr] = (unsigned int)order.size();
+                        order.push_back(*itr);
+                    }
+                    *itr = newIndex[*itr];
+                }
+
+                osg::Array* vertices = geometry.getVertexArray();
+                if (osg::Vec3Array* v3 = dynamic_cast<osg::Vec3Array*>(vertices))
+                {
+                    for(unsigned int i=0; i<_numVertices; ++i) (*v3)[i] = _positions[i];
+                }
+                else if (osg::Vec3dArray* v3d = dynamic_cast<osg::Vec3dArray*>(vertices))
+                {
+                    for(unsigned int i=0; i<_numVertices; ++i) (*v3d)[i] = _positions[i];
+                }
+
+                RemapArrays remap(order);
+                remapArray(vertices, remap);
+                remapArray(geometry.getNormalArray(), remap);
+                remapArray(geometry.getColorArray(), remap);
+                remapArray(geometry.getSecondaryColorArray(), remap);
+                remapArray(geometry.getFogCoordArray(), remap);
+                for(unsigned int i=0; i<geometry.getNumTexCoordArrays(); ++i)
+                {
+                    remapArray(geometry.getTexCoordArray(i), remap);
+                }
+                for(unsigned int i=0; i<geometry.getNumVertexAttribArrays(); ++i)
+                {
+                    remapArray(geometry.getVertexAttribArray(i), remap);
+                }
+
+                osg::DrawElementsUInt* elements = new osg::DrawElementsUInt(GL_TRIANGLES, indices.begin(), indices.end());
+                geometry.removePrimitiveSet(0, geometry.getNumPrimitiveSets());
+                geometry.addPrimitiveSet(elements);
+                geometry.dirtyBound();
+            }
+
+            void remapArray(osg::Array* array, RemapArrays& remap) const
+            {
+                if (array && array->getBinding()==osg::Array::BIND_PER_VERTEX && array->getNumElements()==_numVertices)
+                {
+                    array->accept(remap);
+                }
+            }
+        };
+
+        unsigned int getNumberOfThreads() const
+        {
+            return _numThreads>0 ? _numThreads : (unsigned int)osg::maximum(OpenThreads::GetNumberOfProcessors(), 1);
+        }
+
+        bool _preserveAttributes;
+        double _boundaryWeight;
+        unsigned int _numThreads;
+};
+
+}
+
+#endif
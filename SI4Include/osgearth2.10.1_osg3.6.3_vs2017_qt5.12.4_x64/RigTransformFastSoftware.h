@@ -0,0 +1,679 @@
+/*  -*-c++-*-
+ *  Copyright (C) 2009 Cedric Pinson <cedric.pinson@plopbyte.net>
+ *  Copyright (C) 2017 Julien Valentin <mp3butcher@hotmail.com>
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+ */
+
+#ifndef OSGANIMATION_RIGTRANSFORM_FAST_SOFTWARE
+#define OSGANIMATION_RIGTRANSFORM_FAST_SOFTWARE 1
+
+#include <osgAnimation/RigTransform>
+#include <osgAnimation/RigGeometry>
+#include <osgAnimation/Bone>
+#include <osgAnimation/BoneMapVisitor>
+#include <osgAnimation/VertexInfluence>
+#include <osg/observer_ptr>
+#include <osg/NodeVisitor>
+#include <osg/Timer>
+#include <osg/Notify>
+
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/Condition>
+#include <OpenThreads/ScopedLock>
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define OSGANIMATION_SKINNING_AVX 1
+#endif
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define OSGANIMATION_SKINNING_SSE 1
+#endif
+
+namespace osgAnimation
+{
+
+    /// Worker threads that run software skinning jobs during the update traversal.
+    ///
+    /// RigTransformFastSoftware queues the vertex work of each RigGeometry here
+    /// instead of doing it in the update callback. wait() helps run the queued
+    /// jobs and returns when all are done; SkinningBarrierCallback calls it at
+    /// the end of the update traversal, so the skinned arrays are complete before
+    /// the frame is culled and drawn.
+    class SkinningThreadPool : public osg::Referenced
+    {
+    public:
+        struct Job : public osg::Referenced
+        {
+            /// skin the vertices, returns the number of vertices processed
+            virtual unsigned int run() = 0;
+        };
+
+        struct Stats
+        {
+            Stats() : jobs(0), vertices(0), seconds(0.0) {}
+
+            unsigned int        jobs;
+            unsigned long long  vertices;
+            double              seconds;    ///< summed over all threads
+        };
+
+        SkinningThreadPool(unsigned int numThreads = 0) :
+            _done(false),
+            _outstanding(0)
+        {
+            if (numThreads == 0)
+            {
+                int cpus = OpenThreads::GetNumberOfProcessors();
+                numThreads = cpus > 1 ? (unsigned int)(cpus - 1) : 1;
+            }
+
+            for (unsigned int i = 0; i < numThreads; ++i)
+            {
+                Worker* worker = new Worker(this);
+                _workers.push_back(worker);
+                worker->start();
+            }
+        }
+
+        unsigned int getNumThreads() const { return (unsigned int)_workers.size(); }
+
+        void add(Job* job)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _queue.push_back(job);
+            ++_outstanding;
+            _jobAvailable.signal();
+        }
+
+        /// run queued jobs on the calling thread too, and return once every job is done
+        void wait()
+        {
+            _mutex.lock();
+            for (;;)
+            {
+                if (!_queue.empty())
+                {
+                    osg::ref_ptr<Job> job = _queue.front();
+                    _queue.pop_front();
+                    _mutex.unlock();
+                    execute(job.get());
+                    _mutex.lock();
+                }
+                else if (_outstanding > 0)
+                {
+                    _jobsDone.wait(&_mutex);
+                }
+                else break;
+            }
+            _mutex.unlock();
+        }
+
+        Stats getStats() const
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            return _stats;
+        }
+
+        void resetStats()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _stats = Stats();
+        }
+
+    protected:
+        virtual ~SkinningThreadPool()
+        {
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                _done = true;
+                _jobAvailable.broadcast();
+            }
+            for (unsigned int i = 0; i < _workers.size(); ++i)
+            {
+                _workers[i]->join();
+                delete _workers[i];
+            }
+        }
+
+        struct Worker : public OpenThreads::Thread
+        {
+            Worker(SkinningThreadPool* pool) : _pool(pool) {}
+            virtual void run() { _pool->workerLoop(); }
+            SkinningThreadPool* _pool;
+        };
+
+        void workerLoop()
+        {
+            for (;;)
+            {
+                osg::ref_ptr<Job> job;
+                {
+                    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                    while (_queue.empty() && !_done)
+                        _jobAvailable.wait(&_mutex);
+                    if (_done)
+                        return;
+                    job = _queue.front();
+                    _queue.pop_front();
+                }
+                execute(job.get());
+            }
+        }
+
+        // called without the lock held
+        void execute(Job* job)
+        {
+            const osg::Timer* timer = osg::Timer::instance();
+            osg::Timer_t start = timer->tick();
+            unsigned int vertices = job->run();
+            double seconds = timer->delta_s(start, timer->tick());
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            ++_stats.jobs;
+            _stats.vertices += vertices;
+            _stats.seconds += seconds;
+            if (--_outstanding == 0)
+                _jobsDone.broadcast();
+        }
+
+        mutable OpenThreads::Mutex          _mutex;
+        OpenThreads::Condition              _jobAvailable;
+        OpenThreads::Condition              _jobsDone;
+        std::deque< osg::ref_ptr<Job> >     _queue;
+        std::vector<Worker*>                _workers;
+        bool                                _done;
+        unsigned int                        _outstanding;
+        Stats                               _stats;
+    };
+
+    /// Update callback for the root of the scene (add it with addUpdateCallback)
+    /// that waits for the skinning jobs queued during the update traversal.
+    class SkinningBarrierCallback : public osg::NodeCallback
+    {
+    public:
+        SkinningBarrierCallback(SkinningThreadPool* pool) : _pool(pool) {}
+
+        virtual void operator()(osg::Node* node, osg::NodeVisitor* nv)
+        {
+            traverse(node, nv);
+            if (_pool.valid())
+                _pool->wait();
+        }
+
+    protected:
+        osg::ref_ptr<SkinningThreadPool> _pool;
+    };
+
+    /// Software skinning with float 3x4 matrices, SIMD vertex loops and optional worker threads.
+    ///
+    /// Same results as RigTransformSoftware, organised for throughput:
+    /// - each bone's inverse bind * skeleton space matrix is computed once per frame
+    ///   and shared by every vertex group, and the group matrices are accumulated
+    ///   as float 3x4 affine matrices rather than double 4x4;
+    /// - the source positions and normals are stored grouped by vertex group in
+    ///   separate x, y and z arrays, so each group is transformed 4 (SSE) or 8 (AVX)
+    ///   vertices at a time with its matrix broadcast across lanes;
+    /// - with a SkinningThreadPool, only the matrices are computed in the update
+    ///   callback; the vertex loops run on the pool's threads. Install a
+    ///   SkinningBarrierCallback with the same pool on the scene root.
+    ///
+    /// UseFastSoftwareSkinningVisitor switches the RigGeometries of a subgraph over.
+    class RigTransformFastSoftware : public RigTransform
+    {
+    public:
+        RigTransformFastSoftware(SkinningThreadPool* pool = 0) :
+            _needInit(true),
+            _pool(pool),
+            _sourceModifiedCount(~0u),
+            _job(new SkinJob(this)) {}
+
+        RigTransformFastSoftware(const RigTransformFastSoftware& rts, const osg::CopyOp& copyop) :
+            RigTransform(rts, copyop),
+            _needInit(true),
+            _pool(rts._pool),
+            _sourceModifiedCount(~0u),
+            _job(new SkinJob(this)) {}
+
+        META_Object(osgAnimation, RigTransformFastSoftware)
+
+        void setThreadPool(SkinningThreadPool* pool) { _pool = pool; }
+        SkinningThreadPool* getThreadPool() const { return _pool.get(); }
+
+        /// float 3x4 affine matrix, row vector convention as osg::Matrix: v' = v * M
+        struct Matrix3x4
+        {
+            float m[12];    // rows 0..3, three columns each; row 3 is the translation
+
+            void set(const osg::Matrix& matrix)
+            {
+                for (unsigned int r = 0; r < 4; ++r)
+                    for (unsigned int c = 0; c < 3; ++c)
+                        m[r*3 + c] = (float)matrix(r, c);
+            }
+
+            /// this * rhs
+            Matrix3x4 operator*(const Matrix3x4& rhs) const
+            {
+                Matrix3x4 result;
+                for (unsigned int r = 0; r < 4; ++r)
+                {
+                    for (unsigned int c = 0; c < 3; ++c)
+                    {
+                        result.m[r*3 + c] =
+                            m[r*3 + 0] * rhs.m[0*3 + c] +
+                            m[r*3 + 1] * rhs.m[1*3 + c] +
+                            m[r*3 + 2] * rhs.m[2*3 + c] +
+                            (r == 3 ? rhs.m[9 + c] : 0.0f);
+                    }
+                }
+                return result;
+            }
+        };
+
+        virtual bool prepareData(RigGeometry& rig)
+        {
+            if (!rig.getSourceGeometry())
+            {
+                OSG_WARN << "RigTransformFastSoftware no source geometry found on RigGeometry" << std::endl;
+                return false;
+            }
+            osg::Geometry& source = *rig.getSourceGeometry();
+            osg::Vec3Array* positionSrc = dynamic_cast<osg::Vec3Array*>(source.getVertexArray());
+            osg::Vec3Array* normalSrc = dynamic_cast<osg::Vec3Array*>(source.getNormalArray());
+            if (!positionSrc || positionSrc->empty())
+            {
+                OSG_WARN << "RigTransformFastSoftware no vertex array in the source geometry " << rig.getName() << std::endl;
+                return false;
+            }
+            if (normalSrc && normalSrc->size() != positionSrc->size())
+                normalSrc = 0;
+
+            rig.copyFrom(source);
+
+            osg::Vec3Array* positionDst = new osg::Vec3Array(*positionSrc);
+            positionDst->setDataVariance(osg::Object::DYNAMIC);
+            rig.setVertexArray(positionDst);
+
+            if (normalSrc)
+            {
+                osg::Vec3Array* normalDst = new osg::Vec3Array(*normalSrc);
+                normalDst->setDataVariance(osg::Object::DYNAMIC);
+                rig.setNormalArray(normalDst, osg::Array::BIND_PER_VERTEX);
+            }
+
+            _needInit = true;
+            return true;
+        }
+
+        virtual void operator()(RigGeometry& geom)
+        {
+            // a job from the previous frame may still be running if no barrier was installed
+            if (_job->referenceCount() > 1 && _pool.valid())
+                _pool->wait();
+
+            if (_needInit && !init(geom))
+                return;
+
+            osg::Geometry* source = geom.getSourceGeometry();
+            osg::Vec3Array* positionSrc = source ? dynamic_cast<osg::Vec3Array*>(source->getVertexArray()) : 0;
+            osg::Vec3Array* positionDst = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
+            if (!positionSrc || !positionDst || positionDst->size() != positionSrc->size())
+                return;
+
+            osg::Vec3Array* normalSrc = dynamic_cast<osg::Vec3Array*>(source->getNormalArray());
+            osg::Vec3Array* normalDst = dynamic_cast<osg::Vec3Array*>(geom.getNormalArray());
+            if (!normalSrc || !normalDst || normalSrc->size() != positionSrc->size() || normalDst->size() != positionSrc->size())
+            {
+                normalSrc = 0;
+                normalDst = 0;
+            }
+
+            // the source may be animated too (e.g. by a MorphGeometry callback)
+            unsigned int modifiedCount = positionSrc->getModifiedCount() + (normalSrc ? normalSrc->getModifiedCount() : 0);
+            _job->_refreshSource = modifiedCount != _sourceModifiedCount;
+            _sourceModifiedCount = modifiedCount;
+
+            computeMatrices(geom);
+
+            _job->_positionSrc = positionSrc;
+            _job->_positionDst = positionDst;
+            _job->_normalSrc = normalSrc;
+            _job->_normalDst = normalDst;
+
+            if (_pool.valid())
+                _pool->add(_job.get());
+            else
+                _job->run();
+        }
+
+    protected:
+        virtual ~RigTransformFastSoftware() {}
+
+        struct Influence
+        {
+            unsigned int    bone;
+            float           weight;
+        };
+
+        struct Group
+        {
+            unsigned int    firstVertex;        // range in _indices and the SoA arrays
+            unsigned int    numVertices;
+            unsigned int    firstInfluence;     // range in _influences
+            unsigned int    numInfluences;
+        };
+
+        // the vertex work of one frame, run on the pool or inline
+        struct SkinJob : public SkinningThreadPool::Job
+        {
+            SkinJob(RigTransformFastSoftware* rig) : _rig(rig), _refreshSource(true) {}
+
+            virtual unsigned int run()
+            {
+                if (_refreshSource)
+                    _rig->gatherSource(_positionSrc.get(), _normalSrc.get());
+
+                _rig->skin(_positionDst.get(), _normalDst.get());
+
+                _positionDst->dirty();
+                if (_normalDst.valid())
+                    _normalDst->dirty();
+
+                // don't keep the arrays alive between frames
+                _positionSrc = 0;
+                _positionDst = 0;
+                _normalSrc = 0;
+                _normalDst = 0;
+                return (unsigned int)_rig->_indices.size();
+            }
+
+            RigTransformFastSoftware*       _rig;   // the transform owns the job
+            bool                            _refreshSource;
+            osg::ref_ptr<osg::Vec3Array>    _positionSrc;
+            osg::ref_ptr<osg::Vec3Array>    _positionDst;
+            osg::ref_ptr<osg::Vec3Array>    _normalSrc;
+            osg::ref_ptr<osg::Vec3Array>    _normalDst;
+        };
+        friend struct SkinJob;
+
+        bool init(RigGeometry& geom)
+        {
+            if (!geom.getSkeleton() || !geom.getSourceGeometry())
+                return false;
+
+            const VertexInfluenceMap* influenceMap = geom.getInfluenceMap();
+            const osg::Array* positions = geom.getSourceGeometry()->getVertexArray();
+            if (!influenceMap || !positions)
+                return false;
+
+            const unsigned int numVertices = positions->getNumElements();
+
+            BoneMapVisitor mapVisitor;
+            geom.getSkeleton()->accept(mapVisitor);
+            const BoneMap& boneMap = mapVisitor.getBoneMap();
+
+            // per vertex (bone, weight) lists
+            _bones.clear();
+            std::vector< std::vector<Influence> > perVertex(numVertices);
+            for (VertexInfluenceMap::const_iterator itr = influenceMap->begin(); itr != influenceMap->end(); ++itr)
+            {
+                BoneMap::const_iterator bone = boneMap.find(itr->first);
+                if (bone == boneMap.end())
+                {
+                    OSG_INFO << "RigTransformFastSoftware bone " << itr->first << " not found, skip the influence group" << std::endl;
+                    continue;
+                }
+
+                Influence influence;
+                influence.bone = (unsigned int)_bones.size();
+                _bones.push_back(bone->second.get());
+
+                const VertexInfluence& vi = itr->second;
+                for (VertexInfluence::const_iterator vw = vi.begin(); vw != vi.end(); ++vw)
+                {
+                    if (vw->first >= numVertices || vw->second == 0.0f)
+                        continue;
+                    influence.weight = vw->second;
+                    perVertex[vw->first].push_back(influence);
+                }
+            }
+
+            // vertices sharing the same influences share a matrix
+            typedef std::map< std::vector<std::pair<unsigned int, float> >, std::vector<unsigned int> > GroupMap;
+            GroupMap groupMap;
+            for (unsigned int v = 0; v < numVertices; ++v)
+            {
+                if (perVertex[v].empty())
+                    continue;
+
+                std::vector<std::pair<unsigned int, float> > key;
+                for (unsigned int i = 0; i < perVertex[v].size(); ++i)
+                    key.push_back(std::make_pair(perVertex[v][i].bone, perVertex[v][i].weight));
+                std::sort(key.begin(), key.end());
+                groupMap[key].push_back(v);
+            }
+
+            _groups.clear();
+            _influences.clear();
+            _indices.clear();
+            for (GroupMap::const_iterator itr = groupMap.begin(); itr != groupMap.end(); ++itr)
+            {
+                Group group;
+                group.firstVertex = (unsigned int)_indices.size();
+                group.numVertices = (unsigned int)itr->second.size();
+                group.firstInfluence = (unsigned int)_influences.size();
+                group.numInfluences = (unsigned int)itr->first.size();
+
+                float sum = 0.0f;
+                for (unsigned int i = 0; i < itr->first.size(); ++i)
+                    sum += itr->first[i].second;
+
+                for (unsigned int i = 0; i < itr->first.size(); ++i)
+                {
+                    Influence influence;
+                    influence.bone = itr->first[i].first;
+                    influence.weight = sum > 0.0f ? itr->first[i].second / sum : itr->first[i].second;
+                    _influences.push_back(influence);
+                }
+
+                _indices.insert(_indices.end(), itr->second.begin(), itr->second.end());
+                _groups.push_back(group);
+            }
+
+            _boneMatrices.resize(_bones.size());
+            _groupMatrices.resize(_groups.size());
+            _sourceModifiedCount = ~0u;
+            _needInit = false;
+            return true;
+        }
+
+        // update thread: bone and group matrices for this frame
+        void computeMatrices(RigGeometry& geom)
+        {
+            for (unsigned int i = 0; i < _bones.size(); ++i)
+            {
+                const Bone* bone = _bones[i].get();
+                if (bone)
+                    _boneMatrices[i].set(bone->getInvBindMatrixInSkeletonSpace() * bone->getMatrixInSkeletonSpace());
+                else
+                    _boneMatrices[i].set(osg::Matrix::identity());
+            }
+
+            const osg::Matrix& transform = geom.getMatrixFromSkeletonToGeometry();
+            const osg::Matrix& invTransform = geom.getInvMatrixFromSkeletonToGeometry();
+            const bool identity = transform.isIdentity() && invTransform.isIdentity();
+
+            Matrix3x4 toSkeleton, toGeometry;
+            toSkeleton.set(transform);
+            toGeometry.set(invTransform);
+
+            for (unsigned int g = 0; g < _groups.size(); ++g)
+            {
+                const Group& group = _groups[g];
+                Matrix3x4& result = _groupMatrices[g];
+                for (unsigned int k = 0; k < 12; ++k)
+                    result.m[k] = 0.0f;
+
+                for (unsigned int i = 0; i < group.numInfluences; ++i)
+                {
+                    const Influence& influence = _influences[group.firstInfluence + i];
+                    const float* m = _boneMatrices[influence.bone].m;
+                    for (unsigned int k = 0; k < 12; ++k)
+                        result.m[k] += m[k] * influence.weight;
+                }
+
+                if (!identity)
+                    result = toSkeleton * result * toGeometry;
+            }
+        }
+
+        void gatherSource(const osg::Vec3Array* positions, const osg::Vec3Array* normals)
+        {
+            const unsigned int n = (unsigned int)_indices.size();
+            _px.resize(n); _py.resize(n); _pz.resize(n);
+            for (unsigned int i = 0; i < n; ++i)
+            {
+                const osg::Vec3& p = (*positions)[_indices[i]];
+                _px[i] = p.x(); _py[i] = p.y(); _pz[i] = p.z();
+            }
+
+            _nx.resize(normals ? n : 0); _ny.resize(normals ? n : 0); _nz.resize(normals ? n : 0);
+            for (unsigned int i = 0; normals && i < n; ++i)
+            {
+                const osg::Vec3& v = (*normals)[_indices[i]];
+                _nx[i] = v.x(); _ny[i] = v.y(); _nz[i] = v.z();
+            }
+        }
+
+        void skin(osg::Vec3Array* positions, osg::Vec3Array* normals)
+        {
+            if (_indices.empty())
+                return;
+
+            const bool withNormals = normals && _nx.size() == _indices.size();
+            for (unsigned int g = 0; g < _groups.size(); ++g)
+            {
+                const Group& group = _groups[g];
+                const unsigned int first = group.firstVertex;
+                transform(_groupMatrices[g], true, &_px[first], &_py[first], &_pz[first], &_indices[first], group.numVertices, &positions->front());
+                if (withNormals)
+                    transform(_groupMatrices[g], false, &_nx[first], &_ny[first], &_nz[first], &_indices[first], group.numVertices, &normals->front());
+            }
+        }
+
+        // dst[indices[i]] = (x[i], y[i], z[i]) * matrix, with or without the translation
+        static void transform(const Matrix3x4& matrix, bool translate,
+                              const float* x, const float* y, const float* z,
+                              const unsigned int* indices, unsigned int count, osg::Vec3* dst)
+        {
+            const float* m = matrix.m;
+            const float tx = translate ? m[9] : 0.0f;
+            const float ty = translate ? m[10] : 0.0f;
+            const float tz = translate ? m[11] : 0.0f;
+            unsigned int i = 0;
+
+#if defined(OSGANIMATION_SKINNING_AVX)
+            {
+                const __m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2 = _mm256_set1_ps(m[2]);
+                const __m256 m3 = _mm256_set1_ps(m[3]), m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]);
+                const __m256 m6 = _mm256_set1_ps(m[6]), m7 = _mm256_set1_ps(m[7]), m8 = _mm256_set1_ps(m[8]);
+                const __m256 t0 = _mm256_set1_ps(tx), t1 = _mm256_set1_ps(ty), t2 = _mm256_set1_ps(tz);
+                float rx[8], ry[8], rz[8];
+                for (; i + 8 <= count; i += 8)
+                {
+                    const __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+                    _mm256_storeu_ps(rx, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m0), _mm256_mul_ps(vy, m3)), _mm256_add_ps(_mm256_mul_ps(vz, m6), t0)));
+                    _mm256_storeu_ps(ry, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m1), _mm256_mul_ps(vy, m4)), _mm256_add_ps(_mm256_mul_ps(vz, m7), t1)));
+                    _mm256_storeu_ps(rz, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m2), _mm256_mul_ps(vy, m5)), _mm256_add_ps(_mm256_mul_ps(vz, m8), t2)));
+                    for (unsigned int k = 0; k < 8; ++k)
+                        dst[indices[i + k]].set(rx[k], ry[k], rz[k]);
+                }
+            }
+#endif
+#if defined(OSGANIMATION_SKINNING_SSE)
+            {
+                const __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]);
+                const __m128 m3 = _mm_set1_ps(m[3]), m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]);
+                const __m128 m6 = _mm_set1_ps(m[6]), m7 = _mm_set1_ps(m[7]), m8 = _mm_set1_ps(m[8]);
+                const __m128 t0 = _mm_set1_ps(tx), t1 = _mm_set1_ps(ty), t2 = _mm_set1_ps(tz);
+                float rx[4], ry[4], rz[4];
+                for (; i + 4 <= count; i += 4)
+                {
+                    const __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+                    _mm_storeu_ps(rx, _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m0), _mm_mul_ps(vy, m3)), _mm_add_ps(_mm_mul_ps(vz, m6), t0)));
+                    _mm_storeu_ps(ry, _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m1), _mm_mul_ps(vy, m4)), _mm_add_ps(_mm_mul_ps(vz, m7), t1)));
+                    _mm_storeu_ps(rz, _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m2), _mm_mul_ps(vy, m5)), _mm_add_ps(_mm_mul_ps(vz, m8), t2)));
+                    for (unsigned int k = 0; k < 4; ++k)
+                        dst[indices[i + k]].set(rx[k], ry[k], rz[k]);
+                }
+            }
+#endif
+            for (; i < count; ++i)
+            {
+                dst[indices[i]].set(
+                    x[i]*m[0] + y[i]*m[3] + z[i]*m[6] + tx,
+                    x[i]*m[1] + y[i]*m[4] + z[i]*m[7] + ty,
+                    x[i]*m[2] + y[i]*m[5] + z[i]*m[8] + tz);
+            }
+        }
+
+        bool                                    _needInit;
+        osg::ref_ptr<SkinningThreadPool>        _pool;
+        unsigned int                            _sourceModifiedCount;
+        osg::ref_ptr<SkinJob>                   _job;
+
+        std::vector< osg::observer_ptr<Bone> >  _bones;
+        std::vector<Matrix3x4>                  _boneMatrices;
+        std::vector<Group>                      _groups;
+        std::vector<Influence>                  _influences;
+        std::vector<Matrix3x4>                  _groupMatrices;
+
+        // vertex indices and source data, ordered by group
+        std::vector<unsigned int>               _indices;
+        std::vector<float>                      _px, _py, _pz;
+        std::vector<float>                      _nx, _ny, _nz;
+    };
+
+    /// Switches every RigGeometry of a subgraph to RigTransformFastSoftware.
+    class UseFastSoftwareSkinningVisitor : public osg::NodeVisitor
+    {
+    public:
+        UseFastSoftwareSkinningVisitor(SkinningThreadPool* pool = 0) :
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+            _pool(pool) {}
+
+        virtual void apply(osg::Geometry& geometry)
+        {
+            RigGeometry* rig = dynamic_cast<RigGeometry*>(&geometry);
+            if (!rig || dynamic_cast<RigTransformFastSoftware*>(rig->getRigTransformImplementation()))
+                return;
+
+            rig->setRigTransformImplementation(new RigTransformFastSoftware(_pool.get()));
+
+            // already bound to a skeleton, so the update callback won't prepare it again
+            if (rig->getSkeleton())
+                rig->getRigTransformImplementation()->prepareData(*rig);
+        }
+
+    protected:
+        osg::ref_ptr<SkinningThreadPool> _pool;
+    };
+}
+
+#endif
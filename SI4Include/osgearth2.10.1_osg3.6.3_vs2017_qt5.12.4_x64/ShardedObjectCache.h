@@ -0,0 +1,674 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#ifndef OSGDB_SHARDEDOBJECTCACHE
+#define OSGDB_SHARDEDOBJECTCACHE 1
+
+#include <osg/Node>
+#include <osg/Geometry>
+#include <osg/Image>
+#include <osg/Shape>
+#include <osg/Shader>
+#include <osg/Texture>
+#include <osg/NodeVisitor>
+
+#include <osgDB/Registry>
+#include <osgDB/Callbacks>
+#include <osgDB/Options>
+
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <OpenThreads/Atomic>
+
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <string>
+
+namespace osgDB {
+
+/** Size bounded, concurrent replacement for osgDB::ObjectCache.
+  *
+  * ObjectCache keeps all entries in a single std::map keyed by file name and
+  * Options, compared with ClassComp under one mutex, and only drops entries
+  * by time stamp. ShardedObjectCache instead:
+  *
+  *   - hashes each (file name, Options fingerprint) key to one of a number of
+  *     shards, each with its own mutex and chained hash table, so concurrent
+  *     readers (pager threads, osgEarth URI reads) rarely contend;
+  *   - hashes Options through a 64 bit fingerprint of their contents
+  *     (see getOptionsFingerprint()), computed once per lookup, and only
+  *     compares the Options themselves, with Options::operator==, for
+  *     entries whose file name and fingerprint both match;
+  *   - accounts an estimated size in bytes for every entry (images, arrays,
+  *     primitive sets, texture images of nodes) and, when a memory cap is set,
+  *     evicts least recently used entries that are not referenced elsewhere
+  *     in the application;
+  *   - counts hits, misses and evictions.
+  *
+  * The time stamp based expiry of ObjectCache is kept, with the same meaning.
+  *
+  * ObjectCache methods are not virtual, so the Registry's own cache cannot be
+  * replaced; use ShardedObjectCacheReadCallback::install() to route the
+  * Registry's reads through a ShardedObjectCache instead. */
+class ShardedObjectCache : public osg::Referenced
+{
+    public:
+
+        struct Stats
+        {
+            unsigned int    hits;
+            unsigned int    misses;
+            unsigned int    evictions;      // entries dropped to honour the memory cap
+            unsigned int    expirations;    // entries dropped by removeExpiredObjectsInCache()
+            unsigned int    entries;
+            unsigned long long bytes;
+        };
+
+        /** Creates a cache with the given number of shards and memory cap in bytes
+          * (0 for no cap). The cap is divided evenly between the shards.*/
+        ShardedObjectCache(unsigned int numShards = 16, unsigned long long maxBytes = 0) :
+            _maxBytes(maxBytes)
+        {
+            if (numShards < 1) numShards = 1;
+            for (unsigned int i = 0; i < numShards; ++i)
+                _shards.push_back(new Shard());
+        }
+
+        unsigned int getNumShards() const { return static_cast<unsigned int>(_shards.size()); }
+
+        /** Set the memory cap in bytes; 0 disables the cap. Entries over the new cap
+          * are evicted on the next insertion into their shard.*/
+        void setMaxBytes(unsigned long long maxBytes) { _maxBytes = maxBytes; }
+        unsigned long long getMaxBytes() const { return _maxBytes; }
+
+        /** Fingerprint of the parts of an Options object that can change the result
+          * of a read: the option string, database paths, precision and kd-tree hints
+          * and the number of plugin data entries. Returns 0 for NULL options.
+          * Plugin data values are not hashed, and two Options may share a
+          * fingerprint, so entries are always confirmed with Options::operator==.*/
+        static unsigned long long getOptionsFingerprint(const Options* options)
+        {
+            if (!options) return 0;
+
+            unsigned long long h = hashString(options->getOptionString());
+            const FilePathList& paths = options->getDatabasePathList();
+            for (FilePathList::const_iterator itr = paths.begin(); itr != paths.end(); ++itr)
+                h = hashString(*itr, h * 31u);
+            h = mix(h, options->getPrecisionHint());
+            h = mix(h, options->getBuildKdTreesHint());
+            h = mix(h, options->getNumPluginData());
+            h = mix(h, options->getNumPluginStringData());
+            return h ? h : 1;
+        }
+
+        /** Estimated memory held by an object: image data, height field samples,
+          * array and index data of the geometries and the images of the textures
+          * in a subgraph, or the source of a shader.*/
+        static unsigned long long estimateSizeInBytes(const osg::Object* object)
+        {
+            if (!object) return 0;
+
+            if (const osg::Image* image = dynamic_cast<const osg::Image*>(object))
+                return image->getTotalSizeInBytesIncludingMipmaps();
+
+            if (const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object))
+                return hf->getFloatArray() ? hf->getFloatArray()->getTotalDataSize() : 0;
+
+            if (const osg::BufferData* data = dynamic_cast<const osg::BufferData*>(object))
+                return data->getTotalDataSize();
+
+            if (const osg::Shader* shader = dynamic_cast<const osg::Shader*>(object))
+                return shader->getShaderSource().size();
+
+            if (const osg::Node* node = dynamic_cast<const osg::Node*>(object))
+            {
+                SizeVisitor sv;
+                const_cast<osg::Node*>(node)->accept(sv);
+                return sv._bytes;
+            }
+
+            return 0;
+        }
+
+        /** Add a filename,object,timestamp triple to the cache, replacing any entry with
+          * the same file name and options.*/
+        void addEntryToObjectCache(const std::string& fileName, osg::Object* object, double timestamp = 0.0, const Options* options = NULL)
+        {
+            addEntryToObjectCache(fileName, getOptionsFingerprint(options), object, timestamp, options);
+        }
+
+        /** Add an entry using the fingerprint of "options" computed by the caller.*/
+        void addEntryToObjectCache(const std::string& fileName, unsigned long long fingerprint, osg::Object* object, double timestamp, const Options* options)
+        {
+            if (!object) return;
+
+            const unsigned long long hash = hashKey(fileName, fingerprint);
+            const unsigned long long bytes = estimateSizeInBytes(object) + sizeof(Entry) + fileName.size();
+            Shard& shard = getShard(hash);
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+
+            Entry* entry = shard.find(fileName, fingerprint, hash, options);
+            if (entry)
+            {
+                shard._bytes -= entry->_bytes;
+                shard.unlink(entry);
+            }
+            else
+            {
+                entry = new Entry();
+                entry->_fileName = fileName;
+                entry->_fingerprint = fingerprint;
+                entry->_hash = hash;
+                entry->_options = options;
+                shard.insert(entry);
+            }
+            entry->_object = object;
+            entry->_timestamp = timestamp;
+            entry->_bytes = bytes;
+            shard._bytes += bytes;
+            shard.pushFront(entry);
+
+            if (_maxBytes > 0)
+                evict(shard, _maxBytes / _shards.size());
+        }
+
+        /** Get an ref_ptr<Object> from the cache, or NULL on a miss.*/
+        osg::ref_ptr<osg::Object> getRefFromObjectCache(const std::string& fileName, const Options* options = NULL)
+        {
+            return getRefFromObjectCache(fileName, getOptionsFingerprint(options), options);
+        }
+
+        /** Get an ref_ptr<Object> using the fingerprint of "options" computed by the caller.*/
+        osg::ref_ptr<osg::Object> getRefFromObjectCache(const std::string& fileName, unsigned long long fingerprint, const Options* options)
+        {
+            const unsigned long long hash = hashKey(fileName, fingerprint);
+            Shard& shard = getShard(hash);
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+
+            Entry* entry = shard.find(fileName, fingerprint, hash, options);
+            if (!entry)
+            {
+                ++_misses;
+                return 0;
+            }
+
+            ++_hits;
+            shard.unlink(entry);
+            shard.pushFront(entry);
+            return entry->_object;
+        }
+
+        /** Remove an entry from the cache.*/
+        void removeFromObjectCache(const std::string& fileName, const Options* options = NULL)
+        {
+            const unsigned long long fingerprint = getOptionsFingerprint(options);
+            const unsigned long long hash = hashKey(fileName, fingerprint);
+            Shard& shard = getShard(hash);
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+
+            Entry* entry = shard.find(fileName, fingerprint, hash, options);
+            if (entry)
+                shard.erase(entry);
+        }
+
+        /** For each object in the cache which is referenced elsewhere in the application
+          * set its time stamp to the specified time. Same as
+          * ObjectCache::updateTimeStampOfObjectsInCacheWithExternalReferences().*/
+        void updateTimeStampOfObjectsInCacheWithExternalReferences(double referenceTime)
+        {
+            for (unsigned int i = 0; i < _shards.size(); ++i)
+            {
+                Shard& shard = *_shards[i];
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+                for (Entry* entry = shard._head; entry; entry = entry->_next)
+                {
+                    if (entry->_object->referenceCount() > 1)
+                        entry->_timestamp = referenceTime;
+                }
+            }
+        }
+
+        /** Remove the entries with a time stamp at or before the specified expiry time.
+          * Same as ObjectCache::removeExpiredObjectsInCache().*/
+        void removeExpiredObjectsInCache(double expiryTime)
+        {
+            for (unsigned int i = 0; i < _shards.size(); ++i)
+            {
+                Shard& shard = *_shards[i];
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+                Entry* entry = shard._head;
+                while (entry)
+                {
+                    Entry* next = entry->_next;
+                    if (entry->_timestamp <= expiryTime)
+                    {
+                        shard.erase(entry);
+                        ++_expirations;
+                    }
+                    entry = next;
+                }
+            }
+        }
+
+        /** Remove all entries regardless of having external references or expiry times.*/
+        void clear()
+        {
+            for (unsigned int i = 0; i < _shards.size(); ++i)
+            {
+                Shard& shard = *_shards[i];
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+                shard.clear();
+            }
+        }
+
+        /** Call releaseGLObjects on all objects in the cache.*/
+        void releaseGLObjects(osg::State* state)
+        {
+            for (unsigned int i = 0; i < _shards.size(); ++i)
+            {
+                Shard& shard = *_shards[i];
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+                for (Entry* entry = shard._head; entry; entry = entry->_next)
+                    entry->_object->releaseGLObjects(state);
+            }
+        }
+
+        Stats getStats() const
+        {
+            Stats stats;
+            stats.hits = _hits;
+            stats.misses = _misses;
+            stats.evictions = _evictions;
+            stats.expirations = _expirations;
+            stats.entries = 0;
+            stats.bytes = 0;
+            for (unsigned int i = 0; i < _shards.size(); ++i)
+            {
+                Shard& shard = *_shards[i];
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+                stats.entries += shard._count;
+                stats.bytes += shard._bytes;
+            }
+            return stats;
+        }
+
+        void resetStats()
+        {
+            _hits.exchange(0);
+            _misses.exchange(0);
+            _evictions.exchange(0);
+            _expirations.exchange(0);
+        }
+
+    protected:
+
+        virtual ~ShardedObjectCache()
+        {
+            for (unsigned int i = 0; i < _shards.size(); ++i)
+                delete _shards[i];
+        }
+
+        struct Entry
+        {
+            Entry() : _fingerprint(0), _hash(0), _timestamp(0.0), _bytes(0), _chain(0), _prev(0), _next(0) {}
+
+            std::string                 _fileName;
+            unsigned long long          _fingerprint;
+            unsigned long long          _hash;
+            osg::ref_ptr<const Options> _options;
+            osg::ref_ptr<osg::Object>   _object;
+            double                      _timestamp;
+            unsigned long long          _bytes;
+            Entry*                      _chain;     // next entry in the same bucket
+            Entry*                      _prev;      // LRU list, towards the most recently used
+            Entry*                      _next;      // LRU list, towards the least recently used
+        };
+
+        // One hash table with its own mutex and LRU list.
+        struct Shard
+        {
+            Shard() : _head(0), _tail(0), _count(0), _bytes(0) { _buckets.resize(64, 0); }
+            ~Shard() { clear(); }
+
+            Entry* find(const std::string& fileName, unsigned long long fingerprint, unsigned long long hash, const Options* options) const
+            {
+                for (Entry* entry = _buckets[bucket(hash)]; entry; entry = entry->_chain)
+                {
+                    if (entry->_hash == hash && entry->_fingerprint == fingerprint && entry->_fileName == fileName &&
+                        sameOptions(entry->_options.get(), options))
+                        return entry;
+                }
+                return 0;
+            }
+
+            static bool sameOptions(const Options* lhs, const Options* rhs)
+            {
+                if (lhs == rhs) return true;
+                if (!lhs || !rhs) return false;
+                return *lhs == *rhs;
+            }
+
+            void insert(Entry* entry)
+            {
+                if (_count >= _buckets.size())
+                    rehash(_buckets.size() * 2);
+                Entry*& head = _buckets[bucket(entry->_hash)];
+                entry->_chain = head;
+                head = entry;
+                ++_count;
+            }
+
+            void erase(Entry* entry)
+            {
+                Entry** link = &_buckets[bucket(entry->_hash)];
+                while (*link != entry)
+                    link = &(*link)->_chain;
+                *link = entry->_chain;
+                unlink(entry);
+                _bytes -= entry->_bytes;
+                --_count;
+                delete entry;
+            }
+
+            void pushFront(Entry* entry)
+            {
+                entry->_prev = 0;
+                entry->_next = _head;
+                if (_head) _head->_prev = entry;
+                _head = entry;
+                if (!_tail) _tail = entry;
+            }
+
+            void unlink(Entry* entry)
+            {
+                if (entry->_prev) entry->_prev->_next = entry->_next;
+                else _head = entry->_next;
+                if (entry->_next) entry->_next->_prev = entry->_prev;
+                else _tail = entry->_prev;
+                entry->_prev = entry->_next = 0;
+            }
+
+            void clear()
+            {
+                Entry* entry = _head;
+                while (entry)
+                {
+                    Entry* next = entry->_next;
+                    delete entry;
+                    entry = next;
+                }
+                std::fill(_buckets.begin(), _buckets.end(), (Entry*)0);
+                _head = _tail = 0;
+                _count = 0;
+                _bytes = 0;
+            }
+
+            unsigned int bucket(unsigned long long hash) const
+            {
+                return static_cast<unsigned int>(hash & (_buckets.size() - 1));
+            }
+
+            void rehash(unsigned int size)
+            {
+                std::vector<Entry*> buckets(size, (Entry*)0);
+                _buckets.swap(buckets);
+                for (Entry* entry = _head; entry; entry = entry->_next)
+                {
+                    Entry*& head = _buckets[bucket(entry->_hash)];
+                    entry->_chain = head;
+                    head = entry;
+                }
+            }
+
+            mutable OpenThreads::Mutex  _mutex;
+            std::vector<Entry*>         _buckets;
+            Entry*                      _head;
+            Entry*                      _tail;
+            unsigned int                _count;
+            unsigned long long          _bytes;
+        };
+
+        // Sums the data held by the geometries and textures of a subgraph,
+        // counting shared arrays and images once.
+        struct SizeVisitor : public osg::NodeVisitor
+        {
+            SizeVisitor() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN), _bytes(0) {}
+
+            virtual void apply(osg::Node& node)
+            {
+                if (node.getStateSet())
+                    addStateSet(*node.getStateSet());
+
+                if (osg::Geometry* geom = node.asGeometry())
+                {
+                    add(geom->getVertexArray());
+                    add(geom->getNormalArray());
+                    add(geom->getColorArray());
+                    add(geom->getSecondaryColorArray());
+                    add(geom->getFogCoordArray());
+                    for (unsigned int i = 0; i < geom->getTexCoordArrayList().size(); ++i)
+                        add(geom->getTexCoordArrayList()[i].get());
+                    for (unsigned int i = 0; i < geom->getVertexAttribArrayList().size(); ++i)
+                        add(geom->getVertexAttribArrayList()[i].get());
+                    for (unsigned int i = 0; i < geom->getNumPrimitiveSets(); ++i)
+                        add(geom->getPrimitiveSet(i));
+                }
+
+                traverse(node);
+            }
+
+            void addStateSet(const osg::StateSet& stateSet)
+            {
+                const osg::StateSet::TextureAttributeList& units = stateSet.getTextureAttributeList();
+                for (unsigned int unit = 0; unit < units.size(); ++unit)
+                {
+                    for (osg::StateSet::AttributeList::const_iterator itr = units[unit].begin(); itr != units[unit].end(); ++itr)
+                    {
+                        const osg::Texture* texture = itr->second.first->asTexture();
+                        if (!texture) continue;
+                        for (unsigned int i = 0; i < texture->getNumImages(); ++i)
+                            add(texture->getImage(i));
+                    }
+                }
+            }
+
+            void add(const osg::BufferData* data)
+            {
+                if (data && _seen.insert(data).second)
+                    _bytes += data->getTotalDataSize();
+            }
+
+            std::set<const osg::BufferData*> _seen;
+            unsigned long long _bytes;
+        };
+
+        static unsigned long long hashString(const std::string& s, unsigned long long h = 14695981039346656037ull)
+        {
+            for (std::string::size_type i = 0; i < s.size(); ++i)
+            {
+                h ^= static_cast<unsigned char>(s[i]);
+                h *= 1099511628211ull;
+            }
+            return h;
+        }
+
+        static unsigned long long mix(unsigned long long h, unsigned long long v)
+        {
+            h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+            return h;
+        }
+
+        static unsigned long long hashKey(const std::string& fileName, unsigned long long fingerprint)
+        {
+            return mix(hashString(fileName), fingerprint);
+        }
+
+        Shard& getShard(unsigned long long hash)
+        {
+            return *_shards[static_cast<unsigned int>(hash >> 40) % _shards.size()];
+        }
+
+        // Drops least recently used entries of a shard until it fits in "budget"
+        // bytes. Objects still referenced elsewhere are skipped, since dropping
+        // them would not release any memory.
+        void evict(Shard& shard, unsigned long long budget)
+        {
+            Entry* entry = shard._tail;
+            while (entry && shard._bytes > budget)
+            {
+                Entry* prev = entry->_prev;
+                if (entry->_object->referenceCount() <= 1)
+                {
+                    shard.erase(entry);
+                    ++_evictions;
+                }
+                entry = prev;
+            }
+        }
+
+        std::vector<Shard*>         _shards;
+        unsigned long long          _maxBytes;
+        OpenThreads::Atomic         _hits;
+        OpenThreads::Atomic         _misses;
+        OpenThreads::Atomic         _evictions;
+        OpenThreads::Atomic         _expirations;
+};
+
+
+/** ReadFileCallback that serves the Registry's cached reads from a ShardedObjectCache.
+  *
+  * A read is cached when its Options ask for it through
+  * Options::setObjectCacheHint(), as with the Registry's own ObjectCache. On a
+  * miss the file is read with a copy of the Options whose cache hint bit for
+  * the type being read is cleared, so the object is not stored in the
+  * Registry's ObjectCache as well; other bits, such as CACHE_ARCHIVES, are kept.
+  *
+  *   osgDB::ShardedObjectCache* cache =
+  *       osgDB::ShardedObjectCacheReadCallback::install(512u*1024u*1024u);
+  *   ...
+  *   osgDB::ShardedObjectCache::Stats stats = cache->getStats();
+  */
+class ShardedObjectCacheReadCallback : public ReadFileCallback
+{
+    public:
+
+        ShardedObjectCacheReadCallback(ShardedObjectCache* cache, ReadFileCallback* next = 0) :
+            _cache(cache),
+            _next(next) {}
+
+        ShardedObjectCache* getObjectCache() const { return _cache.get(); }
+
+        /** Install a callback with a new cache of the given memory cap on a Registry,
+          * chaining to the Registry's current read callback. Returns the cache.*/
+        static ShardedObjectCache* install(unsigned long long maxBytes = 0, unsigned int numShards = 16, Registry* registry = Registry::instance())
+        {
+            ShardedObjectCache* existing = get(registry);
+            if (existing)
+            {
+                existing->setMaxBytes(maxBytes);
+                return existing;
+            }
+
+            ShardedObjectCache* cache = new ShardedObjectCache(numShards, maxBytes);
+            registry->setReadFileCallback(new ShardedObjectCacheReadCallback(cache, registry->getReadFileCallback()));
+            return cache;
+        }
+
+        /** The cache installed on a Registry with install(), or NULL.*/
+        static ShardedObjectCache* get(Registry* registry = Registry::instance())
+        {
+            ShardedObjectCacheReadCallback* cb = dynamic_cast<ShardedObjectCacheReadCallback*>(registry->getReadFileCallback());
+            return cb ? cb->getObjectCache() : 0;
+        }
+
+        virtual ReaderWriter::ReadResult readObject(const std::string& fileName, const Options* options)
+        {
+            return read(READ_OBJECT, Options::CACHE_OBJECTS, fileName, options);
+        }
+
+        virtual ReaderWriter::ReadResult readImage(const std::string& fileName, const Options* options)
+        {
+            return read(READ_IMAGE, Options::CACHE_IMAGES, fileName, options);
+        }
+
+        virtual ReaderWriter::ReadResult readHeightField(const std::string& fileName, const Options* options)
+        {
+            return read(READ_HEIGHTFIELD, Options::CACHE_HEIGHTFIELDS, fileName, options);
+        }
+
+        virtual ReaderWriter::ReadResult readNode(const std::string& fileName, const Options* options)
+        {
+            return read(READ_NODE, Options::CACHE_NODES, fileName, options);
+        }
+
+        virtual ReaderWriter::ReadResult readShader(const std::string& fileName, const Options* options)
+        {
+            return read(READ_SHADER, Options::CACHE_SHADERS, fileName, options);
+        }
+
+    protected:
+
+        virtual ~ShardedObjectCacheReadCallback() {}
+
+        enum ReadType
+        {
+            READ_OBJECT,
+            READ_IMAGE,
+            READ_HEIGHTFIELD,
+            READ_NODE,
+            READ_SHADER
+        };
+
+        ReaderWriter::ReadResult read(ReadType type, Options::CacheHintOptions hint, const std::string& fileName, const Options* options)
+        {
+            if (!_cache.valid() || !options || (options->getObjectCacheHint() & hint) == 0)
+                return readFile(type, fileName, options);
+
+            const unsigned long long fingerprint = ShardedObjectCache::getOptionsFingerprint(options);
+            osg::ref_ptr<osg::Object> cached = _cache->getRefFromObjectCache(fileName, fingerprint, options);
+            if (cached.valid())
+                return ReaderWriter::ReadResult(cached.get(), ReaderWriter::ReadResult::FILE_LOADED_FROM_CACHE);
+
+            osg::ref_ptr<Options> uncached = options->cloneOptions();
+            uncached->setObjectCacheHint(Options::CacheHintOptions(options->getObjectCacheHint() & ~hint));
+
+            ReaderWriter::ReadResult result = readFile(type, fileName, uncached.get());
+            if (result.validObject())
+                _cache->addEntryToObjectCache(fileName, fingerprint, result.getObject(), 0.0, options);
+            return result;
+        }
+
+        ReaderWriter::ReadResult readFile(ReadType type, const std::string& fileName, const Options* options)
+        {
+            ReadFileCallback* cb = _next.valid() ? _next.get() : 0;
+            switch (type)
+            {
+                case READ_IMAGE:       return cb ? cb->readImage(fileName, options) : ReadFileCallback::readImage(fileName, options);
+                case READ_HEIGHTFIELD: return cb ? cb->readHeightField(fileName, options) : ReadFileCallback::readHeightField(fileName, options);
+                case READ_NODE:        return cb ? cb->readNode(fileName, options) : ReadFileCallback::readNode(fileName, options);
+                case READ_SHADER:      return cb ? cb->readShader(fileName, options) : ReadFileCallback::readShader(fileName, options);
+                default:               return cb ? cb->readObject(fileName, options) : ReadFileCallback::readObject(fileName, options);
+            }
+        }
+
+        osg::ref_ptr<ShardedObjectCache>    _cache;
+        osg::ref_ptr<ReadFileCallback>      _next;
+};
+
+}
+
+#endif
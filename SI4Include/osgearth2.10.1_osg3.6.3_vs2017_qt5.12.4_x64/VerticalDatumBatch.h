@@ -0,0 +1,388 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef OSGEARTH_VERTICAL_DATUM_BATCH_H
+#define OSGEARTH_VERTICAL_DATUM_BATCH_H 1
+
+#include <osgEarth/Common>
+#include <osgEarth/GeoCommon>
+#include <osgEarth/GeoData>
+#include <osgEarth/Geoid>
+#include <osgEarth/VerticalDatum>
+#include <osgEarth/SpatialReference>
+#include <osg/Shape>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OSGEARTH_VERTICAL_DATUM_BATCH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace osgEarth
+{
+    /**
+     * Batch sampler for a Geoid.
+     *
+     * Geoid::getHeight() locates and bilinearly interpolates the geoid grid
+     * for every call. GeoidSampler instead samples a whole lat/long grid at
+     * once: the source column and weight for each output column, and the
+     * source row pair and weight for each output row, are computed a single
+     * time. Each source row pair is then blended vertically into a scratch
+     * row (SSE2 when available) that is shared by all output rows falling
+     * between the same two geoid rows, leaving one horizontal lerp per sample.
+     *
+     * Results match Geoid::getHeight(..., INTERP_BILINEAR) to within float
+     * rounding, including the zero offset returned outside the geoid bounds.
+     */
+    class GeoidSampler
+    {
+    public:
+        GeoidSampler(const Geoid* geoid) :
+            _hf(geoid && geoid->isValid() ? geoid->getHeightField() : 0L)
+        {
+            if (_hf.valid())
+            {
+                _cols = _hf->getNumColumns();
+                _rows = _hf->getNumRows();
+                _xMin = _hf->getOrigin().x();
+                _yMin = _hf->getOrigin().y();
+                _dx = _hf->getXInterval();
+                _dy = _hf->getYInterval();
+                _xMax = _xMin + _dx*(double)(_cols-1);
+                _yMax = _yMin + _dy*(double)(_rows-1);
+                _data = &_hf->getFloatArray()->front();
+            }
+        }
+
+        bool valid() const { return _hf.valid() && _cols > 1u && _rows > 1u; }
+
+        /**
+         * Samples the geoid offset on a regular lat/long grid. Output is
+         * row-major (cols values per row, south to north) like osg::HeightField.
+         */
+        void sampleGrid(
+            double west, double xstep, unsigned cols,
+            double south, double ystep, unsigned rows,
+            float* out) const
+        {
+            if (!valid())
+            {
+                std::fill(out, out + cols*rows, 0.0f);
+                return;
+            }
+
+            // per-column lookup: source column and weight.
+            std::vector<Lookup> colLookup(cols);
+            unsigned c0 = _cols, c1 = 0u;
+            for (unsigned c = 0; c < cols; ++c)
+            {
+                Lookup& L = colLookup[c];
+                makeLookup(west + xstep*(double)c, _xMin, _xMax, _dx, _cols, L);
+                if (L.inside) {
+                    c0 = osg::minimum(c0, L.index);
+                    c1 = osg::maximum(c1, L.index + 1u);
+                }
+            }
+
+            std::vector<float> blended(_cols);
+            unsigned lastRow = ~0u;
+            float lastWeight = -1.0f;
+
+            for (unsigned r = 0; r < rows; ++r)
+            {
+                Lookup R;
+                makeLookup(south + ystep*(double)r, _yMin, _yMax, _dy, _rows, R);
+                float* outRow = out + r*cols;
+
+                if (!R.inside || c0 > c1)
+                {
+                    std::fill(outRow, outRow + cols, 0.0f);
+                    continue;
+                }
+
+                if (R.index != lastRow || R.weight != lastWeight)
+                {
+                    blendRows(R.index, R.weight, c0, c1 + 1u, &blended.front());
+                    lastRow = R.index;
+                    lastWeight = R.weight;
+                }
+
+                for (unsigned c = 0; c < cols; ++c)
+                {
+                    const Lookup& L = colLookup[c];
+                    if (L.inside)
+                    {
+                        float a = blended[L.index];
+                        float b = blended[L.index + 1u];
+                        outRow[c] = a + (b - a)*L.weight;
+                    }
+                    else
+                    {
+                        outRow[c] = 0.0f;
+                    }
+                }
+            }
+        }
+
+        /**
+         * Samples the geoid offset at arbitrary points (degrees).
+         */
+        void samplePoints(
+            const double* lat_deg, const double* lon_deg, unsigned count,
+            double* out) const
+        {
+            for (unsigned i = 0; i < count; ++i)
+            {
+                Lookup X, Y;
+                if (!valid() ||
+                    !makeLookup(lon_deg[i], _xMin, _xMax, _dx, _cols, X) ||
+                    !makeLookup(lat_deg[i], _yMin, _yMax, _dy, _rows, Y))
+                {
+                    out[i] = 0.0;
+                    continue;
+                }
+
+                const float* s = _data + Y.index*_cols + X.index;
+                const float* n = s + _cols;
+                double bottom = (double)s[0] + ((double)s[1] - (double)s[0])*X.weight;
+                double top    = (double)n[0] + ((double)n[1] - (double)n[0])*X.weight;
+                out[i] = bottom + (top - bottom)*Y.weight;
+            }
+        }
+
+    private:
+        struct Lookup
+        {
+            unsigned index;
+            float weight;
+            bool inside;
+        };
+
+        // Lower source index and fractional weight for one coordinate. The
+        // index is clamped so that index+1 is always a valid sample.
+        static bool makeLookup(double v, double vmin, double vmax, double step, unsigned n, Lookup& out)
+        {
+            out.inside = v >= vmin && v <= vmax;
+            out.index = 0u;
+            out.weight = 0.0f;
+            if (!out.inside)
+                return false;
+
+            double p = (v - vmin) / step;
+            double f = std::floor(p);
+            unsigned i = (unsigned)osg::clampBetween(f, 0.0, (double)(n-2u));
+            out.index = i;
+            out.weight = (float)osg::clampBetween(p - (double)i, 0.0, 1.0);
+            return true;
+        }
+
+        // Blends source rows "row" and "row+1" into "out" for columns [c0, c1).
+        void blendRows(unsigned row, float w, unsigned c0, unsigned c1, float* out) const
+        {
+            c1 = osg::minimum(c1, _cols);
+            const float* s = _data + row*_cols;
+            const float* n = s + _cols;
+            unsigned c = c0;
+
+#ifdef OSGEARTH_VERTICAL_DATUM_BATCH_SSE2
+            const __m128 wv = _mm_set1_ps(w);
+            for (; c + 4u <= c1; c += 4u)
+            {
+                __m128 a = _mm_loadu_ps(s + c);
+                __m128 b = _mm_loadu_ps(n + c);
+                _mm_storeu_ps(out + c, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), wv)));
+            }
+#endif
+            for (; c < c1; ++c)
+            {
+                out[c] = s[c] + (n[c] - s[c])*w;
+            }
+        }
+
+        osg::ref_ptr<const osg::HeightField> _hf;
+        const float* _data;
+        unsigned _cols, _rows;
+        double _xMin, _yMin, _xMax, _yMax, _dx, _dy;
+    };
+
+
+    /**
+     * Batch versions of the VerticalDatum::transform() functions.
+     *
+     * The scalar functions convert each value with msl2hae(), a unit
+     * conversion and hae2msl(), sampling each geoid once per value. These
+     * sample both geoids for the whole batch with a GeoidSampler and then
+     * apply the shift in a single pass.
+     *
+     * Note: datums that override msl2hae()/hae2msl() should continue to use
+     * VerticalDatum::transform().
+     */
+    struct VerticalDatumBatch
+    {
+        /**
+         * Transforms the values in a height field from one vertical datum to
+         * another. Equivalent to VerticalDatum::transform(from, to, extent, hf).
+         */
+        static bool transform(
+            const VerticalDatum* from,
+            const VerticalDatum* to,
+            const GeoExtent&     extent,
+            osg::HeightField*    hf)
+        {
+            if (from == to)
+                return true;
+
+            if (!hf || !extent.isValid())
+                return false;
+
+            unsigned cols = hf->getNumColumns();
+            unsigned rows = hf->getNumRows();
+            if (cols < 2u || rows < 2u)
+                return false;
+
+            osg::Vec3d sw(extent.west(), extent.south(), 0.0);
+            osg::Vec3d ne(extent.east(), extent.north(), 0.0);
+
+            if (extent.getSRS() && !extent.getSRS()->isGeographic())
+            {
+                const SpatialReference* geoSRS = extent.getSRS()->getGeographicSRS();
+                extent.getSRS()->transform(sw, geoSRS, sw);
+                extent.getSRS()->transform(ne, geoSRS, ne);
+            }
+
+            double xstep = std::abs(ne.x() - sw.x()) / double(cols-1);
+            double ystep = std::abs(ne.y() - sw.y()) / double(rows-1);
+
+            std::vector<float> fromOffsets, toOffsets;
+            sampleGrid(from, sw, xstep, ystep, cols, rows, fromOffsets);
+            sampleGrid(to, sw, xstep, ystep, cols, rows, toOffsets);
+
+            const float scale = (float)getScale(from, to);
+            float* h = &hf->getFloatArray()->front();
+            unsigned n = cols*rows;
+
+            for (unsigned i = 0; i < n; ++i)
+            {
+                if (h[i] != NO_DATA_VALUE)
+                {
+                    float fo = fromOffsets.empty() ? 0.0f : fromOffsets[i];
+                    float tt = toOffsets.empty() ? 0.0f : toOffsets[i];
+                    h[i] = (h[i] + fo)*scale - tt;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Transforms an array of Z values from one vertical datum to another.
+         * Equivalent to calling VerticalDatum::transform() for each point.
+         */
+        static bool transform(
+            const VerticalDatum* from,
+            const VerticalDatum* to,
+            const double*        lat_deg,
+            const double*        lon_deg,
+            double*              in_out_z,
+            unsigned             count)
+        {
+            if (from == to)
+                return true;
+
+            std::vector<double> fromOffsets(count, 0.0), toOffsets(count, 0.0);
+            if (count > 0u)
+            {
+                if (from && from->getGeoid())
+                    GeoidSampler(from->getGeoid()).samplePoints(lat_deg, lon_deg, count, &fromOffsets.front());
+                if (to && to->getGeoid())
+                    GeoidSampler(to->getGeoid()).samplePoints(lat_deg, lon_deg, count, &toOffsets.front());
+            }
+
+            const double scale = getScale(from, to);
+            for (unsigned i = 0; i < count; ++i)
+            {
+                in_out_z[i] = (in_out_z[i] + fromOffsets[i])*scale - toOffsets[i];
+            }
+            return true;
+        }
+
+        /**
+         * Checks the batch point transform against VerticalDatum::transform()
+         * at "count" pseudo-random lat/long/height samples, e.g. for
+         * from = VerticalDatum::get("egm96") and to = 0L (ellipsoid).
+         * Returns the largest absolute difference, in the units of "to".
+         */
+        static double compare(
+            const VerticalDatum* from,
+            const VerticalDatum* to,
+            unsigned             count,
+            unsigned             seed = 1u)
+        {
+            std::vector<double> lat(count), lon(count), z(count);
+            for (unsigned i = 0; i < count; ++i)
+            {
+                lat[i] = -90.0  + 180.0*random(seed);
+                lon[i] = -180.0 + 360.0*random(seed);
+                z[i]   = -500.0 + 9500.0*random(seed);
+            }
+
+            std::vector<double> batch(z);
+            if (count > 0u)
+                transform(from, to, &lat.front(), &lon.front(), &batch.front(), count);
+
+            double maxError = 0.0;
+            for (unsigned i = 0; i < count; ++i)
+            {
+                double expected = z[i];
+                VerticalDatum::transform(from, to, lat[i], lon[i], expected);
+                maxError = osg::maximum(maxError, std::abs(batch[i] - expected));
+            }
+            return maxError;
+        }
+
+    private:
+        // LCG in [0, 1], so compare() repeats for a given seed.
+        static double random(unsigned& seed)
+        {
+            seed = seed*1664525u + 1013904223u;
+            return (double)(seed >> 8) / (double)(0xFFFFFFu);
+        }
+
+        static double getScale(const VerticalDatum* from, const VerticalDatum* to)
+        {
+            Units fromUnits = from ? from->getUnits() : Units::METERS;
+            Units toUnits = to ? to->getUnits() : fromUnits;
+            return fromUnits.convertTo(toUnits, 1.0);
+        }
+
+        static void sampleGrid(
+            const VerticalDatum* vd, const osg::Vec3d& sw,
+            double xstep, double ystep, unsigned cols, unsigned rows,
+            std::vector<float>& out)
+        {
+            if (vd && vd->getGeoid())
+            {
+                out.resize(cols*rows);
+                GeoidSampler(vd->getGeoid()).sampleGrid(sw.x(), xstep, cols, sw.y(), ystep, rows, &out.front());
+            }
+        }
+    };
+}
+
+#endif // OSGEARTH_VERTICAL_DATUM_BATCH_H
@@ -66,6 +66,7 @@ protected:
     virtual void itemInserted(QtBrowserItem *item, QtBrowserItem *afterItem);
     virtual void itemRemoved(QtBrowserItem *item);
     virtual void itemChanged(QtBrowserItem *item);
+    virtual void showEvent(QShowEvent *event);
 
 private:
 
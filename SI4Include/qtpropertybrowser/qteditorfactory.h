@@ -52,6 +52,7 @@ class QtSpinBoxFactory : public QtAbstractEditorFactory<QtIntPropertyManager>
 public:
     QtSpinBoxFactory(QObject *parent = 0);
     ~QtSpinBoxFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtIntPropertyManager *manager);
     QWidget *createEditor(QtIntPropertyManager *manager, QtProperty *property,
@@ -124,6 +125,7 @@ class QtCheckBoxFactory : public QtAbstractEditorFactory<QtBoolPropertyManager>
 public:
     QtCheckBoxFactory(QObject *parent = 0);
     ~QtCheckBoxFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtBoolPropertyManager *manager);
     QWidget *createEditor(QtBoolPropertyManager *manager, QtProperty *property,
@@ -146,6 +148,7 @@ class QtDoubleSpinBoxFactory : public QtAbstractEditorFactory<QtDoublePropertyMa
 public:
     QtDoubleSpinBoxFactory(QObject *parent = 0);
     ~QtDoubleSpinBoxFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtDoublePropertyManager *manager);
     QWidget *createEditor(QtDoublePropertyManager *manager, QtProperty *property,
@@ -194,6 +197,7 @@ class QtDateEditFactory : public QtAbstractEditorFactory<QtDatePropertyManager>
 public:
     QtDateEditFactory(QObject *parent = 0);
     ~QtDateEditFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtDatePropertyManager *manager);
     QWidget *createEditor(QtDatePropertyManager *manager, QtProperty *property,
@@ -218,6 +222,7 @@ class QtTimeEditFactory : public QtAbstractEditorFactory<QtTimePropertyManager>
 public:
     QtTimeEditFactory(QObject *parent = 0);
     ~QtTimeEditFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtTimePropertyManager *manager);
     QWidget *createEditor(QtTimePropertyManager *manager, QtProperty *property,
@@ -240,6 +245,7 @@ class QtDateTimeEditFactory : public QtAbstractEditorFactory<QtDateTimePropertyM
 public:
     QtDateTimeEditFactory(QObject *parent = 0);
     ~QtDateTimeEditFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtDateTimePropertyManager *manager);
     QWidget *createEditor(QtDateTimePropertyManager *manager, QtProperty *property,
@@ -262,6 +268,7 @@ class QtKeySequenceEditorFactory : public QtAbstractEditorFactory<QtKeySequenceP
 public:
     QtKeySequenceEditorFactory(QObject *parent = 0);
     ~QtKeySequenceEditorFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtKeySequencePropertyManager *manager);
     QWidget *createEditor(QtKeySequencePropertyManager *manager, QtProperty *property,
@@ -284,6 +291,7 @@ class QtCharEditorFactory : public QtAbstractEditorFactory<QtCharPropertyManager
 public:
     QtCharEditorFactory(QObject *parent = 0);
     ~QtCharEditorFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtCharPropertyManager *manager);
     QWidget *createEditor(QtCharPropertyManager *manager, QtProperty *property,
@@ -306,6 +314,7 @@ class QtEnumEditorFactory : public QtAbstractEditorFactory<QtEnumPropertyManager
 public:
     QtEnumEditorFactory(QObject *parent = 0);
     ~QtEnumEditorFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtEnumPropertyManager *manager);
     QWidget *createEditor(QtEnumPropertyManager *manager, QtProperty *property,
@@ -354,6 +363,7 @@ class QtColorEditorFactory : public QtAbstractEditorFactory<QtColorPropertyManag
 public:
     QtColorEditorFactory(QObject *parent = 0);
     ~QtColorEditorFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtColorPropertyManager *manager);
     QWidget *createEditor(QtColorPropertyManager *manager, QtProperty *property,
@@ -376,6 +386,7 @@ class QtFontEditorFactory : public QtAbstractEditorFactory<QtFontPropertyManager
 public:
     QtFontEditorFactory(QObject *parent = 0);
     ~QtFontEditorFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtFontPropertyManager *manager);
     QWidget *createEditor(QtFontPropertyManager *manager, QtProperty *property,
@@ -66,6 +66,7 @@ private:
     Q_DISABLE_COPY(QtGroupBoxPropertyBrowser)
     Q_PRIVATE_SLOT(d_func(), void slotUpdate())
     Q_PRIVATE_SLOT(d_func(), void slotEditorDestroyed())
+    Q_PRIVATE_SLOT(d_func(), void slotCreatePaintedEditors())
 
 };
 
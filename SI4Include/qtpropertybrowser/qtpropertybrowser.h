@@ -81,12 +81,17 @@ public:
 
     void addSubProperty(QtProperty *property);
     void insertSubProperty(QtProperty *property, QtProperty *afterProperty);
+    void insertSubProperties(const QList<QtProperty *> &properties, QtProperty *afterProperty);
     void removeSubProperty(QtProperty *property);
 protected:
     explicit QtProperty(QtAbstractPropertyManager *manager);
     void propertyChanged();
 private:
+    bool hasAncestor(const QtProperty *property) const;
+    int insertPosition(QtProperty *afterProperty) const;
+
     friend class QtAbstractPropertyManager;
+    friend class QtAbstractPropertyManagerPrivate;
     QScopedPointer<QtPropertyPrivate> d_ptr;
 };
 
@@ -104,10 +109,19 @@ public:
     void clear() const;
 
     QtProperty *addProperty(const QString &name = QString());
+
+    void beginUpdate();
+    void endUpdate();
+    bool isUpdating() const;
+
+    void setValueCacheEnabled(bool enable);
+    bool isValueCacheEnabled() const;
 Q_SIGNALS:
 
     void propertyInserted(QtProperty *property,
                 QtProperty *parent, QtProperty *after);
+    void propertiesInserted(const QList<QtProperty *> &properties,
+                QtProperty *parent, QtProperty *after);
     void propertyChanged(QtProperty *property);
     void propertyRemoved(QtProperty *property, QtProperty *parent);
     void propertyDestroyed(QtProperty *property);
@@ -123,6 +137,7 @@ private:
     QScopedPointer<QtAbstractPropertyManagerPrivate> d_ptr;
     Q_DECLARE_PRIVATE(QtAbstractPropertyManager)
     Q_DISABLE_COPY(QtAbstractPropertyManager)
+    Q_PRIVATE_SLOT(d_func(), void slotPropertyChanged(QtProperty *))
 };
 
 class QtAbstractEditorFactoryBase : public QObject
@@ -130,6 +145,8 @@ class QtAbstractEditorFactoryBase : public QObject
     Q_OBJECT
 public:
     virtual QWidget *createEditor(QtProperty *property, QWidget *parent) = 0;
+    virtual bool releaseEditor(QWidget *editor)
+        { Q_UNUSED(editor) return false; }
 protected:
     explicit QtAbstractEditorFactoryBase(QObject *parent = 0)
         : QObject(parent) {}
@@ -281,6 +298,7 @@ protected:
     virtual void itemChanged(QtBrowserItem *item) = 0;
 
     virtual QWidget *createEditor(QtProperty *property, QWidget *parent);
+    void releaseEditor(QtProperty *property, QWidget *editor);
 private:
 
     bool addFactory(QtAbstractPropertyManager *abstractManager,
@@ -295,6 +313,7 @@ private:
                             QtProperty *))
     Q_PRIVATE_SLOT(d_func(), void slotPropertyDestroyed(QtProperty *))
     Q_PRIVATE_SLOT(d_func(), void slotPropertyDataChanged(QtProperty *))
+    Q_PRIVATE_SLOT(d_func(), void slotFlushPendingChanges())
 
 };
 
@@ -89,6 +89,17 @@ public:
     virtual QVariant value(const QtProperty *property) const;
     virtual QVariant attributeValue(const QtProperty *property, const QString &attribute) const;
 
+    int propertyHandle(const QtProperty *property) const;
+    QtVariantProperty *handleProperty(int handle) const;
+    QVariant handleValue(int handle) const;
+    int intValue(int handle) const;
+    double doubleValue(int handle) const;
+    bool boolValue(int handle) const;
+    void setHandleValue(int handle, const QVariant &val);
+    void setIntValue(int handle, int val);
+    void setDoubleValue(int handle, double val);
+    void setBoolValue(int handle, bool val);
+
     static int enumTypeId();
     static int flagTypeId();
     static int groupTypeId();
@@ -157,6 +168,7 @@ class QtVariantEditorFactory : public QtAbstractEditorFactory<QtVariantPropertyM
 public:
     QtVariantEditorFactory(QObject *parent = 0);
     ~QtVariantEditorFactory();
+    bool releaseEditor(QWidget *editor);
 protected:
     void connectPropertyManager(QtVariantPropertyManager *manager);
     QWidget *createEditor(QtVariantPropertyManager *manager, QtProperty *property,
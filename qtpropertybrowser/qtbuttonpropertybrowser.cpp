@@ -43,6 +43,7 @@
 #include <QtWidgets/QLabel>
 #include <QtCore/QTimer>
 #include <QtCore/QMap>
+#include <QtCore/QHash>
 #include <QtWidgets/QToolButton>
 #include <QtWidgets/QStyle>
 
@@ -70,13 +71,15 @@ public:
     {
         QWidget *widget{nullptr}; // can be null
         QLabel *label{nullptr}; // main label with property name
-        QLabel *widgetLabel{nullptr}; // label substitute showing the current value if there is no widget
+        QLabel *widgetLabel{nullptr}; // label substitute showing the current value if there is no widget (yet)
         QToolButton *button{nullptr}; // expandable button for items with children
         QWidget *container{nullptr}; // container which is expanded when the button is clicked
         QGridLayout *layout{nullptr}; // layout in container
         WidgetItem *parent{nullptr};
         QList<WidgetItem *> children;
+        int rowCount{0}; // rows used in layout, i.e. the sum of gridSpan() of the children
         bool expanded{false};
+        bool editorPending{false}; // widget is created when the item becomes visible
     };
 private:
     void updateLater();
@@ -85,14 +88,25 @@ private:
     void removeRow(QGridLayout *layout, int row) const;
     int gridRow(WidgetItem *item) const;
     int gridSpan(WidgetItem *item) const;
+    int &rowCount(WidgetItem *parent) { return parent ? parent->rowCount : m_rowCount; }
+    bool isShown(WidgetItem *parent) const;
+    void moveSpacer(int row);
     void setExpanded(WidgetItem *item, bool expanded);
+    void createPendingEditor(WidgetItem *item);
+    void createPendingEditors(WidgetItem *parent);
+    void createVisiblePendingEditors(WidgetItem *parent);
+    void removePendingEditor(WidgetItem *item);
+    void releaseEditor(WidgetItem *item, QtProperty *property);
     QToolButton *createButton(QWidget *panret = 0) const;
 
-    QMap<QtBrowserItem *, WidgetItem *> m_indexToItem;
-    QMap<WidgetItem *, QtBrowserItem *> m_itemToIndex;
-    QMap<QWidget *, WidgetItem *> m_widgetToItem;
-    QMap<QObject *, WidgetItem *> m_buttonToItem;
+    QHash<QtBrowserItem *, WidgetItem *> m_indexToItem;
+    QHash<WidgetItem *, QtBrowserItem *> m_itemToIndex;
+    QHash<QWidget *, WidgetItem *> m_widgetToItem;
+    QHash<QObject *, WidgetItem *> m_buttonToItem;
+    QHash<WidgetItem *, QSet<WidgetItem *> > m_pendingEditors; // parent (0 for top level) -> items with a deferred editor
     QGridLayout *m_mainLayout;
+    QLayoutItem *m_spacer;
+    int m_rowCount;
     QList<WidgetItem *> m_children;
     QList<WidgetItem *> m_recreateQueue;
 };
@@ -138,13 +152,109 @@ int QtButtonPropertyBrowserPrivate::gridSpan(WidgetItem *item) const
     return 1;
 }
 
+// Returns true if the children of parent are visible, i.e. the browser is shown and
+// parent as well as all of its ancestors are expanded.
+bool QtButtonPropertyBrowserPrivate::isShown(WidgetItem *parent) const
+{
+    if (!q_ptr->isVisible())
+        return false;
+    for (; parent; parent = parent->parent) {
+        if (!parent->expanded)
+            return false;
+    }
+    return true;
+}
+
 void QtButtonPropertyBrowserPrivate::init(QWidget *parent)
 {
     m_mainLayout = new QGridLayout();
     parent->setLayout(m_mainLayout);
-    QLayoutItem *item = new QSpacerItem(0, 0,
+    m_spacer = new QSpacerItem(0, 0,
                 QSizePolicy::Fixed, QSizePolicy::Expanding);
-    m_mainLayout->addItem(item, 0, 0);
+    m_mainLayout->addItem(m_spacer, 0, 0);
+    m_rowCount = 0;
+}
+
+// Moves the spacer that keeps the rows of the main layout at the top to the given row.
+// The spacer is usually the last item, since it is re-added after each appended row.
+void QtButtonPropertyBrowserPrivate::moveSpacer(int row)
+{
+    const int last = m_mainLayout->count() - 1;
+    if (last >= 0 && m_mainLayout->itemAt(last) == m_spacer)
+        m_mainLayout->takeAt(last);
+    else
+        m_mainLayout->removeItem(m_spacer);
+    m_mainLayout->addItem(m_spacer, row, 0);
+}
+
+// Replaces the value label of an item whose editor was deferred by the editor itself.
+void QtButtonPropertyBrowserPrivate::createPendingEditor(WidgetItem *item)
+{
+    if (!item->editorPending)
+        return;
+    item->editorPending = false;
+    removePendingEditor(item);
+
+    QLabel *placeholder = item->widgetLabel;
+    QWidget *editor = createEditor(m_itemToIndex.value(item)->property(), placeholder->parentWidget());
+    if (!editor)
+        return;
+
+    QGridLayout *layout = item->parent ? item->parent->layout : m_mainLayout;
+    int row, column, rowSpan, columnSpan;
+    layout->getItemPosition(layout->indexOf(placeholder), &row, &column, &rowSpan, &columnSpan);
+    delete placeholder;
+    item->widgetLabel = 0;
+
+    item->widget = editor;
+    QObject::connect(editor, SIGNAL(destroyed()), q_ptr, SLOT(slotEditorDestroyed()));
+    m_widgetToItem[editor] = item;
+    layout->addWidget(editor, row, column, rowSpan, columnSpan);
+    updateItem(item);
+}
+
+// Creates the deferred editors of the children of parent and of its expanded descendants, if they
+// are visible. Pending items are indexed by parent, so items in collapsed branches are never visited.
+void QtButtonPropertyBrowserPrivate::createPendingEditors(WidgetItem *parent)
+{
+    if (m_pendingEditors.isEmpty() || !isShown(parent))
+        return;
+    createVisiblePendingEditors(parent);
+}
+
+void QtButtonPropertyBrowserPrivate::createVisiblePendingEditors(WidgetItem *parent)
+{
+    const auto it = m_pendingEditors.constFind(parent);
+    if (it != m_pendingEditors.cend()) {
+        const QList<WidgetItem *> pending = it.value().values();
+        for (WidgetItem *item : pending)
+            createPendingEditor(item);
+    }
+    const QList<WidgetItem *> &children = parent ? parent->children : m_children;
+    for (WidgetItem *child : children) {
+        if (child->expanded)
+            createVisiblePendingEditors(child);
+    }
+}
+
+void QtButtonPropertyBrowserPrivate::removePendingEditor(WidgetItem *item)
+{
+    const auto it = m_pendingEditors.find(item->parent);
+    if (it == m_pendingEditors.end())
+        return;
+    it.value().remove(item);
+    if (it.value().isEmpty())
+        m_pendingEditors.erase(it);
+}
+
+void QtButtonPropertyBrowserPrivate::releaseEditor(WidgetItem *item, QtProperty *property)
+{
+    if (!item->widget)
+        return;
+    m_widgetToItem.remove(item->widget);
+    QObject::disconnect(item->widget, SIGNAL(destroyed()), q_ptr, SLOT(slotEditorDestroyed()));
+    q_ptr->releaseEditor(property, item->widget);
+    item->widget = 0;
 }
 
 void QtButtonPropertyBrowserPrivate::slotEditorDestroyed()
@@ -152,10 +262,11 @@ void QtButtonPropertyBrowserPrivate::slotEditorDestroyed()
     QWidget *editor = qobject_cast<QWidget *>(q_ptr->sender());
     if (!editor)
         return;
-    if (!m_widgetToItem.contains(editor))
+    const auto it = m_widgetToItem.find(editor);
+    if (it == m_widgetToItem.end())
         return;
-    m_widgetToItem[editor]->widget = 0;
-    m_widgetToItem.remove(editor);
+    it.value()->widget = 0;
+    m_widgetToItem.erase(it);
 }
 
 void QtButtonPropertyBrowserPrivate::slotUpdate()
@@ -206,14 +317,19 @@ void QtButtonPropertyBrowserPrivate::setExpanded(WidgetItem *item, bool expanded
         insertRow(l, row + 1);
         l->addWidget(item->container, row + 1, 0, 1, 2);
         item->container->show();
+        ++rowCount(parent);
     } else {
         l->removeWidget(item->container);
         item->container->hide();
         removeRow(l, row + 1);
+        --rowCount(parent);
     }
 
     item->button->setChecked(expanded);
     item->button->setArrowType(expanded ? Qt::UpArrow : Qt::DownArrow);
+
+    if (expanded)
+        createPendingEditors(item);
 }
 
 void QtButtonPropertyBrowserPrivate::slotToggled(bool checked)
@@ -243,21 +359,22 @@ void QtButtonPropertyBrowserPrivate::propertyInserted(QtBrowserItem *index, QtBr
     WidgetItem *newItem = new WidgetItem();
     newItem->parent = parentItem;
 
+    QList<WidgetItem *> &siblings = parentItem ? parentItem->children : m_children;
     QGridLayout *layout = 0;
     QWidget *parentWidget = 0;
     int row = -1;
+    bool append = false;
     if (!afterItem) {
         row = 0;
-        if (parentItem)
-            parentItem->children.insert(0, newItem);
-        else
-            m_children.insert(0, newItem);
+        append = siblings.isEmpty();
+        siblings.insert(0, newItem);
+    } else if (siblings.last() == afterItem) {
+        row = rowCount(parentItem);
+        append = true;
+        siblings.append(newItem);
     } else {
         row = gridRow(afterItem) + gridSpan(afterItem);
-        if (parentItem)
-            parentItem->children.insert(parentItem->children.indexOf(afterItem) + 1, newItem);
-        else
-            m_children.insert(m_children.indexOf(afterItem) + 1, newItem);
+        siblings.insert(siblings.indexOf(afterItem) + 1, newItem);
     }
 
     if (!parentItem) {
@@ -300,16 +417,24 @@ void QtButtonPropertyBrowserPrivate::propertyInserted(QtBrowserItem *index, QtBr
 
     newItem->label = new QLabel(parentWidget);
     newItem->label->setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed));
-    newItem->widget = createEditor(index->property(), parentWidget);
+    // Editors are created once the row becomes visible, i.e. when the browser is shown and
+    // all ancestors are expanded; until then the value label stands in for them.
+    const bool hasValue = index->property()->hasValue();
+    if (!hasValue || isShown(parentItem))
+        newItem->widget = createEditor(index->property(), parentWidget);
+    else
+        newItem->editorPending = true;
     if (newItem->widget) {
         QObject::connect(newItem->widget, SIGNAL(destroyed()), q_ptr, SLOT(slotEditorDestroyed()));
         m_widgetToItem[newItem->widget] = newItem;
-    } else if (index->property()->hasValue()) {
+    } else if (hasValue) {
         newItem->widgetLabel = new QLabel(parentWidget);
         newItem->widgetLabel->setSizePolicy(QSizePolicy(QSizePolicy::Ignored, QSizePolicy::Fixed));
     }
 
-    insertRow(layout, row);
+    // Rows appended at the end don't need any of the following rows to be moved.
+    if (!append)
+        insertRow(layout, row);
     int span = 1;
     if (newItem->widget)
         layout->addWidget(newItem->widget, row, 1);
@@ -318,9 +443,14 @@ void QtButtonPropertyBrowserPrivate::propertyInserted(QtBrowserItem *index, QtBr
     else
         span = 2;
     layout->addWidget(newItem->label, row, 0, span, 1);
+    ++rowCount(parentItem);
+    if (append && layout == m_mainLayout)
+        moveSpacer(m_rowCount);
 
     m_itemToIndex[newItem] = index;
     m_indexToItem[index] = newItem;
+    if (newItem->editorPending)
+        m_pendingEditors[parentItem].insert(newItem);
 
     updateItem(newItem);
 }
@@ -332,21 +462,25 @@ void QtButtonPropertyBrowserPrivate::propertyRemoved(QtBrowserItem *index)
     m_indexToItem.remove(index);
     m_itemToIndex.remove(item);
 
+    removePendingEditor(item);
+    m_pendingEditors.remove(item); // children still pending below the removed item
+
     WidgetItem *parentItem = item->parent;
 
-    const int row = gridRow(item);
+    QList<WidgetItem *> &siblings = parentItem ? parentItem->children : m_children;
+    const int colSpan = gridSpan(item);
+    const bool last = siblings.last() == item;
+    const int row = last ? rowCount(parentItem) - colSpan : gridRow(item);
 
-    if (parentItem)
-        parentItem->children.removeAt(parentItem->children.indexOf(item));
+    if (last)
+        siblings.removeLast();
     else
-        m_children.removeAt(m_children.indexOf(item));
-
-    const int colSpan = gridSpan(item);
+        siblings.removeAt(siblings.indexOf(item));
+    rowCount(parentItem) -= colSpan;
 
     m_buttonToItem.remove(item->button);
 
-    if (item->widget)
-        delete item->widget;
+    releaseEditor(item, index->property());
     if (item->label)
         delete item->label;
     if (item->widgetLabel)
@@ -356,14 +490,21 @@ void QtButtonPropertyBrowserPrivate::propertyRemoved(QtBrowserItem *index)
     if (item->container)
         delete item->container;
 
+    // Removing the last rows of a layout doesn't need any of the other rows to be moved.
     if (!parentItem) {
-        removeRow(m_mainLayout, row);
-        if (colSpan > 1)
+        if (last) {
+            moveSpacer(m_rowCount);
+        } else {
             removeRow(m_mainLayout, row);
+            if (colSpan > 1)
+                removeRow(m_mainLayout, row);
+        }
     } else if (parentItem->children.count() != 0) {
-        removeRow(parentItem->layout, row);
-        if (colSpan > 1)
+        if (!last) {
             removeRow(parentItem->layout, row);
+            if (colSpan > 1)
+                removeRow(parentItem->layout, row);
+        }
     } else {
         const WidgetItem *grandParent = parentItem->parent;
         QGridLayout *l = 0;
@@ -378,15 +519,21 @@ void QtButtonPropertyBrowserPrivate::propertyRemoved(QtBrowserItem *index)
 
         l->removeWidget(parentItem->button);
         l->removeWidget(parentItem->container);
+        m_buttonToItem.remove(parentItem->button);
         delete parentItem->button;
         delete parentItem->container;
         parentItem->button = 0;
         parentItem->container = 0;
         parentItem->layout = 0;
+        parentItem->rowCount = 0;
+        // A new container starts collapsed, like the button created for it.
+        parentItem->expanded = false;
         if (!m_recreateQueue.contains(parentItem))
             m_recreateQueue.append(parentItem);
-        if (parentSpan > 1)
+        if (parentSpan > 1) {
             removeRow(l, parentRow + 1);
+            --rowCount(parentItem->parent);
+        }
 
         updateLater();
     }
@@ -553,8 +700,8 @@ QtButtonPropertyBrowser::QtButtonPropertyBrowser(QWidget *parent)
 */
 QtButtonPropertyBrowser::~QtButtonPropertyBrowser()
 {
-    const QMap<QtButtonPropertyBrowserPrivate::WidgetItem *, QtBrowserItem *>::ConstIterator icend = d_ptr->m_itemToIndex.constEnd();
-    for (QMap<QtButtonPropertyBrowserPrivate::WidgetItem *, QtBrowserItem *>::ConstIterator  it =  d_ptr->m_itemToIndex.constBegin(); it != icend; ++it)
+    const QHash<QtButtonPropertyBrowserPrivate::WidgetItem *, QtBrowserItem *>::ConstIterator icend = d_ptr->m_itemToIndex.constEnd();
+    for (QHash<QtButtonPropertyBrowserPrivate::WidgetItem *, QtBrowserItem *>::ConstIterator  it =  d_ptr->m_itemToIndex.constBegin(); it != icend; ++it)
         delete it.key();
 }
 
@@ -582,6 +729,15 @@ void QtButtonPropertyBrowser::itemChanged(QtBrowserItem *item)
     d_ptr->propertyChanged(item);
 }
 
+/*!
+    \reimp
+*/
+void QtButtonPropertyBrowser::showEvent(QShowEvent *event)
+{
+    QtAbstractPropertyBrowser::showEvent(event);
+    d_ptr->createPendingEditors(0);
+}
+
 /*!
     Sets the \a item to either collapse or expanded, depending on the value of \a expanded.
 
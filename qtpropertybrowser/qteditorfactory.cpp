@@ -55,6 +55,7 @@
 #include <QtWidgets/QFontDialog>
 #include <QtWidgets/QSpacerItem>
 #include <QtWidgets/QKeySequenceEdit>
+#include <QtCore/QHash>
 #include <QtCore/QMap>
 
 #if defined(Q_CC_MSVC)
@@ -77,28 +78,46 @@ static inline void setupTreeViewEditorMargin(QLayout *lt)
 
 // ---------- EditorFactoryPrivate :
 // Base class for editor factory private classes. Manages mapping of properties to editors and vice versa.
+// Both directions are hashed, so resolving the sender() of an editor signal does not depend on
+// the number of open editors. Editors handed back through releaseEditor() are kept in a small
+// pool and reused by createEditor(), which saves constructing and polishing a new widget each
+// time a browser is repopulated.
 
 template <class Editor>
 class EditorFactoryPrivate
 {
 public:
+    enum { MaxPooledEditors = 64 };
 
     typedef QList<Editor *> EditorList;
-    typedef QMap<QtProperty *, EditorList> PropertyToEditorListMap;
-    typedef QMap<Editor *, QtProperty *> EditorToPropertyMap;
+    typedef QHash<QtProperty *, EditorList> PropertyToEditorListMap;
+    // Keyed on QObject so that sender() and destroyed() objects are looked up without a downcast.
+    typedef QHash<QObject *, QtProperty *> EditorToPropertyMap;
+
+    ~EditorFactoryPrivate() { qDeleteAll(m_editorPool); }
 
     Editor *createEditor(QtProperty *property, QWidget *parent);
     void initializeEditor(QtProperty *property, Editor *e);
+    bool releaseEditor(QWidget *widget, QObject *factory);
     void slotEditorDestroyed(QObject *object);
+    QtProperty *editorProperty(QObject *object) const
+        { return m_editorToProperty.value(object, 0); }
 
     PropertyToEditorListMap  m_createdEditors;
     EditorToPropertyMap m_editorToProperty;
+    EditorList m_editorPool;
 };
 
 template <class Editor>
 Editor *EditorFactoryPrivate<Editor>::createEditor(QtProperty *property, QWidget *parent)
 {
-    Editor *editor = new Editor(parent);
+    Editor *editor = 0;
+    if (m_editorPool.isEmpty()) {
+        editor = new Editor(parent);
+    } else {
+        editor = m_editorPool.takeLast();
+        editor->setParent(parent);
+    }
     initializeEditor(property, editor);
     return editor;
 }
@@ -113,24 +132,42 @@ void EditorFactoryPrivate<Editor>::initializeEditor(QtProperty *property, Editor
     m_editorToProperty.insert(editor, property);
 }
 
+// Detaches an editor from its property and from all connections to the factory, so that
+// the factory's createEditor() can set it up like a new one.
+template <class Editor>
+bool EditorFactoryPrivate<Editor>::releaseEditor(QWidget *widget, QObject *factory)
+{
+    // The widget may have been created by another factory, so it is only cast once it is known to be ours.
+    if (m_editorPool.size() >= MaxPooledEditors || !m_editorToProperty.contains(widget))
+        return false;
+
+    Editor *editor = static_cast<Editor *>(widget);
+    slotEditorDestroyed(editor);
+    QObject::disconnect(editor, 0, factory, 0);
+    editor->setParent(0);
+    m_editorPool.append(editor);
+    return true;
+}
+
 template <class Editor>
 void EditorFactoryPrivate<Editor>::slotEditorDestroyed(QObject *object)
 {
-    const typename EditorToPropertyMap::iterator ecend = m_editorToProperty.end();
-    for (typename EditorToPropertyMap::iterator itEditor = m_editorToProperty.begin(); itEditor !=  ecend; ++itEditor) {
-        if (itEditor.key() == object) {
-            Editor *editor = itEditor.key();
-            QtProperty *property = itEditor.value();
-            const typename PropertyToEditorListMap::iterator pit = m_createdEditors.find(property);
-            if (pit != m_createdEditors.end()) {
-                pit.value().removeAll(editor);
-                if (pit.value().empty())
-                    m_createdEditors.erase(pit);
-            }
-            m_editorToProperty.erase(itEditor);
-            return;
+    const typename EditorToPropertyMap::iterator itEditor = m_editorToProperty.find(object);
+    if (itEditor == m_editorToProperty.end())
+        return;
+    QtProperty *property = itEditor.value();
+    const typename PropertyToEditorListMap::iterator pit = m_createdEditors.find(property);
+    if (pit != m_createdEditors.end()) {
+        // object may already be partly destroyed, so the list is searched as QObjects
+        EditorList &editors = pit.value();
+        for (int i = editors.size() - 1; i >= 0; --i) {
+            if (static_cast<QObject *>(editors.at(i)) == object)
+                editors.removeAt(i);
         }
+        if (editors.empty())
+            m_createdEditors.erase(pit);
     }
+    m_editorToProperty.erase(itEditor);
 }
 
 // ------------ QtSpinBoxFactory
@@ -193,18 +230,13 @@ void QtSpinBoxFactoryPrivate::slotSingleStepChanged(QtProperty *property, int st
 
 void QtSpinBoxFactoryPrivate::slotSetValue(int value)
 {
-    QObject *object = q_ptr->sender();
-    const QMap<QSpinBox *, QtProperty *>::ConstIterator  ecend = m_editorToProperty.constEnd();
-    for (QMap<QSpinBox *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor !=  ecend; ++itEditor) {
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtIntPropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
-    }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtIntPropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -272,6 +304,16 @@ QWidget *QtSpinBoxFactory::createEditor(QtIntPropertyManager *manager, QtPropert
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtSpinBoxFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -344,18 +386,13 @@ void QtSliderFactoryPrivate::slotSingleStepChanged(QtProperty *property, int ste
 
 void QtSliderFactoryPrivate::slotSetValue(int value)
 {
-    QObject *object = q_ptr->sender();
-    const QMap<QSlider *, QtProperty *>::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (QMap<QSlider *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend; ++itEditor ) {
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtIntPropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
-    }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtIntPropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -496,17 +533,13 @@ void QtScrollBarFactoryPrivate::slotSingleStepChanged(QtProperty *property, int
 
 void QtScrollBarFactoryPrivate::slotSetValue(int value)
 {
-    QObject *object = q_ptr->sender();
-    const QMap<QScrollBar *, QtProperty *>::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (QMap<QScrollBar *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend; ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtIntPropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtIntPropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -614,18 +647,13 @@ void QtCheckBoxFactoryPrivate::slotPropertyChanged(QtProperty *property, bool va
 
 void QtCheckBoxFactoryPrivate::slotSetValue(bool value)
 {
-    QObject *object = q_ptr->sender();
-
-    const QMap<QtBoolEdit *, QtProperty *>::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (QMap<QtBoolEdit *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend;  ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtBoolPropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtBoolPropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -686,6 +714,16 @@ QWidget *QtCheckBoxFactory::createEditor(QtBoolPropertyManager *manager, QtPrope
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtCheckBoxFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -782,18 +820,13 @@ void QtDoubleSpinBoxFactoryPrivate::slotDecimalsChanged(QtProperty *property, in
 
 void QtDoubleSpinBoxFactoryPrivate::slotSetValue(double value)
 {
-    QObject *object = q_ptr->sender();
-    const QMap<QDoubleSpinBox *, QtProperty *>::ConstIterator itcend = m_editorToProperty.constEnd();
-    for (QMap<QDoubleSpinBox *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != itcend; ++itEditor) {
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtDoublePropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
-    }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtDoublePropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*! \class QtDoubleSpinBoxFactory
@@ -863,6 +896,16 @@ QWidget *QtDoubleSpinBoxFactory::createEditor(QtDoublePropertyManager *manager,
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtDoubleSpinBoxFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -933,17 +976,13 @@ void QtLineEditFactoryPrivate::slotRegExpChanged(QtProperty *property,
 
 void QtLineEditFactoryPrivate::slotSetValue(const QString &value)
 {
-    QObject *object = q_ptr->sender();
-    const QMap<QLineEdit *, QtProperty *>::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (QMap<QLineEdit *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend; ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtStringPropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtStringPropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -1072,17 +1111,13 @@ void QtDateEditFactoryPrivate::slotRangeChanged(QtProperty *property,
 
 void QtDateEditFactoryPrivate::slotSetValue(const QDate &value)
 {
-    QObject *object = q_ptr->sender();
-    const QMap<QDateEdit *, QtProperty *>::ConstIterator  ecend = m_editorToProperty.constEnd();
-    for (QMap<QDateEdit *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend; ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtDatePropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtDatePropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -1149,6 +1184,16 @@ QWidget *QtDateEditFactory::createEditor(QtDatePropertyManager *manager, QtPrope
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtDateEditFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -1188,17 +1233,13 @@ void QtTimeEditFactoryPrivate::slotPropertyChanged(QtProperty *property, const Q
 
 void QtTimeEditFactoryPrivate::slotSetValue(const QTime &value)
 {
-    QObject *object = q_ptr->sender();
-    const  QMap<QTimeEdit *, QtProperty *>::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (QMap<QTimeEdit *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend; ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtTimePropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtTimePropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -1261,6 +1302,16 @@ QWidget *QtTimeEditFactory::createEditor(QtTimePropertyManager *manager, QtPrope
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtTimeEditFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -1301,17 +1352,13 @@ void QtDateTimeEditFactoryPrivate::slotPropertyChanged(QtProperty *property,
 
 void QtDateTimeEditFactoryPrivate::slotSetValue(const QDateTime &value)
 {
-    QObject *object = q_ptr->sender();
-    const  QMap<QDateTimeEdit *, QtProperty *>::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (QMap<QDateTimeEdit *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend;  ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtDateTimePropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtDateTimePropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -1374,6 +1421,16 @@ QWidget *QtDateTimeEditFactory::createEditor(QtDateTimePropertyManager *manager,
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtDateTimeEditFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -1413,17 +1470,13 @@ void QtKeySequenceEditorFactoryPrivate::slotPropertyChanged(QtProperty *property
 
 void QtKeySequenceEditorFactoryPrivate::slotSetValue(const QKeySequence &value)
 {
-    QObject *object = q_ptr->sender();
-    const  QMap<QKeySequenceEdit *, QtProperty *>::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (QMap<QKeySequenceEdit *, QtProperty *>::ConstIterator itEditor =  m_editorToProperty.constBegin(); itEditor != ecend; ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtKeySequencePropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtKeySequencePropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -1485,6 +1538,16 @@ QWidget *QtKeySequenceEditorFactory::createEditor(QtKeySequencePropertyManager *
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtKeySequenceEditorFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -1692,17 +1755,13 @@ void QtCharEditorFactoryPrivate::slotPropertyChanged(QtProperty *property,
 
 void QtCharEditorFactoryPrivate::slotSetValue(const QChar &value)
 {
-    QObject *object = q_ptr->sender();
-    const QMap<QtCharEdit *, QtProperty *>::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (QMap<QtCharEdit *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend;  ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtCharPropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtCharPropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -1764,6 +1823,16 @@ QWidget *QtCharEditorFactory::createEditor(QtCharPropertyManager *manager,
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtCharEditorFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -1851,17 +1920,13 @@ void QtEnumEditorFactoryPrivate::slotEnumIconsChanged(QtProperty *property,
 
 void QtEnumEditorFactoryPrivate::slotSetValue(int value)
 {
-    QObject *object = q_ptr->sender();
-    const  QMap<QComboBox *, QtProperty *>::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (QMap<QComboBox *, QtProperty *>::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend; ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtEnumPropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtEnumPropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -1919,6 +1984,7 @@ QWidget *QtEnumEditorFactory::createEditor(QtEnumPropertyManager *manager, QtPro
     editor->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Fixed);
     editor->view()->setTextElideMode(Qt::ElideRight);
     QStringList enumNames = manager->enumNames(property);
+    editor->clear();
     editor->addItems(enumNames);
     QMap<int, QIcon> enumIcons = manager->enumIcons(property);
     const int enumNamesCount = enumNames.count();
@@ -1932,6 +1998,16 @@ QWidget *QtEnumEditorFactory::createEditor(QtEnumPropertyManager *manager, QtPro
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtEnumEditorFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -1963,10 +2039,10 @@ public:
     QtEnumEditorFactory *m_enumEditorFactory;
     QtEnumPropertyManager *m_enumPropertyManager;
 
-    QMap<QtProperty *, QtProperty *> m_propertyToEnum;
-    QMap<QtProperty *, QtProperty *> m_enumToProperty;
-    QMap<QtProperty *, QWidgetList > m_enumToEditors;
-    QMap<QWidget *, QtProperty *> m_editorToEnum;
+    QHash<QtProperty *, QtProperty *> m_propertyToEnum;
+    QHash<QtProperty *, QtProperty *> m_enumToProperty;
+    QHash<QtProperty *, QWidgetList > m_enumToEditors;
+    QHash<QObject *, QtProperty *> m_editorToEnum;
     bool m_updatingEnum;
 };
 
@@ -2009,22 +2085,23 @@ void QtCursorEditorFactoryPrivate::slotEditorDestroyed(QObject *object)
     // remove from m_editorToEnum map;
     // remove from m_enumToEditors map;
     // if m_enumToEditors doesn't contains more editors delete enum property;
-    const  QMap<QWidget *, QtProperty *>::ConstIterator ecend = m_editorToEnum.constEnd();
-    for (QMap<QWidget *, QtProperty *>::ConstIterator itEditor = m_editorToEnum.constBegin(); itEditor != ecend; ++itEditor)
-        if (itEditor.key() == object) {
-            QWidget *editor = itEditor.key();
-            QtProperty *enumProp = itEditor.value();
-            m_editorToEnum.remove(editor);
-            m_enumToEditors[enumProp].removeAll(editor);
-            if (m_enumToEditors[enumProp].isEmpty()) {
-                m_enumToEditors.remove(enumProp);
-                QtProperty *property = m_enumToProperty.value(enumProp);
-                m_enumToProperty.remove(enumProp);
-                m_propertyToEnum.remove(property);
-                delete enumProp;
-            }
-            return;
-        }
+    const QHash<QObject *, QtProperty *>::iterator itEditor = m_editorToEnum.find(object);
+    if (itEditor == m_editorToEnum.end())
+        return;
+    QtProperty *enumProp = itEditor.value();
+    m_editorToEnum.erase(itEditor);
+    QWidgetList &editors = m_enumToEditors[enumProp];
+    for (int i = editors.size() - 1; i >= 0; --i) {
+        if (static_cast<QObject *>(editors.at(i)) == object)
+            editors.removeAt(i);
+    }
+    if (editors.isEmpty()) {
+        m_enumToEditors.remove(enumProp);
+        QtProperty *property = m_enumToProperty.value(enumProp);
+        m_enumToProperty.remove(enumProp);
+        m_propertyToEnum.remove(property);
+        delete enumProp;
+    }
 }
 
 /*!
@@ -2231,17 +2308,13 @@ void QtColorEditorFactoryPrivate::slotPropertyChanged(QtProperty *property,
 
 void QtColorEditorFactoryPrivate::slotSetValue(const QColor &value)
 {
-    QObject *object = q_ptr->sender();
-    const EditorToPropertyMap::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (EditorToPropertyMap::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend; ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtColorPropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtColorPropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -2300,6 +2373,16 @@ QWidget *QtColorEditorFactory::createEditor(QtColorPropertyManager *manager,
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtColorEditorFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
@@ -2443,17 +2526,13 @@ void QtFontEditorFactoryPrivate::slotPropertyChanged(QtProperty *property,
 
 void QtFontEditorFactoryPrivate::slotSetValue(const QFont &value)
 {
-    QObject *object = q_ptr->sender();
-    const EditorToPropertyMap::ConstIterator ecend = m_editorToProperty.constEnd();
-    for (EditorToPropertyMap::ConstIterator itEditor = m_editorToProperty.constBegin(); itEditor != ecend; ++itEditor)
-        if (itEditor.key() == object) {
-            QtProperty *property = itEditor.value();
-            QtFontPropertyManager *manager = q_ptr->propertyManager(property);
-            if (!manager)
-                return;
-            manager->setValue(property, value);
-            return;
-        }
+    QtProperty *property = editorProperty(q_ptr->sender());
+    if (!property)
+        return;
+    QtFontPropertyManager *manager = q_ptr->propertyManager(property);
+    if (!manager)
+        return;
+    manager->setValue(property, value);
 }
 
 /*!
@@ -2512,6 +2591,16 @@ QWidget *QtFontEditorFactory::createEditor(QtFontPropertyManager *manager,
     return editor;
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtFontEditorFactory::releaseEditor(QWidget *editor)
+{
+    return d_ptr->releaseEditor(editor, this);
+}
+
 /*!
     \internal
 
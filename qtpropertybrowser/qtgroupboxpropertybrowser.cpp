@@ -38,12 +38,12 @@
 ****************************************************************************/
 
 #include "qtgroupboxpropertybrowser.h"
-#include <QtCore/QSet>
 #include <QtWidgets/QGridLayout>
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QGroupBox>
 #include <QtCore/QTimer>
 #include <QtCore/QMap>
+#include <QtCore/QHash>
 
 QT_BEGIN_NAMESPACE
 
@@ -63,41 +63,139 @@ public:
 
     void slotEditorDestroyed();
     void slotUpdate();
+    void slotCreatePaintedEditors();
 
     struct WidgetItem
     {
         QWidget *widget{nullptr}; // can be null
         QLabel *label{nullptr};
-        QLabel *widgetLabel{nullptr};
+        QLabel *widgetLabel{nullptr}; // shows the value if there is no widget, or until it is created
         QGroupBox *groupBox{nullptr};
         QGridLayout *layout{nullptr};
         QFrame *line{nullptr};
         WidgetItem *parent{nullptr};
         QList<WidgetItem *> children;
+        bool editorPending{false}; // widget is created when its row is first painted
     };
+
+    void editorPainted(WidgetItem *item);
 private:
     void updateLater();
     void updateItem(WidgetItem *item);
     void insertRow(QGridLayout *layout, int row) const;
     void removeRow(QGridLayout *layout, int row) const;
+    void moveSpacer(int row);
+    void createPendingEditor(WidgetItem *item);
+    void releaseEditor(WidgetItem *item, QtProperty *property);
 
     bool hasHeader(WidgetItem *item) const;
 
-    QMap<QtBrowserItem *, WidgetItem *> m_indexToItem;
-    QMap<WidgetItem *, QtBrowserItem *> m_itemToIndex;
-    QMap<QWidget *, WidgetItem *> m_widgetToItem;
+    QHash<QtBrowserItem *, WidgetItem *> m_indexToItem;
+    QHash<WidgetItem *, QtBrowserItem *> m_itemToIndex;
+    QHash<QWidget *, WidgetItem *> m_widgetToItem;
+    QList<WidgetItem *> m_paintedEditors;
     QGridLayout *m_mainLayout;
+    QLayoutItem *m_spacer;
     QList<WidgetItem *> m_children;
     QList<WidgetItem *> m_recreateQueue;
 };
 
+// Value label standing in for a deferred editor. Its first paint tells the
+// browser that the row became visible, and the editor replaces it afterwards.
+class QtPendingEditorLabel : public QLabel
+{
+public:
+    QtPendingEditorLabel(QtGroupBoxPropertyBrowserPrivate *browser,
+                QtGroupBoxPropertyBrowserPrivate::WidgetItem *item, QWidget *parent)
+        : QLabel(parent), m_browser(browser), m_item(item), m_painted(false) {}
+
+protected:
+    virtual void paintEvent(QPaintEvent *event)
+    {
+        QLabel::paintEvent(event);
+        if (!m_painted) {
+            m_painted = true;
+            m_browser->editorPainted(m_item);
+        }
+    }
+
+private:
+    QtGroupBoxPropertyBrowserPrivate *m_browser;
+    QtGroupBoxPropertyBrowserPrivate::WidgetItem *m_item;
+    bool m_painted;
+};
+
 void QtGroupBoxPropertyBrowserPrivate::init(QWidget *parent)
 {
     m_mainLayout = new QGridLayout();
     parent->setLayout(m_mainLayout);
-    QLayoutItem *item = new QSpacerItem(0, 0,
+    m_spacer = new QSpacerItem(0, 0,
                 QSizePolicy::Fixed, QSizePolicy::Expanding);
-    m_mainLayout->addItem(item, 0, 0);
+    m_mainLayout->addItem(m_spacer, 0, 0);
+}
+
+// Moves the spacer that keeps the rows of the main layout at the top to the given row.
+// The spacer is usually the last item, since it is re-added after each appended row.
+void QtGroupBoxPropertyBrowserPrivate::moveSpacer(int row)
+{
+    const int last = m_mainLayout->count() - 1;
+    if (last >= 0 && m_mainLayout->itemAt(last) == m_spacer)
+        m_mainLayout->takeAt(last);
+    else
+        m_mainLayout->removeItem(m_spacer);
+    m_mainLayout->addItem(m_spacer, row, 0);
+}
+
+// Replaces the value label of an item whose editor was deferred by the editor itself.
+void QtGroupBoxPropertyBrowserPrivate::createPendingEditor(WidgetItem *item)
+{
+    if (!item->editorPending)
+        return;
+    item->editorPending = false;
+
+    QLabel *placeholder = item->widgetLabel;
+    QWidget *editor = createEditor(m_itemToIndex.value(item)->property(), placeholder->parentWidget());
+    if (!editor)
+        return;
+
+    QGridLayout *layout = item->parent ? item->parent->layout : m_mainLayout;
+    int row, column, rowSpan, columnSpan;
+    layout->getItemPosition(layout->indexOf(placeholder), &row, &column, &rowSpan, &columnSpan);
+    delete placeholder;
+    item->widgetLabel = 0;
+
+    item->widget = editor;
+    QObject::connect(editor, SIGNAL(destroyed()), q_ptr, SLOT(slotEditorDestroyed()));
+    m_widgetToItem[editor] = item;
+    layout->addWidget(editor, row, column, rowSpan, columnSpan);
+    updateItem(item);
+}
+
+// The placeholder can't be replaced while it paints, so the editors of the rows
+// painted in this pass are created once control returns to the event loop.
+void QtGroupBoxPropertyBrowserPrivate::editorPainted(WidgetItem *item)
+{
+    if (m_paintedEditors.isEmpty())
+        QTimer::singleShot(0, q_ptr, SLOT(slotCreatePaintedEditors()));
+    m_paintedEditors.append(item);
+}
+
+void QtGroupBoxPropertyBrowserPrivate::slotCreatePaintedEditors()
+{
+    const QList<WidgetItem *> painted = m_paintedEditors;
+    m_paintedEditors.clear();
+    for (WidgetItem *item : painted)
+        createPendingEditor(item);
+}
+
+void QtGroupBoxPropertyBrowserPrivate::releaseEditor(WidgetItem *item, QtProperty *property)
+{
+    if (!item->widget)
+        return;
+    m_widgetToItem.remove(item->widget);
+    QObject::disconnect(item->widget, SIGNAL(destroyed()), q_ptr, SLOT(slotEditorDestroyed()));
+    q_ptr->releaseEditor(property, item->widget);
+    item->widget = 0;
 }
 
 void QtGroupBoxPropertyBrowserPrivate::slotEditorDestroyed()
@@ -105,10 +203,11 @@ void QtGroupBoxPropertyBrowserPrivate::slotEditorDestroyed()
     QWidget *editor = qobject_cast<QWidget *>(q_ptr->sender());
     if (!editor)
         return;
-    if (!m_widgetToItem.contains(editor))
+    const auto it = m_widgetToItem.find(editor);
+    if (it == m_widgetToItem.end())
         return;
-    m_widgetToItem[editor]->widget = 0;
-    m_widgetToItem.remove(editor);
+    it.value()->widget = 0;
+    m_widgetToItem.erase(it);
 }
 
 void QtGroupBoxPropertyBrowserPrivate::slotUpdate()
@@ -163,27 +262,27 @@ void QtGroupBoxPropertyBrowserPrivate::propertyInserted(QtBrowserItem *index, Qt
     WidgetItem *afterItem = m_indexToItem.value(afterIndex);
     WidgetItem *parentItem = m_indexToItem.value(index->parent());
 
+    // Whether a group box has header rows depends on the editor of its owner,
+    // so a deferred editor has to be created before the first child is laid out.
+    if (parentItem)
+        createPendingEditor(parentItem);
+
     WidgetItem *newItem = new WidgetItem();
     newItem->parent = parentItem;
 
+    QList<WidgetItem *> &siblings = parentItem ? parentItem->children : m_children;
     QGridLayout *layout = 0;
     QWidget *parentWidget = 0;
     int row = -1;
     if (!afterItem) {
         row = 0;
-        if (parentItem)
-            parentItem->children.insert(0, newItem);
-        else
-            m_children.insert(0, newItem);
+    } else if (siblings.last() == afterItem) {
+        row = siblings.count();
     } else {
-        if (parentItem) {
-            row = parentItem->children.indexOf(afterItem) + 1;
-            parentItem->children.insert(row, newItem);
-        } else {
-            row = m_children.indexOf(afterItem) + 1;
-            m_children.insert(row, newItem);
-        }
+        row = siblings.indexOf(afterItem) + 1;
     }
+    siblings.insert(row, newItem);
+    const bool append = row == siblings.count() - 1;
     if (parentItem && hasHeader(parentItem))
         row += 2;
 
@@ -240,15 +339,14 @@ void QtGroupBoxPropertyBrowserPrivate::propertyInserted(QtBrowserItem *index, Qt
 
     newItem->label = new QLabel(parentWidget);
     newItem->label->setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed));
-    newItem->widget = createEditor(index->property(), parentWidget);
-    if (!newItem->widget) {
-        newItem->widgetLabel = new QLabel(parentWidget);
-    } else {
-        QObject::connect(newItem->widget, SIGNAL(destroyed()), q_ptr, SLOT(slotEditorDestroyed()));
-        m_widgetToItem[newItem->widget] = newItem;
-    }
-
-    insertRow(layout, row);
+    // Editors are created when their row is first painted; until then the value
+    // label stands in for them, so rows that are hidden or scrolled away cost no editor.
+    newItem->editorPending = true;
+    newItem->widgetLabel = new QtPendingEditorLabel(this, newItem, parentWidget);
+
+    // Rows appended at the end don't need any of the following rows to be moved.
+    if (!append)
+        insertRow(layout, row);
     int span = 1;
     if (newItem->widget)
         layout->addWidget(newItem->widget, row, 1);
@@ -257,6 +355,8 @@ void QtGroupBoxPropertyBrowserPrivate::propertyInserted(QtBrowserItem *index, Qt
     else
         span = 2;
     layout->addWidget(newItem->label, row, 0, 1, span);
+    if (append && layout == m_mainLayout)
+        moveSpacer(row + 1);
 
     m_itemToIndex[newItem] = index;
     m_indexToItem[index] = newItem;
@@ -271,22 +371,18 @@ void QtGroupBoxPropertyBrowserPrivate::propertyRemoved(QtBrowserItem *index)
     m_indexToItem.remove(index);
     m_itemToIndex.remove(item);
 
-    WidgetItem *parentItem = item->parent;
+    m_paintedEditors.removeAll(item);
 
-    int row = -1;
+    WidgetItem *parentItem = item->parent;
 
-    if (parentItem) {
-        row = parentItem->children.indexOf(item);
-        parentItem->children.removeAt(row);
-        if (hasHeader(parentItem))
-            row += 2;
-    } else {
-        row = m_children.indexOf(item);
-        m_children.removeAt(row);
-    }
+    QList<WidgetItem *> &siblings = parentItem ? parentItem->children : m_children;
+    int row = siblings.last() == item ? siblings.count() - 1 : siblings.indexOf(item);
+    siblings.removeAt(row);
+    const bool last = row == siblings.count();
+    if (parentItem && hasHeader(parentItem))
+        row += 2;
 
-    if (item->widget)
-        delete item->widget;
+    releaseEditor(item, index->property());
     if (item->label)
         delete item->label;
     if (item->widgetLabel)
@@ -295,9 +391,13 @@ void QtGroupBoxPropertyBrowserPrivate::propertyRemoved(QtBrowserItem *index)
         delete item->groupBox;
 
     if (!parentItem) {
-        removeRow(m_mainLayout, row);
+        if (last)
+            moveSpacer(row);
+        else
+            removeRow(m_mainLayout, row);
     } else if (parentItem->children.count() != 0) {
-        removeRow(parentItem->layout, row);
+        if (!last)
+            removeRow(parentItem->layout, row);
     } else {
         WidgetItem *par = parentItem->parent;
         QGridLayout *l = 0;
@@ -486,8 +586,8 @@ QtGroupBoxPropertyBrowser::QtGroupBoxPropertyBrowser(QWidget *parent)
 */
 QtGroupBoxPropertyBrowser::~QtGroupBoxPropertyBrowser()
 {
-    const QMap<QtGroupBoxPropertyBrowserPrivate::WidgetItem *, QtBrowserItem *>::ConstIterator icend = d_ptr->m_itemToIndex.constEnd();
-    for (QMap<QtGroupBoxPropertyBrowserPrivate::WidgetItem *, QtBrowserItem *>::ConstIterator it = d_ptr->m_itemToIndex.constBegin(); it != icend; ++it)
+    const QHash<QtGroupBoxPropertyBrowserPrivate::WidgetItem *, QtBrowserItem *>::ConstIterator icend = d_ptr->m_itemToIndex.constEnd();
+    for (QHash<QtGroupBoxPropertyBrowserPrivate::WidgetItem *, QtBrowserItem *>::ConstIterator it = d_ptr->m_itemToIndex.constBegin(); it != icend; ++it)
         delete it.key();
 }
 
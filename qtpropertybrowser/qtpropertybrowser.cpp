@@ -40,6 +40,7 @@
 #include "qtpropertybrowser.h"
 #include <QtCore/QSet>
 #include <QtCore/QMap>
+#include <QtCore/QVector>
 #include <QtGui/QIcon>
 
 #if defined(Q_CC_MSVC)
@@ -51,7 +52,13 @@ QT_BEGIN_NAMESPACE
 class QtPropertyPrivate
 {
 public:
-    QtPropertyPrivate(QtAbstractPropertyManager *manager) : m_enabled(true), m_modified(false), m_manager(manager) {}
+    QtPropertyPrivate(QtAbstractPropertyManager *manager) : m_enabled(true), m_modified(false), m_visitMark(0), m_cached(0), m_manager(manager) {}
+
+    enum CachedValue
+    {
+        ValueTextCached = 0x1,
+        ValueIconCached = 0x2
+    };
     QtProperty *q_ptr;
 
     QSet<QtProperty *> m_parentItems;
@@ -64,6 +71,13 @@ public:
     QString m_name;
     bool m_enabled;
     bool m_modified;
+    quint64 m_visitMark; // generation of the last QtProperty::hasAncestor() walk that reached this
+
+    // valueText() and valueIcon() as last formatted by the manager, valid while
+    // the matching CachedValue bit is set; cleared on every propertyChanged().
+    mutable QString m_valueText;
+    mutable QIcon m_valueIcon;
+    mutable int m_cached;
 
     QtAbstractPropertyManager * const m_manager;
 };
@@ -73,14 +87,22 @@ class QtAbstractPropertyManagerPrivate
     QtAbstractPropertyManager *q_ptr;
     Q_DECLARE_PUBLIC(QtAbstractPropertyManager)
 public:
+    QtAbstractPropertyManagerPrivate() : q_ptr(0), m_updateDepth(0), m_valueCacheEnabled(false) {}
+
+    void slotPropertyChanged(QtProperty *property);
+
     void propertyDestroyed(QtProperty *property);
     void propertyChanged(QtProperty *property) const;
     void propertyRemoved(QtProperty *property,
                 QtProperty *parentProperty) const;
     void propertyInserted(QtProperty *property, QtProperty *parentProperty,
                 QtProperty *afterProperty) const;
+    void propertiesInserted(const QList<QtProperty *> &properties, QtProperty *parentProperty,
+                QtProperty *afterProperty) const;
 
     QSet<QtProperty *> m_properties;
+    int m_updateDepth;
+    bool m_valueCacheEnabled;
 };
 
 /*!
@@ -295,7 +317,14 @@ bool QtProperty::hasValue() const
 */
 QIcon QtProperty::valueIcon() const
 {
-    return d_ptr->m_manager->valueIcon(this);
+    if (!d_ptr->m_manager->d_ptr->m_valueCacheEnabled)
+        return d_ptr->m_manager->valueIcon(this);
+
+    if (!(d_ptr->m_cached & QtPropertyPrivate::ValueIconCached)) {
+        d_ptr->m_valueIcon = d_ptr->m_manager->valueIcon(this);
+        d_ptr->m_cached |= QtPropertyPrivate::ValueIconCached;
+    }
+    return d_ptr->m_valueIcon;
 }
 
 /*!
@@ -308,7 +337,14 @@ QIcon QtProperty::valueIcon() const
 */
 QString QtProperty::valueText() const
 {
-    return d_ptr->m_manager->valueText(this);
+    if (!d_ptr->m_manager->d_ptr->m_valueCacheEnabled)
+        return d_ptr->m_manager->valueText(this);
+
+    if (!(d_ptr->m_cached & QtPropertyPrivate::ValueTextCached)) {
+        d_ptr->m_valueText = d_ptr->m_manager->valueText(this);
+        d_ptr->m_cached |= QtPropertyPrivate::ValueTextCached;
+    }
+    return d_ptr->m_valueText;
 }
 
 /*!
@@ -429,6 +465,54 @@ void QtProperty::addSubProperty(QtProperty *property)
     insertSubProperty(property, after);
 }
 
+/*!
+    \internal
+
+    Returns true if \a property is this property or one of its
+    ancestors.
+
+    Only the parents above this property are visited, each one once,
+    so the cost does not depend on the size of the subtree below \a
+    property.
+*/
+bool QtProperty::hasAncestor(const QtProperty *property) const
+{
+    static quint64 generation = 0;
+    ++generation;
+
+    QVector<const QtProperty *> pendingList;
+    pendingList.append(this);
+    d_ptr->m_visitMark = generation;
+    while (!pendingList.isEmpty()) {
+        const QtProperty *i = pendingList.takeLast();
+        if (i == property)
+            return true;
+        for (QtProperty *parent : qAsConst(i->d_ptr->m_parentItems)) {
+            if (parent->d_ptr->m_visitMark != generation) {
+                parent->d_ptr->m_visitMark = generation;
+                pendingList.append(parent);
+            }
+        }
+    }
+    return false;
+}
+
+/*!
+    \internal
+
+    Returns the index in the list of subproperties at which a property
+    inserted after \a afterProperty goes, i.e. 0 if \a afterProperty
+    is 0 or not a subproperty of this property.
+*/
+int QtProperty::insertPosition(QtProperty *afterProperty) const
+{
+    if (!afterProperty || !afterProperty->d_ptr->m_parentItems.contains(const_cast<QtProperty *>(this)))
+        return 0;
+    if (d_ptr->m_subItems.last() == afterProperty)
+        return d_ptr->m_subItems.count();
+    return d_ptr->m_subItems.indexOf(afterProperty) + 1;
+}
+
 /*!
     \fn void QtProperty::insertSubProperty(QtProperty *property, QtProperty *precedingProperty)
 
@@ -448,37 +532,16 @@ void QtProperty::insertSubProperty(QtProperty *property,
     if (!property)
         return;
 
-    if (property == this)
+    // if this item is the item itself or one of its children then cannot add.
+    if (hasAncestor(property))
         return;
 
-    // traverse all children of item. if this item is a child of item then cannot add.
-    QList<QtProperty *> pendingList = property->subProperties();
-    QMap<QtProperty *, bool> visited;
-    while (!pendingList.isEmpty()) {
-        QtProperty *i = pendingList.first();
-        if (i == this)
-            return;
-        pendingList.removeFirst();
-        if (visited.contains(i))
-            continue;
-        visited[i] = true;
-        pendingList += i->subProperties();
-    }
+    // if item is already inserted in this item then cannot add.
+    if (property->d_ptr->m_parentItems.contains(this))
+        return;
 
-    pendingList = subProperties();
-    int pos = 0;
-    int newPos = 0;
-    QtProperty *properAfterProperty = 0;
-    while (pos < pendingList.count()) {
-        QtProperty *i = pendingList.at(pos);
-        if (i == property)
-            return; // if item is already inserted in this item then cannot add.
-        if (i == afterProperty) {
-            newPos = pos + 1;
-            properAfterProperty = afterProperty;
-        }
-        pos++;
-    }
+    const int newPos = insertPosition(afterProperty);
+    QtProperty *properAfterProperty = newPos ? afterProperty : 0;
 
     d_ptr->m_subItems.insert(newPos, property);
     property->d_ptr->m_parentItems.insert(this);
@@ -486,6 +549,46 @@ void QtProperty::insertSubProperty(QtProperty *property,
     d_ptr->m_manager->d_ptr->propertyInserted(property, this, properAfterProperty);
 }
 
+/*!
+    Inserts the given \a properties, in order, after the specified \a
+    afterProperty into this property's list of subproperties. If \a
+    afterProperty is 0, the properties are inserted at the beginning of
+    the list.
+
+    Properties that cannot be inserted with insertSubProperty(), e.g.
+    because they already are subproperties of this property, are
+    skipped.
+
+    The manager emits QtAbstractPropertyManager::propertyInserted() for
+    each inserted property, as insertSubProperty() does, followed by a
+    single QtAbstractPropertyManager::propertiesInserted() signal for the
+    whole list.
+
+    \sa insertSubProperty(), addSubProperty()
+*/
+void QtProperty::insertSubProperties(const QList<QtProperty *> &properties,
+            QtProperty *afterProperty)
+{
+    int newPos = insertPosition(afterProperty);
+    QtProperty *properAfterProperty = newPos ? afterProperty : 0;
+
+    QList<QtProperty *> inserted;
+    inserted.reserve(properties.count());
+    QtProperty *previous = properAfterProperty;
+    for (QtProperty *property : properties) {
+        if (!property || hasAncestor(property) || property->d_ptr->m_parentItems.contains(this))
+            continue;
+        d_ptr->m_subItems.insert(newPos++, property);
+        property->d_ptr->m_parentItems.insert(this);
+        d_ptr->m_manager->d_ptr->propertyInserted(property, this, previous);
+        inserted.append(property);
+        previous = property;
+    }
+
+    if (!inserted.isEmpty())
+        d_ptr->m_manager->d_ptr->propertiesInserted(inserted, this, properAfterProperty);
+}
+
 /*!
     Removes the given \a property from the list of subproperties
     without deleting it.
@@ -499,17 +602,13 @@ void QtProperty::removeSubProperty(QtProperty *property)
 
     d_ptr->m_manager->d_ptr->propertyRemoved(property, this);
 
-    QList<QtProperty *> pendingList = subProperties();
-    int pos = 0;
-    while (pos < pendingList.count()) {
-        if (pendingList.at(pos) == property) {
-            d_ptr->m_subItems.removeAt(pos);
-            property->d_ptr->m_parentItems.remove(this);
+    if (!property->d_ptr->m_parentItems.remove(this))
+        return;
 
-            return;
-        }
-        pos++;
-    }
+    if (d_ptr->m_subItems.last() == property)
+        d_ptr->m_subItems.removeLast();
+    else
+        d_ptr->m_subItems.removeAt(d_ptr->m_subItems.indexOf(property));
 }
 
 /*!
@@ -531,6 +630,11 @@ void QtAbstractPropertyManagerPrivate::propertyDestroyed(QtProperty *property)
     }
 }
 
+void QtAbstractPropertyManagerPrivate::slotPropertyChanged(QtProperty *property)
+{
+    property->d_ptr->m_cached = 0;
+}
+
 void QtAbstractPropertyManagerPrivate::propertyChanged(QtProperty *property) const
 {
     emit q_ptr->propertyChanged(property);
@@ -548,6 +652,12 @@ void QtAbstractPropertyManagerPrivate::propertyInserted(QtProperty *property,
     emit q_ptr->propertyInserted(property, parentProperty, afterProperty);
 }
 
+void QtAbstractPropertyManagerPrivate::propertiesInserted(const QList<QtProperty *> &properties,
+            QtProperty *parentProperty, QtProperty *afterProperty) const
+{
+    emit q_ptr->propertiesInserted(properties, parentProperty, afterProperty);
+}
+
 /*!
     \class QtAbstractPropertyManager
     \internal
@@ -619,6 +729,21 @@ void QtAbstractPropertyManagerPrivate::propertyInserted(QtProperty *property,
     \sa QtAbstractPropertyBrowser::itemInserted()
 */
 
+/*!
+    \fn void QtAbstractPropertyManager::propertiesInserted(const QList<QtProperty *> &properties,
+                QtProperty *parentProperty, QtProperty *precedingProperty)
+
+    This signal is emitted when QtProperty::insertSubProperties()
+    inserts a list of subproperties into an existing property, passing
+    the new \a properties (in order), the \a parentProperty and the
+    \a precedingProperty of the first one as parameters.
+
+    It is emitted after the propertyInserted() signals of the
+    individual properties.
+
+    \sa QtProperty::insertSubProperties(), propertyInserted()
+*/
+
 /*!
     \fn void QtAbstractPropertyManager::propertyChanged(QtProperty *property)
 
@@ -672,6 +797,10 @@ QtAbstractPropertyManager::QtAbstractPropertyManager(QObject *parent)
 {
     d_ptr->q_ptr = this;
 
+    // connected first, so that the cached texts are dropped before any
+    // browser asks for them.
+    connect(this, SIGNAL(propertyChanged(QtProperty*)),
+                this, SLOT(slotPropertyChanged(QtProperty*)));
 }
 
 /*!
@@ -704,6 +833,90 @@ QSet<QtProperty *> QtAbstractPropertyManager::properties() const
     return d_ptr->m_properties;
 }
 
+/*!
+    Starts a batch of property changes.
+
+    While a batch is open the manager still emits propertyChanged() for
+    every change, but property browsers do not update their items right
+    away: they record each changed property once and refresh its items
+    when control returns to the event loop. Properties changed many times
+    in a row, or from several batches within one event loop iteration,
+    are therefore repainted only once.
+
+    Batches can be nested; each call must be matched by a call to
+    endUpdate().
+
+    \sa endUpdate(), isUpdating()
+*/
+void QtAbstractPropertyManager::beginUpdate()
+{
+    d_ptr->m_updateDepth++;
+}
+
+/*!
+    Ends a batch of property changes started with beginUpdate().
+
+    \sa beginUpdate(), isUpdating()
+*/
+void QtAbstractPropertyManager::endUpdate()
+{
+    Q_ASSERT(d_ptr->m_updateDepth > 0);
+    if (d_ptr->m_updateDepth > 0)
+        d_ptr->m_updateDepth--;
+}
+
+/*!
+    Returns true if a batch of property changes is open; otherwise
+    returns false.
+
+    \sa beginUpdate(), endUpdate()
+*/
+bool QtAbstractPropertyManager::isUpdating() const
+{
+    return d_ptr->m_updateDepth > 0;
+}
+
+/*!
+    Sets whether QtProperty::valueText() and QtProperty::valueIcon()
+    cache the text and icon returned by valueText() and valueIcon().
+
+    While the cache is enabled, each property keeps its formatted text
+    and icon until the manager emits propertyChanged() for it, so
+    browsers refreshing unchanged properties do not format strings or
+    render pixmaps again. Only enable the cache in managers that emit
+    propertyChanged() whenever anything their valueText() or
+    valueIcon() depend on changes.
+
+    The cache is disabled by default, so custom managers keep calling
+    valueText() and valueIcon() on every refresh; the managers provided
+    with the property browser enable it.
+
+    \sa isValueCacheEnabled()
+*/
+void QtAbstractPropertyManager::setValueCacheEnabled(bool enable)
+{
+    if (d_ptr->m_valueCacheEnabled == enable)
+        return;
+
+    d_ptr->m_valueCacheEnabled = enable;
+    for (QtProperty *property : qAsConst(d_ptr->m_properties)) {
+        property->d_ptr->m_cached = 0;
+        property->d_ptr->m_valueText.clear();
+        property->d_ptr->m_valueIcon = QIcon();
+    }
+}
+
+/*!
+    Returns true if the texts and icons of this manager's properties
+    are cached; otherwise returns false.
+
+    \sa setValueCacheEnabled()
+*/
+bool QtAbstractPropertyManager::isValueCacheEnabled() const
+{
+    return d_ptr->m_valueCacheEnabled;
+}
+
 /*!
     Returns whether the given \a property has a value.
 
@@ -873,6 +1086,20 @@ void QtAbstractPropertyManager::uninitializeProperty(QtProperty *property)
     \sa QtAbstractEditorFactory::createEditor()
 */
 
+/*!
+    \fn virtual bool QtAbstractEditorFactoryBase::releaseEditor(QWidget *editor)
+
+    Gives an \a editor created by this factory back to the factory
+    when the property browser no longer needs it.
+
+    Returns true if the factory took the editor, e.g. to reuse it for
+    the next createEditor() call; the caller must not access it
+    afterwards. Returns false if the caller should delete the editor
+    itself. The default implementation returns false.
+
+    \sa QtAbstractPropertyBrowser::releaseEditor()
+*/
+
 /*!
     \fn QtAbstractEditorFactoryBase::QtAbstractEditorFactoryBase(QObject *parent = 0)
 
@@ -1106,6 +1333,11 @@ public:
 
 void QtBrowserItemPrivate::addChild(QtBrowserItem *index, QtBrowserItem *after)
 {
+    // appending after the last child is the common case, avoid the scans below
+    if (after && !m_children.isEmpty() && m_children.constLast() == after) {
+        m_children.append(index);
+        return;
+    }
     if (m_children.contains(index))
         return;
     int idx = m_children.indexOf(after) + 1; // we insert after returned idx, if it was -1 then we set idx to 0;
@@ -1232,6 +1464,8 @@ public:
     void slotPropertyRemoved(QtProperty *property, QtProperty *parentProperty);
     void slotPropertyDestroyed(QtProperty *property);
     void slotPropertyDataChanged(QtProperty *property);
+    void slotFlushPendingChanges();
+    void updateIndexes(QtProperty *property);
 
     QList<QtProperty *> m_subItems;
     QMap<QtAbstractPropertyManager *, QList<QtProperty *> > m_managerToProperties;
@@ -1241,6 +1475,11 @@ public:
     QList<QtBrowserItem *> m_topLevelIndexes;
     QMap<QtProperty *, QList<QtBrowserItem *> > m_propertyToIndexes;
 
+    // changes received while the property's manager was updating,
+    // in arrival order
+    QVector<QtProperty *> m_pendingChanges;
+    QSet<QtProperty *> m_pendingChangeSet;
+
     QtBrowserItem *m_currentItem;
 };
 
@@ -1360,7 +1599,10 @@ QtBrowserItem *QtAbstractPropertyBrowserPrivate::createBrowserIndex(QtProperty *
         parentIndex->d_ptr->addChild(newIndex, afterIndex);
     } else {
         m_topLevelPropertyToIndex[property] = newIndex;
-        m_topLevelIndexes.insert(m_topLevelIndexes.indexOf(afterIndex) + 1, newIndex);
+        if (afterIndex && !m_topLevelIndexes.isEmpty() && m_topLevelIndexes.constLast() == afterIndex)
+            m_topLevelIndexes.append(newIndex);
+        else
+            m_topLevelIndexes.insert(m_topLevelIndexes.indexOf(afterIndex) + 1, newIndex);
     }
     m_propertyToIndexes[property].append(newIndex);
 
@@ -1410,8 +1652,10 @@ void QtAbstractPropertyBrowserPrivate::removeBrowserIndex(QtBrowserItem *index)
     QtProperty *property = index->property();
 
     m_propertyToIndexes[property].removeAll(index);
-    if (m_propertyToIndexes[property].isEmpty())
+    if (m_propertyToIndexes[property].isEmpty()) {
         m_propertyToIndexes.remove(property);
+        m_pendingChangeSet.remove(property);
+    }
 
     delete index;
 }
@@ -1456,6 +1700,32 @@ void QtAbstractPropertyBrowserPrivate::slotPropertyDataChanged(QtProperty *prope
     if (!m_propertyToParents.contains(property))
         return;
 
+    if (property->propertyManager()->isUpdating()) {
+        if (m_pendingChangeSet.contains(property))
+            return;
+        if (m_pendingChanges.isEmpty())
+            QMetaObject::invokeMethod(q_ptr, "slotFlushPendingChanges", Qt::QueuedConnection);
+        m_pendingChangeSet.insert(property);
+        m_pendingChanges.append(property);
+        return;
+    }
+
+    updateIndexes(property);
+}
+
+void QtAbstractPropertyBrowserPrivate::slotFlushPendingChanges()
+{
+    const QVector<QtProperty *> pending = m_pendingChanges;
+    m_pendingChanges.clear();
+    for (QtProperty *property : pending) {
+        // properties removed from the browser meanwhile were dropped from the set
+        if (m_pendingChangeSet.remove(property))
+            updateIndexes(property);
+    }
+}
+
+void QtAbstractPropertyBrowserPrivate::updateIndexes(QtProperty *property)
+{
     QMap<QtProperty *, QList<QtBrowserItem *> >::ConstIterator it =
             m_propertyToIndexes.find(property);
     if (it == m_propertyToIndexes.constEnd())
@@ -1775,17 +2045,16 @@ QtBrowserItem *QtAbstractPropertyBrowser::insertProperty(QtProperty *property,
         return 0;
 
     // if item is already inserted in this item then cannot add.
-    QList<QtProperty *> pendingList = properties();
-    int pos = 0;
+    if (d_ptr->m_propertyToParents.value(property).contains(0))
+        return 0;
+
+    const QList<QtProperty *> &subItems = d_ptr->m_subItems;
     int newPos = 0;
-    while (pos < pendingList.count()) {
-        QtProperty *prop = pendingList.at(pos);
-        if (prop == property)
-            return 0;
-        if (prop == afterProperty) {
-            newPos = pos + 1;
-        }
-        pos++;
+    if (afterProperty) {
+        if (!subItems.isEmpty() && subItems.constLast() == afterProperty)
+            newPos = subItems.count();
+        else
+            newPos = subItems.indexOf(afterProperty) + 1;
     }
     d_ptr->createBrowserIndexes(property, 0, afterProperty);
 
@@ -1873,6 +2142,33 @@ QWidget *QtAbstractPropertyBrowser::createEditor(QtProperty *property,
     return w;
 }
 
+/*!
+    Disposes of an \a editor that was created by createEditor() for the
+    given \a property.
+
+    The editor is handed back to the factory associated with the
+    property's manager, which may keep it for reuse; otherwise it is
+    deleted. Browsers that remove and recreate editors often, e.g. when
+    switching between objects with similar properties, should call this
+    function instead of deleting the editor.
+
+    \sa createEditor(), QtAbstractEditorFactoryBase::releaseEditor()
+*/
+void QtAbstractPropertyBrowser::releaseEditor(QtProperty *property, QWidget *editor)
+{
+    if (!editor)
+        return;
+
+    QtAbstractEditorFactoryBase *factory = 0;
+    const Map1::ConstIterator it = m_viewToManagerToFactory()->constFind(this);
+    if (it != m_viewToManagerToFactory()->constEnd())
+        factory = it.value().value(property->propertyManager(), 0);
+
+    if (factory && factory->releaseEditor(editor))
+        return;
+    delete editor;
+}
+
 bool QtAbstractPropertyBrowser::addFactory(QtAbstractPropertyManager *abstractManager,
             QtAbstractEditorFactoryBase *abstractFactory)
 {
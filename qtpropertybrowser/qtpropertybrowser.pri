@@ -3,7 +3,9 @@ SOURCES += $$PWD/qtpropertybrowser.cpp \
             $$PWD/qtpropertymanager.cpp \
             $$PWD/qteditorfactory.cpp \
             $$PWD/qtvariantproperty.cpp \
+            $$PWD/qtpropertyvaluestore.cpp \
             $$PWD/qttreepropertybrowser.cpp \
+            $$PWD/qtvirtualtreepropertybrowser.cpp \
             $$PWD/qtbuttonpropertybrowser.cpp \
             $$PWD/qtgroupboxpropertybrowser.cpp \
             $$PWD/qtpropertybrowserutils.cpp
@@ -11,7 +13,9 @@ HEADERS += $$PWD/qtpropertybrowser.h \
             $$PWD/qtpropertymanager.h \
             $$PWD/qteditorfactory.h \
             $$PWD/qtvariantproperty.h \
+            $$PWD/qtpropertyvaluestore.h \
             $$PWD/qttreepropertybrowser.h \
+            $$PWD/qtvirtualtreepropertybrowser.h \
             $$PWD/qtbuttonpropertybrowser.h \
             $$PWD/qtgroupboxpropertybrowser.h \
             $$PWD/qtpropertybrowserutils_p.h
@@ -46,6 +46,7 @@
 #include <QtWidgets/QLineEdit>
 #include <QtWidgets/QMenu>
 #include <QtCore/QLocale>
+#include <QtCore/QHash>
 
 QT_BEGIN_NAMESPACE
 
@@ -173,9 +174,32 @@ QPixmap QtPropertyBrowserUtils::brushValuePixmap(const QBrush &b)
     return QPixmap::fromImage(img);
 }
 
+// Icons rendered for solid colors and fonts, keyed by value. The caches
+// are only touched from the GUI thread and are dropped when they grow
+// past MaxCachedIcons entries.
+enum { MaxCachedIcons = 256 };
+typedef QHash<quint64, QIcon> ColorIconCache;
+typedef QHash<QString, QIcon> FontIconCache;
+Q_GLOBAL_STATIC(ColorIconCache, colorIconCache)
+Q_GLOBAL_STATIC(FontIconCache, fontIconCache)
+
 QIcon QtPropertyBrowserUtils::brushValueIcon(const QBrush &b)
 {
-    return QIcon(brushValuePixmap(b));
+    // gradients and textures are not worth keying; render them every time.
+    if (b.style() != Qt::SolidPattern || !b.transform().isIdentity())
+        return QIcon(brushValuePixmap(b));
+
+    const quint64 key = quint64(b.color().rgba64());
+    ColorIconCache *cache = colorIconCache();
+    ColorIconCache::const_iterator it = cache->constFind(key);
+    if (it != cache->constEnd())
+        return it.value();
+
+    if (cache->count() >= MaxCachedIcons)
+        cache->clear();
+    const QIcon icon(brushValuePixmap(b));
+    cache->insert(key, icon);
+    return icon;
 }
 
 QString QtPropertyBrowserUtils::colorValueText(const QColor &c)
@@ -202,7 +226,21 @@ QPixmap QtPropertyBrowserUtils::fontValuePixmap(const QFont &font)
 
 QIcon QtPropertyBrowserUtils::fontValueIcon(const QFont &f)
 {
-    return QIcon(fontValuePixmap(f));
+    // fontValuePixmap() only depends on the font with its point size replaced.
+    QFont keyFont = f;
+    keyFont.setPointSize(13);
+    const QString key = keyFont.key();
+
+    FontIconCache *cache = fontIconCache();
+    FontIconCache::const_iterator it = cache->constFind(key);
+    if (it != cache->constEnd())
+        return it.value();
+
+    if (cache->count() >= MaxCachedIcons)
+        cache->clear();
+    const QIcon icon(fontValuePixmap(f));
+    cache->insert(key, icon);
+    return icon;
 }
 
 QString QtPropertyBrowserUtils::fontValueText(const QFont &f)
@@ -658,6 +658,7 @@ QtIntPropertyManager::QtIntPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtIntPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -946,6 +947,7 @@ QtDoublePropertyManager::QtDoublePropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtDoublePropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -1100,6 +1102,7 @@ void QtDoublePropertyManager::setDecimals(QtProperty *property, int prec)
     it.value() = data;
 
     emit decimalsChanged(property, data.decimals);
+    emit propertyChanged(property);
 }
 
 /*!
@@ -1249,6 +1252,7 @@ QtStringPropertyManager::QtStringPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtStringPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -1449,6 +1453,7 @@ QtBoolPropertyManager::QtBoolPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtBoolPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -1612,6 +1617,7 @@ QtDatePropertyManagerPrivate::QtDatePropertyManagerPrivate(QtDatePropertyManager
 QtDatePropertyManager::QtDatePropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtDatePropertyManagerPrivate(this))
 {
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -1818,6 +1824,7 @@ QtTimePropertyManagerPrivate::QtTimePropertyManagerPrivate(QtTimePropertyManager
 QtTimePropertyManager::QtTimePropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtTimePropertyManagerPrivate(this))
 {
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -1934,6 +1941,7 @@ QtDateTimePropertyManagerPrivate::QtDateTimePropertyManagerPrivate(QtDateTimePro
 QtDateTimePropertyManager::QtDateTimePropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtDateTimePropertyManagerPrivate(this))
 {
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -2045,6 +2053,7 @@ QtKeySequencePropertyManager::QtKeySequencePropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtKeySequencePropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -2154,6 +2163,7 @@ QtCharPropertyManager::QtCharPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtCharPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -2320,6 +2330,7 @@ QtLocalePropertyManager::QtLocalePropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtLocalePropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_enumPropertyManager = new QtEnumPropertyManager(this);
     connect(d_ptr->m_enumPropertyManager, SIGNAL(valueChanged(QtProperty*,int)),
@@ -2565,6 +2576,7 @@ QtPointPropertyManager::QtPointPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtPointPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_intPropertyManager = new QtIntPropertyManager(this);
     connect(d_ptr->m_intPropertyManager, SIGNAL(valueChanged(QtProperty*,int)),
@@ -2794,6 +2806,7 @@ QtPointFPropertyManager::QtPointFPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtPointFPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_doublePropertyManager = new QtDoublePropertyManager(this);
     connect(d_ptr->m_doublePropertyManager, SIGNAL(valueChanged(QtProperty*,double)),
@@ -2919,6 +2932,7 @@ void QtPointFPropertyManager::setDecimals(QtProperty *property, int prec)
     it.value() = data;
 
     emit decimalsChanged(property, data.decimals);
+    emit propertyChanged(property);
 }
 
 /*!
@@ -3104,6 +3118,7 @@ QtSizePropertyManager::QtSizePropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtSizePropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_intPropertyManager = new QtIntPropertyManager(this);
     connect(d_ptr->m_intPropertyManager, SIGNAL(valueChanged(QtProperty*,int)),
@@ -3457,6 +3472,7 @@ QtSizeFPropertyManager::QtSizeFPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtSizeFPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_doublePropertyManager = new QtDoublePropertyManager(this);
     connect(d_ptr->m_doublePropertyManager, SIGNAL(valueChanged(QtProperty*,double)),
@@ -3596,6 +3612,7 @@ void QtSizeFPropertyManager::setDecimals(QtProperty *property, int prec)
     it.value() = data;
 
     emit decimalsChanged(property, data.decimals);
+    emit propertyChanged(property);
 }
 
 /*!
@@ -3870,6 +3887,7 @@ QtRectPropertyManager::QtRectPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtRectPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_intPropertyManager = new QtIntPropertyManager(this);
     connect(d_ptr->m_intPropertyManager, SIGNAL(valueChanged(QtProperty*,int)),
@@ -4289,6 +4307,7 @@ QtRectFPropertyManager::QtRectFPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtRectFPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_doublePropertyManager = new QtDoublePropertyManager(this);
     connect(d_ptr->m_doublePropertyManager, SIGNAL(valueChanged(QtProperty*,double)),
@@ -4509,6 +4528,7 @@ void QtRectFPropertyManager::setDecimals(QtProperty *property, int prec)
     it.value() = data;
 
     emit decimalsChanged(property, data.decimals);
+    emit propertyChanged(property);
 }
 
 /*!
@@ -4671,6 +4691,7 @@ QtEnumPropertyManager::QtEnumPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtEnumPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -4981,6 +5002,7 @@ QtFlagPropertyManager::QtFlagPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtFlagPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_boolPropertyManager = new QtBoolPropertyManager(this);
     connect(d_ptr->m_boolPropertyManager, SIGNAL(valueChanged(QtProperty*,bool)),
@@ -5308,6 +5330,7 @@ QtSizePolicyPropertyManager::QtSizePolicyPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtSizePolicyPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_intPropertyManager = new QtIntPropertyManager(this);
     connect(d_ptr->m_intPropertyManager, SIGNAL(valueChanged(QtProperty*,int)),
@@ -5718,6 +5741,7 @@ QtFontPropertyManager::QtFontPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtFontPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
     QObject::connect(qApp, SIGNAL(fontDatabaseChanged()), this, SLOT(slotFontDatabaseChanged()));
 
     d_ptr->m_intPropertyManager = new QtIntPropertyManager(this);
@@ -6094,6 +6118,7 @@ QtColorPropertyManager::QtColorPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtColorPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 
     d_ptr->m_intPropertyManager = new QtIntPropertyManager(this);
     connect(d_ptr->m_intPropertyManager, SIGNAL(valueChanged(QtProperty*,int)),
@@ -6333,6 +6358,7 @@ QtCursorPropertyManager::QtCursorPropertyManager(QObject *parent)
     : QtAbstractPropertyManager(parent), d_ptr(new QtCursorPropertyManagerPrivate)
 {
     d_ptr->q_ptr = this;
+    setValueCacheEnabled(true);
 }
 
 /*!
@@ -0,0 +1,875 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the tools applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qtpropertyvaluestore.h"
+#include "qtvariantproperty.h"
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QPointer>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtCore/QPointF>
+#include <QtCore/QSizeF>
+#include <QtCore/QRectF>
+#include <QtGui/QColor>
+#include <atomic>
+#include <cstring>
+
+QT_BEGIN_NAMESPACE
+
+// One value of a QtPropertyValueStore, guarded by a sequence lock: the
+// sequence is odd while a writer is storing the words.
+struct QtPropertyValueSlot
+{
+    enum { WordCount = 4 };
+
+    QAtomicInteger<quint32> sequence;
+    QAtomicInteger<quint64> words[WordCount];
+    int type;
+};
+
+class QtPropertyValueStorePrivate
+{
+public:
+    QtPropertyValueStorePrivate(int capacity)
+        : m_slots(new QtPropertyValueSlot[capacity]), m_capacity(capacity) {}
+
+    QtPropertyValueSlot *slotAt(int slot) const;
+    void write(QtPropertyValueSlot *s, const quint64 *words) const;
+    quint32 read(const QtPropertyValueSlot *s, quint64 *words) const;
+
+    static int storageType(int type);
+    static void encode(int type, const QVariant &value, quint64 *words);
+    static QVariant decode(int type, const quint64 *words);
+
+    QScopedArrayPointer<QtPropertyValueSlot> m_slots;
+    const int m_capacity;
+    QAtomicInt m_count;
+};
+
+static inline quint64 doubleToWord(double value)
+{
+    quint64 word;
+    memcpy(&word, &value, sizeof(word));
+    return word;
+}
+
+static inline double wordToDouble(quint64 word)
+{
+    double value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+QtPropertyValueSlot *QtPropertyValueStorePrivate::slotAt(int slot) const
+{
+    if (slot < 0 || slot >= m_count.loadAcquire())
+        return 0;
+    return m_slots.data() + slot;
+}
+
+void QtPropertyValueStorePrivate::write(QtPropertyValueSlot *s, const quint64 *words) const
+{
+    quint32 sequence;
+    forever {
+        sequence = s->sequence.load();
+        if (!(sequence & 1) && s->sequence.testAndSetAcquire(sequence, sequence + 1))
+            break;
+        QThread::yieldCurrentThread();
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < QtPropertyValueSlot::WordCount; i++)
+        s->words[i].store(words[i]);
+    s->sequence.storeRelease(sequence + 2);
+}
+
+quint32 QtPropertyValueStorePrivate::read(const QtPropertyValueSlot *s, quint64 *words) const
+{
+    forever {
+        const quint32 sequence = s->sequence.loadAcquire();
+        if (sequence & 1) {
+            QThread::yieldCurrentThread();
+            continue;
+        }
+        for (int i = 0; i < QtPropertyValueSlot::WordCount; i++)
+            words[i] = s->words[i].load();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s->sequence.load() == sequence)
+            return sequence;
+    }
+}
+
+int QtPropertyValueStorePrivate::storageType(int type)
+{
+    switch (type) {
+    case QVariant::Int:
+    case QVariant::Double:
+    case QVariant::Bool:
+    case QVariant::Point:
+    case QVariant::PointF:
+    case QVariant::Size:
+    case QVariant::SizeF:
+    case QVariant::Rect:
+    case QVariant::RectF:
+    case QVariant::Color:
+        return type;
+    default:
+        break;
+    }
+    if (type == QtVariantPropertyManager::enumTypeId() || type == QtVariantPropertyManager::flagTypeId())
+        return QVariant::Int;
+    return QVariant::Invalid;
+}
+
+void QtPropertyValueStorePrivate::encode(int type, const QVariant &value, quint64 *words)
+{
+    for (int i = 0; i < QtPropertyValueSlot::WordCount; i++)
+        words[i] = 0;
+
+    switch (type) {
+    case QVariant::Int:
+        words[0] = quint64(qint64(value.toInt()));
+        break;
+    case QVariant::Double:
+        words[0] = doubleToWord(value.toDouble());
+        break;
+    case QVariant::Bool:
+        words[0] = value.toBool() ? 1 : 0;
+        break;
+    case QVariant::Point:
+    case QVariant::PointF: {
+        const QPointF p = value.toPointF();
+        words[0] = doubleToWord(p.x());
+        words[1] = doubleToWord(p.y());
+        break;
+    }
+    case QVariant::Size:
+    case QVariant::SizeF: {
+        const QSizeF s = value.toSizeF();
+        words[0] = doubleToWord(s.width());
+        words[1] = doubleToWord(s.height());
+        break;
+    }
+    case QVariant::Rect:
+    case QVariant::RectF: {
+        const QRectF r = value.toRectF();
+        words[0] = doubleToWord(r.x());
+        words[1] = doubleToWord(r.y());
+        words[2] = doubleToWord(r.width());
+        words[3] = doubleToWord(r.height());
+        break;
+    }
+    case QVariant::Color:
+        words[0] = quint64(value.value<QColor>().rgba64());
+        break;
+    default:
+        break;
+    }
+}
+
+QVariant QtPropertyValueStorePrivate::decode(int type, const quint64 *words)
+{
+    switch (type) {
+    case QVariant::Int:
+        return int(qint64(words[0]));
+    case QVariant::Double:
+        return wordToDouble(words[0]);
+    case QVariant::Bool:
+        return words[0] != 0;
+    case QVariant::Point:
+        return QPointF(wordToDouble(words[0]), wordToDouble(words[1])).toPoint();
+    case QVariant::PointF:
+        return QPointF(wordToDouble(words[0]), wordToDouble(words[1]));
+    case QVariant::Size:
+        return QSizeF(wordToDouble(words[0]), wordToDouble(words[1])).toSize();
+    case QVariant::SizeF:
+        return QSizeF(wordToDouble(words[0]), wordToDouble(words[1]));
+    case QVariant::Rect:
+        return QRectF(wordToDouble(words[0]), wordToDouble(words[1]),
+                    wordToDouble(words[2]), wordToDouble(words[3])).toRect();
+    case QVariant::RectF:
+        return QRectF(wordToDouble(words[0]), wordToDouble(words[1]),
+                    wordToDouble(words[2]), wordToDouble(words[3]));
+    case QVariant::Color:
+        return QColor::fromRgba64(QRgba64::fromRgba64(words[0]));
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+/*!
+    \class QtPropertyValueStore
+    \internal
+    \inmodule QtDesigner
+
+    \brief The QtPropertyValueStore class provides property values that
+    can be written from any thread.
+
+    Property managers are QObjects living in the GUI thread, so a value
+    computed in a worker thread normally has to travel through a queued
+    signal. QtPropertyValueStore instead holds a fixed number of value
+    slots that worker threads write directly, without a mutex and
+    without allocating:
+
+    \list
+    \li Each slot is guarded by a sequence lock. A writer makes the
+        sequence odd, stores the value and makes it even again; a reader
+        retries until it sees the same even sequence before and after
+        copying the value, so it never observes a half written value.
+    \li The sequence lock is a spin lock, not a lock-free structure:
+        writers of the same slot take turns, yielding while another
+        writer holds it, and readers wait for a write in progress.
+        Give each slot a single writer thread so that writes never wait.
+    \li Values are kept as up to four 64-bit words, which covers the
+        int, double, bool, point, size, rect and color property types
+        (see isTypeSupported()). Enum and flag values are stored as
+        integers.
+    \endlist
+
+    Slots are allocated with addSlot() by the thread that owns the
+    store, before they are handed to the worker threads, and are never
+    released. The store does not own any property; use
+    QtPropertyValuePublisher to copy the values into a
+    QtVariantPropertyManager.
+
+    \sa QtPropertyValuePublisher
+*/
+
+/*!
+    Creates a store with room for \a capacity slots.
+*/
+QtPropertyValueStore::QtPropertyValueStore(int capacity)
+    : d_ptr(new QtPropertyValueStorePrivate(qMax(capacity, 0)))
+{
+}
+
+/*!
+    Destroys this store. No thread may write into it any longer.
+*/
+QtPropertyValueStore::~QtPropertyValueStore()
+{
+}
+
+/*!
+    Returns the number of slots this store can hold.
+*/
+int QtPropertyValueStore::capacity() const
+{
+    return d_ptr->m_capacity;
+}
+
+/*!
+    Returns the number of allocated slots.
+*/
+int QtPropertyValueStore::count() const
+{
+    return d_ptr->m_count.loadAcquire();
+}
+
+/*!
+    Returns true if values of the given \a type can be kept in the
+    store; otherwise returns false.
+*/
+bool QtPropertyValueStore::isTypeSupported(int type)
+{
+    return QtPropertyValueStorePrivate::storageType(type) != QVariant::Invalid;
+}
+
+/*!
+    Allocates a slot for values of the given \a type, initialized to
+    \a initialValue, and returns its index. Returns -1 if the type is
+    not supported or the store is full.
+
+    This function is not thread-safe; call it from the thread that owns
+    the store.
+*/
+int QtPropertyValueStore::addSlot(int type, const QVariant &initialValue)
+{
+    const int storage = QtPropertyValueStorePrivate::storageType(type);
+    const int slot = d_ptr->m_count.load();
+    if (storage == QVariant::Invalid || slot >= d_ptr->m_capacity)
+        return -1;
+
+    QtPropertyValueSlot &s = d_ptr->m_slots[slot];
+    quint64 words[QtPropertyValueSlot::WordCount];
+    QtPropertyValueStorePrivate::encode(storage, initialValue, words);
+    s.type = storage;
+    s.sequence.store(0);
+    for (int i = 0; i < QtPropertyValueSlot::WordCount; i++)
+        s.words[i].store(words[i]);
+    d_ptr->m_count.storeRelease(slot + 1);
+    return slot;
+}
+
+/*!
+    Returns the type in which the given \a slot keeps its value, or
+    QVariant::Invalid if the slot is not allocated. Enum and flag slots
+    report QVariant::Int.
+*/
+int QtPropertyValueStore::slotType(int slot) const
+{
+    const QtPropertyValueSlot *s = d_ptr->slotAt(slot);
+    return s ? s->type : int(QVariant::Invalid);
+}
+
+/*!
+    Stores \a value in the given \a slot, converting it to the type of
+    the slot. This function is thread-safe.
+
+    \sa value()
+*/
+void QtPropertyValueStore::setValue(int slot, const QVariant &value)
+{
+    QtPropertyValueSlot *s = d_ptr->slotAt(slot);
+    if (!s)
+        return;
+
+    quint64 words[QtPropertyValueSlot::WordCount];
+    QtPropertyValueStorePrivate::encode(s->type, value, words);
+    d_ptr->write(s, words);
+}
+
+/*!
+    Stores the integer \a value in the given \a slot. This function is
+    thread-safe.
+*/
+void QtPropertyValueStore::setIntValue(int slot, int value)
+{
+    QtPropertyValueSlot *s = d_ptr->slotAt(slot);
+    if (!s)
+        return;
+    if (s->type != QVariant::Int) {
+        setValue(slot, value);
+        return;
+    }
+
+    const quint64 words[QtPropertyValueSlot::WordCount] = { quint64(qint64(value)), 0, 0, 0 };
+    d_ptr->write(s, words);
+}
+
+/*!
+    Stores the double \a value in the given \a slot. This function is
+    thread-safe.
+*/
+void QtPropertyValueStore::setDoubleValue(int slot, double value)
+{
+    QtPropertyValueSlot *s = d_ptr->slotAt(slot);
+    if (!s)
+        return;
+    if (s->type != QVariant::Double) {
+        setValue(slot, value);
+        return;
+    }
+
+    const quint64 words[QtPropertyValueSlot::WordCount] = { doubleToWord(value), 0, 0, 0 };
+    d_ptr->write(s, words);
+}
+
+/*!
+    Stores the boolean \a value in the given \a slot. This function is
+    thread-safe.
+*/
+void QtPropertyValueStore::setBoolValue(int slot, bool value)
+{
+    QtPropertyValueSlot *s = d_ptr->slotAt(slot);
+    if (!s)
+        return;
+    if (s->type != QVariant::Bool) {
+        setValue(slot, value);
+        return;
+    }
+
+    const quint64 words[QtPropertyValueSlot::WordCount] = { quint64(value ? 1 : 0), 0, 0, 0 };
+    d_ptr->write(s, words);
+}
+
+/*!
+    Stores the point \a value in the given \a slot. This function is
+    thread-safe.
+*/
+void QtPropertyValueStore::setPointFValue(int slot, const QPointF &value)
+{
+    setValue(slot, value);
+}
+
+/*!
+    Stores the size \a value in the given \a slot. This function is
+    thread-safe.
+*/
+void QtPropertyValueStore::setSizeFValue(int slot, const QSizeF &value)
+{
+    setValue(slot, value);
+}
+
+/*!
+    Stores the rectangle \a value in the given \a slot. This function is
+    thread-safe.
+*/
+void QtPropertyValueStore::setRectFValue(int slot, const QRectF &value)
+{
+    setValue(slot, value);
+}
+
+/*!
+    Stores the color \a value in the given \a slot. This function is
+    thread-safe.
+*/
+void QtPropertyValueStore::setColorValue(int slot, const QColor &value)
+{
+    setValue(slot, value);
+}
+
+/*!
+    Returns the value of the given \a slot, or an invalid variant if the
+    slot is not allocated. If \a revision is not 0, it is set to the
+    revision of the returned value. This function is thread-safe.
+
+    \sa revision()
+*/
+QVariant QtPropertyValueStore::value(int slot, quint32 *revision) const
+{
+    const QtPropertyValueSlot *s = d_ptr->slotAt(slot);
+    if (!s)
+        return QVariant();
+
+    quint64 words[QtPropertyValueSlot::WordCount];
+    const quint32 sequence = d_ptr->read(s, words);
+    if (revision)
+        *revision = sequence;
+    return QtPropertyValueStorePrivate::decode(s->type, words);
+}
+
+/*!
+    Returns the revision of the given \a slot. The revision changes
+    every time a value is stored in the slot, so comparing it with the
+    revision returned by value() tells whether the slot was written
+    since. This function is thread-safe.
+*/
+quint32 QtPropertyValueStore::revision(int slot) const
+{
+    const QtPropertyValueSlot *s = d_ptr->slotAt(slot);
+    return s ? s->sequence.loadAcquire() : 0;
+}
+
+class QtPropertyValuePublisherPrivate
+{
+    QtPropertyValuePublisher *q_ptr;
+    Q_DECLARE_PUBLIC(QtPropertyValuePublisher)
+public:
+    QtPropertyValuePublisherPrivate();
+
+    struct Binding
+    {
+        QtVariantProperty *property;
+        int slot;
+        int handle;
+        quint32 revision;
+    };
+
+    void slotPropertyDestroyed(QtProperty *property);
+    void applyValue(const Binding &binding, const QVariant &value) const;
+
+    enum { BudgetCheckInterval = 16 };
+
+    QtPropertyValueStore *m_store;
+    QPointer<QtVariantPropertyManager> m_manager;
+    QTimer m_timer;
+    QVector<Binding> m_bindings;
+    QVector<int> m_freeBindings;
+    QHash<const QtProperty *, int> m_propertyToBinding;
+    int m_cursor;
+    int m_refreshRate;
+    int m_timeBudget;
+    quint64 m_publishedValues;
+    quint64 m_publishCount;
+    qint64 m_busyTime;
+};
+
+QtPropertyValuePublisherPrivate::QtPropertyValuePublisherPrivate()
+    : q_ptr(0), m_store(0), m_cursor(0), m_refreshRate(30), m_timeBudget(8),
+      m_publishedValues(0), m_publishCount(0), m_busyTime(0)
+{
+}
+
+void QtPropertyValuePublisherPrivate::slotPropertyDestroyed(QtProperty *property)
+{
+    const int index = m_propertyToBinding.take(property) - 1;
+    if (index < 0)
+        return;
+
+    m_bindings[index].property = 0;
+    m_freeBindings.append(index);
+}
+
+void QtPropertyValuePublisherPrivate::applyValue(const Binding &binding, const QVariant &value) const
+{
+    if (binding.handle >= 0) {
+        switch (m_store->slotType(binding.slot)) {
+        case QVariant::Int:
+            m_manager->setIntValue(binding.handle, value.toInt());
+            return;
+        case QVariant::Double:
+            m_manager->setDoubleValue(binding.handle, value.toDouble());
+            return;
+        case QVariant::Bool:
+            m_manager->setBoolValue(binding.handle, value.toBool());
+            return;
+        default:
+            break;
+        }
+    }
+    m_manager->setValue(binding.property, value);
+}
+
+/*!
+    \class QtPropertyValuePublisher
+    \internal
+    \inmodule QtDesigner
+
+    \brief The QtPropertyValuePublisher class copies the values of a
+    QtPropertyValueStore into a QtVariantPropertyManager at a fixed
+    rate.
+
+    Each property passed to bind() gets a slot in the store, which
+    worker threads then write as often as they like. While the
+    publisher is active, it wakes up refreshRate() times per second in
+    the manager's thread and copies the values of the slots that were
+    written since the previous pass into their properties:
+
+    \list
+    \li Each value is read as a consistent snapshot of its slot; a
+        property is set at most once per pass, no matter how many times
+        its slot was written.
+    \li The whole pass runs inside QtAbstractPropertyManager::beginUpdate()
+        and endUpdate(), so the browsers repaint each changed property
+        once.
+    \li A pass stops after timeBudget() milliseconds. The next pass
+        continues with the slots that were not visited, so a large
+        store is published in round-robin order without starving the
+        event loop.
+    \li Int, enum, flag, double and bool values are set through the
+        manager's property handles instead of QVariant based setValue().
+    \endlist
+
+    publishedValues(), publishCount() and busyTime() report how much
+    work the publisher has done, e.g. to measure the number of updates
+    per second that can be sustained at a given refresh rate.
+
+    \sa QtPropertyValueStore
+*/
+
+/*!
+    \fn void QtPropertyValuePublisher::published(int count)
+
+    This signal is emitted at the end of a pass that set \a count
+    property values.
+
+    \sa publish()
+*/
+
+/*!
+    Creates a publisher copying values from the given \a store into
+    properties created by the given \a manager, with the given \a parent.
+
+    The publisher does not take ownership of the store, which must
+    outlive it. The publisher is inactive until start() is called.
+*/
+QtPropertyValuePublisher::QtPropertyValuePublisher(QtPropertyValueStore *store,
+            QtVariantPropertyManager *manager, QObject *parent)
+    : QObject(parent), d_ptr(new QtPropertyValuePublisherPrivate)
+{
+    d_ptr->q_ptr = this;
+    d_ptr->m_store = store;
+    d_ptr->m_manager = manager;
+    d_ptr->m_timer.setInterval(1000 / d_ptr->m_refreshRate);
+
+    connect(&d_ptr->m_timer, SIGNAL(timeout()), this, SLOT(publish()));
+    if (manager)
+        connect(manager, SIGNAL(propertyDestroyed(QtProperty *)),
+                    this, SLOT(slotPropertyDestroyed(QtProperty *)));
+}
+
+/*!
+    Destroys this publisher.
+*/
+QtPropertyValuePublisher::~QtPropertyValuePublisher()
+{
+}
+
+/*!
+    Returns the store the values are read from.
+*/
+QtPropertyValueStore *QtPropertyValuePublisher::store() const
+{
+    return d_ptr->m_store;
+}
+
+/*!
+    Returns the manager whose properties are set.
+*/
+QtVariantPropertyManager *QtPropertyValuePublisher::propertyManager() const
+{
+    return d_ptr->m_manager;
+}
+
+/*!
+    Allocates a store slot for the given \a property, initialized to the
+    property's current value, and returns its index. Worker threads
+    write the property's value into that slot.
+
+    Returns the existing slot if the property is already bound, and -1
+    if the property does not belong to propertyManager(), its value
+    type is not supported by QtPropertyValueStore, or the store is full.
+
+    \sa unbind(), boundSlot()
+*/
+int QtPropertyValuePublisher::bind(QtVariantProperty *property)
+{
+    if (!property || !d_ptr->m_store || !d_ptr->m_manager
+                || property->propertyManager() != d_ptr->m_manager.data())
+        return -1;
+
+    const int existing = boundSlot(property);
+    if (existing >= 0)
+        return existing;
+
+    const int slot = d_ptr->m_store->addSlot(property->valueType(), property->value());
+    if (slot < 0)
+        return -1;
+
+    QtPropertyValuePublisherPrivate::Binding binding;
+    binding.property = property;
+    binding.slot = slot;
+    binding.handle = d_ptr->m_manager->propertyHandle(property);
+    binding.revision = d_ptr->m_store->revision(slot);
+
+    int index;
+    if (!d_ptr->m_freeBindings.isEmpty()) {
+        index = d_ptr->m_freeBindings.takeLast();
+        d_ptr->m_bindings[index] = binding;
+    } else {
+        index = d_ptr->m_bindings.count();
+        d_ptr->m_bindings.append(binding);
+    }
+    d_ptr->m_propertyToBinding.insert(property, index + 1);
+    return slot;
+}
+
+/*!
+    Stops publishing values into the given \a property. Its store slot
+    stays allocated, since worker threads may still write to it.
+
+    \sa bind()
+*/
+void QtPropertyValuePublisher::unbind(QtVariantProperty *property)
+{
+    d_ptr->slotPropertyDestroyed(property);
+}
+
+/*!
+    Returns the store slot of the given \a property, or -1 if the
+    property is not bound.
+
+    \sa bind()
+*/
+int QtPropertyValuePublisher::boundSlot(QtVariantProperty *property) const
+{
+    const int index = d_ptr->m_propertyToBinding.value(property) - 1;
+    return index < 0 ? -1 : d_ptr->m_bindings.at(index).slot;
+}
+
+/*!
+    \property QtPropertyValuePublisher::refreshRate
+    \brief the number of passes per second while the publisher is active
+
+    The default is 30.
+*/
+int QtPropertyValuePublisher::refreshRate() const
+{
+    return d_ptr->m_refreshRate;
+}
+
+void QtPropertyValuePublisher::setRefreshRate(int rate)
+{
+    d_ptr->m_refreshRate = qBound(1, rate, 1000);
+    d_ptr->m_timer.setInterval(1000 / d_ptr->m_refreshRate);
+}
+
+/*!
+    \property QtPropertyValuePublisher::timeBudget
+    \brief the maximum time, in milliseconds, a single pass may take
+
+    Slots that were not visited when the budget ran out are published
+    in the next pass. A budget of 0 publishes all slots in every pass.
+    The default is 8.
+*/
+int QtPropertyValuePublisher::timeBudget() const
+{
+    return d_ptr->m_timeBudget;
+}
+
+void QtPropertyValuePublisher::setTimeBudget(int msecs)
+{
+    d_ptr->m_timeBudget = qMax(msecs, 0);
+}
+
+/*!
+    Returns true if the publisher publishes values periodically;
+    otherwise returns false.
+
+    \sa start(), stop()
+*/
+bool QtPropertyValuePublisher::isActive() const
+{
+    return d_ptr->m_timer.isActive();
+}
+
+/*!
+    Returns the number of property values set since the publisher was
+    created or resetStatistics() was called.
+*/
+quint64 QtPropertyValuePublisher::publishedValues() const
+{
+    return d_ptr->m_publishedValues;
+}
+
+/*!
+    Returns the number of passes run since the publisher was created or
+    resetStatistics() was called.
+*/
+quint64 QtPropertyValuePublisher::publishCount() const
+{
+    return d_ptr->m_publishCount;
+}
+
+/*!
+    Returns the time, in nanoseconds, spent in publish() since the
+    publisher was created or resetStatistics() was called.
+*/
+qint64 QtPropertyValuePublisher::busyTime() const
+{
+    return d_ptr->m_busyTime;
+}
+
+/*!
+    Resets publishedValues(), publishCount() and busyTime() to 0.
+*/
+void QtPropertyValuePublisher::resetStatistics()
+{
+    d_ptr->m_publishedValues = 0;
+    d_ptr->m_publishCount = 0;
+    d_ptr->m_busyTime = 0;
+}
+
+/*!
+    Starts publishing values refreshRate() times per second.
+
+    \sa stop(), isActive()
+*/
+void QtPropertyValuePublisher::start()
+{
+    d_ptr->m_timer.start();
+}
+
+/*!
+    Stops publishing values periodically.
+
+    \sa start(), isActive()
+*/
+void QtPropertyValuePublisher::stop()
+{
+    d_ptr->m_timer.stop();
+}
+
+/*!
+    Runs a single pass and returns the number of property values that
+    were set.
+
+    \sa published()
+*/
+int QtPropertyValuePublisher::publish()
+{
+    Q_D(QtPropertyValuePublisher);
+    if (!d->m_store || !d->m_manager || d->m_bindings.isEmpty())
+        return 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 budget = qint64(d->m_timeBudget) * 1000000;
+    const int count = d->m_bindings.count();
+    int published = 0;
+
+    d->m_manager->beginUpdate();
+    for (int visited = 0; visited < count; visited++) {
+        // a slot connected to the manager may have deleted it
+        if (!d->m_manager)
+            break;
+        if (d->m_cursor >= count)
+            d->m_cursor = 0;
+        QtPropertyValuePublisherPrivate::Binding &binding = d->m_bindings[d->m_cursor++];
+        if (!binding.property || d->m_store->revision(binding.slot) == binding.revision)
+            continue;
+
+        const QVariant value = d->m_store->value(binding.slot, &binding.revision);
+        // setting the value may bind or unbind properties; don't keep a reference.
+        const QtPropertyValuePublisherPrivate::Binding current = binding;
+        d->applyValue(current, value);
+        published++;
+
+        if (budget > 0 && published % QtPropertyValuePublisherPrivate::BudgetCheckInterval == 0
+                    && timer.nsecsElapsed() >= budget)
+            break;
+    }
+    if (d->m_manager)
+        d->m_manager->endUpdate();
+
+    d->m_publishedValues += published;
+    d->m_publishCount++;
+    d->m_busyTime += timer.nsecsElapsed();
+    if (published)
+        emit this->published(published);
+    return published;
+}
+
+QT_END_NAMESPACE
+
+#include "moc_qtpropertyvaluestore.cpp"
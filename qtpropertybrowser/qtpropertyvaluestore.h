@@ -0,0 +1,137 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the tools applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QTPROPERTYVALUESTORE_H
+#define QTPROPERTYVALUESTORE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QVariant>
+
+QT_BEGIN_NAMESPACE
+
+class QPointF;
+class QSizeF;
+class QRectF;
+class QColor;
+class QtProperty;
+class QtVariantProperty;
+class QtVariantPropertyManager;
+class QtPropertyValueStorePrivate;
+class QtPropertyValuePublisherPrivate;
+
+class QtPropertyValueStore
+{
+public:
+    explicit QtPropertyValueStore(int capacity);
+    ~QtPropertyValueStore();
+
+    int capacity() const;
+    int count() const;
+
+    static bool isTypeSupported(int type);
+
+    int addSlot(int type, const QVariant &initialValue = QVariant());
+    int slotType(int slot) const;
+
+    void setValue(int slot, const QVariant &value);
+    void setIntValue(int slot, int value);
+    void setDoubleValue(int slot, double value);
+    void setBoolValue(int slot, bool value);
+    void setPointFValue(int slot, const QPointF &value);
+    void setSizeFValue(int slot, const QSizeF &value);
+    void setRectFValue(int slot, const QRectF &value);
+    void setColorValue(int slot, const QColor &value);
+
+    QVariant value(int slot, quint32 *revision = 0) const;
+    quint32 revision(int slot) const;
+
+private:
+    QScopedPointer<QtPropertyValueStorePrivate> d_ptr;
+    Q_DISABLE_COPY(QtPropertyValueStore)
+};
+
+class QtPropertyValuePublisher : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int refreshRate READ refreshRate WRITE setRefreshRate)
+    Q_PROPERTY(int timeBudget READ timeBudget WRITE setTimeBudget)
+public:
+    QtPropertyValuePublisher(QtPropertyValueStore *store, QtVariantPropertyManager *manager,
+                QObject *parent = 0);
+    ~QtPropertyValuePublisher();
+
+    QtPropertyValueStore *store() const;
+    QtVariantPropertyManager *propertyManager() const;
+
+    int bind(QtVariantProperty *property);
+    void unbind(QtVariantProperty *property);
+    int boundSlot(QtVariantProperty *property) const;
+
+    int refreshRate() const;
+    void setRefreshRate(int rate);
+
+    int timeBudget() const;
+    void setTimeBudget(int msecs);
+
+    bool isActive() const;
+
+    quint64 publishedValues() const;
+    quint64 publishCount() const;
+    qint64 busyTime() const;
+    void resetStatistics();
+
+public Q_SLOTS:
+    void start();
+    void stop();
+    int publish();
+
+Q_SIGNALS:
+    void published(int count);
+
+private:
+    QScopedPointer<QtPropertyValuePublisherPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(QtPropertyValuePublisher)
+    Q_DISABLE_COPY(QtPropertyValuePublisher)
+
+    Q_PRIVATE_SLOT(d_func(), void slotPropertyDestroyed(QtProperty *))
+};
+
+QT_END_NAMESPACE
+
+#endif
@@ -41,6 +41,8 @@
 #include "qtpropertymanager.h"
 #include "qteditorfactory.h"
 #include <QtCore/QVariant>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
 #include <QtGui/QIcon>
 #include <QtCore/QDate>
 #include <QtCore/QLocale>
@@ -128,7 +130,7 @@ int QtVariantPropertyManager::iconMapTypeId()
     return qMetaTypeId<QtIconMap>();
 }
 
-typedef QMap<const QtProperty *, QtProperty *> PropertyMap;
+typedef QHash<const QtProperty *, QtProperty *> PropertyMap;
 Q_GLOBAL_STATIC(PropertyMap, propertyToWrappedProperty)
 
 static QtProperty *wrappedProperty(QtProperty *property)
@@ -283,6 +285,25 @@ class QtVariantPropertyManagerPrivate
 public:
     QtVariantPropertyManagerPrivate();
 
+    // Storage class of a registered property. Properties backed by the
+    // int, enum, flag, double and bool managers keep a mirror of their
+    // value in the matching contiguous array below.
+    enum HandleStorage {
+        VariantStorage,
+        IntStorage,
+        EnumStorage,
+        FlagStorage,
+        DoubleStorage,
+        BoolStorage
+    };
+
+    struct HandleSlot {
+        QtVariantProperty *property;
+        QtProperty *internal;
+        QtAbstractPropertyManager *manager;
+        HandleStorage storage;
+    };
+
     bool m_creatingProperty;
     bool m_creatingSubProperties;
     bool m_destroyingSubProperties;
@@ -334,15 +355,27 @@ public:
             QtProperty *internal);
     void removeSubProperty(QtVariantProperty *property);
 
+    void registerHandle(QtVariantProperty *property, QtProperty *internal);
+    void unregisterHandle(const QtProperty *property);
+    const HandleSlot *handleSlot(int handle) const;
+
     QMap<int, QtAbstractPropertyManager *> m_typeToPropertyManager;
     QMap<int, QMap<QString, int> > m_typeToAttributeToAttributeType;
 
-    QMap<const QtProperty *, QPair<QtVariantProperty *, int> > m_propertyToType;
+    QHash<const QtProperty *, QPair<QtVariantProperty *, int> > m_propertyToType;
 
     QMap<int, int> m_typeToValueType;
 
 
-    QMap<QtProperty *, QtVariantProperty *> m_internalToProperty;
+    QHash<QtProperty *, QtVariantProperty *> m_internalToProperty;
+
+    QVector<HandleSlot> m_handleSlots;
+    QVector<int> m_freeHandles;
+    QHash<const QtProperty *, int> m_propertyToHandle;
+    QHash<const QtProperty *, int> m_internalToHandle;
+    QVector<int> m_intValues;
+    QVector<double> m_doubleValues;
+    QVector<bool> m_boolValues;
 
     const QString m_constraintAttribute;
     const QString m_singleStepAttribute;
@@ -406,6 +439,7 @@ QtVariantProperty *QtVariantPropertyManagerPrivate::createSubProperty(QtVariantP
 
     m_internalToProperty[internal] = varChild;
     propertyToWrappedProperty()->insert(varChild, internal);
+    registerHandle(varChild, internal);
     return varChild;
 }
 
@@ -420,6 +454,72 @@ void QtVariantPropertyManagerPrivate::removeSubProperty(QtVariantProperty *prope
     propertyToWrappedProperty()->remove(property);
 }
 
+void QtVariantPropertyManagerPrivate::registerHandle(QtVariantProperty *property, QtProperty *internal)
+{
+    int handle;
+    if (m_freeHandles.isEmpty()) {
+        handle = m_handleSlots.size();
+        m_handleSlots.resize(handle + 1);
+        m_intValues.resize(handle + 1);
+        m_doubleValues.resize(handle + 1);
+        m_boolValues.resize(handle + 1);
+    } else {
+        handle = m_freeHandles.takeLast();
+    }
+
+    HandleSlot &slot = m_handleSlots[handle];
+    slot.property = property;
+    slot.internal = internal;
+    slot.manager = internal->propertyManager();
+    slot.storage = VariantStorage;
+
+    if (QtIntPropertyManager *intManager = qobject_cast<QtIntPropertyManager *>(slot.manager)) {
+        slot.storage = IntStorage;
+        m_intValues[handle] = intManager->value(internal);
+    } else if (QtEnumPropertyManager *enumManager = qobject_cast<QtEnumPropertyManager *>(slot.manager)) {
+        slot.storage = EnumStorage;
+        m_intValues[handle] = enumManager->value(internal);
+    } else if (QtFlagPropertyManager *flagManager = qobject_cast<QtFlagPropertyManager *>(slot.manager)) {
+        slot.storage = FlagStorage;
+        m_intValues[handle] = flagManager->value(internal);
+    } else if (QtDoublePropertyManager *doubleManager = qobject_cast<QtDoublePropertyManager *>(slot.manager)) {
+        slot.storage = DoubleStorage;
+        m_doubleValues[handle] = doubleManager->value(internal);
+    } else if (QtBoolPropertyManager *boolManager = qobject_cast<QtBoolPropertyManager *>(slot.manager)) {
+        slot.storage = BoolStorage;
+        m_boolValues[handle] = boolManager->value(internal);
+    }
+
+    m_propertyToHandle[property] = handle;
+    m_internalToHandle[internal] = handle;
+}
+
+void QtVariantPropertyManagerPrivate::unregisterHandle(const QtProperty *property)
+{
+    const QHash<const QtProperty *, int>::iterator it = m_propertyToHandle.find(property);
+    if (it == m_propertyToHandle.end())
+        return;
+
+    const int handle = it.value();
+    m_propertyToHandle.erase(it);
+
+    HandleSlot &slot = m_handleSlots[handle];
+    m_internalToHandle.remove(slot.internal);
+    slot.property = 0;
+    slot.internal = 0;
+    slot.manager = 0;
+    slot.storage = VariantStorage;
+    m_freeHandles.append(handle);
+}
+
+const QtVariantPropertyManagerPrivate::HandleSlot *QtVariantPropertyManagerPrivate::handleSlot(int handle) const
+{
+    if (handle < 0 || handle >= m_handleSlots.size())
+        return 0;
+    const HandleSlot &slot = m_handleSlots.at(handle);
+    return slot.property ? &slot : 0;
+}
+
 void QtVariantPropertyManagerPrivate::slotPropertyInserted(QtProperty *property,
             QtProperty *parent, QtProperty *after)
 {
@@ -462,6 +562,9 @@ void QtVariantPropertyManagerPrivate::valueChanged(QtProperty *property, const Q
 
 void QtVariantPropertyManagerPrivate::slotValueChanged(QtProperty *property, int val)
 {
+    const int handle = m_internalToHandle.value(property, -1);
+    if (handle >= 0)
+        m_intValues[handle] = val;
     valueChanged(property, QVariant(val));
 }
 
@@ -481,6 +584,9 @@ void QtVariantPropertyManagerPrivate::slotSingleStepChanged(QtProperty *property
 
 void QtVariantPropertyManagerPrivate::slotValueChanged(QtProperty *property, double val)
 {
+    const int handle = m_internalToHandle.value(property, -1);
+    if (handle >= 0)
+        m_doubleValues[handle] = val;
     valueChanged(property, QVariant(val));
 }
 
@@ -506,6 +612,9 @@ void QtVariantPropertyManagerPrivate::slotDecimalsChanged(QtProperty *property,
 
 void QtVariantPropertyManagerPrivate::slotValueChanged(QtProperty *property, bool val)
 {
+    const int handle = m_internalToHandle.value(property, -1);
+    if (handle >= 0)
+        m_boolValues[handle] = val;
     valueChanged(property, QVariant(val));
 }
 
@@ -1240,7 +1349,7 @@ QtVariantPropertyManager::~QtVariantPropertyManager()
 */
 QtVariantProperty *QtVariantPropertyManager::variantProperty(const QtProperty *property) const
 {
-    const QMap<const QtProperty *, QPair<QtVariantProperty *, int> >::const_iterator it = d_ptr->m_propertyToType.constFind(property);
+    const QHash<const QtProperty *, QPair<QtVariantProperty *, int> >::const_iterator it = d_ptr->m_propertyToType.constFind(property);
     if (it == d_ptr->m_propertyToType.constEnd())
         return 0;
     return it.value().first;
@@ -1387,12 +1496,213 @@ int QtVariantPropertyManager::valueType(int propertyType) const
 */
 int QtVariantPropertyManager::propertyType(const QtProperty *property) const
 {
-    const QMap<const QtProperty *, QPair<QtVariantProperty *, int> >::const_iterator it = d_ptr->m_propertyToType.constFind(property);
+    const QHash<const QtProperty *, QPair<QtVariantProperty *, int> >::const_iterator it = d_ptr->m_propertyToType.constFind(property);
     if (it == d_ptr->m_propertyToType.constEnd())
         return 0;
     return it.value().second;
 }
 
+/*!
+    Returns the handle of the given \a property, or -1 if the \a
+    property was not created by this manager.
+
+    Handles are small non-negative integers that stay valid for the
+    lifetime of the property and are reused after the property is
+    deleted. Values of int, enum, flag, double and bool properties are
+    mirrored in contiguous arrays indexed by handle, so reading them
+    through handleValue(), intValue(), doubleValue() or boolValue()
+    does not need any map lookups.
+
+    \sa handleProperty()
+*/
+int QtVariantPropertyManager::propertyHandle(const QtProperty *property) const
+{
+    return d_ptr->m_propertyToHandle.value(property, -1);
+}
+
+/*!
+    Returns the property with the given \a handle, or 0 if the \a handle
+    is not in use.
+
+    \sa propertyHandle()
+*/
+QtVariantProperty *QtVariantPropertyManager::handleProperty(int handle) const
+{
+    const QtVariantPropertyManagerPrivate::HandleSlot *slot = d_ptr->handleSlot(handle);
+    return slot ? slot->property : 0;
+}
+
+/*!
+    Returns the value of the property with the given \a handle, or an
+    invalid variant if the \a handle is not in use.
+
+    \sa propertyHandle(), setHandleValue(), value()
+*/
+QVariant QtVariantPropertyManager::handleValue(int handle) const
+{
+    const QtVariantPropertyManagerPrivate::HandleSlot *slot = d_ptr->handleSlot(handle);
+    if (!slot)
+        return QVariant();
+
+    switch (slot->storage) {
+    case QtVariantPropertyManagerPrivate::IntStorage:
+    case QtVariantPropertyManagerPrivate::EnumStorage:
+    case QtVariantPropertyManagerPrivate::FlagStorage:
+        return d_ptr->m_intValues.at(handle);
+    case QtVariantPropertyManagerPrivate::DoubleStorage:
+        return d_ptr->m_doubleValues.at(handle);
+    case QtVariantPropertyManagerPrivate::BoolStorage:
+        return d_ptr->m_boolValues.at(handle);
+    default:
+        break;
+    }
+    return value(slot->property);
+}
+
+/*!
+    Returns the value of the int, enum or flag property with the given
+    \a handle. Returns 0 if the \a handle does not refer to such a
+    property.
+
+    \sa setIntValue()
+*/
+int QtVariantPropertyManager::intValue(int handle) const
+{
+    const QtVariantPropertyManagerPrivate::HandleSlot *slot = d_ptr->handleSlot(handle);
+    if (!slot || (slot->storage != QtVariantPropertyManagerPrivate::IntStorage &&
+            slot->storage != QtVariantPropertyManagerPrivate::EnumStorage &&
+            slot->storage != QtVariantPropertyManagerPrivate::FlagStorage))
+        return 0;
+    return d_ptr->m_intValues.at(handle);
+}
+
+/*!
+    Returns the value of the double property with the given \a handle.
+    Returns 0 if the \a handle does not refer to a double property.
+
+    \sa setDoubleValue()
+*/
+double QtVariantPropertyManager::doubleValue(int handle) const
+{
+    const QtVariantPropertyManagerPrivate::HandleSlot *slot = d_ptr->handleSlot(handle);
+    if (!slot || slot->storage != QtVariantPropertyManagerPrivate::DoubleStorage)
+        return 0.0;
+    return d_ptr->m_doubleValues.at(handle);
+}
+
+/*!
+    Returns the value of the bool property with the given \a handle.
+    Returns false if the \a handle does not refer to a bool property.
+
+    \sa setBoolValue()
+*/
+bool QtVariantPropertyManager::boolValue(int handle) const
+{
+    const QtVariantPropertyManagerPrivate::HandleSlot *slot = d_ptr->handleSlot(handle);
+    if (!slot || slot->storage != QtVariantPropertyManagerPrivate::BoolStorage)
+        return false;
+    return d_ptr->m_boolValues.at(handle);
+}
+
+/*!
+    Sets the value of the int, enum or flag property with the given \a
+    handle to \a val.
+
+    The call returns immediately if the stored value already equals
+    \a val; otherwise the value is passed to the underlying manager,
+    which applies its constraints and emits the change signals.
+
+    \sa intValue(), setHandleValue()
+*/
+void QtVariantPropertyManager::setIntValue(int handle, int val)
+{
+    const QtVariantPropertyManagerPrivate::HandleSlot *slot = d_ptr->handleSlot(handle);
+    if (!slot || (slot->storage != QtVariantPropertyManagerPrivate::IntStorage &&
+            slot->storage != QtVariantPropertyManagerPrivate::EnumStorage &&
+            slot->storage != QtVariantPropertyManagerPrivate::FlagStorage) ||
+            d_ptr->m_intValues.at(handle) == val)
+        return;
+
+    switch (slot->storage) {
+    case QtVariantPropertyManagerPrivate::IntStorage:
+        static_cast<QtIntPropertyManager *>(slot->manager)->setValue(slot->internal, val);
+        break;
+    case QtVariantPropertyManagerPrivate::EnumStorage:
+        static_cast<QtEnumPropertyManager *>(slot->manager)->setValue(slot->internal, val);
+        break;
+    case QtVariantPropertyManagerPrivate::FlagStorage:
+        static_cast<QtFlagPropertyManager *>(slot->manager)->setValue(slot->internal, val);
+        break;
+    default:
+        break;
+    }
+}
+
+/*!
+    Sets the value of the double property with the given \a handle to
+    \a val.
+
+    \sa doubleValue(), setIntValue()
+*/
+void QtVariantPropertyManager::setDoubleValue(int handle, double val)
+{
+    const QtVariantPropertyManagerPrivate::HandleSlot *slot = d_ptr->handleSlot(handle);
+    if (!slot || slot->storage != QtVariantPropertyManagerPrivate::DoubleStorage ||
+            d_ptr->m_doubleValues.at(handle) == val)
+        return;
+    static_cast<QtDoublePropertyManager *>(slot->manager)->setValue(slot->internal, val);
+}
+
+/*!
+    Sets the value of the bool property with the given \a handle to
+    \a val.
+
+    \sa boolValue(), setIntValue()
+*/
+void QtVariantPropertyManager::setBoolValue(int handle, bool val)
+{
+    const QtVariantPropertyManagerPrivate::HandleSlot *slot = d_ptr->handleSlot(handle);
+    if (!slot || slot->storage != QtVariantPropertyManagerPrivate::BoolStorage ||
+            d_ptr->m_boolValues.at(handle) == val)
+        return;
+    static_cast<QtBoolPropertyManager *>(slot->manager)->setValue(slot->internal, val);
+}
+
+/*!
+    Sets the value of the property with the given \a handle to \a val.
+
+    Int, enum, flag, double and bool properties are updated through the
+    typed setters; other properties fall back to setValue().
+
+    \sa handleValue(), propertyHandle()
+*/
+void QtVariantPropertyManager::setHandleValue(int handle, const QVariant &val)
+{
+    const QtVariantPropertyManagerPrivate::HandleSlot *slot = d_ptr->handleSlot(handle);
+    if (!slot)
+        return;
+
+    switch (slot->storage) {
+    case QtVariantPropertyManagerPrivate::IntStorage:
+    case QtVariantPropertyManagerPrivate::EnumStorage:
+    case QtVariantPropertyManagerPrivate::FlagStorage:
+        if (val.canConvert(QVariant::Int))
+            setIntValue(handle, val.toInt());
+        break;
+    case QtVariantPropertyManagerPrivate::DoubleStorage:
+        if (val.canConvert(QVariant::Double))
+            setDoubleValue(handle, val.toDouble());
+        break;
+    case QtVariantPropertyManagerPrivate::BoolStorage:
+        if (val.canConvert(QVariant::Bool))
+            setBoolValue(handle, val.toBool());
+        break;
+    default:
+        setValue(slot->property, val);
+        break;
+    }
+}
+
 /*!
     Returns the given \a property's value for the specified \a
     attribute
@@ -1784,6 +2094,7 @@ void QtVariantPropertyManager::initializeProperty(QtProperty *property)
         }
         propertyToWrappedProperty()->insert(varProp, internProp);
         if (internProp) {
+            d_ptr->registerHandle(varProp, internProp);
             const QList<QtProperty *> children = internProp->subProperties();
             QtVariantProperty *lastProperty = 0;
             for (QtProperty *child : children) {
@@ -1799,10 +2110,12 @@ void QtVariantPropertyManager::initializeProperty(QtProperty *property)
 */
 void QtVariantPropertyManager::uninitializeProperty(QtProperty *property)
 {
-    const QMap<const QtProperty *, QPair<QtVariantProperty *, int> >::iterator type_it = d_ptr->m_propertyToType.find(property);
+    const QHash<const QtProperty *, QPair<QtVariantProperty *, int> >::iterator type_it = d_ptr->m_propertyToType.find(property);
     if (type_it == d_ptr->m_propertyToType.end())
         return;
 
+    d_ptr->unregisterHandle(property);
+
     PropertyMap::iterator it = propertyToWrappedProperty()->find(property);
     if (it != propertyToWrappedProperty()->end()) {
         QtProperty *internProp = it.value();
@@ -2105,6 +2418,20 @@ QWidget *QtVariantEditorFactory::createEditor(QtVariantPropertyManager *manager,
     return factory->createEditor(wrappedProperty(property), parent);
 }
 
+/*!
+    \internal
+
+    Reimplemented from the QtAbstractEditorFactoryBase class.
+*/
+bool QtVariantEditorFactory::releaseEditor(QWidget *editor)
+{
+    for (auto it = d_ptr->m_factoryToType.cbegin(), cend = d_ptr->m_factoryToType.cend(); it != cend; ++it) {
+        if (it.key()->releaseEditor(editor))
+            return true;
+    }
+    return false;
+}
+
 /*!
     \internal
 
@@ -0,0 +1,1273 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the tools applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qtvirtualtreepropertybrowser.h"
+#include <QtCore/QAbstractItemModel>
+#include <QtCore/QHash>
+#include <QtGui/QIcon>
+#include <QtWidgets/QTreeView>
+#include <QtWidgets/QItemDelegate>
+#include <QtWidgets/QHBoxLayout>
+#include <QtWidgets/QHeaderView>
+#include <QtGui/QPainter>
+#include <QtWidgets/QApplication>
+#include <QtGui/QFocusEvent>
+#include <QtWidgets/QStyle>
+#include <QtGui/QPalette>
+
+QT_BEGIN_NAMESPACE
+
+class QtVirtualTreeModel;
+class QtVirtualTreeView;
+class QtVirtualTreeDelegate;
+
+class QtVirtualTreePropertyBrowserPrivate
+{
+    QtVirtualTreePropertyBrowser *q_ptr;
+    Q_DECLARE_PUBLIC(QtVirtualTreePropertyBrowser)
+
+public:
+    QtVirtualTreePropertyBrowserPrivate();
+    void init(QWidget *parent);
+
+    void propertyInserted(QtBrowserItem *index, QtBrowserItem *afterIndex);
+    void propertyRemoved(QtBrowserItem *index);
+    void propertyChanged(QtBrowserItem *index);
+    QWidget *createEditor(QtProperty *property, QWidget *parent) const
+        { return q_ptr->createEditor(property, parent); }
+    QtProperty *indexToProperty(const QModelIndex &index) const;
+    QtBrowserItem *indexToBrowserItem(const QModelIndex &index) const;
+    bool lastColumn(int column) const;
+    bool hasValue(const QModelIndex &index) const;
+
+    void slotCollapsed(const QModelIndex &index);
+    void slotExpanded(const QModelIndex &index);
+    void slotRowsInserted(const QModelIndex &parent, int first, int last);
+
+    QColor calculatedBackgroundColor(QtBrowserItem *item) const;
+
+    QtVirtualTreeView *treeView() const { return m_treeView; }
+    bool markPropertiesWithoutValue() const { return m_markPropertiesWithoutValue; }
+    QIcon expandIcon() const { return m_expandIcon; }
+
+    QtBrowserItem *currentItem() const;
+    void setCurrentItem(QtBrowserItem *browserItem, bool block);
+    void editItem(QtBrowserItem *browserItem);
+
+    void slotCurrentBrowserItemChanged(QtBrowserItem *item);
+    void slotCurrentIndexChanged(const QModelIndex &current, const QModelIndex &);
+
+    QtBrowserItem *editedItem() const;
+
+private:
+    void updateSpan(const QModelIndex &index);
+
+    QHash<QtBrowserItem *, QColor> m_indexToBackgroundColor;
+
+    QtVirtualTreeModel *m_model;
+    QtVirtualTreeView *m_treeView;
+
+    bool m_headerVisible;
+    QtVirtualTreePropertyBrowser::ResizeMode m_resizeMode;
+    QtVirtualTreeDelegate *m_delegate;
+    bool m_markPropertiesWithoutValue;
+    bool m_browserChangedBlocked;
+    bool m_treeChangedBlocked;
+    QIcon m_expandIcon;
+};
+
+// ------------ QtVirtualTreeNode
+// Shadows one QtBrowserItem. Only the first "fetched" children of a node
+// are exposed to the view, the remaining ones are handed out by fetchMore().
+// A node with fetched > 0 is always reachable from the root through exposed
+// rows, so its model index is valid.
+struct QtVirtualTreeNode
+{
+    QtVirtualTreeNode(QtBrowserItem *i = 0, QtVirtualTreeNode *p = 0)
+        : item(i), parent(p), row(0), fetched(0), populated(false), rowsDirty(false), enabled(true) {}
+
+    QtBrowserItem *item;
+    QtVirtualTreeNode *parent;
+    QList<QtVirtualTreeNode *> children;
+    int row;            // position in parent->children, stale while parent->rowsDirty
+    int fetched;        // number of children exposed to the view
+    bool populated;     // the view has expanded this node at least once
+    bool rowsDirty;     // children were inserted or removed in the middle
+    bool enabled;       // last seen QtProperty::isEnabled()
+};
+
+// ------------ QtVirtualTreeModel
+class QtVirtualTreeModel : public QAbstractItemModel
+{
+public:
+    QtVirtualTreeModel(QtVirtualTreePropertyBrowserPrivate *editorPrivate, QObject *parent = 0);
+    ~QtVirtualTreeModel();
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &child) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+
+    void insertItem(QtBrowserItem *item, QtBrowserItem *afterItem);
+    void removeItem(QtBrowserItem *item);
+    bool changeItem(QtBrowserItem *item);
+
+    bool contains(QtBrowserItem *item) const { return m_itemToNode.contains(item); }
+    QtBrowserItem *indexToBrowserItem(const QModelIndex &index) const
+        { return index.isValid() ? indexToNode(index)->item : 0; }
+    QModelIndex browserItemToIndex(QtBrowserItem *item) const;
+    QModelIndex materialize(QtBrowserItem *item);
+    void setPopulated(const QModelIndex &index);
+
+    int fetchBatchSize() const { return m_fetchBatchSize; }
+    void setFetchBatchSize(int size) { m_fetchBatchSize = qMax(1, size); }
+
+private:
+    QtVirtualTreeNode *indexToNode(const QModelIndex &index) const
+        { return index.isValid() ? static_cast<QtVirtualTreeNode *>(index.internalPointer()) : m_root; }
+    QModelIndex nodeToIndex(QtVirtualTreeNode *node) const;
+    int rowOf(QtVirtualTreeNode *node) const;
+    bool isMaterialized(QtVirtualTreeNode *node) const;
+    bool isEnabled(QtVirtualTreeNode *node) const;
+    void fetch(QtVirtualTreeNode *node, int count);
+    static void deleteNode(QtVirtualTreeNode *node);
+
+    QtVirtualTreePropertyBrowserPrivate *m_editorPrivate;
+    QtVirtualTreeNode *m_root;
+    QHash<QtBrowserItem *, QtVirtualTreeNode *> m_itemToNode;
+    int m_fetchBatchSize;
+};
+
+QtVirtualTreeModel::QtVirtualTreeModel(QtVirtualTreePropertyBrowserPrivate *editorPrivate, QObject *parent) :
+    QAbstractItemModel(parent),
+    m_editorPrivate(editorPrivate),
+    m_root(new QtVirtualTreeNode),
+    m_fetchBatchSize(256)
+{
+    m_root->populated = true;
+}
+
+QtVirtualTreeModel::~QtVirtualTreeModel()
+{
+    deleteNode(m_root);
+}
+
+void QtVirtualTreeModel::deleteNode(QtVirtualTreeNode *node)
+{
+    for (QtVirtualTreeNode *child : qAsConst(node->children))
+        deleteNode(child);
+    delete node;
+}
+
+int QtVirtualTreeModel::rowOf(QtVirtualTreeNode *node) const
+{
+    QtVirtualTreeNode *parent = node->parent;
+    if (parent->rowsDirty) {
+        const int count = parent->children.count();
+        for (int i = 0; i < count; i++)
+            parent->children.at(i)->row = i;
+        parent->rowsDirty = false;
+    }
+    return node->row;
+}
+
+bool QtVirtualTreeModel::isMaterialized(QtVirtualTreeNode *node) const
+{
+    for (QtVirtualTreeNode *n = node; n != m_root; n = n->parent) {
+        if (rowOf(n) >= n->parent->fetched)
+            return false;
+    }
+    return true;
+}
+
+bool QtVirtualTreeModel::isEnabled(QtVirtualTreeNode *node) const
+{
+    for (QtVirtualTreeNode *n = node; n != m_root; n = n->parent) {
+        if (!n->item->property()->isEnabled())
+            return false;
+    }
+    return true;
+}
+
+QModelIndex QtVirtualTreeModel::nodeToIndex(QtVirtualTreeNode *node) const
+{
+    if (node == m_root)
+        return QModelIndex();
+    return createIndex(rowOf(node), 0, node);
+}
+
+QModelIndex QtVirtualTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (row < 0 || column < 0 || column > 1 || parent.column() > 0)
+        return QModelIndex();
+    QtVirtualTreeNode *node = indexToNode(parent);
+    if (row >= node->fetched)
+        return QModelIndex();
+    return createIndex(row, column, node->children.at(row));
+}
+
+QModelIndex QtVirtualTreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid())
+        return QModelIndex();
+    return nodeToIndex(indexToNode(child)->parent);
+}
+
+int QtVirtualTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return 0;
+    return indexToNode(parent)->fetched;
+}
+
+int QtVirtualTreeModel::columnCount(const QModelIndex &) const
+{
+    return 2;
+}
+
+bool QtVirtualTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return false;
+    return !indexToNode(parent)->children.isEmpty();
+}
+
+bool QtVirtualTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return false;
+    const QtVirtualTreeNode *node = indexToNode(parent);
+    return node->fetched < node->children.count();
+}
+
+void QtVirtualTreeModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.column() > 0)
+        return;
+    QtVirtualTreeNode *node = indexToNode(parent);
+    const int remaining = node->children.count() - node->fetched;
+    // Top level rows are handed out in batches as the view scrolls, the
+    // children of an expanded item all at once.
+    fetch(node, node == m_root ? qMin(remaining, m_fetchBatchSize) : remaining);
+}
+
+void QtVirtualTreeModel::fetch(QtVirtualTreeNode *node, int count)
+{
+    if (count <= 0)
+        return;
+    beginInsertRows(nodeToIndex(node), node->fetched, node->fetched + count - 1);
+    node->fetched += count;
+    endInsertRows();
+}
+
+void QtVirtualTreeModel::setPopulated(const QModelIndex &index)
+{
+    QtVirtualTreeNode *node = indexToNode(index);
+    node->populated = true;
+    fetch(node, node->children.count() - node->fetched);
+}
+
+QModelIndex QtVirtualTreeModel::browserItemToIndex(QtBrowserItem *item) const
+{
+    QtVirtualTreeNode *node = m_itemToNode.value(item);
+    if (!node || !isMaterialized(node))
+        return QModelIndex();
+    return nodeToIndex(node);
+}
+
+QModelIndex QtVirtualTreeModel::materialize(QtBrowserItem *item)
+{
+    QtVirtualTreeNode *node = m_itemToNode.value(item);
+    if (!node)
+        return QModelIndex();
+
+    QList<QtVirtualTreeNode *> path;
+    for (QtVirtualTreeNode *n = node; n != m_root; n = n->parent)
+        path.prepend(n);
+    for (QtVirtualTreeNode *n : qAsConst(path)) {
+        const int row = rowOf(n);
+        if (row >= n->parent->fetched)
+            fetch(n->parent, row + 1 - n->parent->fetched);
+    }
+    return nodeToIndex(node);
+}
+
+void QtVirtualTreeModel::insertItem(QtBrowserItem *item, QtBrowserItem *afterItem)
+{
+    QtVirtualTreeNode *parentNode = item->parent() ? m_itemToNode.value(item->parent()) : m_root;
+    if (!parentNode)
+        return;
+
+    const int count = parentNode->children.count();
+    int pos = 0;
+    if (QtVirtualTreeNode *afterNode = m_itemToNode.value(afterItem))
+        pos = (count && parentNode->children.last() == afterNode) ? count : rowOf(afterNode) + 1;
+
+    QtVirtualTreeNode *node = new QtVirtualTreeNode(item, parentNode);
+    node->row = pos;
+    node->enabled = item->property()->isEnabled();
+    m_itemToNode.insert(item, node);
+
+    // Rows inside the exposed range have to be announced. Rows past it are
+    // picked up by fetchMore(), except that the first child of a visible item
+    // and the first batch of top level items are exposed straight away so
+    // the view shows the expand indicator and fills its viewport.
+    bool expose;
+    if (pos < parentNode->fetched)
+        expose = true;
+    else if (parentNode->fetched < count || !isMaterialized(parentNode))
+        expose = false;
+    else if (parentNode == m_root)
+        expose = parentNode->fetched < m_fetchBatchSize;
+    else
+        expose = parentNode->populated || parentNode->fetched == 0;
+
+    if (expose)
+        beginInsertRows(nodeToIndex(parentNode), pos, pos);
+    parentNode->children.insert(pos, node);
+    if (pos < count)
+        parentNode->rowsDirty = true;
+    if (expose) {
+        parentNode->fetched++;
+        endInsertRows();
+    }
+}
+
+void QtVirtualTreeModel::removeItem(QtBrowserItem *item)
+{
+    QtVirtualTreeNode *node = m_itemToNode.take(item);
+    if (!node)
+        return;
+
+    QtVirtualTreeNode *parentNode = node->parent;
+    const int row = rowOf(node);
+    const bool exposed = row < parentNode->fetched;
+
+    if (exposed)
+        beginRemoveRows(nodeToIndex(parentNode), row, row);
+    parentNode->children.removeAt(row);
+    if (row < parentNode->children.count())
+        parentNode->rowsDirty = true;
+    if (exposed) {
+        parentNode->fetched--;
+        endRemoveRows();
+    }
+    deleteNode(node);
+}
+
+// Returns true if the enabled state of the item changed, which affects
+// the whole subtree.
+bool QtVirtualTreeModel::changeItem(QtBrowserItem *item)
+{
+    QtVirtualTreeNode *node = m_itemToNode.value(item);
+    if (!node)
+        return false;
+
+    const bool enabled = item->property()->isEnabled();
+    const bool enabledChanged = node->enabled != enabled;
+    node->enabled = enabled;
+
+    if (isMaterialized(node)) {
+        const int row = rowOf(node);
+        emit dataChanged(createIndex(row, 0, node), createIndex(row, 1, node));
+    }
+    return enabledChanged;
+}
+
+QVariant QtVirtualTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    QtProperty *property = indexToNode(index)->item->property();
+    if (index.column() == 0) {
+        switch (role) {
+        case Qt::DisplayRole:
+            return property->propertyName();
+        case Qt::ToolTipRole: {
+            const QString descriptionToolTip = property->descriptionToolTip();
+            return descriptionToolTip.isEmpty() ? property->propertyName() : descriptionToolTip;
+        }
+        case Qt::StatusTipRole:
+            return property->statusTip();
+        case Qt::WhatsThisRole:
+            return property->whatsThis();
+        case Qt::DecorationRole:
+            if (!property->hasValue() && m_editorPrivate->markPropertiesWithoutValue()
+                    && !m_editorPrivate->treeView()->rootIsDecorated())
+                return m_editorPrivate->expandIcon();
+            break;
+        default:
+            break;
+        }
+    } else if (property->hasValue()) {
+        switch (role) {
+        case Qt::DisplayRole:
+            return property->valueText();
+        case Qt::ToolTipRole: {
+            const QString valueToolTip = property->valueToolTip();
+            return valueToolTip.isEmpty() ? property->valueText() : valueToolTip;
+        }
+        case Qt::DecorationRole:
+            return property->valueIcon();
+        default:
+            break;
+        }
+    }
+    return QVariant();
+}
+
+QVariant QtVirtualTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QVariant();
+    if (section == 0)
+        return QCoreApplication::translate("QtVirtualTreePropertyBrowser", "Property");
+    return QCoreApplication::translate("QtVirtualTreePropertyBrowser", "Value");
+}
+
+Qt::ItemFlags QtVirtualTreeModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return 0;
+    Qt::ItemFlags flags = Qt::ItemIsSelectable | Qt::ItemIsEditable;
+    if (isEnabled(indexToNode(index)))
+        flags |= Qt::ItemIsEnabled;
+    return flags;
+}
+
+// ------------ QtVirtualTreeView
+class QtVirtualTreeView : public QTreeView
+{
+    Q_OBJECT
+public:
+    QtVirtualTreeView(QWidget *parent = 0);
+
+    void setEditorPrivate(QtVirtualTreePropertyBrowserPrivate *editorPrivate)
+        { m_editorPrivate = editorPrivate; }
+
+protected:
+    void keyPressEvent(QKeyEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void drawRow(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+
+private:
+    static bool isEditable(const QModelIndex &index)
+        { return (index.flags() & (Qt::ItemIsEditable | Qt::ItemIsEnabled)) == (Qt::ItemIsEditable | Qt::ItemIsEnabled); }
+
+    QtVirtualTreePropertyBrowserPrivate *m_editorPrivate;
+};
+
+QtVirtualTreeView::QtVirtualTreeView(QWidget *parent) :
+    QTreeView(parent),
+    m_editorPrivate(0)
+{
+    connect(header(), SIGNAL(sectionDoubleClicked(int)), this, SLOT(resizeColumnToContents(int)));
+}
+
+void QtVirtualTreeView::drawRow(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    QStyleOptionViewItem opt = option;
+    const bool hasValue = m_editorPrivate->hasValue(index);
+    if (!hasValue && m_editorPrivate->markPropertiesWithoutValue()) {
+        const QColor c = option.palette.color(QPalette::Dark);
+        painter->fillRect(option.rect, c);
+        opt.palette.setColor(QPalette::AlternateBase, c);
+    } else {
+        const QColor c = m_editorPrivate->calculatedBackgroundColor(m_editorPrivate->indexToBrowserItem(index));
+        if (c.isValid()) {
+            painter->fillRect(option.rect, c);
+            opt.palette.setColor(QPalette::AlternateBase, c.lighter(112));
+        }
+    }
+    QTreeView::drawRow(painter, opt, index);
+    QColor color = static_cast<QRgb>(QApplication::style()->styleHint(QStyle::SH_Table_GridLineColor, &opt));
+    painter->save();
+    painter->setPen(QPen(color));
+    painter->drawLine(opt.rect.x(), opt.rect.bottom(), opt.rect.right(), opt.rect.bottom());
+    painter->restore();
+}
+
+void QtVirtualTreeView::keyPressEvent(QKeyEvent *event)
+{
+    switch (event->key()) {
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+    case Qt::Key_Space: // Trigger Edit
+        if (!m_editorPrivate->editedItem()) {
+            QModelIndex index = currentIndex();
+            if (index.isValid() && m_editorPrivate->hasValue(index) && isEditable(index)) {
+                event->accept();
+                // If the current position is at column 0, move to 1.
+                if (index.column() == 0) {
+                    index = index.sibling(index.row(), 1);
+                    setCurrentIndex(index);
+                }
+                edit(index);
+                return;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    QTreeView::keyPressEvent(event);
+}
+
+void QtVirtualTreeView::mousePressEvent(QMouseEvent *event)
+{
+    QTreeView::mousePressEvent(event);
+    const QModelIndex index = indexAt(event->pos());
+
+    if (index.isValid()) {
+        const QModelIndex valueIndex = index.sibling(index.row(), 1);
+        if ((m_editorPrivate->indexToBrowserItem(index) != m_editorPrivate->editedItem()) && (event->button() == Qt::LeftButton)
+                && (header()->logicalIndexAt(event->pos().x()) == 1)
+                && m_editorPrivate->hasValue(index) && isEditable(valueIndex)) {
+            edit(valueIndex);
+        } else if (!m_editorPrivate->hasValue(index) && m_editorPrivate->markPropertiesWithoutValue() && !rootIsDecorated()) {
+            if (event->pos().x() + header()->offset() < 20)
+                setExpanded(index.sibling(index.row(), 0), !isExpanded(index.sibling(index.row(), 0)));
+        }
+    }
+}
+
+// ------------ QtVirtualTreeDelegate
+class QtVirtualTreeDelegate : public QItemDelegate
+{
+    Q_OBJECT
+public:
+    QtVirtualTreeDelegate(QObject *parent = 0)
+        : QItemDelegate(parent), m_editorPrivate(0), m_editedItem(0), m_editedWidget(0)
+        {}
+
+    void setEditorPrivate(QtVirtualTreePropertyBrowserPrivate *editorPrivate)
+        { m_editorPrivate = editorPrivate; }
+
+    QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &option,
+            const QModelIndex &index) const;
+
+    void updateEditorGeometry(QWidget *editor, const QStyleOptionViewItem &option,
+            const QModelIndex &index) const;
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option,
+            const QModelIndex &index) const;
+
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const;
+
+    void setModelData(QWidget *, QAbstractItemModel *,
+            const QModelIndex &) const {}
+
+    void setEditorData(QWidget *, const QModelIndex &) const {}
+
+    bool eventFilter(QObject *object, QEvent *event);
+    void closeEditors(QtBrowserItem *item);
+
+    QtBrowserItem *editedItem() const { return m_editedItem; }
+
+private slots:
+    void slotEditorDestroyed(QObject *object);
+
+private:
+    typedef QHash<QWidget *, QtBrowserItem *> EditorToItemMap;
+    mutable EditorToItemMap m_editorToItem;
+
+    QtVirtualTreePropertyBrowserPrivate *m_editorPrivate;
+    mutable QtBrowserItem *m_editedItem;
+    mutable QWidget *m_editedWidget;
+};
+
+void QtVirtualTreeDelegate::slotEditorDestroyed(QObject *object)
+{
+    if (QWidget *w = qobject_cast<QWidget *>(object)) {
+        m_editorToItem.remove(w);
+        if (m_editedWidget == w) {
+            m_editedWidget = 0;
+            m_editedItem = 0;
+        }
+    }
+}
+
+// Closes the editors of item and its descendants.
+void QtVirtualTreeDelegate::closeEditors(QtBrowserItem *item)
+{
+    for (auto it = m_editorToItem.cbegin(), end = m_editorToItem.cend(); it != end; ++it) {
+        for (QtBrowserItem *i = it.value(); i; i = i->parent()) {
+            if (i == item) {
+                it.key()->deleteLater();
+                break;
+            }
+        }
+    }
+}
+
+QWidget *QtVirtualTreeDelegate::createEditor(QWidget *parent,
+        const QStyleOptionViewItem &, const QModelIndex &index) const
+{
+    if (index.column() == 1 && m_editorPrivate) {
+        QtBrowserItem *item = m_editorPrivate->indexToBrowserItem(index);
+        if (item && (index.flags() & Qt::ItemIsEnabled)) {
+            QWidget *editor = m_editorPrivate->createEditor(item->property(), parent);
+            if (editor) {
+                editor->setAutoFillBackground(true);
+                editor->installEventFilter(const_cast<QtVirtualTreeDelegate *>(this));
+                connect(editor, SIGNAL(destroyed(QObject*)), this, SLOT(slotEditorDestroyed(QObject*)));
+                m_editorToItem[editor] = item;
+                m_editedItem = item;
+                m_editedWidget = editor;
+            }
+            return editor;
+        }
+    }
+    return 0;
+}
+
+void QtVirtualTreeDelegate::updateEditorGeometry(QWidget *editor,
+        const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    Q_UNUSED(index)
+    editor->setGeometry(option.rect.adjusted(0, 0, 0, -1));
+}
+
+void QtVirtualTreeDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option,
+            const QModelIndex &index) const
+{
+    QtProperty *property = m_editorPrivate->indexToProperty(index);
+    const bool hasValue = property ? property->hasValue() : true;
+    QStyleOptionViewItem opt = option;
+    if ((index.column() == 0 || !hasValue) && property && property->isModified()) {
+        opt.font.setBold(true);
+        opt.fontMetrics = QFontMetrics(opt.font);
+    }
+    QColor c;
+    if (!hasValue && m_editorPrivate->markPropertiesWithoutValue()) {
+        c = opt.palette.color(QPalette::Dark);
+        opt.palette.setColor(QPalette::Text, opt.palette.color(QPalette::BrightText));
+    } else {
+        c = m_editorPrivate->calculatedBackgroundColor(m_editorPrivate->indexToBrowserItem(index));
+        if (c.isValid() && (opt.features & QStyleOptionViewItem::Alternate))
+            c = c.lighter(112);
+    }
+    if (c.isValid())
+        painter->fillRect(option.rect, c);
+    opt.state &= ~QStyle::State_HasFocus;
+    QItemDelegate::paint(painter, opt, index);
+
+    opt.palette.setCurrentColorGroup(QPalette::Active);
+    QColor color = static_cast<QRgb>(QApplication::style()->styleHint(QStyle::SH_Table_GridLineColor, &opt));
+    painter->save();
+    painter->setPen(QPen(color));
+    if (!m_editorPrivate->lastColumn(index.column()) && hasValue) {
+        int right = (option.direction == Qt::LeftToRight) ? option.rect.right() : option.rect.left();
+        painter->drawLine(right, option.rect.y(), right, option.rect.bottom());
+    }
+    painter->restore();
+}
+
+QSize QtVirtualTreeDelegate::sizeHint(const QStyleOptionViewItem &option,
+            const QModelIndex &index) const
+{
+    return QItemDelegate::sizeHint(option, index) + QSize(3, 4);
+}
+
+bool QtVirtualTreeDelegate::eventFilter(QObject *object, QEvent *event)
+{
+    if (event->type() == QEvent::FocusOut) {
+        QFocusEvent *fe = static_cast<QFocusEvent *>(event);
+        if (fe->reason() == Qt::ActiveWindowFocusReason)
+            return false;
+    }
+    return QItemDelegate::eventFilter(object, event);
+}
+
+//  -------- QtVirtualTreePropertyBrowserPrivate implementation
+QtVirtualTreePropertyBrowserPrivate::QtVirtualTreePropertyBrowserPrivate() :
+    m_model(0),
+    m_treeView(0),
+    m_headerVisible(true),
+    m_resizeMode(QtVirtualTreePropertyBrowser::Stretch),
+    m_delegate(0),
+    m_markPropertiesWithoutValue(false),
+    m_browserChangedBlocked(false),
+    m_treeChangedBlocked(false)
+{
+}
+
+// Draw an icon indicating opened/closing branches
+static QIcon drawIndicatorIcon(const QPalette &palette, QStyle *style)
+{
+    QPixmap pix(14, 14);
+    pix.fill(Qt::transparent);
+    QStyleOption branchOption;
+    branchOption.rect = QRect(2, 2, 9, 9); // ### hardcoded in qcommonstyle.cpp
+    branchOption.palette = palette;
+    branchOption.state = QStyle::State_Children;
+
+    QPainter p;
+    // Draw closed state
+    p.begin(&pix);
+    style->drawPrimitive(QStyle::PE_IndicatorBranch, &branchOption, &p);
+    p.end();
+    QIcon rc = pix;
+    rc.addPixmap(pix, QIcon::Selected, QIcon::Off);
+    // Draw opened state
+    branchOption.state |= QStyle::State_Open;
+    pix.fill(Qt::transparent);
+    p.begin(&pix);
+    style->drawPrimitive(QStyle::PE_IndicatorBranch, &branchOption, &p);
+    p.end();
+
+    rc.addPixmap(pix, QIcon::Normal, QIcon::On);
+    rc.addPixmap(pix, QIcon::Selected, QIcon::On);
+    return rc;
+}
+
+void QtVirtualTreePropertyBrowserPrivate::init(QWidget *parent)
+{
+    QHBoxLayout *layout = new QHBoxLayout(parent);
+    layout->setMargin(0);
+    m_treeView = new QtVirtualTreeView(parent);
+    m_treeView->setEditorPrivate(this);
+    m_treeView->setIconSize(QSize(18, 18));
+    // All rows have the same height, so the view never measures rows
+    // that are scrolled out of sight.
+    m_treeView->setUniformRowHeights(true);
+    layout->addWidget(m_treeView);
+
+    m_model = new QtVirtualTreeModel(this, parent);
+    m_treeView->setModel(m_model);
+    m_treeView->setAlternatingRowColors(true);
+    m_treeView->setEditTriggers(QAbstractItemView::EditKeyPressed);
+    m_delegate = new QtVirtualTreeDelegate(parent);
+    m_delegate->setEditorPrivate(this);
+    m_treeView->setItemDelegate(m_delegate);
+    m_treeView->header()->setSectionsMovable(false);
+    m_treeView->header()->setSectionResizeMode(QHeaderView::Stretch);
+
+    m_expandIcon = drawIndicatorIcon(q_ptr->palette(), q_ptr->style());
+
+    QObject::connect(m_treeView, SIGNAL(collapsed(QModelIndex)), q_ptr, SLOT(slotCollapsed(QModelIndex)));
+    QObject::connect(m_treeView, SIGNAL(expanded(QModelIndex)), q_ptr, SLOT(slotExpanded(QModelIndex)));
+    QObject::connect(m_model, SIGNAL(rowsInserted(QModelIndex,int,int)), q_ptr, SLOT(slotRowsInserted(QModelIndex,int,int)));
+    QObject::connect(m_treeView->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)), q_ptr, SLOT(slotCurrentIndexChanged(QModelIndex,QModelIndex)));
+}
+
+QtBrowserItem *QtVirtualTreePropertyBrowserPrivate::currentItem() const
+{
+    return m_model->indexToBrowserItem(m_treeView->currentIndex());
+}
+
+void QtVirtualTreePropertyBrowserPrivate::setCurrentItem(QtBrowserItem *browserItem, bool block)
+{
+    const bool blocked = m_treeChangedBlocked;
+    if (block)
+        m_treeChangedBlocked = true;
+    m_treeView->setCurrentIndex(browserItem ? m_model->materialize(browserItem) : QModelIndex());
+    m_treeChangedBlocked = blocked;
+}
+
+QtProperty *QtVirtualTreePropertyBrowserPrivate::indexToProperty(const QModelIndex &index) const
+{
+    if (QtBrowserItem *idx = m_model->indexToBrowserItem(index))
+        return idx->property();
+    return 0;
+}
+
+QtBrowserItem *QtVirtualTreePropertyBrowserPrivate::indexToBrowserItem(const QModelIndex &index) const
+{
+    return m_model->indexToBrowserItem(index);
+}
+
+bool QtVirtualTreePropertyBrowserPrivate::lastColumn(int column) const
+{
+    return m_treeView->header()->visualIndex(column) == m_model->columnCount() - 1;
+}
+
+bool QtVirtualTreePropertyBrowserPrivate::hasValue(const QModelIndex &index) const
+{
+    if (QtProperty *property = indexToProperty(index))
+        return property->hasValue();
+    return false;
+}
+
+void QtVirtualTreePropertyBrowserPrivate::propertyInserted(QtBrowserItem *index, QtBrowserItem *afterIndex)
+{
+    m_model->insertItem(index, afterIndex);
+}
+
+void QtVirtualTreePropertyBrowserPrivate::propertyRemoved(QtBrowserItem *index)
+{
+    m_model->removeItem(index);
+    m_indexToBackgroundColor.remove(index);
+}
+
+void QtVirtualTreePropertyBrowserPrivate::propertyChanged(QtBrowserItem *index)
+{
+    if (m_model->changeItem(index)) {
+        if (!index->property()->isEnabled())
+            m_delegate->closeEditors(index);
+        m_treeView->viewport()->update();
+    }
+    updateSpan(m_model->browserItemToIndex(index));
+}
+
+// Properties without a value span both columns.
+void QtVirtualTreePropertyBrowserPrivate::updateSpan(const QModelIndex &index)
+{
+    if (!index.isValid())
+        return;
+    const bool span = !hasValue(index);
+    if (m_treeView->isFirstColumnSpanned(index.row(), index.parent()) != span)
+        m_treeView->setFirstColumnSpanned(index.row(), index.parent(), span);
+}
+
+void QtVirtualTreePropertyBrowserPrivate::slotRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    for (int row = first; row <= last; row++)
+        updateSpan(m_model->index(row, 0, parent));
+}
+
+QColor QtVirtualTreePropertyBrowserPrivate::calculatedBackgroundColor(QtBrowserItem *item) const
+{
+    if (m_indexToBackgroundColor.isEmpty())
+        return QColor();
+    for (QtBrowserItem *i = item; i; i = i->parent()) {
+        const QHash<QtBrowserItem *, QColor>::const_iterator it = m_indexToBackgroundColor.constFind(i);
+        if (it != m_indexToBackgroundColor.constEnd())
+            return it.value();
+    }
+    return QColor();
+}
+
+void QtVirtualTreePropertyBrowserPrivate::slotCollapsed(const QModelIndex &index)
+{
+    if (QtBrowserItem *idx = m_model->indexToBrowserItem(index))
+        emit q_ptr->collapsed(idx);
+}
+
+void QtVirtualTreePropertyBrowserPrivate::slotExpanded(const QModelIndex &index)
+{
+    m_model->setPopulated(index);
+    if (QtBrowserItem *idx = m_model->indexToBrowserItem(index))
+        emit q_ptr->expanded(idx);
+}
+
+void QtVirtualTreePropertyBrowserPrivate::slotCurrentBrowserItemChanged(QtBrowserItem *item)
+{
+    if (!m_browserChangedBlocked && item != currentItem())
+        setCurrentItem(item, true);
+}
+
+void QtVirtualTreePropertyBrowserPrivate::slotCurrentIndexChanged(const QModelIndex &current, const QModelIndex &)
+{
+    if (m_treeChangedBlocked)
+        return;
+    m_browserChangedBlocked = true;
+    q_ptr->setCurrentItem(m_model->indexToBrowserItem(current));
+    m_browserChangedBlocked = false;
+}
+
+QtBrowserItem *QtVirtualTreePropertyBrowserPrivate::editedItem() const
+{
+    return m_delegate->editedItem();
+}
+
+void QtVirtualTreePropertyBrowserPrivate::editItem(QtBrowserItem *browserItem)
+{
+    const QModelIndex index = m_model->materialize(browserItem);
+    if (index.isValid()) {
+        const QModelIndex valueIndex = index.sibling(index.row(), 1);
+        m_treeView->setCurrentIndex(valueIndex);
+        m_treeView->edit(valueIndex);
+    }
+}
+
+/*!
+    \class QtVirtualTreePropertyBrowser
+    \internal
+    \inmodule QtDesigner
+
+    \brief The QtVirtualTreePropertyBrowser class provides a QTreeView
+    based property browser for very large property sets.
+
+    QtVirtualTreePropertyBrowser presents the same tree as
+    QtTreePropertyBrowser, but instead of creating a QTreeWidgetItem
+    and formatting its texts and icons for every inserted property, it
+    exposes the browser items through a QAbstractItemModel:
+
+    \list
+    \li Rows are only announced to the view when they can be seen.
+        Top level items are fetched in batches of fetchBatchSize() as
+        the view scrolls, and the subproperties of an item are fetched
+        the first time it is expanded.
+    \li Names, values, icons and tool tips are queried from the
+        QtProperty when the view paints a row, so a property change
+        costs a single dataChanged() notification and no work at all
+        for rows that are not visible.
+    \endlist
+
+    Unlike QtTreePropertyBrowser, items are inserted collapsed; use
+    setExpanded() to open them.
+
+    Use the QtAbstractPropertyBrowser API to add, insert and remove
+    properties from an instance of the QtVirtualTreePropertyBrowser
+    class.
+
+    \sa QtTreePropertyBrowser, QtAbstractPropertyBrowser
+*/
+
+/*!
+    \fn void QtVirtualTreePropertyBrowser::collapsed(QtBrowserItem *item)
+
+    This signal is emitted when the \a item is collapsed.
+
+    \sa expanded(), setExpanded()
+*/
+
+/*!
+    \fn void QtVirtualTreePropertyBrowser::expanded(QtBrowserItem *item)
+
+    This signal is emitted when the \a item is expanded.
+
+    \sa collapsed(), setExpanded()
+*/
+
+/*!
+    Creates a property browser with the given \a parent.
+*/
+QtVirtualTreePropertyBrowser::QtVirtualTreePropertyBrowser(QWidget *parent)
+    : QtAbstractPropertyBrowser(parent), d_ptr(new QtVirtualTreePropertyBrowserPrivate)
+{
+    d_ptr->q_ptr = this;
+
+    d_ptr->init(this);
+    connect(this, SIGNAL(currentItemChanged(QtBrowserItem*)), this, SLOT(slotCurrentBrowserItemChanged(QtBrowserItem*)));
+}
+
+/*!
+    Destroys this property browser.
+
+    Note that the properties that were inserted into this browser are
+    \e not destroyed since they may still be used in other
+    browsers. The properties are owned by the manager that created
+    them.
+
+    \sa QtProperty, QtAbstractPropertyManager
+*/
+QtVirtualTreePropertyBrowser::~QtVirtualTreePropertyBrowser()
+{
+}
+
+/*!
+    \property QtVirtualTreePropertyBrowser::indentation
+    \brief indentation of the items in the tree view.
+*/
+int QtVirtualTreePropertyBrowser::indentation() const
+{
+    return d_ptr->m_treeView->indentation();
+}
+
+void QtVirtualTreePropertyBrowser::setIndentation(int i)
+{
+    d_ptr->m_treeView->setIndentation(i);
+}
+
+/*!
+  \property QtVirtualTreePropertyBrowser::rootIsDecorated
+  \brief whether to show controls for expanding and collapsing root items.
+*/
+bool QtVirtualTreePropertyBrowser::rootIsDecorated() const
+{
+    return d_ptr->m_treeView->rootIsDecorated();
+}
+
+void QtVirtualTreePropertyBrowser::setRootIsDecorated(bool show)
+{
+    d_ptr->m_treeView->setRootIsDecorated(show);
+    d_ptr->m_treeView->viewport()->update();
+}
+
+/*!
+  \property QtVirtualTreePropertyBrowser::alternatingRowColors
+  \brief whether to draw the background using alternating colors.
+  By default this property is set to true.
+*/
+bool QtVirtualTreePropertyBrowser::alternatingRowColors() const
+{
+    return d_ptr->m_treeView->alternatingRowColors();
+}
+
+void QtVirtualTreePropertyBrowser::setAlternatingRowColors(bool enable)
+{
+    d_ptr->m_treeView->setAlternatingRowColors(enable);
+}
+
+/*!
+  \property QtVirtualTreePropertyBrowser::headerVisible
+  \brief whether to show the header.
+*/
+bool QtVirtualTreePropertyBrowser::isHeaderVisible() const
+{
+    return d_ptr->m_headerVisible;
+}
+
+void QtVirtualTreePropertyBrowser::setHeaderVisible(bool visible)
+{
+    if (d_ptr->m_headerVisible == visible)
+        return;
+
+    d_ptr->m_headerVisible = visible;
+    d_ptr->m_treeView->header()->setVisible(visible);
+}
+
+/*!
+  \enum QtVirtualTreePropertyBrowser::ResizeMode
+
+  The resize mode specifies the behavior of the header sections.
+
+  \value Interactive The user can resize the sections.
+  The sections can also be resized programmatically using setSplitterPosition().
+
+  \value Fixed The user cannot resize the section.
+  The section can only be resized programmatically using setSplitterPosition().
+
+  \value Stretch QHeaderView will automatically resize the section to fill the available space.
+  The size cannot be changed by the user or programmatically.
+
+  \value ResizeToContents QHeaderView will automatically resize the section to its optimal
+  size based on the contents of the fetched rows.
+  The size cannot be changed by the user or programmatically.
+
+  \sa setResizeMode()
+*/
+
+/*!
+    \property QtVirtualTreePropertyBrowser::resizeMode
+    \brief the resize mode of setions in the header.
+*/
+
+QtVirtualTreePropertyBrowser::ResizeMode QtVirtualTreePropertyBrowser::resizeMode() const
+{
+    return d_ptr->m_resizeMode;
+}
+
+void QtVirtualTreePropertyBrowser::setResizeMode(QtVirtualTreePropertyBrowser::ResizeMode mode)
+{
+    if (d_ptr->m_resizeMode == mode)
+        return;
+
+    d_ptr->m_resizeMode = mode;
+    QHeaderView::ResizeMode m = QHeaderView::Stretch;
+    switch (mode) {
+        case QtVirtualTreePropertyBrowser::Interactive:      m = QHeaderView::Interactive;      break;
+        case QtVirtualTreePropertyBrowser::Fixed:            m = QHeaderView::Fixed;            break;
+        case QtVirtualTreePropertyBrowser::ResizeToContents: m = QHeaderView::ResizeToContents; break;
+        case QtVirtualTreePropertyBrowser::Stretch:
+        default:                                             m = QHeaderView::Stretch;          break;
+    }
+    d_ptr->m_treeView->header()->setSectionResizeMode(m);
+}
+
+/*!
+    \property QtVirtualTreePropertyBrowser::splitterPosition
+    \brief the position of the splitter between the colunms.
+*/
+
+int QtVirtualTreePropertyBrowser::splitterPosition() const
+{
+    return d_ptr->m_treeView->header()->sectionSize(0);
+}
+
+void QtVirtualTreePropertyBrowser::setSplitterPosition(int position)
+{
+    d_ptr->m_treeView->header()->resizeSection(0, position);
+}
+
+/*!
+    \property QtVirtualTreePropertyBrowser::fetchBatchSize
+    \brief the number of top level rows handed to the view at a time.
+
+    Top level items beyond the first batch are exposed to the view as it
+    is scrolled towards the end. The default is 256.
+*/
+
+int QtVirtualTreePropertyBrowser::fetchBatchSize() const
+{
+    return d_ptr->m_model->fetchBatchSize();
+}
+
+void QtVirtualTreePropertyBrowser::setFetchBatchSize(int size)
+{
+    d_ptr->m_model->setFetchBatchSize(size);
+}
+
+/*!
+    Sets the \a item to either collapse or expanded, depending on the value of \a expanded.
+
+    \sa isExpanded(), expanded(), collapsed()
+*/
+
+void QtVirtualTreePropertyBrowser::setExpanded(QtBrowserItem *item, bool expanded)
+{
+    const QModelIndex index = expanded ? d_ptr->m_model->materialize(item)
+                                       : d_ptr->m_model->browserItemToIndex(item);
+    if (index.isValid())
+        d_ptr->m_treeView->setExpanded(index, expanded);
+}
+
+/*!
+    Returns true if the \a item is expanded; otherwise returns false.
+
+    \sa setExpanded()
+*/
+
+bool QtVirtualTreePropertyBrowser::isExpanded(QtBrowserItem *item) const
+{
+    const QModelIndex index = d_ptr->m_model->browserItemToIndex(item);
+    return index.isValid() && d_ptr->m_treeView->isExpanded(index);
+}
+
+/*!
+    Sets the \a item's background color to \a color. Note that while item's background
+    is rendered every second row is being drawn with alternate color (which is a bit lighter than items \a color)
+
+    \sa backgroundColor(), calculatedBackgroundColor()
+*/
+
+void QtVirtualTreePropertyBrowser::setBackgroundColor(QtBrowserItem *item, const QColor &color)
+{
+    if (!d_ptr->m_model->contains(item))
+        return;
+    if (color.isValid())
+        d_ptr->m_indexToBackgroundColor[item] = color;
+    else
+        d_ptr->m_indexToBackgroundColor.remove(item);
+    d_ptr->m_treeView->viewport()->update();
+}
+
+/*!
+    Returns the \a item's color. If there is no color set for item it returns invalid color.
+
+    \sa calculatedBackgroundColor(), setBackgroundColor()
+*/
+
+QColor QtVirtualTreePropertyBrowser::backgroundColor(QtBrowserItem *item) const
+{
+    return d_ptr->m_indexToBackgroundColor.value(item);
+}
+
+/*!
+    Returns the \a item's color. If there is no color set for item it returns parent \a item's
+    color (if there is no color set for parent it returns grandparent's color and so on). In case
+    the color is not set for \a item and it's top level item it returns invalid color.
+
+    \sa backgroundColor(), setBackgroundColor()
+*/
+
+QColor QtVirtualTreePropertyBrowser::calculatedBackgroundColor(QtBrowserItem *item) const
+{
+    return d_ptr->calculatedBackgroundColor(item);
+}
+
+/*!
+    \property QtVirtualTreePropertyBrowser::propertiesWithoutValueMarked
+    \brief whether to enable or disable marking properties without value.
+
+    When marking is enabled the item's background is rendered in dark color and item's
+    foreground is rendered with light color.
+
+    \sa propertiesWithoutValueMarked()
+*/
+void QtVirtualTreePropertyBrowser::setPropertiesWithoutValueMarked(bool mark)
+{
+    if (d_ptr->m_markPropertiesWithoutValue == mark)
+        return;
+
+    d_ptr->m_markPropertiesWithoutValue = mark;
+    d_ptr->m_treeView->viewport()->update();
+}
+
+bool QtVirtualTreePropertyBrowser::propertiesWithoutValueMarked() const
+{
+    return d_ptr->m_markPropertiesWithoutValue;
+}
+
+/*!
+    \reimp
+*/
+void QtVirtualTreePropertyBrowser::itemInserted(QtBrowserItem *item, QtBrowserItem *afterItem)
+{
+    d_ptr->propertyInserted(item, afterItem);
+}
+
+/*!
+    \reimp
+*/
+void QtVirtualTreePropertyBrowser::itemRemoved(QtBrowserItem *item)
+{
+    d_ptr->propertyRemoved(item);
+}
+
+/*!
+    \reimp
+*/
+void QtVirtualTreePropertyBrowser::itemChanged(QtBrowserItem *item)
+{
+    d_ptr->propertyChanged(item);
+}
+
+/*!
+    Sets the current item to \a item and opens the relevant editor for it.
+*/
+void QtVirtualTreePropertyBrowser::editItem(QtBrowserItem *item)
+{
+    d_ptr->editItem(item);
+}
+
+QT_END_NAMESPACE
+
+#include "moc_qtvirtualtreepropertybrowser.cpp"
+#include "qtvirtualtreepropertybrowser.moc"